@@ -0,0 +1,60 @@
+#ifndef BLUR_H
+#define BLUR_H
+
+
+#include <stdint.h>  // For type uint8_t
+#include "image.h"  // For struct ImageRGB
+#include "convolution.h"  // For enum GeneralFilterIntensity
+
+
+// Largest supported box blur radius. Keeps the running sums of a (2*radius + 1)^2 window within uint32 range
+#define BOX_BLUR_MAX_RADIUS 1024
+
+// Range of standard deviations of the recursive gaussian blur (the recursion coefficients are fitted from 0.5 on)
+#define GAUSSIAN_BLUR_MIN_SIGMA 0.5f
+#define GAUSSIAN_BLUR_MAX_SIGMA 256.0f
+
+// Rows run through the recursions of the horizontal pass at once (transposed into four AVX2 vectors per step)
+#define IIR_GAUSSIAN_LANES 16
+
+// Extension of the image on each side of the recursions of the gaussian blur, in standard deviations
+#define IIR_GAUSSIAN_PADDING_SIGMAS 4.0f
+
+
+// Returns the box blur radius of the general filter intensities (kernel sizes 5, 9 and 13)
+int box_blur_radius(enum GeneralFilterIntensity filterIntensity);
+
+// Returns the number of channels the recursive gaussian blur extends the image by on each side
+int iir_gaussian_padding(float sigma);
+
+
+// Applies a box blur of any radius to a channelsArray using running sums (constant cost per channel for any radius)
+int apply_box_blur_channel(uint8_t *inputChannels, uint8_t *outputChannels, int radius, int imageHeight, int imageWidth,
+        enum BorderMode borderMode);
+
+// Running sum box blur over any number of channel planes in one pass over the strips (one fork/join)
+int apply_box_blur_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, int radius, int imageHeight,
+        int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue);
+
+// Applies the fused running sum box blur over the three (RGB) channels of a given image
+int apply_box_blur_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, int radius, enum BorderMode borderMode);
+
+
+// Recursive (IIR, Young and van Vliet) gaussian blur of any standard deviation over any number of channel planes: causal
+// and anti-causal passes along the columns, then along the rows (constant cost per channel for any sigma). It is not exact:
+// against a sampled gaussian, with the replicate and reflect borders, it is off at hard edges by up to 14 levels for sigma
+// 0.5-1, 9 levels up to 1.5, 6 levels at 2, 4 levels from 3 to 8, 3 levels from 16 and 1 level from 128 (up to 3 levels on
+// photographs below sigma 2, 1 level above). With the zero border the image edges add to this, up to 19 levels for sigma
+// 0.5-1, 8 levels at 2, 6 levels up to 8, 3 levels from 16 and 2 levels from 128
+int apply_iir_gaussian_blur_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, float sigma, int imageHeight,
+        int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue);
+
+// Applies the recursive gaussian blur over the three (RGB) channels of a given image
+int apply_iir_gaussian_blur_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, float sigma, enum BorderMode borderMode);
+
+
+
+
+#endif //BLUR_H
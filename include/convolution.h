@@ -5,26 +5,34 @@
 #include <stdint.h>  // For type uint8_t
 #include "image.h"  // For struct ImageRGB
 #include "pool.h"  // For struct MemoryPool
+#include "pointops.h"  // For struct PointOpEpilogue
 
 
 /**
- * @brief Structure for representing a window (square matrix) used for convolution-based filtering.
- * Contains fields for matrix size and a pointer array of matrix entries (uint8_t).
+ * @brief Structure for representing a kernel (square matrix) used for convolution-based filtering.
+ * Contains fields for matrix size and a pointer array of matrix entries (float).
  */
-typedef struct Window {
+typedef struct Kernel {
         int size;
         float *entries;
-} Window;
+} Kernel;
 
 
 /**
- * @brief Structure for representing a kernel (square matrix) used for convolution-based filtering.
- * Contains fields for matrix size and a pointer array of matrix entries (float).
+ * @brief Structure for representing a separable kernel (rank-1 square matrix) as the outer product of a vertical
+ * and a horizontal 1D kernel. Contains fields for kernel size and pointer arrays of the 1D entries (float).
  */
-typedef struct Kernel {
+typedef struct SeparableKernel {
         int size;
-        float *entries;
-} Kernel;
+        float *horizontalEntries;
+        float *verticalEntries;
+} SeparableKernel;
+
+
+// Kernel sizes of the shipped filters (3 for sharpen, emboss and sobel, 5/9/13 for box and 5/13/19 for gaussian blurs).
+// The convolution backends instantiate their vector row functions with each of these sizes as a compile-time constant,
+// so the loops over the kernel entries are fully unrolled. Other sizes use the generic row functions
+#define FOR_EACH_SPECIALIZED_KERNEL_SIZE(X) X(3) X(5) X(9) X(13) X(19)
 
 // Enumeration for the general different intensity levels of common filters (sharpen, emboss, etc).
 typedef enum GeneralFilterIntensity {
@@ -34,16 +42,19 @@ typedef enum GeneralFilterIntensity {
         FILTER_INTENSITY_INVALID
 } GeneralFilterIntensity;
 
+// Enumeration for the border modes of the convolution pipelines (how channels outside of the image are sampled).
+// Zero: 000|abcd|000, Replicate: aaa|abcd|ddd, Reflect: dcb|abcd|cba (edge not repeated), Wrap: bcd|abcd|abc
+typedef enum BorderMode {
+        BORDER_MODE_ZERO,
+        BORDER_MODE_REPLICATE,
+        BORDER_MODE_REFLECT,
+        BORDER_MODE_WRAP,
+        BORDER_MODE_INVALID
+} BorderMode;
 
 
 
 
-/**
- * @brief Utility function that prints out the elements of the `entries` array in a `Window` structure
- * in rectangular form.
- * @param window Pointer to the Window structure to print.
- */
-void print_window(struct Window *window);
 
 /**
  * @brief Utility function that prints out the elements of the `entries` array in a `Kernelx` structure
@@ -53,10 +64,18 @@ void print_window(struct Window *window);
 void print_kernel(struct Kernel *kernel);
 
 
-struct Window *create_window(int y, int x, int windowSize, int imageHeight, int imageWidth, uint8_t *imageChannelArray, struct MemoryPool *pool);
-void shift_window_right(int y, int x, struct Window *window, int imageHeight, int imageWidth, uint8_t *inputChannelArray);
+// Maps an index outside of [0, length) to the index inside of it that is sampled by the border mode (-1 for zero-padding)
+int map_border_index(int index, int length, enum BorderMode borderMode);
+
+// Copies `count` channels of an image row starting at column `xStart` (may be negative) into a padded row. Only the
+// out-of-bounds (border) columns are mapped through map_border_index, the in-bounds (interior) span is copied as is
+void fill_padded_row(uint8_t *inputRow, int imageWidth, int xStart, int count, enum BorderMode borderMode, uint8_t *paddedRow);
 
 
+// Allocate kernel structures of a given size with aligned (uninitialized) entries
+struct Kernel *allocate_kernel(int size);
+struct SeparableKernel *allocate_separable_kernel(int size);
+
 struct Kernel *create_gaussian_kernel(enum GeneralFilterIntensity filterIntensity);
 struct Kernel *create_box_blur_kernel(enum GeneralFilterIntensity filterIntensity);
 
@@ -65,12 +84,43 @@ struct Kernel *create_emboss_kernel(enum GeneralFilterIntensity filterIntensity)
 
 struct Kernel *create_sobel_vertical_kernel(enum GeneralFilterIntensity filterIntensity);
 struct Kernel *create_sobel_horizontal_kernel(enum GeneralFilterIntensity filterIntensity);
+
+// Bokeh (lens aperture) blurs: normalized disc and hexagon apertures of radius 8, 16 or 32 (kernel size 17, 33 or 65).
+// They are not separable, at these sizes the convolution pipeline runs them through the FFT pipeline
+struct Kernel *create_disc_bokeh_kernel(enum GeneralFilterIntensity filterIntensity);
+struct Kernel *create_hexagonal_bokeh_kernel(enum GeneralFilterIntensity filterIntensity);
 void free_kernel(struct Kernel *kernel);
 
 
+struct SeparableKernel *create_gaussian_separable_kernel(enum GeneralFilterIntensity filterIntensity);
+struct SeparableKernel *create_box_blur_separable_kernel(enum GeneralFilterIntensity filterIntensity);
+void free_separable_kernel(struct SeparableKernel *kernel);
+
+
 uint8_t compute_convolution(float *kernelEntriesArray, float *windowEntriesArray, int arrayLength);
-int apply_convolution_pipeline_channel(uint8_t *inputChannels, uint8_t *outputChannels, struct Kernel *kernel, int imageHeight, int imageWidth);
-int apply_convolution_pipeline_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, struct Kernel *kernel);
+// Convolution pipelines over any number of channel planes in one pass over the tiles (one fork/join). The _channel and
+// _RGB variants are wrappers for one plane and for the three planes of an ImageRGB. Kernels estimated cheaper through FFTs
+// are handed over to the FFT pipeline, apply_direct_convolution_pipeline_planes always convolves directly
+// The _planes functions of every pipeline apply the point operations of an epilogue (NULL for none) to each output row
+// right after computing it
+int apply_direct_convolution_pipeline_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, const struct Kernel *kernel,
+        int imageHeight, int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue);
+int apply_convolution_pipeline_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, const struct Kernel *kernel,
+        int imageHeight, int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue);
+int apply_convolution_pipeline_channel(uint8_t *inputChannels, uint8_t *outputChannels, const struct Kernel *kernel, int imageHeight, int imageWidth,
+        enum BorderMode borderMode);
+int apply_convolution_pipeline_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, const struct Kernel *kernel, enum BorderMode borderMode);
+
+
+int apply_separable_convolution_pipeline_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes,
+        const struct SeparableKernel *kernel, int imageHeight, int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue);
+int apply_separable_convolution_pipeline_channel(uint8_t *inputChannels, uint8_t *outputChannels, const struct SeparableKernel *kernel,
+        int imageHeight, int imageWidth, enum BorderMode borderMode);
+int apply_separable_convolution_pipeline_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, const struct SeparableKernel *kernel,
+        enum BorderMode borderMode);
 
 
 
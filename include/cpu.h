@@ -0,0 +1,40 @@
+#ifndef CPU_H
+#define CPU_H
+
+
+
+// Function attributes compiling a single function for an instruction set (the rest of the program is built for the
+// baseline x86-64 instruction set, so these functions must only be called after checking cpu_feature_level())
+#define CPU_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define CPU_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx2,fma")))
+
+// Function attribute for the shared bodies of multi-versioned kernels, always inlined into the instantiating function
+// (so that constant arguments such as the kernel size are propagated into the loops)
+#define CPU_ALWAYS_INLINE static inline __attribute__((always_inline))
+
+
+// Enumeration for the instruction set levels of the multi-versioned kernels, ordered from narrowest to widest
+typedef enum CpuFeatureLevel {
+        CPU_FEATURE_LEVEL_SCALAR,
+        CPU_FEATURE_LEVEL_SSE41,
+        CPU_FEATURE_LEVEL_AVX2,         // AVX2 and FMA
+        CPU_FEATURE_LEVEL_AVX512,       // AVX-512 F and BW
+        CPU_FEATURE_LEVEL_INVALID
+} CpuFeatureLevel;
+
+
+
+// Returns the widest instruction set level supported by the processor (detected once, later calls are a lock-free load,
+// main() detects it up front). The environment variable
+// IMAGEPROCESSOR_CPU ("scalar", "sse4.1", "avx2" or "avx512") lowers the level for testing, it is never raised above
+// what the processor supports
+enum CpuFeatureLevel cpu_feature_level(void);
+
+
+// Returns the name of an instruction set level (same names as accepted by IMAGEPROCESSOR_CPU)
+const char *cpu_feature_level_name(enum CpuFeatureLevel level);
+
+
+
+#endif //CPU_H
@@ -0,0 +1,32 @@
+#ifndef FFT_H
+#define FFT_H
+
+
+#include <stdint.h>  // For type uint8_t
+#include "convolution.h"  // For struct Kernel and enum BorderMode
+
+
+// Smallest and largest (power of two) sizes of the square tiles transformed by the FFT convolution pipeline
+#define FFT_MIN_TILE_SIZE 16
+#define FFT_MAX_TILE_SIZE 512
+
+
+
+// Returns the estimated cost of the FFT convolution pipeline on one plane for a kernel size and image dimensions, in units
+// of one kernel entry per output channel of the direct pipeline (see the blur planner), or a negative value when no tile
+// size can hold the kernel
+double fft_convolution_cost(int kernelSize, int imageHeight, int imageWidth);
+
+
+// Carries out the parallelized FFT convolution pipeline (overlap-save over square tiles) for any number of channel
+// planes of the input image, and stores results into the output planes. Two real tiles are transformed at once as the
+// real and imaginary parts of one complex tile. Results match the direct pipeline within +-1 (float rounding).
+// Returns 0 on failure
+int apply_fft_convolution_pipeline_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, const struct Kernel *kernel,
+        int imageHeight, int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue);
+
+
+
+
+#endif //FFT_H
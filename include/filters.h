@@ -3,6 +3,8 @@
 
 
 #include "convolution.h"  // For enum GaussianBlurIntensity
+#include "planner.h"  // For struct BlurPlan
+#include "pointops.h"  // For struct PointOpEpilogue
 
 
 // Enumeration for the different filter types 
@@ -13,18 +15,93 @@ typedef enum TypeFilter {
         FILTER_EMBOSS,
         FILTER_SHARPEN,
         FILTER_SOBEL_EDGE_DETECTION,
+        FILTER_DISC_BOKEH,
+        FILTER_HEXAGONAL_BOKEH,
+        FILTER_BRIGHTNESS,              // Point operations (fused into the previous stage of a filter chain)
+        FILTER_CONTRAST,
+        FILTER_GAMMA,
+        FILTER_THRESHOLD,
         FILTER_INVALID
 } TypeFilter;
 
 
+// Largest number of stages of a filter chain
+#define FILTER_CHAIN_MAX_STAGES 16
+
+// Output rows of a strip of a streamed filter chain (when no strip height is given)
+#define FILTER_STREAM_STRIP_ROWS 256
+
+
+/**
+ * @brief Structure for representing one stage of a filter chain: the filter, its general intensity, for blurs of a
+ * given strength and box blurs the blur plan for the image dimensions (BLUR_SHAPE_INVALID for the other filters), and
+ * the point operations fused into the stores of the stage.
+ */
+typedef struct FilterStage {
+        enum TypeFilter typeFilter;
+        enum GeneralFilterIntensity filterIntensity;
+        struct BlurPlan blurPlan;
+        struct PointOpEpilogue epilogue;
+} FilterStage;
+
+/**
+ * @brief Structure for representing a chain of filters applied one after the other to the same image in memory.
+ */
+typedef struct FilterChain {
+        int numStages;
+        struct FilterStage stages[FILTER_CHAIN_MAX_STAGES];
+} FilterChain;
+
+
 // Applies the greyscale filter to an RGB image. Saves results in a created ImageOneChannel struct and frees the input image
 struct ImageOneChannel *apply_filter_greyscale(struct ImageRGB **inputImage);
 
-// Applies a generic convolution based filter (e.g. emboss, sharpen) on an input image. Both input and output image are RGB
-struct ImageRGB *apply_filter_generic_convolution(struct ImageRGB **inputImage, enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity);
+// Applies a generic convolution based filter (e.g. emboss, sharpen, bokeh blurs) on an input image. Both input and output image are RGB
+// The border mode determines how channels outside of the image are sampled
+struct ImageRGB *apply_filter_generic_convolution(struct ImageRGB **inputImage, enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity,
+        enum BorderMode borderMode);
+
+// Applies a blur planned by plan_blur() on an input image through its backend. Both input and output image are RGB
+struct ImageRGB *apply_filter_blur(struct ImageRGB **inputImage, const struct BlurPlan *plan, enum BorderMode borderMode);
+
+// Applies a gaussian blur of any standard deviation (GAUSSIAN_BLUR_MIN_SIGMA to GAUSSIAN_BLUR_MAX_SIGMA) on an input image,
+// through the backend picked by the blur planner for the image. Both input and output image are RGB
+struct ImageRGB *apply_filter_gaussian_blur(struct ImageRGB **inputImage, float sigma, enum BorderMode borderMode);
+
+// Applies a box blur of any radius (up to BOX_BLUR_MAX_RADIUS) on an input image, through the backend picked by the blur
+// planner for the image. Both input and output image are RGB
+struct ImageRGB *apply_filter_box_blur(struct ImageRGB **inputImage, int radius, enum BorderMode borderMode);
+
+// Initializes a filter chain stage for the image dimensions and the border mode. The strength is the radius or standard
+// deviation of a blur (0 for a general intensity) or the value of a point operation. Blurs given a strength and box blurs
+// are planned. Returns 0 for an invalid stage
+int init_filter_stage(struct FilterStage *stage, enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity,
+        float strength, int imageHeight, int imageWidth, enum BorderMode borderMode);
+
+// Adds a stage to a filter chain (see init_filter_stage). A point operation following another stage is fused into the
+// epilogue of that stage instead, so it costs no pass over the image of its own. Returns 0 for an invalid stage
+int add_filter_chain_stage(struct FilterChain *filterChain, enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity,
+        float strength, int imageHeight, int imageWidth, enum BorderMode borderMode);
+
+// Applies the stages of a filter chain one after the other in memory, alternating between the input image and one more
+// image. The result is saved in outputImageRGB, or in outputImageOneChannel when a greyscale or sobel stage turned the
+// image into a greyscale one (the stages after it run on the single plane). Frees the input image, returns 0 on failure
+int apply_filter_chain(struct ImageRGB **inputImage, const struct FilterChain *filterChain, enum BorderMode borderMode,
+        struct ImageRGB **outputImageRGB, struct ImageOneChannel **outputImageOneChannel);
+
+// Applies the stages of a filter chain to an image streamed from an uncompressed file in horizontal strips (stripHeight
+// output rows, 0 for FILTER_STREAM_STRIP_ROWS), each read with the rows the stages reach above and below it. The output
+// rows of every strip are written to the output file (BMP, PPM, or PGM for a greyscale result) before the next strip is
+// read, so the peak memory is O(width*(stripHeight + halo)) instead of O(width*height). The results match apply_filter_chain
+// up to rounding for the FFT backend, which picks its tiles for the strip, and for the recursive gaussian, whose recursions
+// are cut at the halo (some channels are off by 1 level). The wrap border mode cannot be streamed. Returns 0 on failure
+int apply_filter_chain_streaming(struct ImageStream *inputStream, int height, int width, const char *outputPath,
+        ImageFileType outputFileType, const struct FilterChain *filterChain, enum BorderMode borderMode, int stripHeight);
 
-// Applies the sobel operator filter to an RGB image. Saves results in a created ImageOneChannel struct and frees the input image
-struct ImageOneChannel *apply_filter_sobel_edge_detection(struct ImageRGB **inputImage, enum GeneralFilterIntensity filterIntensity);
+// Applies the sobel operator filter to an RGB image in a single fused pass (luminance, signed gradients and magnitude per
+// tile). Saves results in a created ImageOneChannel struct and frees the input image
+struct ImageOneChannel *apply_filter_sobel_edge_detection(struct ImageRGB **inputImage, enum GeneralFilterIntensity filterIntensity,
+        enum BorderMode borderMode);
 
 
 
@@ -0,0 +1,46 @@
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+
+#include <stdint.h>  // For types uint8_t, int16_t and int32_t
+#include "image.h"  // For struct ImageRGB
+#include "convolution.h"  // For struct Kernel
+
+
+/**
+ * @brief Structure for representing a kernel quantized to fixed-point, used by the integer convolution backend.
+ * Contains fields for the kernel size, the number of fractional bits of the quantized entries (`shift`), a flag
+ * indicating that the entries fit the 8-bit (maddubs) path with int16 accumulation (`useBytes`), a pointer
+ * array of the quantized entries (int16_t) in row-major order, and a pointer array of the entries of each pair of
+ * kernel rows interleaved as broadcast by the vector row functions (int32_t, ((size + 1) / 2) * size of them).
+ */
+typedef struct FixedPointKernel {
+        int size;
+        int shift;
+        int useBytes;
+        int16_t *entries;
+        int32_t *entryPairs;
+} FixedPointKernel;
+
+
+// Quantizes the entries of a float kernel to fixed-point. Picks the 8-bit path when it is exact to within half of
+// a channel level, and otherwise the largest number of fractional bits for which int16 entries and int32 sums cannot overflow
+struct FixedPointKernel *create_fixed_point_kernel(const struct Kernel *kernel);
+void free_fixed_point_kernel(struct FixedPointKernel *kernel);
+
+
+// Carries out the parallelized integer convolution pipeline directly on the uint8 channelsArray of the input image.
+// Results match the float pipeline (roundf and clamp) within +-1. The _planes variant handles any number of channel
+// planes in one pass over the tiles
+int apply_fixed_point_convolution_pipeline_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes,
+        const struct FixedPointKernel *kernel, int imageHeight, int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue);
+int apply_fixed_point_convolution_pipeline_channel(uint8_t *inputChannels, uint8_t *outputChannels, const struct FixedPointKernel *kernel,
+        int imageHeight, int imageWidth, enum BorderMode borderMode);
+int apply_fixed_point_convolution_pipeline_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, const struct FixedPointKernel *kernel,
+        enum BorderMode borderMode);
+
+
+
+
+#endif //FIXEDPOINT_H
@@ -2,16 +2,32 @@
 #define IMAGE_H
 
 #include <stdint.h>
+#include "png.h"  // For enum PngCompression
+#include "jpeg.h"  // For enum JpegSubsampling
 
 
-// Enumeration for valid image file types including png, jpg, and bmp.
+// Enumeration for valid image file types including png, jpg, bmp, ppm and pgm (bmp, ppm and pgm are uncompressed and
+// written through a memory mapping of the output file, pgm only holds one channel).
 typedef enum FileType {
         FILE_TYPE_PNG,
         FILE_TYPE_JPG,
-        FILE_TYPE_BMP
+        FILE_TYPE_BMP,
+        FILE_TYPE_PPM,
+        FILE_TYPE_PGM
 } ImageFileType;
 
 
+/**
+ * @brief Structure for representing the options of the encoders of save_imageRGB and save_imageOneChannel (NULL options
+ * stand for the defaults of init_image_save_options).
+ */
+typedef struct ImageSaveOptions {
+        enum PngCompression pngCompression;
+        int jpgQuality;                         // 1 to 100
+        enum JpegSubsampling jpgSubsampling;
+} ImageSaveOptions;
+
+
 // Enumeration for the channel types of a three-channeled image (R, G, B).
 typedef enum ChannelTypeRGB {
         CHANNEL_TYPE_RED,
@@ -48,7 +64,8 @@ typedef enum ImageType {
 
 
 // Loads image from disk using stb_image.h. Transforms the loaded image into a struct ImageRGB
-// and returns pointer to the struct
+// and returns pointer to the struct. Uncompressed BMP (24 or 32 bit), PPM and PGM (8 bit) files are read
+// from a memory mapping of the file instead
 struct ImageRGB *load_imageRGB(const char *filename);
 struct ImageOneChannel *load_imageOneChannel(const char *filename);
 
@@ -57,14 +74,39 @@ struct ImageRGB *load_empty_imageRGB(int width, int height);
 struct ImageOneChannel *load_empty_imageOneChannel(int width, int height);
 
 
-int save_imageRGB(struct ImageRGB *image, const char *filename, ImageFileType fileType);
-int save_imageOneChannel(struct ImageOneChannel *image, const char *filename, ImageFileType fileType);
+// Saves image to disk. BMP, PPM and PGM files are written into a memory mapping of the file, PNG files by the parallel
+// encoder of png.h and JPG files by the parallel encoder of jpeg.h (both straight from the planes). Returns 0 on failure
+int save_imageRGB(struct ImageRGB *image, const char *filename, ImageFileType fileType, const struct ImageSaveOptions *options);
+int save_imageOneChannel(struct ImageOneChannel *image, const char *filename, ImageFileType fileType, const struct ImageSaveOptions *options);
+
+// Sets the default save options (full PNG compression, JPG quality 100 without chroma subsampling)
+void init_image_save_options(struct ImageSaveOptions *options);
 
 
 void free_imageRGB(struct ImageRGB *image);
 void free_imageOneChannel(struct ImageOneChannel *image);
 
 
+// Uncompressed image file (BMP, PPM or PGM) read or written one strip of rows at a time, top row first, so that images
+// larger than the memory can be processed. The file is mapped and the pages of the rows already read or written are
+// released, the peak memory is that of the strips the caller holds
+typedef struct ImageStream ImageStream;
+
+// Opens a file for reading its rows. Returns NULL for compressed formats (PNG, JPG)
+struct ImageStream *open_image_read_stream(const char *filename, int *width, int *height);
+
+// Reads the next numRows rows into planes (1 plane: grey, 3 planes: R, G, B) with a row stride of the image width
+int read_image_stream_rows(struct ImageStream *stream, int numRows, uint8_t **planes, int numPlanes);
+
+// Creates a file of numPlanes planes (PGM files hold 1 plane) for writing its rows
+struct ImageStream *open_image_write_stream(const char *filename, ImageFileType fileType, int width, int height, int numPlanes);
+
+// Writes the next numRows rows from planes with a row stride of the image width
+int write_image_stream_rows(struct ImageStream *stream, int numRows, uint8_t *const *planes);
+
+void close_image_stream(struct ImageStream *stream);
+
+
 
 
 
@@ -0,0 +1,52 @@
+#ifndef INTERLEAVE_H
+#define INTERLEAVE_H
+
+
+#include <stddef.h>  // For type size_t
+#include <stdint.h>  // For type uint8_t
+
+
+// Largest number of interleaved channels per pixel (e.g. RGBA)
+#define INTERLEAVE_MAX_CHANNELS 4
+
+// Pixels converted by one thread at a time (images below one block are converted by the calling thread alone)
+#define INTERLEAVE_BLOCK_PIXELS 32768
+
+
+/**
+ * @brief Structure for representing the byte shuffles of an interleaved layout. A group of 16 / bytesPerChannel pixels
+ * fills numChannels chunks of 16 interleaved bytes, and 16 bytes of every plane. gather[c][k] moves the bytes of channel c
+ * from chunk k to their place in the plane, scatter[k][c] moves them back (-1 zeroes a byte, it belongs to another
+ * chunk or channel). The vector versions OR the shuffles of every chunk (or channel) together.
+ */
+typedef struct InterleaveShuffles {
+        int numChannels, bytesPerChannel;
+        int8_t gather[INTERLEAVE_MAX_CHANNELS][INTERLEAVE_MAX_CHANNELS][16] __attribute__((aligned(16)));
+        int8_t scatter[INTERLEAVE_MAX_CHANNELS][INTERLEAVE_MAX_CHANNELS][16] __attribute__((aligned(16)));
+} InterleaveShuffles;
+
+
+
+// Converts interleaved pixels (RGBRGBRGB, AoS) into separate channel planes (RRRGGGBBB, SoA). Pixels have 2 to
+// INTERLEAVE_MAX_CHANNELS channels of 1 or 2 bytes each (8 or 16 bit channels, stored as in memory), plane c receives
+// channel c of every pixel. Runs the byte shuffles of the widest instruction set level, in parallel over blocks of pixels.
+// Returns 0 for an unsupported layout
+int deinterleave_channels(const uint8_t *source, uint8_t **planes, int numChannels, int bytesPerChannel, size_t numPixels);
+
+// Converts separate channel planes into interleaved pixels (the inverse of deinterleave_channels)
+int interleave_channels(uint8_t *const *planes, uint8_t *destination, int numChannels, int bytesPerChannel, size_t numPixels);
+
+// Builds the byte shuffles of a layout once for the row versions below, returns 0 for an unsupported layout
+int build_interleave_shuffles(struct InterleaveShuffles *shuffles, int numChannels, int bytesPerChannel);
+
+// Deinterleaves one row of pixels with prebuilt shuffles on the calling thread alone, for callers already running in
+// parallel over rows
+void deinterleave_channels_row(const uint8_t *source, uint8_t **planes, const struct InterleaveShuffles *shuffles, size_t numPixels);
+
+// Interleaves one row of pixels with prebuilt shuffles on the calling thread alone (the inverse of deinterleave_channels_row)
+void interleave_channels_row(uint8_t *const *planes, uint8_t *destination, const struct InterleaveShuffles *shuffles, size_t numPixels);
+
+
+
+
+#endif //INTERLEAVE_H
@@ -0,0 +1,35 @@
+#ifndef JPEG_H
+#define JPEG_H
+
+
+#include <stdint.h>  // For type uint8_t
+
+
+// Largest width and height of a baseline JPEG file
+#define JPEG_MAX_DIMENSION 65535
+
+
+// Enumeration for the chroma subsampling of the JPEG encoder (the horizontal and vertical resolution of Cb and Cr relative to Y)
+typedef enum JpegSubsampling {
+        JPEG_SUBSAMPLING_444,           // Full resolution chroma (the default)
+        JPEG_SUBSAMPLING_422,           // Half horizontal resolution chroma
+        JPEG_SUBSAMPLING_420,           // Half horizontal and vertical resolution chroma
+        JPEG_SUBSAMPLING_INVALID
+} JpegSubsampling;
+
+
+
+// Writes planes (three planes: R, G, B as a YCbCr JPEG, one plane: a greyscale JPEG) as a baseline JPEG file with the standard
+// quantization tables scaled to the quality (1 to 100) and the standard Huffman tables, reading the planes directly. Every
+// row of MCUs is a restart interval of its own, so the rows are colour converted, transformed, quantized and Huffman coded
+// in parallel, and joined in order with RST markers. Returns 0 on failure
+int write_jpeg_planes(const char *filename, uint8_t *const *planes, int numPlanes, int width, int height, int quality,
+        enum JpegSubsampling subsampling);
+
+// Returns the name of a chroma subsampling (e.g. "4:2:0")
+const char *jpeg_subsampling_name(enum JpegSubsampling subsampling);
+
+
+
+
+#endif //JPEG_H
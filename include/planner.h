@@ -0,0 +1,97 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+
+#include <stdio.h>  // For type FILE
+#include <stdint.h>  // For type uint8_t
+#include "image.h"  // For struct ImageRGB
+#include "convolution.h"  // For enum BorderMode
+
+
+// Smallest standard deviation given to the recursive gaussian, with the replicate and reflect borders only. From it up to
+// GAUSSIAN_BLUR_MAX_SIGMA the recursion stays within 3 levels of the sampled gaussian at hard edges (1 level on photographs).
+// Below it, it is off by 4-14 levels at hard edges, and with the zero border it is off by several levels at the image edges
+// up to a standard deviation of about 100
+#define PLANNER_IIR_MIN_SIGMA 16.0f
+
+// Radius of the sampled gaussian kernels in standard deviations
+#define PLANNER_GAUSSIAN_RADIUS_SIGMAS 3.0f
+
+
+// Enumeration for the blurs accepted by the planner
+typedef enum BlurShape {
+        BLUR_SHAPE_GAUSSIAN,    // Strength is the standard deviation
+        BLUR_SHAPE_BOX,         // Strength is the radius (integer)
+        BLUR_SHAPE_INVALID
+} BlurShape;
+
+// Enumeration for the backends of the blurs
+typedef enum BlurBackend {
+        BLUR_BACKEND_DIRECT,            // Direct convolution with the sampled 2D kernel (size^2 per channel)
+        BLUR_BACKEND_SEPARABLE,         // Two 1D passes with the sampled kernel (2*size per channel)
+        BLUR_BACKEND_RUNNING_SUM,       // Running sums (box only, constant per channel)
+        BLUR_BACKEND_IIR,               // Recursive gaussian (gaussian only, constant per channel)
+        BLUR_BACKEND_FFT,               // FFT convolution with the sampled 2D kernel (log of the tile size per channel)
+        BLUR_BACKEND_COUNT
+} BlurBackend;
+
+
+/**
+ * @brief Structure for representing the plan of a blur: the blur and its strength, the size of its sampled kernel and the
+ * backend of the lowest estimated cost (in nanoseconds per plane) for the image dimensions.
+ */
+typedef struct BlurPlan {
+        enum BlurShape shape;
+        float strength;
+        int kernelSize;
+        enum BlurBackend backend;
+        double estimatedCost;
+} BlurPlan;
+
+
+// Returns the name of a backend (e.g. "separable")
+const char *blur_backend_name(enum BlurBackend backend);
+
+
+// Returns the estimated cost (nanoseconds per plane) of a backend for a blur of a given kernel size and strength, or a
+// negative value when the backend cannot run the blur correctly (or within the accuracy bound of the recursive gaussian)
+// with the border mode
+double estimate_blur_backend_cost(enum BlurBackend backend, enum BlurShape shape, float strength, int kernelSize, int imageHeight,
+        int imageWidth, enum BorderMode borderMode);
+
+// Returns 1 when the FFT pipeline is estimated cheaper than the direct pipeline for a kernel size, 0 otherwise
+int convolution_prefers_fft(int kernelSize, int imageHeight, int imageWidth);
+
+
+// Plans a blur of any strength (a standard deviation of GAUSSIAN_BLUR_MIN_SIGMA to GAUSSIAN_BLUR_MAX_SIGMA or a radius of 1
+// to BOX_BLUR_MAX_RADIUS): picks the cheapest backend that runs it correctly with the border mode. Returns a plan with
+// BLUR_SHAPE_INVALID for an invalid blur
+struct BlurPlan plan_blur(enum BlurShape shape, float strength, int imageHeight, int imageWidth, enum BorderMode borderMode);
+
+
+// Runs a planned blur over any number of channel planes (returns 0 on failure)
+int apply_blur_plan_planes(const struct BlurPlan *plan, uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, int imageHeight,
+        int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue);
+
+// Runs a planned blur over the three (RGB) channels of a given image
+int apply_blur_plan_RGB(const struct BlurPlan *plan, struct ImageRGB *inputImage, struct ImageRGB *outputImage, enum BorderMode borderMode);
+
+
+// The cost model of the backends is in nanoseconds per output channel (one thread): a fixed part plus a part per kernel
+// entry (direct), tap (separable) or unit of the FFT cost model. The defaults are measured values, the calibration replaces
+// them with values of the host
+
+// Measures every backend on the given synthetic planes (imageSize x imageSize) and fits the cost model (returns 0 on failure)
+int calibrate_blur_cost_model(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, int imageSize);
+
+// Writes the cost model as "cost backend fixed perEntry" lines (saved along with the tile shapes)
+void save_blur_cost_model(FILE *file);
+
+// Reads a "cost backend fixed perEntry" line into the cost model. Returns 1 when the line was a cost line, 0 otherwise
+int parse_blur_cost_line(const char *line);
+
+
+
+
+#endif //PLANNER_H
@@ -0,0 +1,38 @@
+#ifndef PNG_H
+#define PNG_H
+
+
+#include <stdint.h>  // For type uint8_t
+
+
+// Filtered bytes of the rows deflated by one thread at a time (at least one row). Every band starts without a history of
+// matches, larger bands compress slightly better
+#define PNG_BAND_BYTES (1 << 20)
+
+
+// Enumeration for the compression modes of the PNG encoder, from the fastest to the smallest files
+typedef enum PngCompression {
+        PNG_COMPRESSION_STORE,          // Unfiltered rows in stored (uncompressed) deflate blocks
+        PNG_COMPRESSION_RLE,            // Up filter on every row, runs of a repeated pixel only
+        PNG_COMPRESSION_FAST,           // Up filter on every row, greedy matching over short hash chains
+        PNG_COMPRESSION_FULL,           // Filter picked per row, lazy matching over longer hash chains (the default)
+        PNG_COMPRESSION_INVALID
+} PngCompression;
+
+
+
+// Writes planes (three planes: R, G, B as an 8 bit RGB PNG, one plane: an 8 bit greyscale PNG) as a PNG file, reading the
+// planes directly. The rows are split into bands which are filtered (per row the filter of the smallest sum of absolute
+// differences, or the fixed filter of the compression mode) and deflated in parallel, each into an IDAT chunk of its own.
+// The deflate stream of every band but the last ends byte aligned (a sync flush after fixed Huffman codes), so the bands
+// join into a single zlib stream whose Adler-32 is combined from those of the bands. The compression mode trades the size
+// of the file for the speed of the encoder. Returns 0 on failure
+int write_png_planes(const char *filename, uint8_t *const *planes, int numPlanes, int width, int height, enum PngCompression compression);
+
+// Returns the name of a compression mode (e.g. "fast")
+const char *png_compression_name(enum PngCompression compression);
+
+
+
+
+#endif //PNG_H
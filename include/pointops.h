@@ -0,0 +1,48 @@
+#ifndef POINTOPS_H
+#define POINTOPS_H
+
+
+#include <stdint.h>  // For type uint8_t
+
+
+// Largest number of point operations composed into one epilogue
+#define POINT_OP_MAX_OPS 16
+
+
+// Enumeration for the point operations (per channel functions of the channel value)
+typedef enum PointOpType {
+        POINT_OP_BRIGHTNESS,    // Adds the value (-255 to 255)
+        POINT_OP_CONTRAST,      // Scales the distance to 128 by the value (0 to 16)
+        POINT_OP_GAMMA,         // Gamma correction 255*(v/255)^(1/value) (0.1 to 10, above 1 brightens)
+        POINT_OP_THRESHOLD,     // 255 from the value on (0 to 255), 0 below it
+        POINT_OP_INVALID
+} PointOpType;
+
+
+/**
+ * @brief Structure for representing an epilogue of point operations attached to a pipeline: the operations are composed
+ * into one lookup table of the 256 channel values, which the pipelines apply to every output row right after computing
+ * it (while it is still in the L1 cache), so any number of point operations costs one table lookup per channel and no
+ * extra pass over the image.
+ */
+typedef struct PointOpEpilogue {
+        int numOps;
+        uint8_t table[256];
+} PointOpEpilogue;
+
+
+
+// Initializes an epilogue without operations (identity table)
+void init_point_op_epilogue(struct PointOpEpilogue *epilogue);
+
+// Composes a point operation after the operations of an epilogue. Returns 0 for an invalid operation or value
+int append_point_op(struct PointOpEpilogue *epilogue, enum PointOpType type, float value);
+
+
+// Applies an epilogue to `count` channels of an output row in place (nothing for NULL or an epilogue without operations)
+void apply_point_op_epilogue_row(const struct PointOpEpilogue *epilogue, uint8_t *row, int count);
+
+
+
+
+#endif //POINTOPS_H
@@ -16,7 +16,10 @@
  * - Structure for representing a simple memory pool.
  * 
  * - Used to optimize memory allocation/deallocation, specifically for managing a preallocated memory block
- *   needed by `Window` structures in the convolution pipeline.
+ *   needed by the tiles (rings of converted rows, padded tiles) of the convolution pipelines.
+ * 
+ * - Every thread owns one persistent pool (arena), see acquire_thread_memory_pool(). The pipelines empty it between
+ *   tiles and use mark_pool()/rollback_pool() for scratch buffers that only live in part of a tile.
  * 
  * - The structure contains fields that represent the total sizes of the two memory regions, `poolSizeOne` 
  *   and `poolSizeTwo`, along with pointers to the next available memory blocks in each region, `nextFreeOne` 
@@ -50,9 +53,26 @@ void free_from_pool(struct MemoryPool *pool, void *ptrToStart, size_t size);
 void empty_pool(struct MemoryPool *pool);
 
 
+// Returns the current position of the nextFree pointer, to be handed back to rollback_pool()
+void *mark_pool(struct MemoryPool *pool);
+
+
+// Pushes the nextFree MemoryPool field pointer back to a position returned by mark_pool(), freeing everything allocated since
+void rollback_pool(struct MemoryPool *pool, void *mark);
+
+
 // Frees the memoryPool structure and its associated memory
 void release_entire_memory_pool(struct MemoryPool *pool);
 
 
+// Returns the (emptied) persistent MemoryPool of the calling thread, created on first use and grown when it is smaller
+// than `desiredSize`. The pool stays alive between parallel regions and must not be released by the caller
+struct MemoryPool *acquire_thread_memory_pool(size_t desiredSize);
+
+
+// Frees the persistent MemoryPools of the OpenMP worker threads (call once, outside of any parallel region)
+void release_thread_memory_pools(void);
+
+
 
 #endif //POOL_H
\ No newline at end of file
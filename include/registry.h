@@ -0,0 +1,34 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+
+#include "convolution.h"  // For struct Kernel, struct SeparableKernel and enum GeneralFilterIntensity
+#include "fixedpoint.h"  // For struct FixedPointKernel
+#include "filters.h"  // For enum TypeFilter
+
+
+/**
+ * @brief Structure for representing the registered forms of one (filter, intensity) kernel, side by side: the float
+ * kernel, its separable 1D form (NULL when the kernel is not separable) and its fixed-point form (NULL when it cannot
+ * be quantized). All of them are owned by the registry and shared read-only.
+ */
+typedef struct KernelSet {
+        const struct Kernel *kernel;
+        const struct SeparableKernel *separableKernel;
+        const struct FixedPointKernel *fixedPointKernel;
+} KernelSet;
+
+
+
+// Returns the kernels of a convolution based filter (gaussian blur, box blur, emboss, sharpen or bokeh) and intensity. They are
+// built on the first request and shared by every later request (thread-safe). Returns NULL on failure
+const struct KernelSet *get_registered_kernels(enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity);
+
+
+// Frees every registered kernel (no kernel set handed out before may be used afterwards)
+void release_kernel_registry(void);
+
+
+
+
+#endif //REGISTRY_H
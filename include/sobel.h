@@ -0,0 +1,30 @@
+#ifndef SOBEL_H
+#define SOBEL_H
+
+
+#include <stdint.h>  // For type uint8_t
+#include "convolution.h"  // For enum GeneralFilterIntensity and enum BorderMode
+
+
+// Fixed-point luminance weights (7 fractional bits), same as the vector loops of the greyscale filter
+#define SOBEL_LUMA_RED_WEIGHT 38
+#define SOBEL_LUMA_GREEN_WEIGHT 75
+#define SOBEL_LUMA_BLUE_WEIGHT 14
+
+
+
+// Returns the factor applied to the gradient magnitude for a sobel filter intensity (same as the sobel kernels)
+float sobel_intensity_scale(enum GeneralFilterIntensity filterIntensity);
+
+
+// Carries out the fused sobel pipeline on the three (RGB) input planes: every tile computes the luminance of its rows
+// (and halo) on the fly, evaluates both separable 3x3 sobel kernels with signed int16 gradients and stores only the
+// clamped gradient magnitude into the output channels. Returns 0 on failure
+int apply_sobel_pipeline(uint8_t **inputPlanes, uint8_t *outputChannels, float scale, int imageHeight, int imageWidth,
+        enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue);
+
+
+
+
+#endif //SOBEL_H
@@ -0,0 +1,62 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+
+#include <stddef.h>  // For type size_t
+
+
+// Largest kernel size with its own entry in the calibration table (larger kernels always use the cache model)
+#define TUNING_MAX_KERNEL_SIZE 64
+
+
+/**
+ * @brief Structure for representing the data cache geometry of the processor (sizes in bytes, per core).
+ */
+typedef struct CacheGeometry {
+        size_t levelOneSize;
+        size_t levelTwoSize;
+        size_t lineSize;
+} CacheGeometry;
+
+
+/**
+ * @brief Structure for representing the shape of the output tiles (in channels) of a convolution pipeline.
+ */
+typedef struct TileShape {
+        int width;
+        int height;
+} TileShape;
+
+
+// Enumeration for the tiled convolution pipelines, each of them has its own working set per tile
+typedef enum TuningPipeline {
+        TUNING_PIPELINE_DIRECT,         // Ring of kernel-size rows converted to floats per plane
+        TUNING_PIPELINE_SEPARABLE,      // Intermediate float buffer of the horizontal pass
+        TUNING_PIPELINE_FIXED_POINT,    // Padded uint8 tile
+        TUNING_PIPELINE_SOBEL,          // Padded uint8 luminance tile (3x3 kernels only)
+        TUNING_PIPELINE_COUNT
+} TuningPipeline;
+
+
+
+// Detects the data cache sizes once (sysfs on Linux, GetLogicalProcessorInformation on Windows, cpuid as the fallback)
+struct CacheGeometry detect_cache_geometry(void);
+
+
+// Picks the tile shape of a pipeline for a kernel size. A calibrated shape is used when one was loaded, otherwise the
+// shape is derived from the kernel size and the detected cache geometry. Tiles are made shorter when the image would
+// not give every thread a few of them
+struct TileShape choose_tile_shape(enum TuningPipeline pipeline, int kernelSize, int imageHeight, int imageWidth);
+
+
+// Measures candidate tile shapes of every pipeline for the common kernel sizes on a synthetic image, keeps the fastest
+// ones and saves them to `path` along with the calibrated cost model of the blur planner (returns 0 on failure)
+int calibrate_tile_shapes(const char *path);
+
+
+// Loads tile shapes and blur costs saved by calibrate_tile_shapes() (returns 0 on failure, the cache model stays in use)
+int load_tile_shapes(const char *path);
+
+
+
+#endif //TUNING_H
@@ -0,0 +1,769 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  // For memset() and memcpy()
+#include <math.h>  // For sqrt() and ceilf()
+#include <stdint.h>  // For types uint8_t and uint32_t
+#include <immintrin.h>  // For AVX2 intrinsics
+#include <omp.h>  // For multithreading
+#include "image.h"
+#include "pool.h"
+#include "blur.h"
+#include "cpu.h"
+
+
+
+int iir_gaussian_padding(float sigma) {
+
+        return (int) ceilf(IIR_GAUSSIAN_PADDING_SIGMAS*sigma);
+
+}
+
+
+int box_blur_radius(enum GeneralFilterIntensity filterIntensity) {
+
+        // Radii of the box blur kernel sizes 5, 9 and 13 (same as create_box_blur_kernel)
+        switch (filterIntensity) {
+                case FILTER_INTENSITY_LIGHT:    return 2;
+                case FILTER_INTENSITY_MEDIUM:   return 4;
+                case FILTER_INTENSITY_HIGH:     return 6;
+                default:                        return 0;
+        }
+
+}
+
+
+// Computes the window sums P[x + 2*radius + 1] - P[x] of the prefix sums P, 8 channels at a time
+CPU_TARGET_AVX2
+static void subtract_prefix_sums_avx2(uint32_t *prefixSums, int radius, uint32_t *rowSums, int imageWidth) {
+
+        int x = 0;
+        for (; x + 8 <= imageWidth; x += 8) {
+                __m256i upper_vec32u = _mm256_loadu_si256((__m256i*) &prefixSums[x + 2*radius + 1]);
+                __m256i lower_vec32u = _mm256_loadu_si256((__m256i*) &prefixSums[x]);
+                _mm256_storeu_si256((__m256i*) &rowSums[x], _mm256_sub_epi32(upper_vec32u, lower_vec32u));
+        }
+        for (; x < imageWidth; x++) {
+                rowSums[x] = prefixSums[x + 2*radius + 1] - prefixSums[x];
+        }
+
+}
+
+
+// Computes the horizontal window sums (2*radius + 1 channels) of every channel of an image row. The row is extended by
+// `radius` channels on both sides according to the border mode, and the window sums are computed from the prefix sums of
+// the extended row, so the cost per channel does not depend on the radius
+static void compute_row_window_sums(uint8_t *inputRow, int imageWidth, int radius, enum BorderMode borderMode,
+        uint8_t *extendedRow, uint32_t *prefixSums, uint32_t *rowSums, int useAvx2) {
+
+        // Extend the row with its border (only the 2*radius border channels are remapped)
+        int extendedLength = imageWidth + 2*radius;
+        fill_padded_row(inputRow, imageWidth, -radius, extendedLength, borderMode, extendedRow);
+
+        // Compute prefix sums of the extended row, prefixSums[i] is the sum of the first i channels
+        prefixSums[0] = 0;
+        for (int i = 0; i < extendedLength; i++) {
+                prefixSums[i+1] = prefixSums[i] + extendedRow[i];
+        }
+
+        // The window of channel x covers channels [x, x + 2*radius] of the extended row
+        if (useAvx2) {
+                subtract_prefix_sums_avx2(prefixSums, radius, rowSums, imageWidth);
+                return;
+        }
+        for (int x = 0; x < imageWidth; x++) {
+                rowSums[x] = prefixSums[x + 2*radius + 1] - prefixSums[x];
+        }
+
+}
+
+
+// Adds (sign = 1) or subtracts (sign = -1) a row of window sums to the column sums, 8 channels at a time
+CPU_TARGET_AVX2
+static void update_column_sums_avx2(uint32_t *columnSums, uint32_t *rowSums, int imageWidth, int sign) {
+
+        int x = 0;
+        for (; x + 8 <= imageWidth; x += 8) {
+                __m256i columnSums_vec32u = _mm256_loadu_si256((__m256i*) &columnSums[x]);
+                __m256i rowSums_vec32u = _mm256_loadu_si256((__m256i*) &rowSums[x]);
+                columnSums_vec32u = (sign > 0) ? _mm256_add_epi32(columnSums_vec32u, rowSums_vec32u) :
+                                                 _mm256_sub_epi32(columnSums_vec32u, rowSums_vec32u);
+                _mm256_storeu_si256((__m256i*) &columnSums[x], columnSums_vec32u);
+        }
+        for (; x < imageWidth; x++) {
+                columnSums[x] = (sign > 0) ? columnSums[x] + rowSums[x] : columnSums[x] - rowSums[x];
+        }
+
+}
+
+
+// Adds (sign = 1) or subtracts (sign = -1) a row of window sums to the column sums
+static void update_column_sums(uint32_t *columnSums, uint32_t *rowSums, int imageWidth, int sign, int useAvx2) {
+
+        if (useAvx2) {
+                update_column_sums_avx2(columnSums, rowSums, imageWidth, sign);
+                return;
+        }
+        for (int x = 0; x < imageWidth; x++) {
+                columnSums[x] = (sign > 0) ? columnSums[x] + rowSums[x] : columnSums[x] - rowSums[x];
+        }
+
+}
+
+
+// Divides the column sums by the window area and stores the rounded (and clamped) results into an output row, 8 channels
+// at a time
+CPU_TARGET_AVX2
+static void store_normalized_column_sums_avx2(uint32_t *columnSums, uint8_t *outputRow, int imageWidth, float inverseArea) {
+
+        __m256 inverseArea_ps = _mm256_set1_ps(inverseArea);
+        __m256 half_ps = _mm256_set1_ps(0.5f);
+        __m256 max_ps = _mm256_set1_ps(255.0f);
+
+        int x = 0;
+        for (; x + 8 <= imageWidth; x += 8) {
+
+                // Normalize the window sums and round half away from zero (sums are non-negative)
+                __m256 values_ps = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((__m256i*) &columnSums[x])), inverseArea_ps);
+                values_ps = _mm256_floor_ps(_mm256_add_ps(_mm256_min_ps(values_ps, max_ps), half_ps));
+
+                // Convert float -> int32 -> uint16 -> uint8 and store 8 channels
+                __m256i values_32i = _mm256_cvttps_epi32(values_ps);
+                __m128i values_16u = _mm_packus_epi32(_mm256_castsi256_si128(values_32i), _mm256_extracti128_si256(values_32i, 1));
+                _mm_storel_epi64((__m128i*) &outputRow[x], _mm_packus_epi16(values_16u, values_16u));
+
+        }
+        for (; x < imageWidth; x++) {
+                float value = columnSums[x] * inverseArea + 0.5f;
+                outputRow[x] = (value >= 255.0f) ? 255 : (uint8_t) value;
+        }
+
+}
+
+
+// Divides the column sums by the window area and stores the rounded (and clamped) results into an output row
+static void store_normalized_column_sums(uint32_t *columnSums, uint8_t *outputRow, int imageWidth, float inverseArea, int useAvx2) {
+
+        if (useAvx2) {
+                store_normalized_column_sums_avx2(columnSums, outputRow, imageWidth, inverseArea);
+                return;
+        }
+        for (int x = 0; x < imageWidth; x++) {
+                float value = columnSums[x] * inverseArea + 0.5f;
+                outputRow[x] = (value >= 255.0f) ? 255 : (uint8_t) value;
+        }
+
+}
+
+
+// Carries out the parallelized running sum box blur for any number of channel planes of the input image in one pass over
+// the strips (one fork/join), and stores results into the output planes. Each thread handles a strip of rows: the
+// horizontal window sums of a row come from its prefix sums, and the vertical window sums are kept as running column sums
+// that gain one row and lose one row per output row
+int apply_box_blur_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, int radius, int imageHeight,
+        int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue) {
+
+        // Validate the radius
+        if (radius < 0 || radius > BOX_BLUR_MAX_RADIUS) {
+                fprintf(stderr, "\nFatal error: box blur radius must be between 0 and %d.\n", BOX_BLUR_MAX_RADIUS);
+                return 0;
+        }
+
+        // Initialize useful values (the border channels are included in the normalization, same as create_box_blur_kernel)
+        int windowSize = 2*radius + 1;
+        float inverseArea = 1.0f / ((float) windowSize * (float) windowSize);
+
+        // Use the AVX2 row helpers when supported
+        int useAvx2 = (cpu_feature_level() >= CPU_FEATURE_LEVEL_AVX2);
+
+        // Use one strip of rows per thread so that the warm-up of the column sums (2*radius + 1 rows) is paid once per thread
+        int numStrips = omp_get_max_threads();
+        if (numStrips > imageHeight) numStrips = imageHeight;
+        int stripHeight = (imageHeight + numStrips - 1) / numStrips;
+
+        // Flag to indicate error in the parallel processing
+        int errorFlag = 0;
+
+        // Parallelize over strips of rows
+        #pragma omp parallel shared(errorFlag)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread, sized once per parallel region to store
+                // the column sums, one extended row, its prefix sums and its window sums (shared by all planes)
+                int extendedLength = imageWidth + 2*radius;
+                size_t alignedRowSize = memory_size_alignment(sizeof(uint32_t)*imageWidth);
+                size_t alignedExtendedRowSize = memory_size_alignment(extendedLength);
+                size_t alignedPrefixSize = memory_size_alignment(sizeof(uint32_t)*(extendedLength + 1));
+                struct MemoryPool *pool = acquire_thread_memory_pool(2*alignedRowSize + alignedExtendedRowSize + alignedPrefixSize);
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                #pragma omp for schedule(static)
+                for (int yy = 0; yy < imageHeight; yy += stripHeight) {
+
+                        // Start the strip with an empty arena
+                        if (pool == NULL) continue;
+                        empty_pool(pool);
+                        uint32_t *columnSums = (uint32_t*)allocate_from_pool(pool, sizeof(uint32_t)*imageWidth);
+                        uint32_t *rowSums = (uint32_t*)allocate_from_pool(pool, sizeof(uint32_t)*imageWidth);
+                        uint8_t *extendedRow = (uint8_t*)allocate_from_pool(pool, extendedLength);
+                        uint32_t *prefixSums = (uint32_t*)allocate_from_pool(pool, sizeof(uint32_t)*(extendedLength + 1));
+
+                        int stripEnd = (yy + stripHeight < imageHeight) ? yy + stripHeight : imageHeight;
+
+                        for (int plane = 0; plane < numPlanes; plane++) {
+
+                                uint8_t *inputChannels = inputPlanes[plane];
+                                uint8_t *outputChannels = outputPlanes[plane];
+
+                                // Warm up the column sums with the window of the first row in the strip (rows outside of the image are
+                                // sampled according to the border mode, zero-padded rows add nothing)
+                                memset(columnSums, 0, sizeof(uint32_t)*imageWidth);
+                                for (int y = yy - radius; y <= yy + radius; y++) {
+                                        int mappedRow = map_border_index(y, imageHeight, borderMode);
+                                        if (mappedRow < 0) continue;
+                                        compute_row_window_sums(&inputChannels[(size_t) mappedRow*imageWidth], imageWidth, radius, borderMode,
+                                                extendedRow, prefixSums, rowSums, useAvx2);
+                                        update_column_sums(columnSums, rowSums, imageWidth, 1, useAvx2);
+                                }
+
+                                // Slide the window down the strip
+                                for (int y = yy; y < stripEnd; y++) {
+
+                                        store_normalized_column_sums(columnSums, &outputChannels[(size_t) y*imageWidth], imageWidth, inverseArea,
+                                        useAvx2);
+                                        apply_point_op_epilogue_row(epilogue, &outputChannels[(size_t) y*imageWidth], imageWidth);
+
+                                        // Last row of the strip
+                                        if (y + 1 == stripEnd) break;
+
+                                        // Row entering the window of the next output row
+                                        int enteringRow = map_border_index(y + radius + 1, imageHeight, borderMode);
+                                        if (enteringRow >= 0) {
+                                                compute_row_window_sums(&inputChannels[(size_t) enteringRow*imageWidth], imageWidth, radius, borderMode,
+                                                        extendedRow, prefixSums, rowSums, useAvx2);
+                                                update_column_sums(columnSums, rowSums, imageWidth, 1, useAvx2);
+                                        }
+
+                                        // Row leaving the window of the next output row
+                                        int leavingRow = map_border_index(y - radius, imageHeight, borderMode);
+                                        if (leavingRow >= 0) {
+                                                compute_row_window_sums(&inputChannels[(size_t) leavingRow*imageWidth], imageWidth, radius, borderMode,
+                                                        extendedRow, prefixSums, rowSums, useAvx2);
+                                                update_column_sums(columnSums, rowSums, imageWidth, -1, useAvx2);
+                                        }
+                                }
+                        }
+                }
+        }
+
+        // Check if an error occurred during the parallel processing and return 0
+        if (errorFlag) return 0;
+
+        // Indicate that box blur executed successfully for all planes
+        return 1;
+
+}
+
+
+// Carries out the running sum box blur for given channelsArray of input image and stores result into output image
+int apply_box_blur_channel(uint8_t *inputChannels, uint8_t *outputChannels, int radius, int imageHeight, int imageWidth,
+        enum BorderMode borderMode) {
+
+        return apply_box_blur_planes(&inputChannels, &outputChannels, 1, radius, imageHeight, imageWidth, borderMode, NULL);
+
+}
+
+
+// Carries out the fused running sum box blur over the three (RGB) channels of a given image
+int apply_box_blur_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, int radius, enum BorderMode borderMode) {
+
+        uint8_t *inputPlanes[3] = {inputImage->redChannels, inputImage->greenChannels, inputImage->blueChannels};
+        uint8_t *outputPlanes[3] = {outputImage->redChannels, outputImage->greenChannels, outputImage->blueChannels};
+
+        return apply_box_blur_planes(inputPlanes, outputPlanes, 3, radius, inputImage->height, inputImage->width, borderMode, NULL);
+
+}
+
+
+// Recursive (IIR) gaussian blur coefficients of Young and van Vliet: w[n] = b*x[n] + a1*w[n-1] + a2*w[n-2] + a3*w[n-3]
+// for the causal pass, and the same recursion backwards over w[n] for the anti-causal pass. The boundary matrix maps the
+// causal results of the last three steps (minus the last input) to the anti-causal results of the last step and the two
+// steps past the end, for an input that keeps its last value past the end (Triggs and Sdika)
+typedef struct IirGaussianCoefficients {
+        double b;
+        double a1;
+        double a2;
+        double a3;
+        double boundary[3][3];
+} IirGaussianCoefficients;
+
+
+// Computes the recursion coefficients of a standard deviation. The recursions run in double precision: the gain of the
+// feedback grows like sigma^3, and float rounding of the results would add up to several levels for large sigma
+static struct IirGaussianCoefficients iir_gaussian_coefficients(float sigma) {
+
+        // Denominator m0 + m1*d + m2*d^2 + m3*d^3 of the recursion in the backward difference d = q*(1 - z^-1) (Young and
+        // van Vliet). Its coefficients b0 to b3 in z^-1 are expanded here: the published ones are rounded, and for large q
+        // their q^3 terms no longer cancel (a sigma of 256 came out as 185)
+        const double m0 = 1.57825, m1 = 2.44413, m2 = 1.4281, m3 = 0.422205;
+
+        // Scale parameter q of the recursion (fitted to the standard deviation)
+        double q = (sigma >= 2.5f) ? 0.98711*sigma - 0.96330 : 3.97156 - 4.14554*sqrt(1.0 - 0.26891*sigma);
+
+        double b0 = m0 + m1*q + m2*q*q + m3*q*q*q;
+        double b1 = m1*q + 2.0*m2*q*q + 3.0*m3*q*q*q;
+        double b2 = -(m2*q*q + 3.0*m3*q*q*q);
+        double b3 = m3*q*q*q;
+
+        // Normalize by b0, the gain of the recursion is 1 (b + a1 + a2 + a3 = 1)
+        struct IirGaussianCoefficients coefficients;
+        double a1 = coefficients.a1 = b1 / b0;
+        double a2 = coefficients.a2 = b2 / b0;
+        double a3 = coefficients.a3 = b3 / b0;
+        coefficients.b = 1.0 - (a1 + a2 + a3);
+
+        // Boundary matrix (Triggs and Sdika, scaled by b for the normalized recursion)
+        double scale = coefficients.b / ((1.0 + a1 - a2 + a3)*(1.0 - a1 - a2 - a3)*(1.0 + a2 + (a1 - a3)*a3));
+        coefficients.boundary[0][0] = scale*(1.0 - a2 - a1*a3 - a3*a3);
+        coefficients.boundary[0][1] = scale*(a1 + a3)*(a2 + a1*a3);
+        coefficients.boundary[0][2] = scale*a3*(a1 + a2*a3);
+        coefficients.boundary[1][0] = scale*(a1 + a2*a3);
+        coefficients.boundary[1][1] = -scale*(a2 - 1.0)*(a2 + a1*a3);
+        coefficients.boundary[1][2] = -scale*a3*(a1*a3 + a3*a3 + a2 - 1.0);
+        coefficients.boundary[2][0] = scale*(a1*a3 + a2 + a1*a1 - a2*a2);
+        coefficients.boundary[2][1] = scale*(a1*a2 + a2*a2*a3 - a1*a3*a3 - a3*a3*a3 - a2*a3 + a3);
+        coefficients.boundary[2][2] = scale*a3*(a1 + a2*a3);
+        return coefficients;
+
+}
+
+
+// Starts the anti-causal recursion of `count` independent channels at the end of the causal one: `last`, `last1` and
+// `last2` hold the causal results of the last three steps, `input` the inputs of the last step. The anti-causal results
+// of the last step replace the causal ones in `last`, those of the two steps past the end are stored into `next` and
+// `next2` (`next` may be `input`)
+static void iir_gaussian_boundary(double *last, const double *last1, const double *last2, const double *input, double *next,
+        double *next2, int count, const struct IirGaussianCoefficients *coefficients) {
+
+        const double (*boundary)[3] = coefficients->boundary;
+        for (int k = 0; k < count; k++) {
+                double value = input[k];
+                double d0 = last[k] - value;
+                double d1 = last1[k] - value;
+                double d2 = last2[k] - value;
+                last[k] = value + boundary[0][0]*d0 + boundary[0][1]*d1 + boundary[0][2]*d2;
+                next[k] = value + boundary[1][0]*d0 + boundary[1][1]*d1 + boundary[1][2]*d2;
+                next2[k] = value + boundary[2][0]*d0 + boundary[2][1]*d1 + boundary[2][2]*d2;
+        }
+
+}
+
+
+// Runs the causal and anti-causal recursions in place over `count` steps of IIR_GAUSSIAN_LANES independent lanes (rows of
+// the horizontal pass, transposed), followed by two spare steps. The causal recursion starts from the steady state of the
+// first input, the anti-causal one from the boundary of the last input
+static void iir_gaussian_lanes_scalar(double *lanes, int count, const struct IirGaussianCoefficients *coefficients) {
+
+        double w1[IIR_GAUSSIAN_LANES], w2[IIR_GAUSSIAN_LANES], w3[IIR_GAUSSIAN_LANES];
+        double *lastStep = &lanes[(count - 1)*IIR_GAUSSIAN_LANES];
+        double *spareSteps = &lanes[count*IIR_GAUSSIAN_LANES];
+
+        // Causal pass (the inputs of the last step are kept in the first spare step)
+        memcpy(spareSteps, lastStep, sizeof(double)*IIR_GAUSSIAN_LANES);
+        for (int lane = 0; lane < IIR_GAUSSIAN_LANES; lane++) {
+                w1[lane] = w2[lane] = w3[lane] = lanes[lane];
+        }
+        for (int i = 0; i < count; i++) {
+                double *step = &lanes[i*IIR_GAUSSIAN_LANES];
+                for (int lane = 0; lane < IIR_GAUSSIAN_LANES; lane++) {
+                        double w = coefficients->b*step[lane] + coefficients->a1*w1[lane] + coefficients->a2*w2[lane] +
+                                coefficients->a3*w3[lane];
+                        w3[lane] = w2[lane]; w2[lane] = w1[lane]; w1[lane] = w;
+                        step[lane] = w;
+                }
+        }
+
+        // Anti-causal pass
+        iir_gaussian_boundary(lastStep, lastStep - IIR_GAUSSIAN_LANES, lastStep - 2*IIR_GAUSSIAN_LANES, spareSteps, spareSteps,
+                spareSteps + IIR_GAUSSIAN_LANES, IIR_GAUSSIAN_LANES, coefficients);
+        for (int lane = 0; lane < IIR_GAUSSIAN_LANES; lane++) {
+                w1[lane] = lastStep[lane];
+                w2[lane] = spareSteps[lane];
+                w3[lane] = spareSteps[IIR_GAUSSIAN_LANES + lane];
+        }
+        for (int i = count - 2; i >= 0; i--) {
+                double *step = &lanes[i*IIR_GAUSSIAN_LANES];
+                for (int lane = 0; lane < IIR_GAUSSIAN_LANES; lane++) {
+                        double w = coefficients->b*step[lane] + coefficients->a1*w1[lane] + coefficients->a2*w2[lane] +
+                                coefficients->a3*w3[lane];
+                        w3[lane] = w2[lane]; w2[lane] = w1[lane]; w1[lane] = w;
+                        step[lane] = w;
+                }
+        }
+
+}
+
+
+// AVX2 version, the lanes of a step are four independent vectors (the recursion latency of one hides behind the others)
+CPU_TARGET_AVX2
+static void iir_gaussian_lanes_avx2(double *lanes, int count, const struct IirGaussianCoefficients *coefficients) {
+
+        __m256d b_pd = _mm256_set1_pd(coefficients->b);
+        __m256d a1_pd = _mm256_set1_pd(coefficients->a1);
+        __m256d a2_pd = _mm256_set1_pd(coefficients->a2);
+        __m256d a3_pd = _mm256_set1_pd(coefficients->a3);
+        __m256d w1_pd[4], w2_pd[4], w3_pd[4];
+        double *lastStep = &lanes[(count - 1)*IIR_GAUSSIAN_LANES];
+        double *spareSteps = &lanes[count*IIR_GAUSSIAN_LANES];
+
+        // Causal pass (the inputs of the last step are kept in the first spare step)
+        memcpy(spareSteps, lastStep, sizeof(double)*IIR_GAUSSIAN_LANES);
+        for (int v = 0; v < 4; v++) {
+                w1_pd[v] = w2_pd[v] = w3_pd[v] = _mm256_loadu_pd(&lanes[4*v]);
+        }
+        for (int i = 0; i < count; i++) {
+                double *step = &lanes[i*IIR_GAUSSIAN_LANES];
+                #pragma GCC unroll 4
+                for (int v = 0; v < 4; v++) {
+                        __m256d w_pd = _mm256_fmadd_pd(a3_pd, w3_pd[v], _mm256_mul_pd(b_pd, _mm256_loadu_pd(&step[4*v])));
+                        w_pd = _mm256_fmadd_pd(a2_pd, w2_pd[v], w_pd);
+                        w_pd = _mm256_fmadd_pd(a1_pd, w1_pd[v], w_pd);
+                        w3_pd[v] = w2_pd[v]; w2_pd[v] = w1_pd[v]; w1_pd[v] = w_pd;
+                        _mm256_storeu_pd(&step[4*v], w_pd);
+                }
+        }
+
+        // Anti-causal pass
+        iir_gaussian_boundary(lastStep, lastStep - IIR_GAUSSIAN_LANES, lastStep - 2*IIR_GAUSSIAN_LANES, spareSteps, spareSteps,
+                spareSteps + IIR_GAUSSIAN_LANES, IIR_GAUSSIAN_LANES, coefficients);
+        for (int v = 0; v < 4; v++) {
+                w1_pd[v] = _mm256_loadu_pd(&lastStep[4*v]);
+                w2_pd[v] = _mm256_loadu_pd(&spareSteps[4*v]);
+                w3_pd[v] = _mm256_loadu_pd(&spareSteps[IIR_GAUSSIAN_LANES + 4*v]);
+        }
+        for (int i = count - 2; i >= 0; i--) {
+                double *step = &lanes[i*IIR_GAUSSIAN_LANES];
+                #pragma GCC unroll 4
+                for (int v = 0; v < 4; v++) {
+                        __m256d w_pd = _mm256_fmadd_pd(a3_pd, w3_pd[v], _mm256_mul_pd(b_pd, _mm256_loadu_pd(&step[4*v])));
+                        w_pd = _mm256_fmadd_pd(a2_pd, w2_pd[v], w_pd);
+                        w_pd = _mm256_fmadd_pd(a1_pd, w1_pd[v], w_pd);
+                        w3_pd[v] = w2_pd[v]; w2_pd[v] = w1_pd[v]; w1_pd[v] = w_pd;
+                        _mm256_storeu_pd(&step[4*v], w_pd);
+                }
+        }
+
+}
+
+
+// One step of the recursions along the columns, over `count` channels of a row (in place): row = b*row + a1*w1 + a2*w2 +
+// a3*w3, where w1, w2 and w3 are the rows of the previous three steps
+typedef void (*IirGaussianRowFunction)(double *row, const double *w1, const double *w2, const double *w3, int count,
+        const struct IirGaussianCoefficients *coefficients);
+
+
+// Scalar version
+static void iir_gaussian_row_scalar(double *row, const double *w1, const double *w2, const double *w3, int count,
+        const struct IirGaussianCoefficients *coefficients) {
+
+        for (int x = 0; x < count; x++) {
+                row[x] = coefficients->b*row[x] + coefficients->a1*w1[x] + coefficients->a2*w2[x] + coefficients->a3*w3[x];
+        }
+
+}
+
+
+// AVX2 version, 4 channels at a time
+CPU_TARGET_AVX2
+static void iir_gaussian_row_avx2(double *row, const double *w1, const double *w2, const double *w3, int count,
+        const struct IirGaussianCoefficients *coefficients) {
+
+        __m256d b_pd = _mm256_set1_pd(coefficients->b);
+        __m256d a1_pd = _mm256_set1_pd(coefficients->a1);
+        __m256d a2_pd = _mm256_set1_pd(coefficients->a2);
+        __m256d a3_pd = _mm256_set1_pd(coefficients->a3);
+
+        int x = 0;
+        for (; x + 4 <= count; x += 4) {
+                __m256d w_pd = _mm256_mul_pd(b_pd, _mm256_loadu_pd(&row[x]));
+                w_pd = _mm256_fmadd_pd(a1_pd, _mm256_loadu_pd(&w1[x]), w_pd);
+                w_pd = _mm256_fmadd_pd(a2_pd, _mm256_loadu_pd(&w2[x]), w_pd);
+                w_pd = _mm256_fmadd_pd(a3_pd, _mm256_loadu_pd(&w3[x]), w_pd);
+                _mm256_storeu_pd(&row[x], w_pd);
+        }
+        for (; x < count; x++) {
+                row[x] = coefficients->b*row[x] + coefficients->a1*w1[x] + coefficients->a2*w2[x] + coefficients->a3*w3[x];
+        }
+
+}
+
+
+// Vertical pass over a chunk of `columns` columns starting at column x: the columns, extended by `padding` rows on both
+// sides according to the border mode, are converted into the extended plane and the recursions run down and back up the
+// rows in place (the two spare rows past the extended rows start the anti-causal pass). The rows of all columns advance
+// together, so every step is a contiguous row segment
+static void iir_gaussian_vertical_columns(uint8_t *inputChannels, double *extendedChannels, int x, int columns, int imageHeight,
+        int imageWidth, int padding, enum BorderMode borderMode, IirGaussianRowFunction recurseRow,
+        const struct IirGaussianCoefficients *coefficients) {
+
+        int count = imageHeight + 2*padding;
+        double *spareRow = &extendedChannels[(size_t) count*imageWidth + x];
+
+        // Causal pass down the extended columns (the steps before the first row are in its steady state, the inputs of
+        // the last row are kept in the first spare row)
+        for (int i = 0; i < count; i++) {
+
+                double *row = &extendedChannels[(size_t) i*imageWidth + x];
+                int y = map_border_index(i - padding, imageHeight, borderMode);
+                if (y < 0) {
+                        memset(row, 0, sizeof(double)*columns);
+                } else {
+                        uint8_t *inputRow = &inputChannels[(size_t) y*imageWidth + x];
+                        for (int c = 0; c < columns; c++) row[c] = (double) inputRow[c];
+                }
+                if (i == count - 1) memcpy(spareRow, row, sizeof(double)*columns);
+                if (i == 0) continue;
+
+                recurseRow(row, &extendedChannels[(size_t) (i - 1)*imageWidth + x],
+                        &extendedChannels[(size_t) ((i >= 2) ? i - 2 : 0)*imageWidth + x],
+                        &extendedChannels[(size_t) ((i >= 3) ? i - 3 : 0)*imageWidth + x], columns, coefficients);
+        }
+
+        // Anti-causal pass back up, from the boundary of the last row
+        iir_gaussian_boundary(&extendedChannels[(size_t) (count - 1)*imageWidth + x], &extendedChannels[(size_t) (count - 2)*imageWidth + x],
+                &extendedChannels[(size_t) (count - 3)*imageWidth + x], spareRow, spareRow, spareRow + imageWidth, columns,
+                coefficients);
+        for (int i = count - 2; i >= 0; i--) {
+                recurseRow(&extendedChannels[(size_t) i*imageWidth + x], &extendedChannels[(size_t) (i + 1)*imageWidth + x],
+                        &extendedChannels[(size_t) (i + 2)*imageWidth + x], &extendedChannels[(size_t) (i + 3)*imageWidth + x],
+                        columns, coefficients);
+        }
+
+}
+
+
+// Transposes a 4x4 block of doubles held in four AVX2 registers
+CPU_TARGET_AVX2
+CPU_ALWAYS_INLINE void transpose_4x4_pd(__m256d *block) {
+
+        __m256d t0 = _mm256_unpacklo_pd(block[0], block[1]);
+        __m256d t1 = _mm256_unpackhi_pd(block[0], block[1]);
+        __m256d t2 = _mm256_unpacklo_pd(block[2], block[3]);
+        __m256d t3 = _mm256_unpackhi_pd(block[2], block[3]);
+
+        block[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+        block[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+        block[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+        block[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+
+}
+
+
+// Transposes the channels [0, imageWidth) of IIR_GAUSSIAN_LANES rows into the lanes (rowStride apart, lanes start at the
+// first image column), 4x4 blocks at a time. Returns the number of columns transposed (multiple of 4)
+CPU_TARGET_AVX2
+static int transpose_rows_to_lanes_avx2(const double *rows, int rowStride, double *lanes, int imageWidth) {
+
+        int x = 0;
+        for (; x + 4 <= imageWidth; x += 4) {
+                for (int group = 0; group < IIR_GAUSSIAN_LANES; group += 4) {
+                        __m256d block[4];
+                        for (int j = 0; j < 4; j++) block[j] = _mm256_loadu_pd(&rows[(size_t) (group + j)*rowStride + x]);
+                        transpose_4x4_pd(block);
+                        for (int k = 0; k < 4; k++) _mm256_storeu_pd(&lanes[(x + k)*IIR_GAUSSIAN_LANES + group], block[k]);
+                }
+        }
+        return x;
+
+}
+
+
+// Transposes the lanes back into IIR_GAUSSIAN_LANES output rows (rowStride apart), rounded half away from zero and clamped
+// to [0, 255], two 4x4 blocks (8 columns) at a time. Returns the number of columns stored (multiple of 8)
+CPU_TARGET_AVX2
+static int store_lanes_to_rows_avx2(const double *lanes, uint8_t *outputRows, int rowStride, int imageWidth) {
+
+        __m256d zero_pd = _mm256_setzero_pd();
+        __m256d max_pd = _mm256_set1_pd(255.0);
+        __m256d half_pd = _mm256_set1_pd(0.5);
+
+        int x = 0;
+        for (; x + 8 <= imageWidth; x += 8) {
+                for (int group = 0; group < IIR_GAUSSIAN_LANES; group += 4) {
+                        __m256d left[4], right[4];
+                        for (int k = 0; k < 4; k++) {
+                                left[k] = _mm256_loadu_pd(&lanes[(x + k)*IIR_GAUSSIAN_LANES + group]);
+                                right[k] = _mm256_loadu_pd(&lanes[(x + 4 + k)*IIR_GAUSSIAN_LANES + group]);
+                        }
+                        transpose_4x4_pd(left);
+                        transpose_4x4_pd(right);
+                        for (int j = 0; j < 4; j++) {
+
+                                // Clamp, round and convert double -> int32 -> uint16 -> uint8 (8 channels)
+                                __m128i left_32i = _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_min_pd(_mm256_max_pd(left[j], zero_pd),
+                                        max_pd), half_pd));
+                                __m128i right_32i = _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_min_pd(_mm256_max_pd(right[j], zero_pd),
+                                        max_pd), half_pd));
+                                __m128i values_16u = _mm_packus_epi32(left_32i, right_32i);
+                                _mm_storel_epi64((__m128i*) &outputRows[(size_t) (group + j)*rowStride + x],
+                                        _mm_packus_epi16(values_16u, values_16u));
+                        }
+                }
+        }
+        return x;
+
+}
+
+
+// Horizontal pass over a group of (at most IIR_GAUSSIAN_LANES) rows starting at row y: the rows, extended by `padding`
+// columns on both sides according to the border mode, are transposed into the lanes of the recursion, and the results are
+// rounded and clamped into the output rows
+static void iir_gaussian_horizontal_rows(double *blurredColumns, uint8_t *outputChannels, int y, int imageHeight, int imageWidth,
+        int padding, enum BorderMode borderMode, double *lanes, int useAvx2, const struct IirGaussianCoefficients *coefficients,
+        const struct PointOpEpilogue *epilogue) {
+
+        int rows = (y + IIR_GAUSSIAN_LANES <= imageHeight) ? IIR_GAUSSIAN_LANES : imageHeight - y;
+        int count = imageWidth + 2*padding;
+        double *rowsStart = &blurredColumns[(size_t) y*imageWidth];
+        uint8_t *outputStart = &outputChannels[(size_t) y*imageWidth];
+        double *interiorLanes = &lanes[padding*IIR_GAUSSIAN_LANES];
+
+        // Transpose the interior of full groups with the AVX2 blocks
+        int vectorEnd = (useAvx2 && rows == IIR_GAUSSIAN_LANES) ? transpose_rows_to_lanes_avx2(rowsStart, imageWidth, interiorLanes,
+                imageWidth) : 0;
+
+        // Transpose the rest of the extended rows (only the border columns are remapped, unused lanes are zero)
+        for (int lane = 0; lane < IIR_GAUSSIAN_LANES; lane++) {
+                if (lane >= rows) {
+                        for (int i = 0; i < count; i++) lanes[i*IIR_GAUSSIAN_LANES + lane] = 0.0;
+                        continue;
+                }
+                double *row = &rowsStart[(size_t) lane*imageWidth];
+                for (int i = 0; i < padding; i++) {
+                        int left = map_border_index(i - padding, imageWidth, borderMode);
+                        int right = map_border_index(imageWidth + i, imageWidth, borderMode);
+                        lanes[i*IIR_GAUSSIAN_LANES + lane] = (left < 0) ? 0.0 : row[left];
+                        lanes[(padding + imageWidth + i)*IIR_GAUSSIAN_LANES + lane] = (right < 0) ? 0.0 : row[right];
+                }
+                for (int x = vectorEnd; x < imageWidth; x++) {
+                        interiorLanes[x*IIR_GAUSSIAN_LANES + lane] = row[x];
+                }
+        }
+
+        if (useAvx2) {
+                iir_gaussian_lanes_avx2(lanes, count, coefficients);
+        } else {
+                iir_gaussian_lanes_scalar(lanes, count, coefficients);
+        }
+
+        // Round half away from zero and clamp to [0, 255] (same as the convolution pipelines)
+        vectorEnd = (useAvx2 && rows == IIR_GAUSSIAN_LANES) ? store_lanes_to_rows_avx2(interiorLanes, outputStart, imageWidth,
+                imageWidth) : 0;
+        for (int lane = 0; lane < rows; lane++) {
+                uint8_t *outputRow = &outputStart[(size_t) lane*imageWidth];
+                for (int x = vectorEnd; x < imageWidth; x++) {
+                        double value = interiorLanes[x*IIR_GAUSSIAN_LANES + lane];
+                        outputRow[x] = (value <= 0.0) ? 0 : (value >= 255.0) ? 255 : (uint8_t) (value + 0.5);
+                }
+                apply_point_op_epilogue_row(epilogue, outputRow, imageWidth);
+        }
+
+}
+
+
+// Carries out the parallelized recursive gaussian blur for any number of channel planes of the input image in one
+// fork/join, and stores results into the output planes. For each plane the vertical pass runs over chunks of columns into
+// a double plane of the extended rows, then the horizontal pass over groups of rows. The recursions run over the image
+// extended by IIR_GAUSSIAN_PADDING_SIGMAS*sigma channels on each side (sampled according to the border mode), and start
+// from the boundaries of an input that keeps the value of the extension past it
+int apply_iir_gaussian_blur_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, float sigma, int imageHeight,
+        int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue) {
+
+        // Validate the standard deviation
+        if (!(sigma >= GAUSSIAN_BLUR_MIN_SIGMA && sigma <= GAUSSIAN_BLUR_MAX_SIGMA)) {
+                fprintf(stderr, "\nFatal error: gaussian blur sigma must be between %.1f and %.1f.\n", GAUSSIAN_BLUR_MIN_SIGMA,
+                        GAUSSIAN_BLUR_MAX_SIGMA);
+                return 0;
+        }
+
+        // Initialize useful values
+        struct IirGaussianCoefficients coefficients = iir_gaussian_coefficients(sigma);
+        int padding = iir_gaussian_padding(sigma);
+        int extendedHeight = imageHeight + 2*padding;
+
+        // Select the recursion functions for the processor's instruction set level
+        int useAvx2 = (cpu_feature_level() >= CPU_FEATURE_LEVEL_AVX2);
+        IirGaussianRowFunction recurseRow = useAvx2 ? iir_gaussian_row_avx2 : iir_gaussian_row_scalar;
+
+        // Split the columns into one chunk per thread (multiples of 16 channels, at least 64)
+        int chunkWidth = (imageWidth + omp_get_max_threads() - 1) / omp_get_max_threads();
+        chunkWidth = (chunkWidth < 64) ? 64 : (chunkWidth + 15) & ~15;
+
+        // Allocate the double plane of the extended rows and the two spare rows (reused by every plane)
+        double *extendedChannels = (double*)malloc(sizeof(double)*(extendedHeight + 2)*(size_t) imageWidth);
+        if (extendedChannels == NULL) {
+                fprintf(stderr, "\nFatal error: could not allocate memory for the gaussian blur.\n");
+                return 0;
+        }
+        double *blurredColumns = &extendedChannels[(size_t) padding*imageWidth];  // Rows of the image after the vertical pass
+
+        // Flag to indicate error in the parallel processing
+        int errorFlag = 0;
+
+        #pragma omp parallel shared(errorFlag)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread, sized once per parallel region to store
+                // the lanes of the extended rows and the two spare steps
+                size_t lanesSize = sizeof(double)*IIR_GAUSSIAN_LANES*(size_t) (imageWidth + 2*padding + 2);
+                struct MemoryPool *pool = acquire_thread_memory_pool(memory_size_alignment(lanesSize));
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                for (int plane = 0; plane < numPlanes; plane++) {
+
+                        // Vertical pass over chunks of columns (the implicit barrier completes the blurred columns)
+                        #pragma omp for schedule(static)
+                        for (int x = 0; x < imageWidth; x += chunkWidth) {
+                                int columns = (x + chunkWidth <= imageWidth) ? chunkWidth : imageWidth - x;
+                                iir_gaussian_vertical_columns(inputPlanes[plane], extendedChannels, x, columns, imageHeight, imageWidth,
+                                        padding, borderMode, recurseRow, &coefficients);
+                        }
+
+                        // Horizontal pass over groups of rows
+                        #pragma omp for schedule(static)
+                        for (int y = 0; y < imageHeight; y += IIR_GAUSSIAN_LANES) {
+                                if (pool == NULL) continue;
+                                empty_pool(pool);
+                                double *lanes = (double*)allocate_from_pool(pool, lanesSize);
+                                iir_gaussian_horizontal_rows(blurredColumns, outputPlanes[plane], y, imageHeight, imageWidth, padding,
+                                        borderMode, lanes, useAvx2, &coefficients, epilogue);
+                        }
+                }
+        }
+
+        free(extendedChannels);
+
+        // Check if an error occurred during the parallel processing and return 0
+        if (errorFlag) return 0;
+
+        // Indicate that the gaussian blur executed successfully for all planes
+        return 1;
+
+}
+
+
+// Carries out the recursive gaussian blur over the three (RGB) channels of a given image
+int apply_iir_gaussian_blur_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, float sigma, enum BorderMode borderMode) {
+
+        uint8_t *inputPlanes[3] = {inputImage->redChannels, inputImage->greenChannels, inputImage->blueChannels};
+        uint8_t *outputPlanes[3] = {outputImage->redChannels, outputImage->greenChannels, outputImage->blueChannels};
+
+        return apply_iir_gaussian_blur_planes(inputPlanes, outputPlanes, 3, sigma, inputImage->height, inputImage->width,
+                borderMode, NULL);
+
+}
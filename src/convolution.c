@@ -1,6 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>  // For memmove()
+#include <string.h>  // For memset() and memcpy()
 #include <math.h>  // For roundf()
 #include <stdint.h>  // For type uint8_t
 #include <immintrin.h>  // For AVX2 intrinsics
@@ -8,6 +8,10 @@
 #include "image.h"
 #include "pool.h"
 #include "convolution.h"
+#include "tuning.h"
+#include "fft.h"
+#include "planner.h"
+#include "cpu.h"
 
 
 
@@ -15,17 +19,6 @@ static const double CONST_PI = 3.141592653589793f;
 
 
 
-void print_window(struct Window *window) {
-        printf("\n");
-        for (int y = 0; y < window->size; y++) {
-		for (int x = 0; x < window->size; x++) {
-			printf(" %.2f ", window->entries[y*window->size + x]);
-		}
-		printf("\n");
-	}
-        printf("\n"); 
-}
-
 void print_kernel(struct Kernel *kernel) {
         printf("\n");
         for (int y = 0; y < kernel->size; y++) {
@@ -39,85 +32,39 @@ void print_kernel(struct Kernel *kernel) {
 
 
 
-struct Window *create_window(int y, int x, int windowSize, int imageHeight, int imageWidth, uint8_t *imageChannelArray, struct MemoryPool *pool) {
+struct Kernel *allocate_kernel(int size) {
 
-        // Create a Window struct (on heap) and initialize size field
-        struct Window *window = (struct Window*)allocate_from_pool(pool, sizeof(struct Window));
-        if (window == NULL) {
-                fprintf(stderr, "\nFatal error: could not allocate memory for Window structure.\n");
-		return NULL;
-        }
-        window->size = windowSize;
-
-        // Allocate memory for the entries array from the memory pool
-        window->entries = (float*)allocate_from_pool(pool, (windowSize*windowSize)*sizeof(float));
-        if (window->entries == NULL) {
-                free_from_pool(pool, (void*) window,  sizeof(struct Window));
-                fprintf(stderr, "\nFatal error: could not allocate memory for Window structure.\n");
+        // Create a Kernel struct and initialize size field
+        struct Kernel *kernel = (struct Kernel*)malloc(sizeof(struct Kernel));
+        if (kernel == NULL) {
+                fprintf(stderr, "\nFatal error: could not allocate memory for kernel structure.\n");
 		return NULL;
         }
+        kernel->size = size;
 
-        int halfWindowSize = windowSize / 2;  // Half the window size (used for offset calculations)
-        int windowIndex = 0;  // Current index in the window's entries array
-
-        // Loop over the defined window region of the image in row-major order
-        for (int windowY = y - halfWindowSize; windowY <= y + halfWindowSize; windowY++) {
-                for (int windowX = x - halfWindowSize; windowX <= x + halfWindowSize; windowX++) {
-
-                        if (windowY < 0 || windowY >= imageHeight || windowX < 0 || windowX >= imageWidth) {
-                                window->entries[windowIndex] = 0; // Apply zero-padding for out-of-bounds indices
-                        } 
-                        else {
-                                // Determine the index of the Image's channelArray and capture into the Window's entries array
-                                int imageChannelIndex = (windowY * imageWidth) + windowX;
-                                window->entries[windowIndex] = imageChannelArray[imageChannelIndex];
-                        }
-
-                        windowIndex++;  // Move to the next element in the window's entries array 
+        // Allocate memory for the entries array
+        #ifdef _WIN32
+                // For Windows and MinGW, use _aligned_malloc
+                kernel->entries = (float*)_aligned_malloc((size*size)*sizeof(float), MEMORY_ALIGNMENT);
+                if (kernel->entries == NULL) {
+                        free(kernel);
+                        fprintf(stderr, "\nFatal error: could not allocate memory for kernel structure.\n");
+                        return NULL;
                 }
-        }
-
-        return window;
-
-}
-
-
-void shift_window_right(int y, int x, struct Window *window, int imageHeight, int imageWidth, uint8_t *inputChannelArray) {
-
-        // Initialize useful values
-        int windowSize = window->size;
-        int halfWindowSize = windowSize / 2;
-        int xRightmost = (x + halfWindowSize) + 1;  // The rightmost column of the shifted window 
-
-        // Shift all columns of the window one step to the left to reuse data locally
-        // Loop over each row of the window and use memmove (highly optimized compared to brute force loop)
-        for (int windowRow = 0; windowRow < windowSize; windowRow++) {
-                memmove(&window->entries[windowRow*windowSize],  // Destination (first column)
-                        &window->entries[windowRow*windowSize + 1],  // Source (second column)
-                        (windowSize-1)*sizeof(*window->entries));  // Size, in bytes, of data to move
-        }
-
-        // Initialize index for inserting data into the rightmost column of the window
-        int colInsertIndex = windowSize - 1;
-
-        // Loop to insert data into the new rightmost column data (or zero-padding if out of bounds)
-        for (int row = y - halfWindowSize; row <= y + halfWindowSize; row++) {
-                
-                if (row < 0 || row >= imageHeight || xRightmost < 0 || xRightmost >= imageWidth) {
-                        window->entries[colInsertIndex] = 0;  // Zero-padding for out-of-bounds pixels
-                } else {  
-                        // Determine the index of the Image's channelArray and capture into the Window's entries array
-                        int imageIndex = (row * imageWidth) + xRightmost;
-                        window->entries[colInsertIndex] = (float) inputChannelArray[imageIndex];
+        #else
+                // For POSIX systems (Linux, macOS), use posix_memalign
+                if (posix_memalign((void**)&kernel->entries, MEMORY_ALIGNMENT, (size*size)*sizeof(float)) != 0) {
+                        free(kernel);
+                        fprintf(stderr, "\nFatal error: could not allocate memory for kernel structure.\n");
+                        return NULL;
                 }
+        #endif
 
-                colInsertIndex += windowSize;  // Move to the next row's rightmost column
-        }
+        return kernel;
 
 }
 
 
-
 struct Kernel *create_gaussian_kernel(enum GeneralFilterIntensity filterIntensity) {
 
         // Create a Kernel struct
@@ -447,6 +394,84 @@ struct Kernel *create_sobel_vertical_kernel(enum GeneralFilterIntensity filterIn
 }
 
 
+// Radius of the bokeh kernels for each intensity (kernel size 2*radius + 1)
+static int bokeh_radius(enum GeneralFilterIntensity filterIntensity) {
+
+        switch (filterIntensity) {
+                case FILTER_INTENSITY_LIGHT:    return 8;
+                case FILTER_INTENSITY_MEDIUM:   return 16;
+                case FILTER_INTENSITY_HIGH:     return 32;
+                default:                        return 16;
+        }
+
+}
+
+
+// Tests whether a point (relative to the kernel center, in units of the radius) lies within the aperture of a bokeh
+// kernel: a disc of radius 1, or a regular hexagon of circumradius 1 with flat top and bottom sides
+static int inside_bokeh_aperture(float x, float y, int hexagonal) {
+
+        if (!hexagonal) return x*x + y*y <= 1.0f;
+
+        float absX = fabsf(x);
+        float absY = fabsf(y);
+        return absY <= 0.8660254f && 1.7320508f*absX + absY <= 1.7320508f;
+
+}
+
+
+// Creates a normalized bokeh kernel from the coverage of each entry by the aperture (8x8 samples per entry, so the
+// aperture edges are antialiased)
+static struct Kernel *create_bokeh_kernel(enum GeneralFilterIntensity filterIntensity, int hexagonal) {
+
+        int radius = bokeh_radius(filterIntensity);
+        struct Kernel *kernel = allocate_kernel(2*radius + 1);
+        if (kernel == NULL) return NULL;
+
+        float sumEntries = 0;  // For kernel normalization
+
+        for (int j = 0; j < kernel->size; j++) {
+                for (int i = 0; i < kernel->size; i++) {
+
+                        // Count the samples of the entry within the aperture
+                        int coveredSamples = 0;
+                        for (int sy = 0; sy < 8; sy++) {
+                                for (int sx = 0; sx < 8; sx++) {
+                                        float x = (i - radius + (sx + 0.5f)/8 - 0.5f) / (radius + 0.5f);
+                                        float y = (j - radius + (sy + 0.5f)/8 - 0.5f) / (radius + 0.5f);
+                                        coveredSamples += inside_bokeh_aperture(x, y, hexagonal);
+                                }
+                        }
+
+                        kernel->entries[j*kernel->size + i] = coveredSamples / 64.0f;
+                        sumEntries += coveredSamples / 64.0f;
+                }
+        }
+
+        // Normalize the kernel
+        for (int i = 0; i < kernel->size*kernel->size; i++) {
+                kernel->entries[i] /= sumEntries;
+        }
+
+        return kernel;
+
+}
+
+
+struct Kernel *create_disc_bokeh_kernel(enum GeneralFilterIntensity filterIntensity) {
+
+        return create_bokeh_kernel(filterIntensity, 0);
+
+}
+
+
+struct Kernel *create_hexagonal_bokeh_kernel(enum GeneralFilterIntensity filterIntensity) {
+
+        return create_bokeh_kernel(filterIntensity, 1);
+
+}
+
+
 // Frees kernel struct properly (for specific memory alignment functions)
 void free_kernel(struct Kernel *kernel) {
         
@@ -462,9 +487,131 @@ void free_kernel(struct Kernel *kernel) {
 
 
 
+// Allocates a SeparableKernel struct with aligned memory for both of its 1D entries arrays (one contiguous block)
+struct SeparableKernel *allocate_separable_kernel(int size) {
+
+        // Create a SeparableKernel struct and initialize size field
+        struct SeparableKernel *kernel = (struct SeparableKernel*)malloc(sizeof(struct SeparableKernel));
+        if (kernel == NULL) {
+                fprintf(stderr, "\nFatal error: could not allocate memory for kernel structure.\n");
+		return NULL;
+        }
+        kernel->size = size;
+
+        // Pad each 1D entries array to a multiple of 8 floats so both arrays stay aligned for AVX2 loads
+        int paddedSize = (size + 7) & ~7;
+
+        // Allocate memory for both entries arrays
+        #ifdef _WIN32
+                // For Windows and MinGW, use _aligned_malloc
+                kernel->horizontalEntries = (float*)_aligned_malloc((2*paddedSize)*sizeof(float), MEMORY_ALIGNMENT);
+                if (kernel->horizontalEntries == NULL) {
+                        free(kernel);
+                        fprintf(stderr, "\nFatal error: could not allocate memory for kernel structure.\n");
+                        return NULL;
+                }
+        #else
+                // For POSIX systems (Linux, macOS), use posix_memalign
+                if (posix_memalign((void**)&kernel->horizontalEntries, MEMORY_ALIGNMENT, (2*paddedSize)*sizeof(float)) != 0) {
+                        free(kernel);
+                        fprintf(stderr, "\nFatal error: could not allocate memory for kernel structure.\n");
+                        return NULL;
+                }
+        #endif
+        kernel->verticalEntries = kernel->horizontalEntries + paddedSize;
+
+        return kernel;
+
+}
+
+
+struct SeparableKernel *create_gaussian_separable_kernel(enum GeneralFilterIntensity filterIntensity) {
+
+        // Determine desired kernel size and standard deviation value (same as create_gaussian_kernel)
+        int size;
+        float stddev;
+        switch (filterIntensity) {
+                case FILTER_INTENSITY_LIGHT:    size = 5;  stddev = 1; break;
+                case FILTER_INTENSITY_MEDIUM:   size = 13; stddev = 2; break;
+                case FILTER_INTENSITY_HIGH:     size = 19; stddev = 3; break;
+                default:
+                        fprintf(stderr, "\nFatal error: invalid gaussian blur intensity.\n\n");
+                        return NULL;
+        }
+
+        // Create a SeparableKernel struct
+        struct SeparableKernel *kernel = allocate_separable_kernel(size);
+        if (kernel == NULL) return NULL;
+
+        int halfWindowSize = size / 2;  // Half the kernel size (used for offset calculations)
+        float sumEntries = 0.0;  // For kernel normalization
+
+        // Apply the 1D gaussian function to each entry. The 2D gaussian is the outer product of this
+        // function with itself, so the constant factor cancels out in the normalization
+        for (int i = -halfWindowSize; i <= halfWindowSize; i++) {
+                float result = exp(-((i*i)/(2.0*stddev*stddev)));
+                kernel->horizontalEntries[i+halfWindowSize] = result;
+                sumEntries += result;
+        }
+
+        // Normalize the kernel and copy the entries into the vertical kernel
+        for (int i = 0; i < size; i++) {
+                kernel->horizontalEntries[i] /= sumEntries;
+                kernel->verticalEntries[i] = kernel->horizontalEntries[i];
+        }
+
+        return kernel;
+
+}
+
+
+struct SeparableKernel *create_box_blur_separable_kernel(enum GeneralFilterIntensity filterIntensity) {
+
+        // Determine desired kernel size (same as create_box_blur_kernel)
+        int size;
+        switch (filterIntensity) {
+                case FILTER_INTENSITY_LIGHT:    size = 5;  break;
+                case FILTER_INTENSITY_MEDIUM:   size = 9;  break;
+                case FILTER_INTENSITY_HIGH:     size = 13; break;
+                default:
+                        fprintf(stderr, "\nFatal error: invalid box blur intensity.\n\n");
+                        return NULL;
+        }
+
+        // Create a SeparableKernel struct
+        struct SeparableKernel *kernel = allocate_separable_kernel(size);
+        if (kernel == NULL) return NULL;
+
+        // Set each entry to the normalized value 1/size (the 2D kernel entries are then 1/size^2)
+        for (int i = 0; i < size; i++) {
+                kernel->horizontalEntries[i] = 1.0f / size;
+                kernel->verticalEntries[i] = 1.0f / size;
+        }
+
+        return kernel;
+
+}
+
+
+// Frees separable kernel struct properly (both entries arrays live in a single aligned block)
+void free_separable_kernel(struct SeparableKernel *kernel) {
+
+#ifdef _WIN32
+        // For Windows and MinGW, use _aligned_free
+        _aligned_free(kernel->horizontalEntries);
+#else
+        // For POSIX systems, use free
+        free(kernel->horizontalEntries);
+#endif
+        free(kernel);
+}
+
+
+
 
 // Use AVX2 vectorization (SIMD intrinsics) to boost convolution algorithm on kernel and window
-uint8_t compute_convolution(float *kernelEntriesArray, float *windowEntriesArray, int arrayLength) {
+CPU_TARGET_AVX2
+static uint8_t compute_convolution_avx2(float *kernelEntriesArray, float *windowEntriesArray, int arrayLength) {
 
         // Set an AVX2 register (of type single precision floating point) to 0
         __m256 temp_ps = _mm256_setzero_ps();
@@ -510,100 +657,771 @@ uint8_t compute_convolution(float *kernelEntriesArray, float *windowEntriesArray
 }
 
 
-// Carries out the parallized convolution pipeline for given channelsArray of input image and stores result into output image
-int apply_convolution_pipeline_channel(uint8_t *inputChannels, uint8_t *outputChannels, struct Kernel *kernel, int imageHeight, 
-        int imageWidth) {
+uint8_t compute_convolution(float *kernelEntriesArray, float *windowEntriesArray, int arrayLength) {
+
+        // Use the AVX2 version when supported
+        if (cpu_feature_level() >= CPU_FEATURE_LEVEL_AVX2) {
+                return compute_convolution_avx2(kernelEntriesArray, windowEntriesArray, arrayLength);
+        }
+
+        // Multiply and sum the kernel and window entries
+        float convolutionResult = 0.0f;
+        for (int i = 0; i < arrayLength; i++) {
+                convolutionResult += (kernelEntriesArray[i] * windowEntriesArray[i]);
+        }
+
+        // Return the clamped and rounded convolution result
+        if (convolutionResult <= 0) {
+                return 0;
+        } else if (convolutionResult >= 255) {
+                return 255;
+        } else { 
+                return (uint8_t) roundf(convolutionResult);
+        }
+
+}
+
+
+int map_border_index(int index, int length, enum BorderMode borderMode) {
+
+        // Indices inside of [0, length) are not remapped
+        if (index >= 0 && index < length) return index;
+
+        switch (borderMode) {
+                case BORDER_MODE_REPLICATE:
+                        return (index < 0) ? 0 : length - 1;
+                case BORDER_MODE_REFLECT: {
+                        // Mirror about the edge channels (period of 2*(length-1)), also for indices more than a length away
+                        if (length == 1) return 0;
+                        int period = 2*(length - 1);
+                        int mirrored = ((index % period) + period) % period;
+                        return (mirrored < length) ? mirrored : period - mirrored;
+                }
+                case BORDER_MODE_WRAP:
+                        return ((index % length) + length) % length;
+                default:
+                        return -1;  // Zero-padding
+        }
+
+}
+
+
+void fill_padded_row(uint8_t *inputRow, int imageWidth, int xStart, int count, enum BorderMode borderMode, uint8_t *paddedRow) {
+
+        // Determine the in-bounds span of the requested columns (relative to the padded row)
+        int spanStart = (xStart < 0) ? -xStart : 0;
+        int spanEnd = (xStart + count > imageWidth) ? imageWidth - xStart : count;
+        if (spanStart > count) spanStart = count;
+        if (spanEnd < spanStart) spanEnd = spanStart;
+
+        // Interior: copy the in-bounds span as is
+        memcpy(&paddedRow[spanStart], &inputRow[xStart + spanStart], spanEnd - spanStart);
+
+        // Border: sample the out-of-bounds columns on both sides of the span according to the border mode
+        for (int i = 0; i < spanStart; i++) {
+                int x = map_border_index(xStart + i, imageWidth, borderMode);
+                paddedRow[i] = (x < 0) ? 0 : inputRow[x];
+        }
+        for (int i = spanEnd; i < count; i++) {
+                int x = map_border_index(xStart + i, imageWidth, borderMode);
+                paddedRow[i] = (x < 0) ? 0 : inputRow[x];
+        }
+
+}
+
+
+// Converts the `count` channels of an image row starting at column `xStart` (may be negative) into floats
+// Columns outside of the image are sampled according to the border mode
+static void convert_row_to_padded_floats(uint8_t *inputRow, int imageWidth, int xStart, int count, enum BorderMode borderMode,
+        float *paddedRow) {
+
+        // Determine the in-bounds span of the requested columns (relative to the padded row)
+        int spanStart = (xStart < 0) ? -xStart : 0;
+        int spanEnd = (xStart + count > imageWidth) ? imageWidth - xStart : count;
+        if (spanStart > count) spanStart = count;
+        if (spanEnd < spanStart) spanEnd = spanStart;
+
+        // Border: sample the out-of-bounds columns on both sides of the span according to the border mode
+        for (int i = 0; i < spanStart; i++) {
+                int x = map_border_index(xStart + i, imageWidth, borderMode);
+                paddedRow[i] = (x < 0) ? 0.0f : (float) inputRow[x];
+        }
+        for (int i = spanEnd; i < count; i++) {
+                int x = map_border_index(xStart + i, imageWidth, borderMode);
+                paddedRow[i] = (x < 0) ? 0.0f : (float) inputRow[x];
+        }
+
+        // Convert the in-bounds span (a plain loop, vectorized by the compiler for the baseline instruction set)
+        for (int i = spanStart; i < spanEnd; i++) {
+                paddedRow[i] = (float) inputRow[xStart + i];
+        }
+
+}
+
+
+// Rounds and clamps a float to uint8 (same behaviour as compute_convolution)
+static inline uint8_t clamp_float(float value) {
+
+        // Clamp to [0, 255] and round half away from zero (values are non-negative after clamping)
+        if (value <= 0.0f) return 0;
+        if (value >= 255.0f) return 255;
+        return (uint8_t) (value + 0.5f);
+
+}
+
+
+// Rounds and clamps 8 floats (two SSE registers) to uint8 and stores `count` (<= 8) of them
+CPU_TARGET_SSE41
+static void store_clamped_floats_sse41(__m128 lower_ps, __m128 upper_ps, uint8_t *outputArray, int count) {
+
+        // Clamp to [0, 255] and round half away from zero (values are non-negative after clamping)
+        __m128 zero_ps = _mm_setzero_ps(), max_ps = _mm_set1_ps(255.0f), half_ps = _mm_set1_ps(0.5f);
+        lower_ps = _mm_floor_ps(_mm_add_ps(_mm_min_ps(_mm_max_ps(lower_ps, zero_ps), max_ps), half_ps));
+        upper_ps = _mm_floor_ps(_mm_add_ps(_mm_min_ps(_mm_max_ps(upper_ps, zero_ps), max_ps), half_ps));
+
+        // Convert float -> int32 -> uint16 -> uint8
+        __m128i values_16u = _mm_packus_epi32(_mm_cvttps_epi32(lower_ps), _mm_cvttps_epi32(upper_ps));
+        __m128i values_8u = _mm_packus_epi16(values_16u, values_16u);
+
+        // Store all 8 values at once, or only the first `count` values at the end of a row
+        if (count == 8) {
+                _mm_storel_epi64((__m128i*) outputArray, values_8u);
+        } else {
+                uint8_t tempArray[16];
+                _mm_storeu_si128((__m128i*) tempArray, values_8u);
+                memcpy(outputArray, tempArray, count);
+        }
+
+}
+
+
+// Rounds and clamps 8 floats to uint8 (same behaviour as compute_convolution) and stores `count` (<= 8) of them
+CPU_TARGET_AVX2
+static void store_clamped_floats(__m256 values_ps, uint8_t *outputArray, int count) {
+
+        // Clamp to [0, 255] and round half away from zero (values are non-negative after clamping)
+        values_ps = _mm256_min_ps(_mm256_max_ps(values_ps, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+        values_ps = _mm256_floor_ps(_mm256_add_ps(values_ps, _mm256_set1_ps(0.5f)));
+
+        // Convert float -> int32 -> uint16 -> uint8
+        __m256i values_32i = _mm256_cvttps_epi32(values_ps);
+        __m128i values_16u = _mm_packus_epi32(_mm256_castsi256_si128(values_32i), _mm256_extracti128_si256(values_32i, 1));
+        __m128i values_8u = _mm_packus_epi16(values_16u, values_16u);
+
+        // Store all 8 values at once, or only the first `count` values at the end of a row
+        if (count == 8) {
+                _mm_storel_epi64((__m128i*) outputArray, values_8u);
+        } else {
+                uint8_t tempArray[16];
+                _mm_storeu_si128((__m128i*) tempArray, values_8u);
+                memcpy(outputArray, tempArray, count);
+        }
+
+}
+
+
+// Converts input row `y` (starting at column `xStart`) into a ring slot of `stride` floats. Rows outside of the image
+// are sampled according to the border mode
+static void convert_ring_row(uint8_t *inputChannels, int imageHeight, int imageWidth, int y, int xStart, int stride,
+        enum BorderMode borderMode, float *ringRow) {
+
+        int mappedY = map_border_index(y, imageHeight, borderMode);
+        if (mappedY < 0) {
+                memset(ringRow, 0, sizeof(float)*stride);
+        } else {
+                convert_row_to_padded_floats(&inputChannels[(size_t) mappedY*imageWidth], imageWidth, xStart, stride, borderMode, ringRow);
+        }
+
+}
+
+
+// Computes `count` (at most 32) neighbouring output channels of a row. Vectorizes across the output channels: each kernel
+// entry is broadcast and fused-multiply added against the shifted input rows, so no horizontal reduction is needed.
+// The rows hold at least 31 readable channels past the last kernel column
+typedef void (*ConvolutionRowFunction)(float **rows, float *kernelEntriesArray, int kernelSize, uint8_t *outputRow, int count);
+
+
+// Scalar version (separate multiply and add, results may differ by one from the FMA versions on rounding ties)
+static void compute_convolution_row_scalar(float **rows, float *kernelEntriesArray, int kernelSize, uint8_t *outputRow, int count) {
+
+        for (int x = 0; x < count; x++) {
+
+                // Same summation order as the vector versions (kernel entries in row-major order)
+                float sum = 0.0f;
+                for (int j = 0; j < kernelSize; j++) {
+                        for (int i = 0; i < kernelSize; i++) {
+                                sum += kernelEntriesArray[j*kernelSize + i] * rows[j][x + i];
+                        }
+                }
+                outputRow[x] = clamp_float(sum);
+        }
+
+}
+
+
+// SSE4.1 version: two groups of four SSE registers (4 output channels each), separate multiply and add
+CPU_TARGET_SSE41
+static void compute_convolution_row_sse41(float **rows, float *kernelEntriesArray, int kernelSize, uint8_t *outputRow, int count) {
+
+        for (int x = 0; x < count; x += 16) {
+
+                __m128 sumOne_ps = _mm_setzero_ps();
+                __m128 sumTwo_ps = _mm_setzero_ps();
+                __m128 sumThree_ps = _mm_setzero_ps();
+                __m128 sumFour_ps = _mm_setzero_ps();
+
+                // Loop over the kernel entries in row-major order
+                for (int j = 0; j < kernelSize; j++) {
+
+                        float *row = rows[j] + x;
+
+                        for (int i = 0; i < kernelSize; i++) {
+                                __m128 entry_ps = _mm_set1_ps(kernelEntriesArray[j*kernelSize + i]);
+                                sumOne_ps = _mm_add_ps(sumOne_ps, _mm_mul_ps(entry_ps, _mm_loadu_ps(&row[i])));
+                                sumTwo_ps = _mm_add_ps(sumTwo_ps, _mm_mul_ps(entry_ps, _mm_loadu_ps(&row[i + 4])));
+                                sumThree_ps = _mm_add_ps(sumThree_ps, _mm_mul_ps(entry_ps, _mm_loadu_ps(&row[i + 8])));
+                                sumFour_ps = _mm_add_ps(sumFour_ps, _mm_mul_ps(entry_ps, _mm_loadu_ps(&row[i + 12])));
+                        }
+                }
+
+                // Store the rounded and clamped results (only the first `count` channels)
+                int remaining = count - x;
+                store_clamped_floats_sse41(sumOne_ps, sumTwo_ps, &outputRow[x], (remaining < 8) ? remaining : 8);
+                if (remaining > 8) store_clamped_floats_sse41(sumThree_ps, sumFour_ps, &outputRow[x + 8], (remaining < 16) ? remaining - 8 : 8);
+        }
+
+}
+
+
+// AVX2 version: four AVX2 registers of 8 output channels each (independent accumulators also hide the FMA latency)
+CPU_TARGET_AVX2
+CPU_ALWAYS_INLINE void compute_convolution_row_avx2_body(float **rows, float *kernelEntriesArray, int kernelSize, uint8_t *outputRow,
+        int count) {
+
+        __m256 sumOne_ps = _mm256_setzero_ps();
+        __m256 sumTwo_ps = _mm256_setzero_ps();
+        __m256 sumThree_ps = _mm256_setzero_ps();
+        __m256 sumFour_ps = _mm256_setzero_ps();
+
+        // Loop over the kernel entries in row-major order
+        for (int j = 0; j < kernelSize; j++) {
+
+                float *row = rows[j];
+
+                #pragma GCC unroll 19
+                for (int i = 0; i < kernelSize; i++) {
+
+                        // Broadcast the kernel entry and multiply it with the input row shifted by the entry's column
+                        __m256 entry_ps = _mm256_set1_ps(kernelEntriesArray[j*kernelSize + i]);
+                        sumOne_ps = _mm256_fmadd_ps(entry_ps, _mm256_loadu_ps(&row[i]), sumOne_ps);
+                        sumTwo_ps = _mm256_fmadd_ps(entry_ps, _mm256_loadu_ps(&row[i + 8]), sumTwo_ps);
+                        sumThree_ps = _mm256_fmadd_ps(entry_ps, _mm256_loadu_ps(&row[i + 16]), sumThree_ps);
+                        sumFour_ps = _mm256_fmadd_ps(entry_ps, _mm256_loadu_ps(&row[i + 24]), sumFour_ps);
+
+                }
+        }
+
+        // Store the rounded and clamped results (only the first `count` channels)
+        store_clamped_floats(sumOne_ps, &outputRow[0], (count < 8) ? count : 8);
+        if (count > 8)  store_clamped_floats(sumTwo_ps, &outputRow[8], (count < 16) ? count - 8 : 8);
+        if (count > 16) store_clamped_floats(sumThree_ps, &outputRow[16], (count < 24) ? count - 16 : 8);
+        if (count > 24) store_clamped_floats(sumFour_ps, &outputRow[24], (count < 32) ? count - 24 : 8);
+
+}
+
+
+// Rounds and clamps 16 floats to uint8 and stores the first `count` (<= 16) of them with a masked store
+CPU_TARGET_AVX512
+static void store_clamped_floats_avx512(__m512 values_ps, uint8_t *outputArray, int count) {
+
+        values_ps = _mm512_min_ps(_mm512_max_ps(values_ps, _mm512_setzero_ps()), _mm512_set1_ps(255.0f));
+        values_ps = _mm512_roundscale_ps(_mm512_add_ps(values_ps, _mm512_set1_ps(0.5f)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        __mmask16 storeMask = (__mmask16) ((1u << count) - 1);
+        _mm512_mask_cvtusepi32_storeu_epi8(outputArray, storeMask, _mm512_cvttps_epi32(values_ps));
+
+}
+
+
+// AVX-512 version: two AVX-512 registers of 16 output channels each (same FMA order as the AVX2 version)
+CPU_TARGET_AVX512
+CPU_ALWAYS_INLINE void compute_convolution_row_avx512_body(float **rows, float *kernelEntriesArray, int kernelSize, uint8_t *outputRow,
+        int count) {
+
+        __m512 sumLower_ps = _mm512_setzero_ps();
+        __m512 sumUpper_ps = _mm512_setzero_ps();
+
+        // Loop over the kernel entries in row-major order
+        for (int j = 0; j < kernelSize; j++) {
+
+                float *row = rows[j];
+
+                #pragma GCC unroll 19
+                for (int i = 0; i < kernelSize; i++) {
+                        __m512 entry_ps = _mm512_set1_ps(kernelEntriesArray[j*kernelSize + i]);
+                        sumLower_ps = _mm512_fmadd_ps(entry_ps, _mm512_loadu_ps(&row[i]), sumLower_ps);
+                        sumUpper_ps = _mm512_fmadd_ps(entry_ps, _mm512_loadu_ps(&row[i + 16]), sumUpper_ps);
+                }
+        }
+
+        // Store the rounded and clamped results (only the first `count` channels)
+        store_clamped_floats_avx512(sumLower_ps, &outputRow[0], (count < 16) ? count : 16);
+        if (count > 16) store_clamped_floats_avx512(sumUpper_ps, &outputRow[16], count - 16);
+
+}
+
+
+// Instantiates the AVX2 and AVX-512 row functions for a kernel size (a constant for the specialized versions, the
+// `kernelSize` argument for the generic ones)
+#define DEFINE_CONVOLUTION_ROW_FUNCTIONS(SUFFIX, SIZE) \
+        CPU_TARGET_AVX2 \
+        static void compute_convolution_row_avx2_##SUFFIX(float **rows, float *kernelEntriesArray, int kernelSize, \
+                uint8_t *outputRow, int count) { \
+                (void) kernelSize; \
+                compute_convolution_row_avx2_body(rows, kernelEntriesArray, SIZE, outputRow, count); \
+        } \
+        CPU_TARGET_AVX512 \
+        static void compute_convolution_row_avx512_##SUFFIX(float **rows, float *kernelEntriesArray, int kernelSize, \
+                uint8_t *outputRow, int count) { \
+                (void) kernelSize; \
+                compute_convolution_row_avx512_body(rows, kernelEntriesArray, SIZE, outputRow, count); \
+        }
+#define DEFINE_SPECIALIZED_CONVOLUTION_ROW_FUNCTIONS(SIZE) DEFINE_CONVOLUTION_ROW_FUNCTIONS(SIZE, SIZE)
+
+DEFINE_CONVOLUTION_ROW_FUNCTIONS(generic, kernelSize)
+FOR_EACH_SPECIALIZED_KERNEL_SIZE(DEFINE_SPECIALIZED_CONVOLUTION_ROW_FUNCTIONS)
+
+
+// Selects the widest version of compute_convolution_row supported by the processor, specialized for the kernel size
+// when possible
+static ConvolutionRowFunction select_convolution_row_function(int kernelSize) {
+
+        #define CONVOLUTION_ROW_CASE_AVX512(SIZE) case SIZE: return compute_convolution_row_avx512_##SIZE;
+        #define CONVOLUTION_ROW_CASE_AVX2(SIZE) case SIZE: return compute_convolution_row_avx2_##SIZE;
+
+        switch (cpu_feature_level()) {
+                case CPU_FEATURE_LEVEL_AVX512:
+                        switch (kernelSize) {
+                                FOR_EACH_SPECIALIZED_KERNEL_SIZE(CONVOLUTION_ROW_CASE_AVX512)
+                                default: return compute_convolution_row_avx512_generic;
+                        }
+                case CPU_FEATURE_LEVEL_AVX2:
+                        switch (kernelSize) {
+                                FOR_EACH_SPECIALIZED_KERNEL_SIZE(CONVOLUTION_ROW_CASE_AVX2)
+                                default: return compute_convolution_row_avx2_generic;
+                        }
+                case CPU_FEATURE_LEVEL_SSE41:   return compute_convolution_row_sse41;
+                default:                        return compute_convolution_row_scalar;
+        }
+
+        #undef CONVOLUTION_ROW_CASE_AVX512
+        #undef CONVOLUTION_ROW_CASE_AVX2
+
+}
+
+
+// Horizontal pass of the separable pipeline: convolves `count` channels of a padded input row with the horizontal kernel
+// into an intermediate row (the padded row holds at least 7 readable channels past the last kernel column)
+typedef void (*SeparableHorizontalFunction)(float *paddedRow, float *entries, int kernelSize, float *intermediateRow, int count);
+
+// Vertical pass of the separable pipeline: convolves `count` columns of the intermediate buffer (starting at the row of
+// the first kernel entry) with the vertical kernel and stores the rounded and clamped results into an output row
+typedef void (*SeparableVerticalFunction)(float *intermediate, int rowLength, float *entries, int kernelSize, uint8_t *outputRow,
+        int count);
+
+
+// Scalar version of the horizontal pass (separate multiply and add)
+static void convolve_horizontal_row_scalar(float *paddedRow, float *entries, int kernelSize, float *intermediateRow, int count) {
+
+        for (int x = 0; x < count; x++) {
+                float sum = 0.0f;
+                for (int i = 0; i < kernelSize; i++) {
+                        sum += entries[i] * paddedRow[x + i];
+                }
+                intermediateRow[x] = sum;
+        }
+
+}
+
+
+// AVX2 version of the horizontal pass: vectorizes across 8 neighbouring output channels, broadcasts each kernel entry
+// (once per row, into `entries_ps`) and uses fused-multiply add against the shifted input row (writes `count` rounded
+// up to a multiple of 8 channels)
+CPU_TARGET_AVX2
+CPU_ALWAYS_INLINE void convolve_horizontal_row_avx2_body(float *paddedRow, float *entries, int kernelSize, __m256 *entries_ps,
+        float *intermediateRow, int count) {
+
+        for (int i = 0; i < kernelSize; i++) entries_ps[i] = _mm256_set1_ps(entries[i]);
+
+        for (int x = 0; x < count; x += 8) {
+                __m256 sum_ps = _mm256_setzero_ps();
+                #pragma GCC unroll 19
+                for (int i = 0; i < kernelSize; i++) {
+                        sum_ps = _mm256_fmadd_ps(entries_ps[i], _mm256_loadu_ps(&paddedRow[x + i]), sum_ps);
+                }
+                _mm256_storeu_ps(&intermediateRow[x], sum_ps);
+        }
+
+}
+
+
+// Scalar version of the vertical pass (separate multiply and add)
+static void convolve_vertical_row_scalar(float *intermediate, int rowLength, float *entries, int kernelSize, uint8_t *outputRow,
+        int count) {
+
+        for (int x = 0; x < count; x++) {
+                float sum = 0.0f;
+                for (int i = 0; i < kernelSize; i++) {
+                        sum += entries[i] * intermediate[i*rowLength + x];
+                }
+                outputRow[x] = clamp_float(sum);
+        }
+
+}
+
+
+// AVX2 version of the vertical pass, 8 neighbouring columns at a time (kernel entries broadcast once per row)
+CPU_TARGET_AVX2
+CPU_ALWAYS_INLINE void convolve_vertical_row_avx2_body(float *intermediate, int rowLength, float *entries, int kernelSize,
+        __m256 *entries_ps, uint8_t *outputRow, int count) {
+
+        for (int i = 0; i < kernelSize; i++) entries_ps[i] = _mm256_set1_ps(entries[i]);
+
+        for (int x = 0; x < count; x += 8) {
+                __m256 sum_ps = _mm256_setzero_ps();
+                #pragma GCC unroll 19
+                for (int i = 0; i < kernelSize; i++) {
+                        sum_ps = _mm256_fmadd_ps(entries_ps[i], _mm256_loadu_ps(&intermediate[i*rowLength + x]), sum_ps);
+                }
+                store_clamped_floats(sum_ps, &outputRow[x], (count - x < 8) ? count - x : 8);
+        }
+
+}
+
+
+// Instantiates the AVX2 passes for a kernel size (a constant for the specialized versions, the `kernelSize` argument for
+// the generic ones). With a constant size the broadcast entries stay in registers and the entry loops are unrolled
+#define DEFINE_SEPARABLE_PASS_FUNCTIONS(SUFFIX, SIZE) \
+        CPU_TARGET_AVX2 \
+        static void convolve_horizontal_row_avx2_##SUFFIX(float *paddedRow, float *entries, int kernelSize, \
+                float *intermediateRow, int count) { \
+                __m256 entries_ps[SIZE]; \
+                (void) kernelSize; \
+                convolve_horizontal_row_avx2_body(paddedRow, entries, SIZE, entries_ps, intermediateRow, count); \
+        } \
+        CPU_TARGET_AVX2 \
+        static void convolve_vertical_row_avx2_##SUFFIX(float *intermediate, int rowLength, float *entries, int kernelSize, \
+                uint8_t *outputRow, int count) { \
+                __m256 entries_ps[SIZE]; \
+                (void) kernelSize; \
+                convolve_vertical_row_avx2_body(intermediate, rowLength, entries, SIZE, entries_ps, outputRow, count); \
+        }
+#define DEFINE_SPECIALIZED_SEPARABLE_PASS_FUNCTIONS(SIZE) DEFINE_SEPARABLE_PASS_FUNCTIONS(SIZE, SIZE)
+
+DEFINE_SEPARABLE_PASS_FUNCTIONS(generic, kernelSize)
+FOR_EACH_SPECIALIZED_KERNEL_SIZE(DEFINE_SPECIALIZED_SEPARABLE_PASS_FUNCTIONS)
+
+
+// Selects the versions of the passes for the processor's instruction set level, specialized for the kernel size when
+// possible
+static void select_separable_pass_functions(int kernelSize, SeparableHorizontalFunction *convolveHorizontalRow,
+        SeparableVerticalFunction *convolveVerticalRow) {
+
+        #define SEPARABLE_PASS_CASE(SIZE) \
+                case SIZE: \
+                        *convolveHorizontalRow = convolve_horizontal_row_avx2_##SIZE; \
+                        *convolveVerticalRow = convolve_vertical_row_avx2_##SIZE; \
+                        return;
+
+        if (cpu_feature_level() < CPU_FEATURE_LEVEL_AVX2) {
+                *convolveHorizontalRow = convolve_horizontal_row_scalar;
+                *convolveVerticalRow = convolve_vertical_row_scalar;
+                return;
+        }
+
+        switch (kernelSize) {
+                FOR_EACH_SPECIALIZED_KERNEL_SIZE(SEPARABLE_PASS_CASE)
+                default:
+                        *convolveHorizontalRow = convolve_horizontal_row_avx2_generic;
+                        *convolveVerticalRow = convolve_vertical_row_avx2_generic;
+                        return;
+        }
+
+        #undef SEPARABLE_PASS_CASE
+
+}
+
+
+// Carries out the parallized convolution pipeline for any number of channel planes (channelsArrays) of the input image
+// in one pass over the tiles (one fork/join), and stores results into the output planes. Each tile keeps, per plane, a
+// ring of `windowSize` input rows converted to floats: moving down one output row converts exactly one new input row into
+// the slot of the row that left the kernel, and the kernel row pointers are rotated (no copying)
+int apply_direct_convolution_pipeline_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, const struct Kernel *kernel,
+        int imageHeight, int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue) {
 
         // Initialize useful values
         int windowSize = kernel->size;
         int haloSize = windowSize / 2;
-        int tileSize = 64 - 2*haloSize;
-        int windowEntriesArrayLength = windowSize*windowSize; 
+        struct TileShape tileShape = choose_tile_shape(TUNING_PIPELINE_DIRECT, windowSize, imageHeight, imageWidth);
+        int tileSize = tileShape.width;
+        int tileHeight = tileShape.height;
+        int stride = tileSize + 2*haloSize + 32;  // Converted row including its halo and slack for the last vectors
+        ConvolutionRowFunction computeConvolutionRow = select_convolution_row_function(windowSize);
 
         // Flag to indicate error in the parallel processing
         int errorFlag = 0;
 
         // Parallelize over tiles in row-major order
-        #pragma omp parallel for collapse(2) schedule(static) shared(errorFlag)
-        for (int yy = 0; yy < imageHeight; yy += tileSize) {
-                for (int xx = 0; xx < imageWidth; xx += tileSize) {
-
-                        // Create a MemoryPool to store one Window struct and its entries array PER TILE
-                        int alignedWindowSize = memory_size_alignment(sizeof(struct Window)) +
-                                                memory_size_alignment(sizeof(float)*(windowSize*windowSize));
-                        struct MemoryPool *pool = init_memory_pool(alignedWindowSize);
-                        if (pool == NULL) {
-                                #pragma omp atomic write
-                                errorFlag = 1;
-                                continue; // Skip to the next iteration
-                        }
-                        
-
-                        // Loop over the channels in current tile in row-major order
-                        for (int y = yy; y < (yy + tileSize) && y < imageHeight; y++) {
-
-                                // Create a Window struct centered at the start of the current row in the tile
-                                struct Window *window; 
-                                window = create_window(y, xx, windowSize, imageHeight, imageWidth, inputChannels, pool);
-                                if (window == NULL) {
-                                        #pragma omp atomic write
-                                        errorFlag = 1;
-                                        break; // Exit the processing of this tile
+        #pragma omp parallel shared(errorFlag)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread, sized once per parallel region to store
+                // the rings of converted rows (one per plane) and the kernel row pointers
+                size_t alignedRingSize = memory_size_alignment(sizeof(float)*(windowSize*stride));
+                size_t alignedRowPointersSize = memory_size_alignment(sizeof(float*)*windowSize);
+                struct MemoryPool *pool = acquire_thread_memory_pool(numPlanes*alignedRingSize + alignedRowPointersSize);
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                #pragma omp for collapse(2) schedule(static)
+                for (int yy = 0; yy < imageHeight; yy += tileHeight) {
+                        for (int xx = 0; xx < imageWidth; xx += tileSize) {
+
+                                // Start the tile with an empty arena
+                                if (pool == NULL) continue;
+                                empty_pool(pool);
+                                float *rings = (float*)allocate_from_pool(pool, numPlanes*alignedRingSize);
+                                float **rows = (float**)allocate_from_pool(pool, sizeof(float*)*windowSize);
+                                size_t ringLength = alignedRingSize / sizeof(float);
+
+                                // Determine the actual tile dimensions (tiles on the right and bottom edges may be cut off)
+                                int currentTileWidth = (xx + tileSize <= imageWidth) ? tileSize : imageWidth - xx;
+                                int currentTileHeight = (yy + tileHeight <= imageHeight) ? tileHeight : imageHeight - yy;
+
+                                // Fill the rings with the input rows of the first output row in the tile. Input row (yy - haloSize + k)
+                                // lives in ring slot (k % windowSize)
+                                for (int plane = 0; plane < numPlanes; plane++) {
+                                        float *ring = &rings[plane*ringLength];
+                                        for (int k = 0; k < windowSize - 1; k++) {
+                                                convert_ring_row(inputPlanes[plane], imageHeight, imageWidth, yy - haloSize + k, xx - haloSize,
+                                                        stride, borderMode, &ring[(k % windowSize)*stride]);
+                                        }
                                 }
 
-                                for (int x = xx; x < (xx + tileSize) && x < imageWidth; x++) {
+                                // Loop over the rows of the tile, computing the row of every plane before moving down
+                                for (int y = 0; y < currentTileHeight; y++) {
+                                        for (int plane = 0; plane < numPlanes; plane++) {
+
+                                                float *ring = &rings[plane*ringLength];
+                                                uint8_t *outputRow = &outputPlanes[plane][(size_t) (yy + y)*imageWidth + xx];
 
-                                        // Compute the convolution between the window and kernel and capture into output image struct
-                                        int channelIndex = (y * imageWidth) + x;
-                                        outputChannels[channelIndex] = compute_convolution(kernel->entries, window->entries, 
-                                                windowEntriesArrayLength);
-                                        
-                                        // Shift the Window right if not currently at last column in the tile
-                                        if (x < (xx + tileSize - 1) && x < (imageWidth - 1)) {
-                                                shift_window_right(y, x, window, imageHeight, imageWidth, inputChannels);
+                                                // Convert the input row entering the kernel at the bottom (it replaces the row that left at the top)
+                                                int k = y + windowSize - 1;
+                                                convert_ring_row(inputPlanes[plane], imageHeight, imageWidth, yy - haloSize + k, xx - haloSize,
+                                                        stride, borderMode, &ring[(k % windowSize)*stride]);
+
+                                                // Rotate the kernel row pointers over the ring
+                                                for (int j = 0; j < windowSize; j++) {
+                                                        rows[j] = &ring[((y + j) % windowSize)*stride];
+                                                }
+
+                                                // Compute up to 32 neighbouring output channels at a time
+                                                for (int x = 0; x < currentTileWidth; x += 32) {
+
+                                                        // Shift the row pointers to the current group of output channels
+                                                        float *shiftedRows[windowSize];
+                                                        for (int j = 0; j < windowSize; j++) {
+                                                                shiftedRows[j] = rows[j] + x;
+                                                        }
+
+                                                        // Compute the convolution and capture into the output plane
+                                                        int count = (currentTileWidth - x < 32) ? currentTileWidth - x : 32;
+                                                        computeConvolutionRow(shiftedRows, kernel->entries, windowSize, &outputRow[x], count);
+                                                }
+
+                                                // Fused point operations on the finished row
+                                                apply_point_op_epilogue_row(epilogue, outputRow, currentTileWidth);
                                         }
-                                
                                 }
-
-                                empty_pool(pool);  // Empty the memory pool to "free" the window 
                         }
-
-                        release_entire_memory_pool(pool);  // Completely free the memory pool struct
                 }
         }
 
         // Check if an error occurred during the parallel processing and return 0
         if (errorFlag) return 0;
 
-        // Indicate that convolution pipeline executed successfully for given channel
+        // Indicate that convolution pipeline executed successfully for all planes
         return 1;
 
 }
 
 
-// Applies the image_convolution_pipeline_channel for each of three (RGB) channels of a given image
-int apply_convolution_pipeline_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, struct Kernel *kernel) {
+// Carries out the convolution pipeline for given channelsArray of input image and stores result into output image
+// Hands large kernels over to the FFT pipeline when the blur planner estimates it cheaper (O(log(tile size)) instead of
+// O(size^2) work per channel), the others run through the direct pipeline
+int apply_convolution_pipeline_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, const struct Kernel *kernel,
+        int imageHeight, int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue) {
 
-        // Initializing useful values
-        int imageHeight = inputImage->height;
-        int imageWidth = inputImage->width;
-        int windowSize = kernel->size;
+        if (convolution_prefers_fft(kernel->size, imageHeight, imageWidth)) {
+                return apply_fft_convolution_pipeline_planes(inputPlanes, outputPlanes, numPlanes, kernel, imageHeight, imageWidth,
+                        borderMode, epilogue);
+        }
+        return apply_direct_convolution_pipeline_planes(inputPlanes, outputPlanes, numPlanes, kernel, imageHeight, imageWidth,
+                borderMode, epilogue);
+
+}
+
+
+int apply_convolution_pipeline_channel(uint8_t *inputChannels, uint8_t *outputChannels, const struct Kernel *kernel, int imageHeight, 
+        int imageWidth, enum BorderMode borderMode) {
 
-        // Apply convolution pipeline for redChannels array of the input image struct
-        int convolutionRed = apply_convolution_pipeline_channel(inputImage->redChannels, outputImage->redChannels,
-                kernel, imageHeight, imageWidth);        
-        if (convolutionRed == 0) return 0;
+        return apply_convolution_pipeline_planes(&inputChannels, &outputChannels, 1, kernel, imageHeight, imageWidth, borderMode,
+                NULL);
 
-        // Apply convolution pipeline for greenChannels array of the input image struct
-        int convolutionGreen = apply_convolution_pipeline_channel(inputImage->greenChannels, outputImage->greenChannels,
-                kernel, imageHeight, imageWidth);        
-        if (convolutionGreen == 0) return 0;
+}
+
+
+// Carries out the fused convolution pipeline over the three (RGB) channels of a given image
+int apply_convolution_pipeline_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, const struct Kernel *kernel,
+        enum BorderMode borderMode) {
+
+        uint8_t *inputPlanes[3] = {inputImage->redChannels, inputImage->greenChannels, inputImage->blueChannels};
+        uint8_t *outputPlanes[3] = {outputImage->redChannels, outputImage->greenChannels, outputImage->blueChannels};
+
+        return apply_convolution_pipeline_planes(inputPlanes, outputPlanes, 3, kernel, inputImage->height, inputImage->width,
+                borderMode, NULL);
+
+}
+
+
+
+// Carries out the parallelized two-pass (horizontal then vertical) convolution pipeline with a separable kernel for any
+// number of channel planes of the input image in one pass over the tiles (one fork/join), and stores results into the
+// output planes
+int apply_separable_convolution_pipeline_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes,
+        const struct SeparableKernel *kernel, int imageHeight, int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue) {
+
+        // Initialize useful values
+        int kernelSize = kernel->size;
+        int haloSize = kernelSize / 2;
+        struct TileShape tileShape = choose_tile_shape(TUNING_PIPELINE_SEPARABLE, kernelSize, imageHeight, imageWidth);
+        int tileWidth = tileShape.width;
+        int tileHeight = tileShape.height;
+        int paddedRowLength = tileWidth + 2*haloSize + 8;  // Input row of a tile including its halo (and slack for AVX2)
+        int intermediateRows = tileHeight + 2*haloSize;  // Rows of the horizontal pass needed by the vertical pass
+
+        // Select the versions of the passes for the processor's instruction set level and the kernel size
+        SeparableHorizontalFunction convolveHorizontalRow;
+        SeparableVerticalFunction convolveVerticalRow;
+        select_separable_pass_functions(kernelSize, &convolveHorizontalRow, &convolveVerticalRow);
+
+        // Flag to indicate error in the parallel processing
+        int errorFlag = 0;
+
+        // Parallelize over tiles in row-major order
+        #pragma omp parallel shared(errorFlag)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread, sized once per parallel region to store
+                // the padded input row and the intermediate buffer (shared by all planes)
+                size_t alignedPaddedRowSize = memory_size_alignment(sizeof(float)*paddedRowLength);
+                size_t alignedIntermediateSize = memory_size_alignment(sizeof(float)*(intermediateRows*tileWidth));
+                struct MemoryPool *pool = acquire_thread_memory_pool(alignedPaddedRowSize + alignedIntermediateSize);
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                #pragma omp for collapse(2) schedule(static)
+                for (int yy = 0; yy < imageHeight; yy += tileHeight) {
+                        for (int xx = 0; xx < imageWidth; xx += tileWidth) {
+
+                                // Start the tile with an empty arena
+                                if (pool == NULL) continue;
+                                empty_pool(pool);
+                                float *intermediate = (float*)allocate_from_pool(pool, sizeof(float)*(intermediateRows*tileWidth));
+
+                                // Determine the actual tile dimensions (tiles on the right and bottom edges may be cut off)
+                                int currentTileWidth = (xx + tileWidth <= imageWidth) ? tileWidth : imageWidth - xx;
+                                int currentTileHeight = (yy + tileHeight <= imageHeight) ? tileHeight : imageHeight - yy;
+                                int currentIntermediateRows = currentTileHeight + 2*haloSize;
+
+                                for (int plane = 0; plane < numPlanes; plane++) {
+
+                                        uint8_t *inputChannels = inputPlanes[plane];
+                                        uint8_t *outputChannels = outputPlanes[plane];
+
+                                        // The padded input row is only needed by the horizontal pass, hand it back to the arena afterwards
+                                        void *horizontalPassMark = mark_pool(pool);
+                                        float *paddedRow = (float*)allocate_from_pool(pool, sizeof(float)*paddedRowLength);
+
+                                        // Horizontal pass: convolve every input row of the tile (including the vertical halo) with the
+                                        // horizontal kernel and capture the results into the intermediate buffer
+                                        for (int row = 0; row < currentIntermediateRows; row++) {
+
+                                                int y = map_border_index(yy - haloSize + row, imageHeight, borderMode);
+                                                float *intermediateRow = &intermediate[row*tileWidth];
 
-        // Apply convolution pipeline for blueChannels array of the input image struct
-        int convolutionBlue = apply_convolution_pipeline_channel(inputImage->blueChannels, outputImage->blueChannels,
-                kernel, imageHeight, imageWidth);        
-        if (convolutionBlue == 0) return 0;
+                                                // Zero-padded rows outside of the image have a horizontal pass of zero
+                                                if (y < 0) {
+                                                        memset(intermediateRow, 0, sizeof(float)*tileWidth);
+                                                        continue;
+                                                }
 
-        // Indicate that convolution pipeline executed successfully for all channels
+                                                // Gather the input row (with its horizontal halo sampled by the border mode) as floats
+                                                convert_row_to_padded_floats(&inputChannels[(size_t) y*imageWidth], imageWidth, xx - haloSize,
+                                                        paddedRowLength, borderMode, paddedRow);
+
+                                                // Convolve the row with the horizontal kernel
+                                                convolveHorizontalRow(paddedRow, kernel->horizontalEntries, kernelSize, intermediateRow,
+                                                        currentTileWidth);
+                                        }
+
+                                        rollback_pool(pool, horizontalPassMark);
+
+                                        // Vertical pass: convolve the columns of the intermediate buffer with the vertical kernel and
+                                        // capture the rounded and clamped results into the output plane
+                                        for (int row = 0; row < currentTileHeight; row++) {
+
+                                                uint8_t *outputRow = &outputChannels[(size_t) (yy + row)*imageWidth + xx];
+                                                convolveVerticalRow(&intermediate[row*tileWidth], tileWidth, kernel->verticalEntries, kernelSize,
+                                                        outputRow, currentTileWidth);
+                                                apply_point_op_epilogue_row(epilogue, outputRow, currentTileWidth);
+                                        }
+                                }
+                        }
+                }
+        }
+
+        // Check if an error occurred during the parallel processing and return 0
+        if (errorFlag) return 0;
+
+        // Indicate that separable convolution pipeline executed successfully for all planes
         return 1;
+
+}
+
+
+// Carries out the separable convolution pipeline for given channelsArray of input image and stores result into output image
+int apply_separable_convolution_pipeline_channel(uint8_t *inputChannels, uint8_t *outputChannels, const struct SeparableKernel *kernel,
+        int imageHeight, int imageWidth, enum BorderMode borderMode) {
+
+        return apply_separable_convolution_pipeline_planes(&inputChannels, &outputChannels, 1, kernel, imageHeight, imageWidth,
+                borderMode, NULL);
+
+}
+
+
+// Carries out the fused separable convolution pipeline over the three (RGB) channels of a given image
+int apply_separable_convolution_pipeline_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, const struct SeparableKernel *kernel,
+        enum BorderMode borderMode) {
+
+        uint8_t *inputPlanes[3] = {inputImage->redChannels, inputImage->greenChannels, inputImage->blueChannels};
+        uint8_t *outputPlanes[3] = {outputImage->redChannels, outputImage->greenChannels, outputImage->blueChannels};
+
+        return apply_separable_convolution_pipeline_planes(inputPlanes, outputPlanes, 3, kernel, inputImage->height,
+                inputImage->width, borderMode, NULL);
+
 }
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>  // For getenv()
+#include <string.h>  // For strcmp()
+#include "cpu.h"
+
+
+
+// Names of the instruction set levels (also accepted by the IMAGEPROCESSOR_CPU environment variable)
+static const char *featureLevelNames[CPU_FEATURE_LEVEL_INVALID] = {"scalar", "sse4.1", "avx2", "avx512"};
+
+// Detected (or overridden) instruction set level, detected once (an int, so that it can be read and written atomically)
+static int featureLevel = CPU_FEATURE_LEVEL_INVALID;
+
+
+
+// Determines the widest instruction set level supported by the processor and the operating system
+static enum CpuFeatureLevel detect_feature_level(void) {
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        // __builtin_cpu_supports also checks that the operating system saves the wider registers (XGETBV)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                        __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+                return CPU_FEATURE_LEVEL_AVX512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return CPU_FEATURE_LEVEL_AVX2;
+        if (__builtin_cpu_supports("sse4.1")) return CPU_FEATURE_LEVEL_SSE41;
+#endif
+        return CPU_FEATURE_LEVEL_SCALAR;
+
+}
+
+
+enum CpuFeatureLevel cpu_feature_level(void) {
+
+        // Once detected, the level is returned by an atomic load alone (the function is called from parallel regions)
+        int knownLevel;
+        #pragma omp atomic read
+        knownLevel = featureLevel;
+        if (knownLevel != CPU_FEATURE_LEVEL_INVALID) return (enum CpuFeatureLevel) knownLevel;
+
+        // The first use detects the level, threads calling meanwhile wait for it
+        #pragma omp critical(cpu_feature_level)
+        {
+                if (featureLevel == CPU_FEATURE_LEVEL_INVALID) {
+
+                        enum CpuFeatureLevel level = detect_feature_level();
+
+                        // Lower the level if requested by the environment (never above what is supported)
+                        const char *overrideName = getenv("IMAGEPROCESSOR_CPU");
+                        if (overrideName != NULL) {
+                                enum CpuFeatureLevel overrideLevel = CPU_FEATURE_LEVEL_INVALID;
+                                for (int i = 0; i < CPU_FEATURE_LEVEL_INVALID; i++) {
+                                        if (strcmp(overrideName, featureLevelNames[i]) == 0) overrideLevel = (enum CpuFeatureLevel) i;
+                                }
+                                if (overrideLevel == CPU_FEATURE_LEVEL_INVALID) {
+                                        fprintf(stderr, "\nWarning: unknown IMAGEPROCESSOR_CPU value \"%s\", using \"%s\".\n",
+                                                overrideName, featureLevelNames[level]);
+                                } else if (overrideLevel > level) {
+                                        fprintf(stderr, "\nWarning: IMAGEPROCESSOR_CPU \"%s\" is not supported, using \"%s\".\n",
+                                                overrideName, featureLevelNames[level]);
+                                } else {
+                                        level = overrideLevel;
+                                }
+                        }
+
+                        #pragma omp atomic write
+                        featureLevel = (int) level;
+                }
+                knownLevel = featureLevel;
+        }
+
+        return (enum CpuFeatureLevel) knownLevel;
+
+}
+
+
+const char *cpu_feature_level_name(enum CpuFeatureLevel level) {
+
+        if (level < 0 || level >= CPU_FEATURE_LEVEL_INVALID) return "invalid";
+        return featureLevelNames[level];
+
+}
@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  // For memset()
+#include <math.h>  // For cos(), sin() and log2()
+#include <stdint.h>  // For type uint8_t
+#include <immintrin.h>  // For AVX2 intrinsics
+#include <omp.h>  // For multithreading
+#include "pool.h"
+#include "convolution.h"
+#include "fft.h"
+#include "cpu.h"
+
+
+
+// Cost model of the FFT pipeline per channel of a tile, in units of one kernel entry per output channel of the direct
+// pipeline: every butterfly level of the transforms (log2 of the tile size of them) and the remaining work (loading,
+// transposes, spectrum product and storing). The blur planner converts the units into time
+#define FFT_COST_PER_LEVEL 20.0
+#define FFT_COST_PER_CHANNEL 16.0
+
+
+static const double FFT_PI = 3.14159265358979323846;
+
+
+
+/**
+ * @brief Structure for representing the precomputed tables of a radix-2 FFT of a given (power of two) size: the
+ * bit-reversed index of every position, and the real and imaginary parts of the twiddle factors exp(-2*pi*i*m/size)
+ * for m < size/2.
+ */
+typedef struct FftPlan {
+        int size;
+        int *bitReversal;
+        float *twiddleRe;
+        float *twiddleIm;
+} FftPlan;
+
+
+
+static void free_fft_plan(struct FftPlan *plan) {
+        free(plan->bitReversal);
+        free(plan->twiddleRe);
+        free(plan->twiddleIm);
+        free(plan);
+}
+
+
+static struct FftPlan *create_fft_plan(int size) {
+
+        // Create a FftPlan struct and allocate its tables
+        struct FftPlan *plan = (struct FftPlan*)malloc(sizeof(struct FftPlan));
+        if (plan == NULL) {
+                fprintf(stderr, "\nFatal error: could not allocate memory for the FFT tables.\n");
+                return NULL;
+        }
+        plan->size = size;
+        plan->bitReversal = (int*)malloc(size*sizeof(int));
+        plan->twiddleRe = (float*)malloc((size/2)*sizeof(float));
+        plan->twiddleIm = (float*)malloc((size/2)*sizeof(float));
+        if (plan->bitReversal == NULL || plan->twiddleRe == NULL || plan->twiddleIm == NULL) {
+                free_fft_plan(plan);
+                fprintf(stderr, "\nFatal error: could not allocate memory for the FFT tables.\n");
+                return NULL;
+        }
+
+        // Bit-reversed indices
+        int numBits = 0;
+        while ((1 << numBits) < size) numBits++;
+        for (int index = 0; index < size; index++) {
+                int reversed = 0;
+                for (int bit = 0; bit < numBits; bit++) {
+                        if (index & (1 << bit)) reversed |= 1 << (numBits - 1 - bit);
+                }
+                plan->bitReversal[index] = reversed;
+        }
+
+        // Twiddle factors (evaluated in double precision)
+        for (int m = 0; m < size/2; m++) {
+                plan->twiddleRe[m] = (float) cos(2.0*FFT_PI*m / size);
+                plan->twiddleIm[m] = (float) -sin(2.0*FFT_PI*m / size);
+        }
+
+        return plan;
+
+}
+
+
+
+// Radix-2 butterfly between two rows of a split-complex tile (`count` channels): with t = w*B, B = A - t and A = A + t
+typedef void (*FftButterflyFunction)(float *reA, float *imA, float *reB, float *imB, float wRe, float wIm, int count);
+
+
+// Scalar version
+static void butterfly_rows_scalar(float *reA, float *imA, float *reB, float *imB, float wRe, float wIm, int count) {
+
+        for (int x = 0; x < count; x++) {
+                float tRe = wRe*reB[x] - wIm*imB[x];
+                float tIm = wRe*imB[x] + wIm*reB[x];
+                reB[x] = reA[x] - tRe;
+                imB[x] = imA[x] - tIm;
+                reA[x] += tRe;
+                imA[x] += tIm;
+        }
+
+}
+
+
+// AVX2 version, 8 channels at a time (the tile sizes are multiples of 8)
+CPU_TARGET_AVX2
+static void butterfly_rows_avx2(float *reA, float *imA, float *reB, float *imB, float wRe, float wIm, int count) {
+
+        __m256 wRe_ps = _mm256_set1_ps(wRe);
+        __m256 wIm_ps = _mm256_set1_ps(wIm);
+
+        for (int x = 0; x < count; x += 8) {
+
+                __m256 reA_ps = _mm256_loadu_ps(&reA[x]);
+                __m256 imA_ps = _mm256_loadu_ps(&imA[x]);
+                __m256 reB_ps = _mm256_loadu_ps(&reB[x]);
+                __m256 imB_ps = _mm256_loadu_ps(&imB[x]);
+
+                // t = w*B (complex product)
+                __m256 tRe_ps = _mm256_fmsub_ps(wRe_ps, reB_ps, _mm256_mul_ps(wIm_ps, imB_ps));
+                __m256 tIm_ps = _mm256_fmadd_ps(wRe_ps, imB_ps, _mm256_mul_ps(wIm_ps, reB_ps));
+
+                _mm256_storeu_ps(&reB[x], _mm256_sub_ps(reA_ps, tRe_ps));
+                _mm256_storeu_ps(&imB[x], _mm256_sub_ps(imA_ps, tIm_ps));
+                _mm256_storeu_ps(&reA[x], _mm256_add_ps(reA_ps, tRe_ps));
+                _mm256_storeu_ps(&imA[x], _mm256_add_ps(imA_ps, tIm_ps));
+        }
+
+}
+
+
+// Swaps two rows of `count` floats
+static void swap_rows(float *rowA, float *rowB, int count) {
+
+        for (int x = 0; x < count; x++) {
+                float temp = rowA[x];
+                rowA[x] = rowB[x];
+                rowB[x] = temp;
+        }
+
+}
+
+
+// Transforms every column of a split-complex square tile (iterative decimation in time). The butterflies combine whole
+// rows, so the inner loops run over contiguous channels. The inverse transform is not scaled
+static void fft_columns(const struct FftPlan *plan, float *re, float *im, int inverse, FftButterflyFunction butterfly) {
+
+        int size = plan->size;
+
+        // Reorder the rows into bit-reversed order
+        for (int row = 0; row < size; row++) {
+                int reversed = plan->bitReversal[row];
+                if (reversed > row) {
+                        swap_rows(&re[row*size], &re[reversed*size], size);
+                        swap_rows(&im[row*size], &im[reversed*size], size);
+                }
+        }
+
+        // Combine pairs of transforms of length `span` into transforms of length 2*span
+        for (int span = 1; span < size; span *= 2) {
+                int step = size / (2*span);
+                for (int m = 0; m < span; m++) {
+                        float wRe = plan->twiddleRe[m*step];
+                        float wIm = inverse ? -plan->twiddleIm[m*step] : plan->twiddleIm[m*step];
+                        for (int start = m; start < size; start += 2*span) {
+                                butterfly(&re[start*size], &im[start*size], &re[(start + span)*size], &im[(start + span)*size],
+                                        wRe, wIm, size);
+                        }
+                }
+        }
+
+}
+
+
+// Transposes a square plane of floats into another one (in blocks of 16x16 to stay within cache lines)
+static void transpose_plane(const float *input, float *output, int size) {
+
+        for (int yy = 0; yy < size; yy += 16) {
+                for (int xx = 0; xx < size; xx += 16) {
+                        for (int y = yy; y < yy + 16 && y < size; y++) {
+                                for (int x = xx; x < xx + 16 && x < size; x++) {
+                                        output[x*size + y] = input[y*size + x];
+                                }
+                        }
+                }
+        }
+
+}
+
+
+// Forward 2D transform of the split-complex tile (re, im). The spectrum is left transposed in (spectrumRe, spectrumIm),
+// which saves the transpose back (the inverse transform starts from the transposed spectrum)
+static void fft_forward_2d(const struct FftPlan *plan, float *re, float *im, float *spectrumRe, float *spectrumIm,
+        FftButterflyFunction butterfly) {
+
+        fft_columns(plan, re, im, 0, butterfly);
+        transpose_plane(re, spectrumRe, plan->size);
+        transpose_plane(im, spectrumIm, plan->size);
+        fft_columns(plan, spectrumRe, spectrumIm, 0, butterfly);
+
+}
+
+
+// Inverse 2D transform (not scaled) of a transposed spectrum into the split-complex tile (re, im). The spectrum is
+// overwritten
+static void fft_inverse_2d(const struct FftPlan *plan, float *spectrumRe, float *spectrumIm, float *re, float *im,
+        FftButterflyFunction butterfly) {
+
+        fft_columns(plan, spectrumRe, spectrumIm, 1, butterfly);
+        transpose_plane(spectrumRe, re, plan->size);
+        transpose_plane(spectrumIm, im, plan->size);
+        fft_columns(plan, re, im, 1, butterfly);
+
+}
+
+
+// Multiplies a spectrum by the kernel spectrum, channel by channel (complex products)
+static void multiply_spectra(float *re, float *im, const float *kernelRe, const float *kernelIm, size_t count) {
+
+        for (size_t i = 0; i < count; i++) {
+                float productRe = re[i]*kernelRe[i] - im[i]*kernelIm[i];
+                float productIm = re[i]*kernelIm[i] + im[i]*kernelRe[i];
+                re[i] = productRe;
+                im[i] = productIm;
+        }
+
+}
+
+
+// Gathers a square tile of channels (top left corner at yStart, xStart, both may be negative) as floats. Channels outside
+// of the image are sampled according to the border mode
+static void load_tile(uint8_t *inputChannels, int imageHeight, int imageWidth, int yStart, int xStart, int size,
+        enum BorderMode borderMode, uint8_t *rowBuffer, float *tile) {
+
+        for (int row = 0; row < size; row++) {
+
+                float *tileRow = &tile[row*size];
+                int y = map_border_index(yStart + row, imageHeight, borderMode);
+                if (y < 0) {
+                        memset(tileRow, 0, sizeof(float)*size);
+                        continue;
+                }
+
+                fill_padded_row(&inputChannels[(size_t) y*imageWidth], imageWidth, xStart, size, borderMode, rowBuffer);
+                for (int x = 0; x < size; x++) {
+                        tileRow[x] = (float) rowBuffer[x];
+                }
+        }
+
+}
+
+
+// Stores the valid block of a convolved tile (at most blockSize x blockSize channels, cut off at the image edges),
+// rounded and clamped to uint8 and mapped through the point operations of the epilogue
+static void store_tile(const float *tile, int size, int blockSize, uint8_t *outputChannels, int imageHeight, int imageWidth,
+        int yStart, int xStart, const struct PointOpEpilogue *epilogue) {
+
+        int rows = (yStart + blockSize <= imageHeight) ? blockSize : imageHeight - yStart;
+        int columns = (xStart + blockSize <= imageWidth) ? blockSize : imageWidth - xStart;
+
+        for (int row = 0; row < rows; row++) {
+                uint8_t *outputRow = &outputChannels[(size_t) (yStart + row)*imageWidth + xStart];
+                for (int x = 0; x < columns; x++) {
+
+                        // Clamp to [0, 255] and round half away from zero (same as the direct pipeline)
+                        float value = tile[row*size + x];
+                        outputRow[x] = (value <= 0.0f) ? 0 : (value >= 255.0f) ? 255 : (uint8_t) (value + 0.5f);
+                }
+                apply_point_op_epilogue_row(epilogue, outputRow, columns);
+        }
+
+}
+
+
+// Estimated cost of the FFT pipeline on one plane with a tile size (see FFT_COST_PER_LEVEL), or a negative value when
+// the tile size cannot hold the kernel
+static double fft_tile_size_cost(int tileSize, int kernelSize, int imageHeight, int imageWidth) {
+
+        int blockSize = tileSize - kernelSize + 1;
+        if (blockSize < 8) return -1.0;
+
+        double numTiles = (double) ((imageHeight + blockSize - 1) / blockSize) * ((imageWidth + blockSize - 1) / blockSize);
+        return numTiles * tileSize*tileSize * (FFT_COST_PER_LEVEL*log2(tileSize) + FFT_COST_PER_CHANNEL);
+
+}
+
+
+// Picks the tile size of the lowest estimated cost, tiles larger than needed to cover the image are not considered
+// (returns 0 when no tile size can hold the kernel)
+static int choose_fft_tile_size(int kernelSize, int imageHeight, int imageWidth, double *cost) {
+
+        int largestDimension = (imageHeight > imageWidth) ? imageHeight : imageWidth;
+        int bestSize = 0;
+        *cost = -1.0;
+
+        for (int tileSize = FFT_MIN_TILE_SIZE; tileSize <= FFT_MAX_TILE_SIZE; tileSize *= 2) {
+                double tileCost = fft_tile_size_cost(tileSize, kernelSize, imageHeight, imageWidth);
+                if (tileCost >= 0.0 && (bestSize == 0 || tileCost < *cost)) {
+                        bestSize = tileSize;
+                        *cost = tileCost;
+                }
+                if (tileSize >= largestDimension + kernelSize - 1) break;
+        }
+
+        return bestSize;
+
+}
+
+
+double fft_convolution_cost(int kernelSize, int imageHeight, int imageWidth) {
+
+        double cost;
+        if (choose_fft_tile_size(kernelSize, imageHeight, imageWidth, &cost) == 0) return -1.0;
+        return cost;
+
+}
+
+
+int apply_fft_convolution_pipeline_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, const struct Kernel *kernel,
+        int imageHeight, int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue) {
+
+        // Initialize useful values
+        int kernelSize = kernel->size;
+        int haloSize = kernelSize / 2;
+        double cost;
+        int tileSize = choose_fft_tile_size(kernelSize, imageHeight, imageWidth, &cost);
+        if (tileSize == 0) {
+                fprintf(stderr, "\nFatal error: kernel too large for the FFT convolution pipeline.\n");
+                return 0;
+        }
+        int blockSize = tileSize - kernelSize + 1;  // Output channels per tile side (overlap-save)
+        int tilesAcross = (imageWidth + blockSize - 1) / blockSize;
+        int numTiles = ((imageHeight + blockSize - 1) / blockSize) * tilesAcross;
+        int numItems = numPlanes*numTiles;  // (plane, tile) pairs, transformed two at a time
+        size_t planeSize = (size_t) tileSize*tileSize;
+
+        // Select the butterfly for the processor's instruction set level
+        FftButterflyFunction butterfly = (cpu_feature_level() >= CPU_FEATURE_LEVEL_AVX2) ? butterfly_rows_avx2 : butterfly_rows_scalar;
+
+        // Create the FFT tables and the buffer of the kernel spectrum (with room for its transform)
+        struct FftPlan *plan = create_fft_plan(tileSize);
+        if (plan == NULL) return 0;
+        float *kernelBuffer = (float*)malloc(4*planeSize*sizeof(float));
+        if (kernelBuffer == NULL) {
+                free_fft_plan(plan);
+                fprintf(stderr, "\nFatal error: could not allocate memory for the kernel spectrum.\n");
+                return 0;
+        }
+        float *kernelRe = kernelBuffer;
+        float *kernelIm = kernelBuffer + planeSize;
+        float *spectrumRe = kernelBuffer + 2*planeSize;
+        float *spectrumIm = kernelBuffer + 3*planeSize;
+
+        // Kernel spectrum: the pipelines correlate the tile with the kernel, which is the product with the conjugate of
+        // the kernel spectrum. The 1/size^2 scaling of the inverse transform is folded in
+        memset(kernelBuffer, 0, 2*planeSize*sizeof(float));
+        for (int j = 0; j < kernelSize; j++) {
+                for (int i = 0; i < kernelSize; i++) {
+                        kernelRe[j*tileSize + i] = kernel->entries[j*kernelSize + i];
+                }
+        }
+        fft_forward_2d(plan, kernelRe, kernelIm, spectrumRe, spectrumIm, butterfly);
+        float scale = 1.0f / (float) planeSize;
+        for (size_t i = 0; i < planeSize; i++) {
+                kernelRe[i] = spectrumRe[i]*scale;
+                kernelIm[i] = -spectrumIm[i]*scale;
+        }
+
+        // Flag to indicate error in the parallel processing
+        int errorFlag = 0;
+
+        // Parallelize over pairs of (plane, tile) items
+        #pragma omp parallel shared(errorFlag)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread, sized once per parallel region to store
+                // the split-complex tile, its transposed spectrum and a row of channels
+                size_t alignedPlaneSize = memory_size_alignment(sizeof(float)*planeSize);
+                struct MemoryPool *pool = acquire_thread_memory_pool(4*alignedPlaneSize + memory_size_alignment(tileSize));
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                #pragma omp for schedule(static)
+                for (int pair = 0; pair < (numItems + 1) / 2; pair++) {
+
+                        // Start the pair with an empty arena
+                        if (pool == NULL) continue;
+                        empty_pool(pool);
+                        float *tile[2];
+                        tile[0] = (float*)allocate_from_pool(pool, sizeof(float)*planeSize);
+                        tile[1] = (float*)allocate_from_pool(pool, sizeof(float)*planeSize);
+                        float *tileSpectrumRe = (float*)allocate_from_pool(pool, sizeof(float)*planeSize);
+                        float *tileSpectrumIm = (float*)allocate_from_pool(pool, sizeof(float)*planeSize);
+                        uint8_t *rowBuffer = (uint8_t*)allocate_from_pool(pool, tileSize);
+
+                        // Gather the two real tiles as the real and imaginary parts (the kernel is real, so the two
+                        // convolutions stay separated in the real and imaginary parts of the result)
+                        for (int half = 0; half < 2; half++) {
+                                int item = 2*pair + half;
+                                if (item >= numItems) {
+                                        memset(tile[half], 0, sizeof(float)*planeSize);
+                                        continue;
+                                }
+                                int plane = item / numTiles;
+                                int tileIndex = item % numTiles;
+                                int yStart = (tileIndex / tilesAcross)*blockSize;
+                                int xStart = (tileIndex % tilesAcross)*blockSize;
+                                load_tile(inputPlanes[plane], imageHeight, imageWidth, yStart - haloSize, xStart - haloSize, tileSize,
+                                        borderMode, rowBuffer, tile[half]);
+                        }
+
+                        // Convolve in the frequency domain
+                        fft_forward_2d(plan, tile[0], tile[1], tileSpectrumRe, tileSpectrumIm, butterfly);
+                        multiply_spectra(tileSpectrumRe, tileSpectrumIm, kernelRe, kernelIm, planeSize);
+                        fft_inverse_2d(plan, tileSpectrumRe, tileSpectrumIm, tile[0], tile[1], butterfly);
+
+                        // Capture the valid blocks into the output planes
+                        for (int half = 0; half < 2; half++) {
+                                int item = 2*pair + half;
+                                if (item >= numItems) continue;
+                                int plane = item / numTiles;
+                                int tileIndex = item % numTiles;
+                                store_tile(tile[half], tileSize, blockSize, outputPlanes[plane], imageHeight, imageWidth,
+                                        (tileIndex / tilesAcross)*blockSize, (tileIndex % tilesAcross)*blockSize, epilogue);
+                        }
+                }
+        }
+
+        // Free the FFT tables and the kernel spectrum
+        free(kernelBuffer);
+        free_fft_plan(plan);
+
+        // Check if an error occurred during the parallel processing and return 0
+        if (errorFlag) return 0;
+
+        // Indicate that the FFT convolution pipeline executed successfully for all planes
+        return 1;
+
+}
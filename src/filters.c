@@ -1,14 +1,207 @@
 #include <stdio.h>
+#include <string.h>  // For memcpy()
 #include <math.h>  // For roundf()
 #include <immintrin.h>  // For AVX2 support
 #include <omp.h>  // For parallel processing
 #include <stdint.h>  // For uint8_t
 #include "image.h"
 #include "convolution.h"
+#include "blur.h"
+#include "fixedpoint.h"
+#include "sobel.h"
 #include "filters.h"
+#include "registry.h"
+#include "planner.h"
+#include "pointops.h"
+#include "cpu.h"
 
 
 
+// Grayscale channel weights (scaled to int16 for precision, 7 fractional bits)
+#define GREYSCALE_RED_WEIGHT ((int16_t) (0.299 * 128))
+#define GREYSCALE_GREEN_WEIGHT ((int16_t) (0.587 * 128))
+#define GREYSCALE_BLUE_WEIGHT ((int16_t) (0.114 * 128))
+
+
+// Converts the pixels of a row to greyscale. Pixels before `vectorEnd` use the fixed-point weights, the remaining pixels
+// of the row use the exact weights (so every instruction set level gives the same results)
+typedef void (*GreyscaleRowFunction)(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *outputRow, int vectorEnd,
+        int width);
+
+
+// Converts the pixels [x, width) of a row to greyscale with the exact weights
+static void greyscale_row_tail(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *outputRow, int x, int width) {
+
+        for (; x < width; x++) {
+
+                float greyscaleResult = 0.299*redRow[x] + 0.587*greenRow[x] + 0.114*blueRow[x];
+
+                if (greyscaleResult <= 0) {
+                        outputRow[x] = 0;
+                } else if (greyscaleResult >= 255) {
+                        outputRow[x] = 255;
+                } else {
+                        outputRow[x] = roundf(greyscaleResult);
+                }
+        }
+
+}
+
+
+// Converts the pixels [x, vectorEnd) of a row to greyscale with the fixed-point weights, one pixel at a time
+static void greyscale_row_fixed_point(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *outputRow, int x, int vectorEnd) {
+
+        for (; x < vectorEnd; x++) {
+                outputRow[x] = (uint8_t) ((GREYSCALE_RED_WEIGHT*redRow[x] + GREYSCALE_GREEN_WEIGHT*greenRow[x] +
+                        GREYSCALE_BLUE_WEIGHT*blueRow[x]) >> 7);
+        }
+
+}
+
+
+// Scalar version
+static void greyscale_row_scalar(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *outputRow, int vectorEnd, int width) {
+
+        greyscale_row_fixed_point(redRow, greenRow, blueRow, outputRow, 0, vectorEnd);
+        greyscale_row_tail(redRow, greenRow, blueRow, outputRow, vectorEnd, width);
+
+}
+
+
+// SSE4.1 version, 8 pixels at a time
+CPU_TARGET_SSE41
+static void greyscale_row_sse41(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *outputRow, int vectorEnd, int width) {
+
+        __m128i redWeight_vec16i = _mm_set1_epi16(GREYSCALE_RED_WEIGHT);
+        __m128i greenWeight_vec16i = _mm_set1_epi16(GREYSCALE_GREEN_WEIGHT);
+        __m128i blueWeight_vec16i = _mm_set1_epi16(GREYSCALE_BLUE_WEIGHT);
+
+        int x = 0;
+        for (; x + 8 <= vectorEnd; x += 8) {
+
+                // Load 8 pixels from each channel of type uint8 and convert to int16
+                __m128i red_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &redRow[x]));
+                __m128i green_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &greenRow[x]));
+                __m128i blue_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &blueRow[x]));
+
+                // Weighted sum, normalized by 128 (right bitshift by 7), and pack to uint8
+                __m128i greyscale_vec16i = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(red_vec16i, redWeight_vec16i),
+                        _mm_mullo_epi16(green_vec16i, greenWeight_vec16i)), _mm_mullo_epi16(blue_vec16i, blueWeight_vec16i));
+                greyscale_vec16i = _mm_srli_epi16(greyscale_vec16i, 7);
+                _mm_storel_epi64((__m128i*) &outputRow[x], _mm_packus_epi16(greyscale_vec16i, greyscale_vec16i));
+        }
+
+        greyscale_row_fixed_point(redRow, greenRow, blueRow, outputRow, x, vectorEnd);
+        greyscale_row_tail(redRow, greenRow, blueRow, outputRow, vectorEnd, width);
+
+}
+
+
+// AVX2 version, 16 pixels at a time
+CPU_TARGET_AVX2
+static void greyscale_row_avx2(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *outputRow, int vectorEnd, int width) {
+
+        // Load weights into 256 bit AVX2 registers
+        __m256i redWeight_vec16i = _mm256_set1_epi16(GREYSCALE_RED_WEIGHT);
+        __m256i greenWeight_vec16i = _mm256_set1_epi16(GREYSCALE_GREEN_WEIGHT);
+        __m256i blueWeight_vec16i = _mm256_set1_epi16(GREYSCALE_BLUE_WEIGHT);
+
+        int x = 0;
+        for (; x + 16 <= vectorEnd; x += 16) {
+
+                // Load 16 pixels from each channel of type uint8 and convert to int16
+                __m256i redChannels_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &redRow[x]));
+                __m256i greenChannels_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &greenRow[x]));
+                __m256i blueChannels_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &blueRow[x]));
+
+                // Perform the greycale operation
+                __m256i greyscale_vec16i = _mm256_add_epi16(
+                        _mm256_add_epi16(
+                                _mm256_mullo_epi16(redChannels_vec16i, redWeight_vec16i),
+                                _mm256_mullo_epi16(greenChannels_vec16i, greenWeight_vec16i)
+                        ),
+                        _mm256_mullo_epi16(blueChannels_vec16i, blueWeight_vec16i)
+                );
+
+                // Normalize results by dividing greyscale values by 128 (right bitshift by 7)
+                greyscale_vec16i = _mm256_srli_epi16(greyscale_vec16i, 7);
+
+                // Convert int16 result values to clamped uint8 values
+                greyscale_vec16i = _mm256_packus_epi16(greyscale_vec16i, 
+                        _mm256_permute2x128_si256(greyscale_vec16i, greyscale_vec16i, 0x11));
+                
+                // Extract the first 128 bits (16 uint8) from result vector and store into output image
+                _mm_storeu_si128((__m128i*) &outputRow[x], _mm256_extracti128_si256(greyscale_vec16i, 0));
+
+        }
+
+        greyscale_row_fixed_point(redRow, greenRow, blueRow, outputRow, x, vectorEnd);
+        greyscale_row_tail(redRow, greenRow, blueRow, outputRow, vectorEnd, width);
+
+}
+
+
+// AVX-512 version, 32 pixels at a time
+CPU_TARGET_AVX512
+static void greyscale_row_avx512(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *outputRow, int vectorEnd, int width) {
+
+        __m512i redWeight_vec16i = _mm512_set1_epi16(GREYSCALE_RED_WEIGHT);
+        __m512i greenWeight_vec16i = _mm512_set1_epi16(GREYSCALE_GREEN_WEIGHT);
+        __m512i blueWeight_vec16i = _mm512_set1_epi16(GREYSCALE_BLUE_WEIGHT);
+
+        int x = 0;
+        for (; x + 32 <= vectorEnd; x += 32) {
+
+                // Load 32 pixels from each channel of type uint8 and convert to int16
+                __m512i red_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &redRow[x]));
+                __m512i green_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &greenRow[x]));
+                __m512i blue_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &blueRow[x]));
+
+                // Weighted sum, normalized by 128 (right bitshift by 7), narrowed to uint8 (results are at most 254)
+                __m512i greyscale_vec16i = _mm512_add_epi16(_mm512_add_epi16(_mm512_mullo_epi16(red_vec16i, redWeight_vec16i),
+                        _mm512_mullo_epi16(green_vec16i, greenWeight_vec16i)), _mm512_mullo_epi16(blue_vec16i, blueWeight_vec16i));
+                greyscale_vec16i = _mm512_srli_epi16(greyscale_vec16i, 7);
+                _mm256_storeu_si256((__m256i*) &outputRow[x], _mm512_cvtepi16_epi8(greyscale_vec16i));
+        }
+
+        greyscale_row_fixed_point(redRow, greenRow, blueRow, outputRow, x, vectorEnd);
+        greyscale_row_tail(redRow, greenRow, blueRow, outputRow, vectorEnd, width);
+
+}
+
+
+// Selects the widest greyscale row function supported by the processor
+static GreyscaleRowFunction select_greyscale_row_function(void) {
+
+        switch (cpu_feature_level()) {
+                case CPU_FEATURE_LEVEL_AVX512:  return greyscale_row_avx512;
+                case CPU_FEATURE_LEVEL_AVX2:    return greyscale_row_avx2;
+                case CPU_FEATURE_LEVEL_SSE41:   return greyscale_row_sse41;
+                default:                        return greyscale_row_scalar;
+        }
+
+}
+
+
+// Converts the three (RGB) input planes to greyscale, in parallel over the rows, and applies the point operations of an
+// epilogue (may be NULL) to the converted rows
+static void apply_greyscale_planes(uint8_t **inputPlanes, uint8_t *outputChannels, int height, int width,
+        const struct PointOpEpilogue *epilogue) {
+
+        // Parallelize the loop over image ROWS (pixels before vectorEnd go through the vector loops)
+        GreyscaleRowFunction greyscaleRow = select_greyscale_row_function();
+        int vectorEnd = (width > 0) ? ((width - 1) / 16) * 16 : 0;
+        #pragma omp parallel for schedule(static)
+        for (int pixelY = 0; pixelY < height; pixelY++) {
+                size_t index = (size_t) pixelY*width;
+                greyscaleRow(&inputPlanes[0][index], &inputPlanes[1][index], &inputPlanes[2][index], &outputChannels[index],
+                        vectorEnd, width);
+                apply_point_op_epilogue_row(epilogue, &outputChannels[index], width);
+        }
+
+}
+
+
 struct ImageOneChannel *apply_filter_greyscale(struct ImageRGB **inputImage) {
 
         // Verify input image parameter
@@ -25,89 +218,97 @@ struct ImageOneChannel *apply_filter_greyscale(struct ImageRGB **inputImage) {
                 return NULL;
         }
 
-        // Initialize useful values
-        int width = (*inputImage)->width;
-        int height = (*inputImage)->height;
+        // Convert the RGB planes to greyscale
+        uint8_t *inputPlanes[3] = {(*inputImage)->redChannels, (*inputImage)->greenChannels, (*inputImage)->blueChannels};
+        apply_greyscale_planes(inputPlanes, outputImage->pixels, (*inputImage)->height, (*inputImage)->width, NULL);
 
-        // Grayscale channel weights (scaled to int16 for precision)
-        int16_t redWeight_int16 = (int16_t) (0.299 * 128);
-        int16_t greenWeight_int16 = (int16_t) (0.587 * 128);
-        int16_t blueWeight_int16 = (int16_t) (0.114 * 128);
+        // Free and nullify the input image struct
+        free_imageRGB(*inputImage); *inputImage = NULL; 
 
-        // Load weights into 256 bit AVX2 registers
-        __m256i redWeight_vec16i = _mm256_set1_epi16(redWeight_int16);
-        __m256i greenWeight_vec16i = _mm256_set1_epi16(greenWeight_int16);
-        __m256i blueWeight_vec16i = _mm256_set1_epi16(blueWeight_int16);
+        return outputImage;
 
-        // Parallelize the loop over image PIXELS in row-major order
-        #pragma omp parallel for schedule(static)
-        for (int pixelY = 0; pixelY < height; pixelY++) {
-                
-                int pixelX = 0;
-                for (; pixelX + 16 < width; pixelX += 16) {
-                        
-                        // Index in the channels/pixels array
-                        int index = (pixelY * width) + pixelX;
-
-                        // Load 16 pixels from each channel of type uint8 and convert to int16
-                        __m256i redChannels_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &(*inputImage)->redChannels[index]));
-                        __m256i greenChannels_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &(*inputImage)->greenChannels[index]));
-                        __m256i blueChannels_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &(*inputImage)->blueChannels[index]));
-
-                        // Perform the greycale operation
-                        __m256i greyscale_vec16i = _mm256_add_epi16(
-                                _mm256_add_epi16(
-                                        _mm256_mullo_epi16(redChannels_vec16i, redWeight_vec16i),
-                                        _mm256_mullo_epi16(greenChannels_vec16i, greenWeight_vec16i)
-                                ),
-                                _mm256_mullo_epi16(blueChannels_vec16i, blueWeight_vec16i)
-                        );
-
-                        // Normalize results by dividing greyscale values by 128 (right bitshift by 7)
-                        greyscale_vec16i = _mm256_srli_epi16(greyscale_vec16i, 7);
-
-                        // Convert int16 result values to clamped uint8 values
-                        greyscale_vec16i = _mm256_packus_epi16(greyscale_vec16i, 
-                                _mm256_permute2x128_si256(greyscale_vec16i, greyscale_vec16i, 0x11));
-                        
-                        // Extract the first 128 bits (16 uint8) from result vector and store into output image
-                        __m128i greyscale_vec8u = _mm256_extracti128_si256(greyscale_vec16i, 0);
-                        _mm_storeu_si128((__m128i*) &(outputImage->pixels[index]), greyscale_vec8u);
+}
 
+
+// Copies input planes into output planes through the point operations of an epilogue, in parallel over the rows (each
+// row is mapped while it is in the L1 cache)
+static void apply_point_op_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, int height, int width,
+        const struct PointOpEpilogue *epilogue) {
+
+        #pragma omp parallel for collapse(2) schedule(static)
+        for (int plane = 0; plane < numPlanes; plane++) {
+                for (int pixelY = 0; pixelY < height; pixelY++) {
+                        size_t index = (size_t) pixelY*width;
+                        memcpy(&outputPlanes[plane][index], &inputPlanes[plane][index], width);
+                        apply_point_op_epilogue_row(epilogue, &outputPlanes[plane][index], width);
                 }
+        }
 
-                // Process the remaining pixels
-                for (; pixelX < width; pixelX++) {
-                        
-                        int index = (pixelY * width) + pixelX;
+}
 
-                        int redChannel = (*inputImage)->redChannels[index];
-                        int greenChannel = (*inputImage)->greenChannels[index];
-                        int blueChannel = (*inputImage)->blueChannels[index];
 
-                        float greyscaleResult = 0.299*redChannel + 0.587*greenChannel + 0.114*blueChannel;
+// Runs one filter stage from input planes (three, or one for a greyscale image) into output planes, with the point
+// operations of the stage fused into its stores. Greyscale and sobel stages write only the first output plane, the other
+// stages as many planes as they read. Returns 0 on failure
+static int apply_filter_stage_planes(const struct FilterStage *stage, uint8_t **inputPlanes, int numPlanes, uint8_t **outputPlanes,
+        int height, int width, enum BorderMode borderMode) {
 
-                        if (greyscaleResult <= 0) {
-                                outputImage->pixels[index] = 0;
-                        } else if (greyscaleResult >= 255) {
-                                outputImage->pixels[index] = 255;
-                        } else {
-                                outputImage->pixels[index] = roundf(greyscaleResult);
-                        }
+        const struct PointOpEpilogue *epilogue = &stage->epilogue;
 
-                }
+        // Planned blurs (a radius or standard deviation, or the box blur of a general intensity)
+        if (stage->blurPlan.shape != BLUR_SHAPE_INVALID) {
+                return apply_blur_plan_planes(&stage->blurPlan, inputPlanes, outputPlanes, numPlanes, height, width, borderMode,
+                        epilogue);
+        }
 
+        // Point operations leading a chain have no stage to be fused into, they run as a pass of their own
+        if (stage->typeFilter >= FILTER_BRIGHTNESS && stage->typeFilter <= FILTER_THRESHOLD) {
+                apply_point_op_planes(inputPlanes, outputPlanes, numPlanes, height, width, epilogue);
+                return 1;
         }
 
-        // Free and nullify the input image struct
-        free_imageRGB(*inputImage); *inputImage = NULL; 
+        // A greyscale image is its own greyscale and its own luminance (the sobel pipeline reads it as three equal planes)
+        uint8_t *greyscalePlanes[3] = {inputPlanes[0], inputPlanes[0], inputPlanes[0]};
+        uint8_t **colourPlanes = (numPlanes == 1) ? greyscalePlanes : inputPlanes;
+        if (stage->typeFilter == FILTER_GREYSCALE) {
+                if (numPlanes == 1) {
+                        apply_point_op_planes(inputPlanes, outputPlanes, 1, height, width, epilogue);
+                } else {
+                        apply_greyscale_planes(inputPlanes, outputPlanes[0], height, width, epilogue);
+                }
+                return 1;
+        }
+        if (stage->typeFilter == FILTER_SOBEL_EDGE_DETECTION) {
+                return apply_sobel_pipeline(colourPlanes, outputPlanes[0], sobel_intensity_scale(stage->filterIntensity), height, width,
+                        borderMode, epilogue);
+        }
 
-        return outputImage;
+        // Get the filter's kernels from the registry (built once, shared by every call)
+        const struct KernelSet *kernelSet = get_registered_kernels(stage->typeFilter, stage->filterIntensity);
+        if (kernelSet == NULL) return 0;
+
+        // Gaussian blur kernels are rank-1 (separable), so run them through the two-pass separable pipeline which
+        // needs 2*size instead of size*size multiply-adds per channel. The other kernels run through the integer
+        // convolution pipeline, which works directly on the uint8 channels (16 or 32 channels per AVX2 register
+        // instead of 8 floats). The bokeh kernels are large and not separable, they run through the float convolution
+        // pipeline which hands them over to the FFT pipeline, as do kernels without a fixed-point form
+        if (stage->typeFilter == FILTER_GAUSSIAN_BLUR) {
+                return apply_separable_convolution_pipeline_planes(inputPlanes, outputPlanes, numPlanes, kernelSet->separableKernel,
+                        height, width, borderMode, epilogue);
+        } else if (stage->typeFilter == FILTER_DISC_BOKEH || stage->typeFilter == FILTER_HEXAGONAL_BOKEH ||
+                        kernelSet->fixedPointKernel == NULL) {
+                return apply_convolution_pipeline_planes(inputPlanes, outputPlanes, numPlanes, kernelSet->kernel, height, width, borderMode,
+                        epilogue);
+        } else {
+                return apply_fixed_point_convolution_pipeline_planes(inputPlanes, outputPlanes, numPlanes, kernelSet->fixedPointKernel,
+                        height, width, borderMode, epilogue);
+        }
 
 }
 
 
-struct ImageRGB *apply_filter_generic_convolution(struct ImageRGB **inputImage, enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity) {
+struct ImageRGB *apply_filter_generic_convolution(struct ImageRGB **inputImage, enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity,
+        enum BorderMode borderMode) {
 
         // Verify input image parameter
         if (inputImage == NULL || *inputImage == NULL || (*inputImage)->redChannels == NULL ||
@@ -117,6 +318,12 @@ struct ImageRGB *apply_filter_generic_convolution(struct ImageRGB **inputImage,
                 return NULL;
         }
 
+        // The box blur is planned like a box blur of any radius (usually on running sums, whose cost does not depend on
+        // the kernel size)
+        if (typeFilter == FILTER_BOX_BLUR) {
+                return apply_filter_box_blur(inputImage, box_blur_radius(filterIntensity), borderMode);
+        }
+
         // Create a blank Image struct for the output image
         struct ImageRGB *outputImage = load_empty_imageRGB((*inputImage)->width, (*inputImage)->height);
         if (outputImage == NULL) {
@@ -124,39 +331,95 @@ struct ImageRGB *apply_filter_generic_convolution(struct ImageRGB **inputImage,
                 return NULL;
         }
 
-        // Create the desired filter's convolution kernel
-        struct Kernel *kernel;
-        switch (typeFilter) {
-                case FILTER_GAUSSIAN_BLUR: kernel = create_gaussian_kernel(filterIntensity); break;
-                case FILTER_BOX_BLUR:      kernel = create_box_blur_kernel(filterIntensity); break;
-                case FILTER_EMBOSS:        kernel = create_emboss_kernel(filterIntensity);   break;
-                case FILTER_SHARPEN:       kernel = create_sharpen_kernel(filterIntensity);  break;
-        }
-        if (kernel == NULL) {
-                free_imageRGB(*inputImage); *inputImage = NULL; 
+        // Run the filter's kernels on the RGB planes
+        struct FilterStage stage;
+        init_filter_stage(&stage, typeFilter, filterIntensity, 0.0f, (*inputImage)->height, (*inputImage)->width, borderMode);
+        uint8_t *inputPlanes[3] = {(*inputImage)->redChannels, (*inputImage)->greenChannels, (*inputImage)->blueChannels};
+        uint8_t *outputPlanes[3] = {outputImage->redChannels, outputImage->greenChannels, outputImage->blueChannels};
+        int convolutionPipeline = apply_filter_stage_planes(&stage, inputPlanes, 3, outputPlanes, (*inputImage)->height,
+                (*inputImage)->width, borderMode);
+
+        // Free and nullify the input image struct (the registered kernels are kept)
+        free_imageRGB(*inputImage); *inputImage = NULL;
+        if (convolutionPipeline == 0) {
                 free_imageRGB(outputImage);
                 return NULL;
         }
 
-        // Apply the convolution pipeline to the input image and capture the result in the output image
-        int convolutionPipeline = apply_convolution_pipeline_RGB(*inputImage, outputImage, kernel);
-        if (convolutionPipeline == 0) {
+        return outputImage;
+
+}
+
+
+struct ImageRGB *apply_filter_blur(struct ImageRGB **inputImage, const struct BlurPlan *plan, enum BorderMode borderMode) {
+
+        // Verify input image parameter
+        if (inputImage == NULL || *inputImage == NULL || (*inputImage)->redChannels == NULL ||
+                        (*inputImage)->greenChannels == NULL || (*inputImage)->blueChannels == NULL ) {
+                fprintf(stderr, "\nFatal error: input image structure could not be processed in the blur filter.\n");
+                free_imageRGB(*inputImage); *inputImage = NULL;
+                return NULL;
+        }
+
+        // Create a blank Image struct for the output image
+        struct ImageRGB *outputImage = load_empty_imageRGB((*inputImage)->width, (*inputImage)->height);
+        if (outputImage == NULL) {
+                free_imageRGB(*inputImage); *inputImage = NULL;
+                return NULL;
+        }
+
+        // Run the planned blur backend on the input image and capture the result in the output image
+        int blur = apply_blur_plan_RGB(plan, *inputImage, outputImage, borderMode);
+        if (blur == 0) {
                 free_imageRGB(*inputImage); *inputImage = NULL; 
                 free_imageRGB(outputImage);
-                free_kernel(kernel); 
                 return NULL;
         }
 
-        // Free and nullify the input image struct, free the kernel struct
+        // Free and nullify the input image struct
         free_imageRGB(*inputImage); *inputImage = NULL; 
-        free_kernel(kernel);
 
         return outputImage;
 
 }
 
 
-struct ImageOneChannel *apply_filter_sobel_edge_detection(struct ImageRGB **inputImage, enum GeneralFilterIntensity filterIntensity) {
+// Plans a blur for the dimensions of the input image and applies it
+static struct ImageRGB *plan_and_apply_filter_blur(struct ImageRGB **inputImage, enum BlurShape shape, float strength,
+        enum BorderMode borderMode) {
+
+        if (inputImage == NULL || *inputImage == NULL) {
+                fprintf(stderr, "\nFatal error: input image structure could not be processed in the blur filter.\n");
+                return NULL;
+        }
+
+        struct BlurPlan plan = plan_blur(shape, strength, (*inputImage)->height, (*inputImage)->width, borderMode);
+        if (plan.shape == BLUR_SHAPE_INVALID) {
+                free_imageRGB(*inputImage); *inputImage = NULL;
+                return NULL;
+        }
+
+        return apply_filter_blur(inputImage, &plan, borderMode);
+
+}
+
+
+struct ImageRGB *apply_filter_gaussian_blur(struct ImageRGB **inputImage, float sigma, enum BorderMode borderMode) {
+
+        return plan_and_apply_filter_blur(inputImage, BLUR_SHAPE_GAUSSIAN, sigma, borderMode);
+
+}
+
+
+struct ImageRGB *apply_filter_box_blur(struct ImageRGB **inputImage, int radius, enum BorderMode borderMode) {
+
+        return plan_and_apply_filter_blur(inputImage, BLUR_SHAPE_BOX, (float) radius, borderMode);
+
+}
+
+
+struct ImageOneChannel *apply_filter_sobel_edge_detection(struct ImageRGB **inputImage, enum GeneralFilterIntensity filterIntensity,
+        enum BorderMode borderMode) {
 
         // Verify input image parameter
         if (inputImage == NULL || *inputImage == NULL || (*inputImage)->redChannels == NULL ||
@@ -170,137 +433,298 @@ struct ImageOneChannel *apply_filter_sobel_edge_detection(struct ImageRGB **inpu
         int width = (*inputImage)->width;
         int height = (*inputImage)->height;
 
-        // Create 2 blank temporary Image structs and one output blank image struct
+        // Create a blank output image struct (the fused pipeline needs no intermediate images)
         struct ImageOneChannel *outputImage = load_empty_imageOneChannel(width, height);
-        struct ImageOneChannel *tempImageOne = load_empty_imageOneChannel(width, height);
-        struct ImageOneChannel *tempImageTwo = load_empty_imageOneChannel(width, height);
-        if (outputImage == NULL || tempImageOne == NULL || tempImageTwo == NULL) {
+        if (outputImage == NULL) {
                 free_imageRGB(*inputImage); *inputImage = NULL;
-                free_imageOneChannel(outputImage); free_imageOneChannel(tempImageOne); free_imageOneChannel(tempImageTwo);
                 return NULL;
         }
 
-        // Apply the greyscale filter to the input RGB image, result will be an ImageOneChannel struct
-        // This function also takes care of freeing and nullifying the input image
-        struct ImageOneChannel *inputGreyscaleImage = apply_filter_greyscale(inputImage);
-        if (inputGreyscaleImage == NULL) {
-                free_imageOneChannel(outputImage); free_imageOneChannel(tempImageOne); free_imageOneChannel(tempImageTwo);
+        // Compute luminance, both sobel gradients and their magnitude in one pass over the tiles of the RGB planes
+        uint8_t *inputPlanes[3] = {(*inputImage)->redChannels, (*inputImage)->greenChannels, (*inputImage)->blueChannels};
+        int sobel = apply_sobel_pipeline(inputPlanes, outputImage->pixels, sobel_intensity_scale(filterIntensity), height, width,
+                borderMode, NULL);
+
+        // Free and nullify the input image struct
+        free_imageRGB(*inputImage); *inputImage = NULL;
+
+        if (sobel == 0) {
+                free_imageOneChannel(outputImage);
                 return NULL;
         }
 
-        // Create horizontal and vertical sobel kernels
-        struct Kernel *horizontalSobel = create_sobel_horizontal_kernel(filterIntensity);
-        struct Kernel *verticalSobel = create_sobel_vertical_kernel(filterIntensity);
-        if (horizontalSobel == NULL || verticalSobel == NULL) {
-                free_imageOneChannel(outputImage); free_imageOneChannel(tempImageOne); free_imageOneChannel(tempImageTwo);
-                free_imageOneChannel(inputGreyscaleImage);
-                free_kernel(horizontalSobel); free_kernel(verticalSobel);
-                return NULL;
+        return outputImage;
+
+}
+
+
+// Returns the point operation of a point operation filter (POINT_OP_INVALID for the other filters)
+static enum PointOpType point_op_of_filter(enum TypeFilter typeFilter) {
+
+        switch (typeFilter) {
+                case FILTER_BRIGHTNESS:         return POINT_OP_BRIGHTNESS;
+                case FILTER_CONTRAST:           return POINT_OP_CONTRAST;
+                case FILTER_GAMMA:              return POINT_OP_GAMMA;
+                case FILTER_THRESHOLD:          return POINT_OP_THRESHOLD;
+                default:                        return POINT_OP_INVALID;
         }
 
-        // Apply the horizontalSobel Kernel to the greyscaleInputImage and save results into tempImageOne
-        int horizontalConvolution = apply_convolution_pipeline_channel(inputGreyscaleImage->pixels, tempImageOne->pixels,
-                horizontalSobel, height, width);
-        if (horizontalConvolution == 0) {
-                free_imageOneChannel(outputImage); free_imageOneChannel(tempImageOne); free_imageOneChannel(tempImageTwo);
-                free_imageOneChannel(inputGreyscaleImage);
-                free_kernel(horizontalSobel); free_kernel(verticalSobel);
-                return NULL;
+}
+
+
+int init_filter_stage(struct FilterStage *stage, enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity,
+        float strength, int imageHeight, int imageWidth, enum BorderMode borderMode) {
+
+        stage->typeFilter = typeFilter;
+        stage->filterIntensity = filterIntensity;
+        stage->blurPlan = (struct BlurPlan) {BLUR_SHAPE_INVALID, 0.0f, 0, BLUR_BACKEND_DIRECT, 0.0};
+        init_point_op_epilogue(&stage->epilogue);
+
+        // Plan the blurs of a given strength, and the box blurs of a general intensity (like apply_filter_generic_convolution)
+        if (typeFilter == FILTER_BOX_BLUR) {
+                float radius = (strength > 0.0f) ? strength : (float) box_blur_radius(filterIntensity);
+                stage->blurPlan = plan_blur(BLUR_SHAPE_BOX, radius, imageHeight, imageWidth, borderMode);
+                return stage->blurPlan.shape != BLUR_SHAPE_INVALID;
         }
-        
-        // Apply the verticalSobel Kernel to the greyscaleInputImage and save results into tempImageTwo
-        int verticalConvolution = apply_convolution_pipeline_channel(inputGreyscaleImage->pixels, tempImageTwo->pixels,
-                verticalSobel, height, width);
-        if (verticalConvolution == 0) {
-                free_imageOneChannel(outputImage); free_imageOneChannel(tempImageOne); free_imageOneChannel(tempImageTwo);
-                free_imageOneChannel(inputGreyscaleImage);
-                free_kernel(horizontalSobel); free_kernel(verticalSobel);
-                return NULL;
+        if (typeFilter == FILTER_GAUSSIAN_BLUR && strength > 0.0f) {
+                stage->blurPlan = plan_blur(BLUR_SHAPE_GAUSSIAN, strength, imageHeight, imageWidth, borderMode);
+                return stage->blurPlan.shape != BLUR_SHAPE_INVALID;
         }
 
-        // Combine the effects of each sobel kernel
-        #pragma omp parallel for schedule(static)
-        for (int y = 0; y < height; y++) {
-
-                int x = 0;
-                for (; x + 16 < width; x += 16) {
-
-                        // Index in the pixels array
-                        int index = (y * width) + x;
-
-                        // Load 16 pixels, of type uint8, from each tempImage and convert to int16
-                        __m256i tempOnePixels_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &(tempImageOne->pixels[index])));
-                        __m256i tempTwoPixels_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &(tempImageTwo->pixels[index])));
-
-                        // Extract first 8 pixels (currently int16) and convert to precision-single floating point for each tempImage
-                        __m256i tempOnePixelsFirstEight_32i = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(tempOnePixels_vec16i, 0));
-                        __m256i tempTwoPixelsFirstEight_32i = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(tempTwoPixels_vec16i, 0));
-                        __m256 tempOnePixelsFirstEight_ps = _mm256_cvtepi32_ps(tempOnePixelsFirstEight_32i);
-                        __m256 tempTwoPixelsFirstEight_ps = _mm256_cvtepi32_ps(tempTwoPixelsFirstEight_32i);
-
-                        // Extract last 8 pixels (currently int16) and convert to precision-single floating point for each tempImage
-                        __m256i tempOnePixelsLastEight_32i = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(tempOnePixels_vec16i, 1));
-                        __m256i tempTwoPixelsLastEight_32i = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(tempTwoPixels_vec16i, 1));
-                        __m256 tempOnePixelsLastEight_ps = _mm256_cvtepi32_ps(tempOnePixelsLastEight_32i);
-                        __m256 tempTwoPixelsLastEight_ps = _mm256_cvtepi32_ps(tempTwoPixelsLastEight_32i);
-
-                        // Perform the "magnitude" operation for each group of 8 pixels (currently precision-single floating point)
-                        __m256 lowerHalf_ps = _mm256_sqrt_ps(
-                                _mm256_add_ps(
-                                        _mm256_mul_ps(tempOnePixelsFirstEight_ps, tempOnePixelsFirstEight_ps),
-                                        _mm256_mul_ps(tempTwoPixelsFirstEight_ps, tempTwoPixelsFirstEight_ps)
-                                )
-                        );
-                        __m256 upperHalf_ps = _mm256_sqrt_ps(
-                                _mm256_add_ps(
-                                        _mm256_mul_ps(tempOnePixelsLastEight_ps, tempOnePixelsLastEight_ps),
-                                        _mm256_mul_ps(tempTwoPixelsLastEight_ps, tempTwoPixelsLastEight_ps)
-                                )
-                        );
-
-                        // Convert each half from precision-single floating point to int32 and clamp
-                        __m256i lowerHalf_32i = _mm256_cvtps_epi32(lowerHalf_ps);
-                        lowerHalf_32i = _mm256_min_epi32(_mm256_max_epi32(lowerHalf_32i, _mm256_set1_epi32(0)), _mm256_set1_epi32(255));
-                        __m256i upperHalf_32i = _mm256_cvtps_epi32(upperHalf_ps);
-                        upperHalf_32i = _mm256_min_epi32(_mm256_max_epi32(upperHalf_32i, _mm256_set1_epi32(0)), _mm256_set1_epi32(255));
-
-                        // Convert each half from int32 to int16 values
-                        __m128i lowerHalf_16i = _mm256_extracti128_si256(_mm256_packus_epi32(lowerHalf_32i, _mm256_permute2x128_si256(lowerHalf_32i, lowerHalf_32i, 0x11)), 0);
-                        __m128i upperHalf_16i = _mm256_extracti128_si256(_mm256_packus_epi32(upperHalf_32i, _mm256_permute2x128_si256(upperHalf_32i, upperHalf_32i, 0x11)), 0);
-
-                         // Combine halves, convert result to clamped uint8 values, and store into output image
-                        __m256i result_16i = _mm256_insertf128_si256(_mm256_castsi128_si256(lowerHalf_16i), upperHalf_16i, 1);
-                        __m128i result_8u = _mm256_extracti128_si256(_mm256_packus_epi16(result_16i, _mm256_permute2x128_si256(result_16i, result_16i, 0x11)), 0);
-                        _mm_storeu_si128((__m128i*) &(outputImage->pixels[index]), result_8u);
-                                
-                }
+        // A point operation stage is its own epilogue
+        enum PointOpType pointOp = point_op_of_filter(typeFilter);
+        if (pointOp != POINT_OP_INVALID) return append_point_op(&stage->epilogue, pointOp, strength);
+
+        return typeFilter != FILTER_INVALID && filterIntensity != FILTER_INTENSITY_INVALID;
+
+}
 
-                // Process remaining pixels in row
-                for (; x < width; x++) {
 
-                        int index = y * width + x;
+int add_filter_chain_stage(struct FilterChain *filterChain, enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity,
+        float strength, int imageHeight, int imageWidth, enum BorderMode borderMode) {
+
+        // Fuse a point operation into the epilogue of the previous stage
+        enum PointOpType pointOp = point_op_of_filter(typeFilter);
+        if (pointOp != POINT_OP_INVALID && filterChain->numStages > 0) {
+                return append_point_op(&filterChain->stages[filterChain->numStages - 1].epilogue, pointOp, strength);
+        }
+
+        if (filterChain->numStages >= FILTER_CHAIN_MAX_STAGES) {
+                fprintf(stderr, "\nFatal error: a filter chain must have 1 to %d stages.\n", FILTER_CHAIN_MAX_STAGES);
+                return 0;
+        }
+        if (!init_filter_stage(&filterChain->stages[filterChain->numStages], typeFilter, filterIntensity, strength, imageHeight,
+                        imageWidth, borderMode)) {
+                return 0;
+        }
+        filterChain->numStages++;
+        return 1;
+
+}
+
+
+int apply_filter_chain(struct ImageRGB **inputImage, const struct FilterChain *filterChain, enum BorderMode borderMode,
+        struct ImageRGB **outputImageRGB, struct ImageOneChannel **outputImageOneChannel) {
+
+        *outputImageRGB = NULL;
+        *outputImageOneChannel = NULL;
+
+        // Verify input image and filter chain parameters
+        if (inputImage == NULL || *inputImage == NULL || (*inputImage)->redChannels == NULL ||
+                        (*inputImage)->greenChannels == NULL || (*inputImage)->blueChannels == NULL ) {
+                fprintf(stderr, "\nFatal error: input image structure could not be processed in the filter chain.\n");
+                if (inputImage != NULL) {
+                        free_imageRGB(*inputImage); *inputImage = NULL;
+                }
+                return 0;
+        }
+        if (filterChain->numStages < 1 || filterChain->numStages > FILTER_CHAIN_MAX_STAGES) {
+                fprintf(stderr, "\nFatal error: a filter chain must have 1 to %d stages.\n", FILTER_CHAIN_MAX_STAGES);
+                free_imageRGB(*inputImage); *inputImage = NULL;
+                return 0;
+        }
+
+        // Initialize useful values
+        int width = (*inputImage)->width;
+        int height = (*inputImage)->height;
 
-                        int magnitude = sqrt(pow(tempImageOne->pixels[index], 2) + pow(tempImageTwo->pixels[index], 2));
+        // The stages alternate between two RGB images: the input image and one more, allocated by the first stage. A
+        // greyscale image (after a greyscale or sobel stage) only uses the first plane of an RGB image, except for the
+        // result of the last stage which is written straight into the one channel output image
+        struct ImageRGB *currentImage = *inputImage; *inputImage = NULL;
+        struct ImageRGB *otherImage = NULL;
+        struct ImageOneChannel *greyscaleImage = NULL;
+        int numPlanes = 3;
+        for (int i = 0; i < filterChain->numStages; i++) {
+
+                const struct FilterStage *stage = &filterChain->stages[i];
+                int reducesToGreyscale = (stage->typeFilter == FILTER_GREYSCALE || stage->typeFilter == FILTER_SOBEL_EDGE_DETECTION);
+                int lastStage = (i == filterChain->numStages - 1);
+
+                // Pick the output planes of the stage
+                uint8_t *outputPlanes[3];
+                if (lastStage && (reducesToGreyscale || numPlanes == 1)) {
+                        greyscaleImage = load_empty_imageOneChannel(width, height);
+                        if (greyscaleImage == NULL) break;
+                        outputPlanes[0] = greyscaleImage->pixels;
+                } else {
+                        if (otherImage == NULL) otherImage = load_empty_imageRGB(width, height);
+                        if (otherImage == NULL) break;
+                        outputPlanes[0] = otherImage->redChannels;
+                        outputPlanes[1] = otherImage->greenChannels;
+                        outputPlanes[2] = otherImage->blueChannels;
+                }
 
-                        if (magnitude <= 0) {
-                                outputImage->pixels[index] = 0;
-                        } else if (magnitude >= 255) {
-                                outputImage->pixels[index] = 255;
-                        } else {
-                                outputImage->pixels[index] = roundf(magnitude);
-                        }
+                // Run the stage, then swap the images (the output of the stage is the input of the next one)
+                uint8_t *inputPlanes[3] = {currentImage->redChannels, currentImage->greenChannels, currentImage->blueChannels};
+                if (!apply_filter_stage_planes(stage, inputPlanes, numPlanes, outputPlanes, height, width, borderMode)) {
+                        if (greyscaleImage != NULL) free_imageOneChannel(greyscaleImage);
+                        break;
+                }
+                if (reducesToGreyscale) numPlanes = 1;
+                if (greyscaleImage == NULL) {
+                        struct ImageRGB *swapImage = currentImage;
+                        currentImage = otherImage;
+                        otherImage = swapImage;
+                }
+                if (lastStage) {
+                        *outputImageOneChannel = greyscaleImage;
+                        *outputImageRGB = (greyscaleImage == NULL) ? currentImage : NULL;
                 }
+        }
+
+        // Free the images that are not the output image
+        if (*outputImageRGB != currentImage) free_imageRGB(currentImage);
+        if (otherImage != NULL) free_imageRGB(otherImage);
+
+        return *outputImageRGB != NULL || *outputImageOneChannel != NULL;
 
+}
+
+
+// Returns the rows above and below an output row that a stage reads (the halo of its strips), or -1 for an invalid stage
+static int filter_stage_halo(const struct FilterStage *stage) {
+
+        // Planned blurs reach half their kernel. The recursive gaussian reaches the whole image, but its response falls
+        // below half a level within the kernel size (six standard deviations), so cutting it there only moves the rounding
+        // of some channels by 1 level
+        if (stage->blurPlan.shape != BLUR_SHAPE_INVALID) {
+                if (stage->blurPlan.backend == BLUR_BACKEND_IIR) return stage->blurPlan.kernelSize;
+                return stage->blurPlan.kernelSize / 2;
         }
 
-        // Free all structs
-        free_imageOneChannel(tempImageOne); free_imageOneChannel(tempImageTwo);
-        free_imageOneChannel(inputGreyscaleImage);
-        free_kernel(horizontalSobel); free_kernel(verticalSobel);
+        switch (stage->typeFilter) {
+                case FILTER_GREYSCALE:
+                case FILTER_BRIGHTNESS:
+                case FILTER_CONTRAST:
+                case FILTER_GAMMA:
+                case FILTER_THRESHOLD:
+                        return 0;
+                case FILTER_SOBEL_EDGE_DETECTION:
+                        return 1;
+                default:
+                        break;
+        }
 
-        return outputImage;
+        const struct KernelSet *kernelSet = get_registered_kernels(stage->typeFilter, stage->filterIntensity);
+        if (kernelSet == NULL) return -1;
+        return kernelSet->kernel->size / 2;
 
 }
 
 
+int apply_filter_chain_streaming(struct ImageStream *inputStream, int height, int width, const char *outputPath,
+        ImageFileType outputFileType, const struct FilterChain *filterChain, enum BorderMode borderMode, int stripHeight) {
 
+        // Verify the parameters
+        if (filterChain->numStages < 1 || filterChain->numStages > FILTER_CHAIN_MAX_STAGES) {
+                fprintf(stderr, "\nFatal error: a filter chain must have 1 to %d stages.\n", FILTER_CHAIN_MAX_STAGES);
+                return 0;
+        }
+        if (borderMode == BORDER_MODE_WRAP) {
+                fprintf(stderr, "\nFatal error: the wrap border mode reads the opposite edge of the image and cannot be streamed.\n");
+                return 0;
+        }
+
+        // Sum the halos of the stages: an output row depends on the input rows that far above and below it. Every stage
+        // corrupts its own halo at the inner edges of a strip, so strips read with the total halo on both sides give exact
+        // output rows. Determine the planes of the output at the same time
+        int halo = 0;
+        int outputNumPlanes = 3;
+        for (int i = 0; i < filterChain->numStages; i++) {
+                int stageHalo = filter_stage_halo(&filterChain->stages[i]);
+                if (stageHalo < 0) return 0;
+                halo += stageHalo;
+                enum TypeFilter typeFilter = filterChain->stages[i].typeFilter;
+                if (typeFilter == FILTER_GREYSCALE || typeFilter == FILTER_SOBEL_EDGE_DETECTION) outputNumPlanes = 1;
+        }
+        if (stripHeight <= 0) stripHeight = FILTER_STREAM_STRIP_ROWS;
+        if (stripHeight < 2*halo) stripHeight = 2*halo;  // Recompute fewer halo rows than the strip outputs
+        if (stripHeight > height) stripHeight = height;
+
+        // The strip buffers hold the output rows of a strip and the halo on both sides: the input rows (kept between strips,
+        // the halo of the next strip is carried over instead of being read again) and two work buffers for the stages
+        int bufferRows = (stripHeight + 2*halo < height) ? stripHeight + 2*halo : height;
+        struct ImageRGB *inputRows = load_empty_imageRGB(width, bufferRows);
+        struct ImageRGB *workRows[2] = {load_empty_imageRGB(width, bufferRows), load_empty_imageRGB(width, bufferRows)};
+        struct ImageStream *outputStream = open_image_write_stream(outputPath, outputFileType, width, height, outputNumPlanes);
+        int streamed = (inputRows != NULL && workRows[0] != NULL && workRows[1] != NULL && outputStream != NULL);
+
+        // Rows [loadedStart, loadedEnd) of the image are in the input buffer
+        int loadedStart = 0, loadedEnd = 0;
+        for (int outputStart = 0; streamed && outputStart < height; outputStart += stripHeight) {
+
+                int outputEnd = (outputStart + stripHeight < height) ? outputStart + stripHeight : height;
+                int stripStart = (outputStart - halo > 0) ? outputStart - halo : 0;
+                int stripEnd = (outputEnd + halo < height) ? outputEnd + halo : height;
+                int stripRows = stripEnd - stripStart;
+
+                // Carry the rows shared with the previous strip to the front of the input buffer, then read the new rows
+                uint8_t *inputPlanes[3] = {inputRows->redChannels, inputRows->greenChannels, inputRows->blueChannels};
+                int carriedRows = loadedEnd - stripStart;
+                for (int plane = 0; plane < 3 && carriedRows > 0; plane++) {
+                        memmove(inputPlanes[plane], &inputPlanes[plane][(size_t) (stripStart - loadedStart)*width], (size_t) carriedRows*width);
+                }
+                if (carriedRows < 0) carriedRows = 0;
+                uint8_t *readPlanes[3];
+                for (int plane = 0; plane < 3; plane++) readPlanes[plane] = &inputPlanes[plane][(size_t) carriedRows*width];
+                if (!read_image_stream_rows(inputStream, stripRows - carriedRows, readPlanes, 3)) {
+                        streamed = 0;
+                        break;
+                }
+                loadedStart = stripStart;
+                loadedEnd = stripEnd;
+
+                // Run the stages on the strip, alternating between the work buffers (the strip is an image of its own, whose
+                // top and bottom edges are the edges of the image or at least the remaining halo away from the output rows)
+                uint8_t **currentPlanes = inputPlanes;
+                uint8_t *workPlanes[2][3];
+                int numPlanes = 3;
+                for (int i = 0; i < filterChain->numStages && streamed; i++) {
+                        const struct FilterStage *stage = &filterChain->stages[i];
+                        struct ImageRGB *stageRows = workRows[i % 2];
+                        workPlanes[i % 2][0] = stageRows->redChannels;
+                        workPlanes[i % 2][1] = stageRows->greenChannels;
+                        workPlanes[i % 2][2] = stageRows->blueChannels;
+                        streamed = apply_filter_stage_planes(stage, currentPlanes, numPlanes, workPlanes[i % 2], stripRows, width, borderMode);
+                        if (stage->typeFilter == FILTER_GREYSCALE || stage->typeFilter == FILTER_SOBEL_EDGE_DETECTION) numPlanes = 1;
+                        currentPlanes = workPlanes[i % 2];
+                }
+
+                // Hand the output rows of the strip over to the output file
+                uint8_t *outputPlanes[3];
+                for (int plane = 0; plane < numPlanes; plane++) {
+                        outputPlanes[plane] = &currentPlanes[plane][(size_t) (outputStart - stripStart)*width];
+                }
+                if (streamed) streamed = write_image_stream_rows(outputStream, outputEnd - outputStart, outputPlanes);
+        }
+
+        // Free the strip buffers and close the output file
+        if (inputRows != NULL) free_imageRGB(inputRows);
+        if (workRows[0] != NULL) free_imageRGB(workRows[0]);
+        if (workRows[1] != NULL) free_imageRGB(workRows[1]);
+        close_image_stream(outputStream);
+
+        return streamed;
+
+}
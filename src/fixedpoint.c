@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  // For memset() and memcpy()
+#include <math.h>  // For lround() and fabs()
+#include <stdint.h>  // For types uint8_t, int16_t and int32_t
+#include <immintrin.h>  // For AVX2 intrinsics
+#include <omp.h>  // For multithreading
+#include "image.h"
+#include "pool.h"
+#include "convolution.h"
+#include "fixedpoint.h"
+#include "tuning.h"
+#include "cpu.h"
+
+
+
+// Extra columns at the end of each padded tile row so that the last (partial) vector of a row can be loaded
+#define FIXED_POINT_ROW_SLACK 32
+
+
+
+// Quantizes the kernel entries with `shift` fractional bits. Returns the sum of absolute quantized entries and
+// captures the largest absolute quantized entry and the total absolute quantization error
+static long quantize_entries(const struct Kernel *kernel, int shift, int16_t *entries, long *maxEntry, double *quantizationError) {
+
+        double scale = (double) (1L << shift);
+        long sumEntries = 0;
+        *maxEntry = 0;
+        *quantizationError = 0.0;
+
+        for (int i = 0; i < kernel->size*kernel->size; i++) {
+                long quantized = lround(kernel->entries[i] * scale);
+                long absQuantized = (quantized < 0) ? -quantized : quantized;
+                if (absQuantized > *maxEntry) *maxEntry = absQuantized;
+                sumEntries += absQuantized;
+                *quantizationError += fabs(kernel->entries[i] - quantized / scale);
+
+                // Only store entries that fit into int16 (callers reject the shift otherwise)
+                if (absQuantized <= INT16_MAX) entries[i] = (int16_t) quantized;
+        }
+
+        return sumEntries;
+
+}
+
+
+// Fills the entry pairs of the vector row functions: entry (j, i) and entry (j + 1, i) of every pair of kernel rows (an odd
+// last kernel row is paired with zero), interleaved as int8 (repeated twice) or as int16 values in an int32. Frees the
+// kernel and returns NULL on failure
+static struct FixedPointKernel *interleave_entry_pairs(struct FixedPointKernel *kernel) {
+
+        int kernelSize = kernel->size;
+        int numRowPairs = (kernelSize + 1) / 2;
+        kernel->entryPairs = (int32_t*)malloc((numRowPairs*kernelSize)*sizeof(int32_t));
+        if (kernel->entryPairs == NULL) {
+                free(kernel->entries);
+                free(kernel);
+                fprintf(stderr, "\nFatal error: could not allocate memory for kernel structure.\n");
+                return NULL;
+        }
+
+        for (int pair = 0; pair < numRowPairs; pair++) {
+                int j = 2*pair;
+                for (int i = 0; i < kernelSize; i++) {
+                        int entryA = kernel->entries[j*kernelSize + i];
+                        int entryB = (j + 1 < kernelSize) ? kernel->entries[(j + 1)*kernelSize + i] : 0;
+                        uint32_t entryPair;
+                        if (kernel->useBytes) {
+                                entryPair = (uint32_t) (entryA & 0xFF) | ((uint32_t) (entryB & 0xFF) << 8);
+                                entryPair |= entryPair << 16;
+                        } else {
+                                entryPair = (uint32_t) (entryA & 0xFFFF) | ((uint32_t) entryB << 16);
+                        }
+                        kernel->entryPairs[pair*kernelSize + i] = (int32_t) entryPair;
+                }
+        }
+
+        return kernel;
+
+}
+
+
+struct FixedPointKernel *create_fixed_point_kernel(const struct Kernel *kernel) {
+
+        // Create a FixedPointKernel struct and initialize size field
+        struct FixedPointKernel *fixedKernel = (struct FixedPointKernel*)malloc(sizeof(struct FixedPointKernel));
+        if (fixedKernel == NULL) {
+                fprintf(stderr, "\nFatal error: could not allocate memory for kernel structure.\n");
+		return NULL;
+        }
+        fixedKernel->size = kernel->size;
+
+        // Allocate memory for the entries array
+        fixedKernel->entries = (int16_t*)malloc((kernel->size*kernel->size)*sizeof(int16_t));
+        if (fixedKernel->entries == NULL) {
+                free(fixedKernel);
+                fprintf(stderr, "\nFatal error: could not allocate memory for kernel structure.\n");
+		return NULL;
+        }
+
+        long maxEntry;
+        double quantizationError;
+        fixedKernel->entryPairs = NULL;
+
+        // 8-bit path: the largest shift for which int8 entries can be used by maddubs without saturating pairs, and
+        // for which int16 accumulators cannot overflow (sum of absolute entries * 255 <= INT16_MAX). Only used when
+        // the quantization error cannot move a result by more than half a channel level
+        for (int shift = 7; shift >= 0; shift--) {
+                long sumEntries = quantize_entries(kernel, shift, fixedKernel->entries, &maxEntry, &quantizationError);
+                if (sumEntries <= 128 && maxEntry <= 127) {
+                        fixedKernel->shift = shift;
+                        fixedKernel->useBytes = (quantizationError*255.0 <= 0.5);
+                        break;
+                }
+                fixedKernel->useBytes = 0;
+        }
+        if (fixedKernel->useBytes) return interleave_entry_pairs(fixedKernel);
+
+        // 16-bit path: the largest shift for which entries fit into int16 and int32 accumulators cannot overflow
+        for (int shift = 24; shift >= 0; shift--) {
+                long sumEntries = quantize_entries(kernel, shift, fixedKernel->entries, &maxEntry, &quantizationError);
+                if (maxEntry <= INT16_MAX && (double) sumEntries*255.0 + (double) (1L << shift) <= (double) INT32_MAX) {
+                        fixedKernel->shift = shift;
+                        return interleave_entry_pairs(fixedKernel);
+                }
+        }
+
+        // Kernel entries too large to be represented in int16
+        free(fixedKernel->entries);
+        free(fixedKernel);
+        fprintf(stderr, "\nFatal error: kernel entries cannot be represented in fixed-point.\n");
+        return NULL;
+
+}
+
+
+void free_fixed_point_kernel(struct FixedPointKernel *kernel) {
+        free(kernel->entryPairs);
+        free(kernel->entries);
+        free(kernel);
+}
+
+
+
+// Copies the rows of a tile (including the halo) into a padded uint8 buffer, so that the inner loops never check image
+// bounds. The halo outside of the image is sampled according to the border mode
+static void fill_padded_tile(uint8_t *inputChannels, int imageHeight, int imageWidth, int yStart, int xStart, int rows,
+        int rowLength, int stride, enum BorderMode borderMode, uint8_t *paddedTile) {
+
+        for (int row = 0; row < rows; row++) {
+
+                int y = map_border_index(yStart + row, imageHeight, borderMode);
+                uint8_t *paddedRow = &paddedTile[row*stride];
+
+                // Zero-padded rows outside of the image
+                if (y < 0) {
+                        memset(paddedRow, 0, stride);
+                        continue;
+                }
+
+                // Copy the row with its horizontal halo, the row slack is only read by discarded output channels
+                fill_padded_row(&inputChannels[(size_t) y*imageWidth], imageWidth, xStart, rowLength, borderMode, paddedRow);
+                memset(&paddedRow[rowLength], 0, stride - rowLength);
+        }
+
+}
+
+
+// Computes `width` output channels of a row of the padded tile (the row of the first kernel entry is `row`)
+typedef void (*FixedPointRowFunction)(const struct FixedPointKernel *kernel, uint8_t *paddedTile, int stride, uint8_t *zeroRow, int row,
+        uint8_t *outputRow, int width);
+
+
+// Scalar version: exact int32 sums, same rounding and clamping as the vector epilogues (so the results are identical)
+static void convolve_row_scalar(const struct FixedPointKernel *kernel, uint8_t *paddedTile, int stride, uint8_t *zeroRow, int row,
+        uint8_t *outputRow, int width) {
+
+        (void) zeroRow;
+        int kernelSize = kernel->size;
+        int32_t half = (kernel->shift > 0) ? (1 << (kernel->shift - 1)) : 0;
+
+        for (int channel = 0; channel < width; channel++) {
+
+                int32_t sum = 0;
+                for (int j = 0; j < kernelSize; j++) {
+                        uint8_t *tileRow = &paddedTile[(row + j)*stride + channel];
+                        for (int i = 0; i < kernelSize; i++) {
+                                sum += kernel->entries[j*kernelSize + i] * tileRow[i];
+                        }
+                }
+
+                // Round half up, shift out the fractional bits and clamp to uint8
+                int32_t result = (sum + half) >> kernel->shift;
+                outputRow[channel] = (result < 0) ? 0 : (result > 255) ? 255 : (uint8_t) result;
+        }
+
+}
+
+
+// Computes the output channels of a row 32 at a time with int8 entries: each pair of kernel rows is interleaved byte-wise
+// so that maddubs multiplies and adds both rows at once, results are accumulated in int16. The entry pairs are broadcast
+// once per row into `entryPairs_vec8i`
+CPU_TARGET_AVX2
+CPU_ALWAYS_INLINE void convolve_row_bytes_body(const struct FixedPointKernel *kernel, int kernelSize, __m256i *entryPairs_vec8i,
+        uint8_t *paddedTile, int stride, uint8_t *zeroRow, int row, uint8_t *outputRow, int width) {
+
+        int numRowPairs = (kernelSize + 1) / 2;
+        for (int k = 0; k < numRowPairs*kernelSize; k++) entryPairs_vec8i[k] = _mm256_set1_epi32(kernel->entryPairs[k]);
+
+        for (int x = 0; x < width; x += 32) {
+
+                __m256i sumLower_vec16i = _mm256_setzero_si256();  // Channels 0-7 and 16-23
+                __m256i sumUpper_vec16i = _mm256_setzero_si256();  // Channels 8-15 and 24-31
+
+                for (int pair = 0; pair < numRowPairs; pair++) {
+
+                        // Rows of the kernel row pair (an odd last kernel row is paired with a zero row)
+                        int j = 2*pair;
+                        uint8_t *rowA = &paddedTile[(row + j)*stride + x];
+                        uint8_t *rowB = (j + 1 < kernelSize) ? &paddedTile[(row + j + 1)*stride + x] : zeroRow;
+
+                        #pragma GCC unroll 19
+                        for (int i = 0; i < kernelSize; i++) {
+
+                                // Load 32 channels of each row and interleave them byte-wise
+                                __m256i channelsA_vec8u = _mm256_loadu_si256((__m256i*) &rowA[i]);
+                                __m256i channelsB_vec8u = _mm256_loadu_si256((__m256i*) &rowB[i]);
+                                __m256i lower_vec8u = _mm256_unpacklo_epi8(channelsA_vec8u, channelsB_vec8u);
+                                __m256i upper_vec8u = _mm256_unpackhi_epi8(channelsA_vec8u, channelsB_vec8u);
+
+                                // Multiply uint8 channels by int8 entries and add adjacent pairs into int16
+                                __m256i entries_vec8i = entryPairs_vec8i[pair*kernelSize + i];
+                                sumLower_vec16i = _mm256_add_epi16(sumLower_vec16i, _mm256_maddubs_epi16(lower_vec8u, entries_vec8i));
+                                sumUpper_vec16i = _mm256_add_epi16(sumUpper_vec16i, _mm256_maddubs_epi16(upper_vec8u, entries_vec8i));
+                        }
+                }
+
+                // Rounding epilogue: add half and shift out the fractional bits (round half up, same as roundf for positive results)
+                if (kernel->shift > 0) {
+                        __m256i half_vec16i = _mm256_set1_epi16((int16_t) (1 << (kernel->shift - 1)));
+                        sumLower_vec16i = _mm256_srai_epi16(_mm256_add_epi16(sumLower_vec16i, half_vec16i), kernel->shift);
+                        sumUpper_vec16i = _mm256_srai_epi16(_mm256_add_epi16(sumUpper_vec16i, half_vec16i), kernel->shift);
+                }
+
+                // Saturation epilogue: pack int16 -> uint8 with clamping (the unpack order is restored by the pack)
+                __m256i result_vec8u = _mm256_packus_epi16(sumLower_vec16i, sumUpper_vec16i);
+
+                // Store all 32 channels at once, or only the remaining channels at the end of a row
+                if (width - x >= 32) {
+                        _mm256_storeu_si256((__m256i*) &outputRow[x], result_vec8u);
+                } else {
+                        uint8_t tempArray[32];
+                        _mm256_storeu_si256((__m256i*) tempArray, result_vec8u);
+                        memcpy(&outputRow[x], tempArray, width - x);
+                }
+        }
+
+}
+
+
+// Computes the output channels of a row 16 at a time with int16 entries: each pair of kernel rows is interleaved word-wise
+// so that madd multiplies and adds both rows at once, results are accumulated in int32. The entry pairs are broadcast
+// once per row into `entryPairs_vec16i`
+CPU_TARGET_AVX2
+CPU_ALWAYS_INLINE void convolve_row_words_body(const struct FixedPointKernel *kernel, int kernelSize, __m256i *entryPairs_vec16i,
+        uint8_t *paddedTile, int stride, uint8_t *zeroRow, int row, uint8_t *outputRow, int width) {
+
+        int numRowPairs = (kernelSize + 1) / 2;
+        for (int k = 0; k < numRowPairs*kernelSize; k++) entryPairs_vec16i[k] = _mm256_set1_epi32(kernel->entryPairs[k]);
+
+        for (int x = 0; x < width; x += 16) {
+
+                __m256i sumLower_vec32i = _mm256_setzero_si256();  // Channels 0-3 and 8-11
+                __m256i sumUpper_vec32i = _mm256_setzero_si256();  // Channels 4-7 and 12-15
+
+                for (int pair = 0; pair < numRowPairs; pair++) {
+
+                        // Rows of the kernel row pair (an odd last kernel row is paired with a zero row)
+                        int j = 2*pair;
+                        uint8_t *rowA = &paddedTile[(row + j)*stride + x];
+                        uint8_t *rowB = (j + 1 < kernelSize) ? &paddedTile[(row + j + 1)*stride + x] : zeroRow;
+
+                        #pragma GCC unroll 19
+                        for (int i = 0; i < kernelSize; i++) {
+
+                                // Load 16 channels of each row, convert to int16 and interleave them word-wise
+                                __m256i channelsA_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &rowA[i]));
+                                __m256i channelsB_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &rowB[i]));
+                                __m256i lower_vec16i = _mm256_unpacklo_epi16(channelsA_vec16i, channelsB_vec16i);
+                                __m256i upper_vec16i = _mm256_unpackhi_epi16(channelsA_vec16i, channelsB_vec16i);
+
+                                // Multiply int16 channels by int16 entries and add adjacent pairs into int32
+                                __m256i entries_vec16i = entryPairs_vec16i[pair*kernelSize + i];
+                                sumLower_vec32i = _mm256_add_epi32(sumLower_vec32i, _mm256_madd_epi16(lower_vec16i, entries_vec16i));
+                                sumUpper_vec32i = _mm256_add_epi32(sumUpper_vec32i, _mm256_madd_epi16(upper_vec16i, entries_vec16i));
+                        }
+                }
+
+                // Rounding epilogue: add half and shift out the fractional bits (round half up, same as roundf for positive results)
+                if (kernel->shift > 0) {
+                        __m256i half_vec32i = _mm256_set1_epi32(1 << (kernel->shift - 1));
+                        sumLower_vec32i = _mm256_srai_epi32(_mm256_add_epi32(sumLower_vec32i, half_vec32i), kernel->shift);
+                        sumUpper_vec32i = _mm256_srai_epi32(_mm256_add_epi32(sumUpper_vec32i, half_vec32i), kernel->shift);
+                }
+
+                // Saturation epilogue: pack int32 -> int16 -> uint8 with clamping (the unpack order is restored by the first pack)
+                __m256i result_vec16i = _mm256_packs_epi32(sumLower_vec32i, sumUpper_vec32i);
+                __m256i result_vec8u = _mm256_permute4x64_epi64(_mm256_packus_epi16(result_vec16i, result_vec16i), 0x08);
+
+                // Store all 16 channels at once, or only the remaining channels at the end of a row
+                if (width - x >= 16) {
+                        _mm_storeu_si128((__m128i*) &outputRow[x], _mm256_castsi256_si128(result_vec8u));
+                } else {
+                        uint8_t tempArray[16];
+                        _mm_storeu_si128((__m128i*) tempArray, _mm256_castsi256_si128(result_vec8u));
+                        memcpy(&outputRow[x], tempArray, width - x);
+                }
+        }
+
+}
+
+
+// Instantiates the AVX2 row functions for a kernel size (a constant for the specialized versions, `kernel->size` for the
+// generic ones). With a constant size the entry pairs stay in registers and the entry loops are unrolled
+#define DEFINE_FIXED_POINT_ROW_FUNCTIONS(SUFFIX, SIZE) \
+        CPU_TARGET_AVX2 \
+        static void convolve_row_bytes_##SUFFIX(const struct FixedPointKernel *kernel, uint8_t *paddedTile, int stride, \
+                uint8_t *zeroRow, int row, uint8_t *outputRow, int width) { \
+                __m256i entryPairs_vec8i[((SIZE) + 1) / 2 * (SIZE)]; \
+                convolve_row_bytes_body(kernel, SIZE, entryPairs_vec8i, paddedTile, stride, zeroRow, row, outputRow, width); \
+        } \
+        CPU_TARGET_AVX2 \
+        static void convolve_row_words_##SUFFIX(const struct FixedPointKernel *kernel, uint8_t *paddedTile, int stride, \
+                uint8_t *zeroRow, int row, uint8_t *outputRow, int width) { \
+                __m256i entryPairs_vec16i[((SIZE) + 1) / 2 * (SIZE)]; \
+                convolve_row_words_body(kernel, SIZE, entryPairs_vec16i, paddedTile, stride, zeroRow, row, outputRow, width); \
+        }
+#define DEFINE_SPECIALIZED_FIXED_POINT_ROW_FUNCTIONS(SIZE) DEFINE_FIXED_POINT_ROW_FUNCTIONS(SIZE, SIZE)
+
+DEFINE_FIXED_POINT_ROW_FUNCTIONS(generic, kernel->size)
+FOR_EACH_SPECIALIZED_KERNEL_SIZE(DEFINE_SPECIALIZED_FIXED_POINT_ROW_FUNCTIONS)
+
+
+// Selects the row function for the processor's instruction set level and the kernel, specialized for the kernel size
+// when possible
+static FixedPointRowFunction select_fixed_point_row_function(const struct FixedPointKernel *kernel) {
+
+        #define FIXED_POINT_ROW_CASE(SIZE) case SIZE: return kernel->useBytes ? convolve_row_bytes_##SIZE : convolve_row_words_##SIZE;
+
+        if (cpu_feature_level() < CPU_FEATURE_LEVEL_AVX2) return convolve_row_scalar;
+
+        switch (kernel->size) {
+                FOR_EACH_SPECIALIZED_KERNEL_SIZE(FIXED_POINT_ROW_CASE)
+                default: return kernel->useBytes ? convolve_row_bytes_generic : convolve_row_words_generic;
+        }
+
+        #undef FIXED_POINT_ROW_CASE
+
+}
+
+
+// Carries out the parallelized integer convolution pipeline for any number of channel planes of the input image in one
+// pass over the tiles (one fork/join), and stores results into the output planes. The padded tile buffer is reused by
+// every plane of a tile
+int apply_fixed_point_convolution_pipeline_planes(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes,
+        const struct FixedPointKernel *kernel, int imageHeight, int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue) {
+
+        // Initialize useful values
+        int kernelSize = kernel->size;
+        int haloSize = kernelSize / 2;
+        struct TileShape tileShape = choose_tile_shape(TUNING_PIPELINE_FIXED_POINT, kernelSize, imageHeight, imageWidth);
+        int tileWidth = tileShape.width;
+        int tileHeight = tileShape.height;
+        int stride = (int) memory_size_alignment(tileWidth + 2*haloSize + FIXED_POINT_ROW_SLACK);
+        int paddedRows = tileHeight + 2*haloSize;
+
+        // Select the row function for the processor's instruction set level and the kernel size
+        FixedPointRowFunction convolveRow = select_fixed_point_row_function(kernel);
+
+        // Flag to indicate error in the parallel processing
+        int errorFlag = 0;
+
+        // Parallelize over tiles in row-major order
+        #pragma omp parallel shared(errorFlag)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread, sized once per parallel region to store
+                // the padded tile and a zero row
+                struct MemoryPool *pool = acquire_thread_memory_pool((paddedRows + 1)*stride);
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                #pragma omp for collapse(2) schedule(static)
+                for (int yy = 0; yy < imageHeight; yy += tileHeight) {
+                        for (int xx = 0; xx < imageWidth; xx += tileWidth) {
+
+                                // Start the tile with an empty arena
+                                if (pool == NULL) continue;
+                                empty_pool(pool);
+                                uint8_t *paddedTile = (uint8_t*)allocate_from_pool(pool, paddedRows*stride);
+                                uint8_t *zeroRow = (uint8_t*)allocate_from_pool(pool, stride);
+                                memset(zeroRow, 0, stride);
+
+                                // Determine the actual tile dimensions (tiles on the right and bottom edges may be cut off)
+                                int currentTileWidth = (xx + tileWidth <= imageWidth) ? tileWidth : imageWidth - xx;
+                                int currentTileHeight = (yy + tileHeight <= imageHeight) ? tileHeight : imageHeight - yy;
+
+                                for (int plane = 0; plane < numPlanes; plane++) {
+
+                                        uint8_t *inputChannels = inputPlanes[plane];
+                                        uint8_t *outputChannels = outputPlanes[plane];
+
+                                        // Gather the tile and its halo into the zero-padded buffer
+                                        fill_padded_tile(inputChannels, imageHeight, imageWidth, yy - haloSize, xx - haloSize,
+                                                currentTileHeight + 2*haloSize, currentTileWidth + 2*haloSize, stride, borderMode, paddedTile);
+
+                                        // Loop over the rows of the tile, vectorizing across neighbouring output channels
+                                        for (int row = 0; row < currentTileHeight; row++) {
+                                                uint8_t *outputRow = &outputChannels[(size_t) (yy + row)*imageWidth + xx];
+                                                convolveRow(kernel, paddedTile, stride, zeroRow, row, outputRow, currentTileWidth);
+                                                apply_point_op_epilogue_row(epilogue, outputRow, currentTileWidth);
+                                        }
+                                }
+                        }
+                }
+        }
+
+        // Check if an error occurred during the parallel processing and return 0
+        if (errorFlag) return 0;
+
+        // Indicate that convolution pipeline executed successfully for all planes
+        return 1;
+
+}
+
+
+// Carries out the integer convolution pipeline for given channelsArray of input image and stores result into output image
+int apply_fixed_point_convolution_pipeline_channel(uint8_t *inputChannels, uint8_t *outputChannels, const struct FixedPointKernel *kernel,
+        int imageHeight, int imageWidth, enum BorderMode borderMode) {
+
+        return apply_fixed_point_convolution_pipeline_planes(&inputChannels, &outputChannels, 1, kernel, imageHeight, imageWidth,
+                borderMode, NULL);
+
+}
+
+
+// Carries out the fused integer convolution pipeline over the three (RGB) channels of a given image
+int apply_fixed_point_convolution_pipeline_RGB(struct ImageRGB *inputImage, struct ImageRGB *outputImage, const struct FixedPointKernel *kernel,
+        enum BorderMode borderMode) {
+
+        uint8_t *inputPlanes[3] = {inputImage->redChannels, inputImage->greenChannels, inputImage->blueChannels};
+        uint8_t *outputPlanes[3] = {outputImage->redChannels, outputImage->greenChannels, outputImage->blueChannels};
+
+        return apply_fixed_point_convolution_pipeline_planes(inputPlanes, outputPlanes, 3, kernel, inputImage->height,
+                inputImage->width, borderMode, NULL);
+
+}
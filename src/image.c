@@ -1,66 +1,1042 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>  // For memcpy() and memset()
 #include <math.h>
+#include <immintrin.h>
+#include <omp.h>  // For parallel processing
+#ifdef _WIN32
+    #include <windows.h>  // For CreateFileMapping() and MapViewOfFile()
+#else
+    #include <fcntl.h>  // For open()
+    #include <unistd.h>  // For ftruncate() and close()
+    #include <sys/mman.h>  // For mmap() and munmap()
+    #include <sys/stat.h>  // For fstat()
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image.h"
-#include "stb_image_write.h"
 #include "image.h"
+#include "interleave.h"
+#include "png.h"
+#include "jpeg.h"
+#include "pool.h"
+#include "cpu.h"
+
+
+
+// Colour converts a row of YCbCr samples into the three planes, with the fixed point formula of stb_image (so that the
+// planes match what stbi_load() produces), one pixel at a time
+static void ycbcr_to_planes_scalar(const uint8_t *luma, const uint8_t *chromaBlue, const uint8_t *chromaRed, uint8_t *red,
+        uint8_t *green, uint8_t *blue, int start, int count) {
+
+        for (int x = start; x < count; x++) {
+                int lumaFixed = (luma[x] << 20) + (1 << 19);
+                int cr = chromaRed[x] - 128;
+                int cb = chromaBlue[x] - 128;
+                int r = lumaFixed + cr*stbi__float2fixed(1.40200f);
+                int g = lumaFixed + cr*(-stbi__float2fixed(0.71414f)) + ((cb*(-stbi__float2fixed(0.34414f))) & (int) 0xffff0000);
+                int b = lumaFixed + cb*stbi__float2fixed(1.77200f);
+                r >>= 20;
+                g >>= 20;
+                b >>= 20;
+                red[x] = (uint8_t) (r < 0 ? 0 : (r > 255 ? 255 : r));
+                green[x] = (uint8_t) (g < 0 ? 0 : (g > 255 ? 255 : g));
+                blue[x] = (uint8_t) (b < 0 ? 0 : (b > 255 ? 255 : b));
+        }
+
+}
+
+
+// SSE4.1 version, 8 pixels at a time (two groups of 4 in 32 bit lanes)
+CPU_TARGET_SSE41
+static void ycbcr_to_planes_sse41(const uint8_t *luma, const uint8_t *chromaBlue, const uint8_t *chromaRed, uint8_t *red,
+        uint8_t *green, uint8_t *blue, int count) {
+
+        __m128i crToRed = _mm_set1_epi32(stbi__float2fixed(1.40200f));
+        __m128i crToGreen = _mm_set1_epi32(-stbi__float2fixed(0.71414f));
+        __m128i cbToGreen = _mm_set1_epi32(-stbi__float2fixed(0.34414f));
+        __m128i cbToBlue = _mm_set1_epi32(stbi__float2fixed(1.77200f));
+        __m128i greenMask = _mm_set1_epi32((int) 0xffff0000);
+        __m128i rounding = _mm_set1_epi32(1 << 19);
+        __m128i chromaBias = _mm_set1_epi32(128);
+        uint8_t *planes[3] = {red, green, blue};
+
+        int x = 0;
+        for (; x + 8 <= count; x += 8) {
+                __m128i lumaBytes = _mm_loadl_epi64((__m128i*) &luma[x]);
+                __m128i cbBytes = _mm_loadl_epi64((__m128i*) &chromaBlue[x]);
+                __m128i crBytes = _mm_loadl_epi64((__m128i*) &chromaRed[x]);
+
+                // Convert each group of 4 pixels in 32 bit fixed point
+                __m128i channels[3][2];
+                for (int half = 0; half < 2; half++) {
+                        __m128i lumaFixed = _mm_add_epi32(_mm_slli_epi32(_mm_cvtepu8_epi32(lumaBytes), 20), rounding);
+                        __m128i cb = _mm_sub_epi32(_mm_cvtepu8_epi32(cbBytes), chromaBias);
+                        __m128i cr = _mm_sub_epi32(_mm_cvtepu8_epi32(crBytes), chromaBias);
+                        channels[0][half] = _mm_srai_epi32(_mm_add_epi32(lumaFixed, _mm_mullo_epi32(cr, crToRed)), 20);
+                        __m128i green_vec = _mm_add_epi32(_mm_add_epi32(lumaFixed, _mm_mullo_epi32(cr, crToGreen)),
+                                _mm_and_si128(_mm_mullo_epi32(cb, cbToGreen), greenMask));
+                        channels[1][half] = _mm_srai_epi32(green_vec, 20);
+                        channels[2][half] = _mm_srai_epi32(_mm_add_epi32(lumaFixed, _mm_mullo_epi32(cb, cbToBlue)), 20);
+                        lumaBytes = _mm_srli_si128(lumaBytes, 4);
+                        cbBytes = _mm_srli_si128(cbBytes, 4);
+                        crBytes = _mm_srli_si128(crBytes, 4);
+                }
+
+                // Pack with saturation to [0, 255] and store
+                for (int c = 0; c < 3; c++) {
+                        __m128i words = _mm_packs_epi32(channels[c][0], channels[c][1]);
+                        _mm_storel_epi64((__m128i*) &planes[c][x], _mm_packus_epi16(words, words));
+                }
+        }
+
+        ycbcr_to_planes_scalar(luma, chromaBlue, chromaRed, red, green, blue, x, count);
+
+}
+
+
+// AVX2 version, 8 pixels at a time
+CPU_TARGET_AVX2
+static void ycbcr_to_planes_avx2(const uint8_t *luma, const uint8_t *chromaBlue, const uint8_t *chromaRed, uint8_t *red,
+        uint8_t *green, uint8_t *blue, int count) {
+
+        __m256i crToRed = _mm256_set1_epi32(stbi__float2fixed(1.40200f));
+        __m256i crToGreen = _mm256_set1_epi32(-stbi__float2fixed(0.71414f));
+        __m256i cbToGreen = _mm256_set1_epi32(-stbi__float2fixed(0.34414f));
+        __m256i cbToBlue = _mm256_set1_epi32(stbi__float2fixed(1.77200f));
+        __m256i greenMask = _mm256_set1_epi32((int) 0xffff0000);
+        __m256i rounding = _mm256_set1_epi32(1 << 19);
+        __m256i chromaBias = _mm256_set1_epi32(128);
+        uint8_t *planes[3] = {red, green, blue};
+
+        int x = 0;
+        for (; x + 8 <= count; x += 8) {
+                __m256i lumaFixed = _mm256_add_epi32(_mm256_slli_epi32(
+                        _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*) &luma[x])), 20), rounding);
+                __m256i cb = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*) &chromaBlue[x])), chromaBias);
+                __m256i cr = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*) &chromaRed[x])), chromaBias);
+
+                // Convert in 32 bit fixed point
+                __m256i channels[3];
+                channels[0] = _mm256_srai_epi32(_mm256_add_epi32(lumaFixed, _mm256_mullo_epi32(cr, crToRed)), 20);
+                channels[1] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(lumaFixed, _mm256_mullo_epi32(cr, crToGreen)),
+                        _mm256_and_si256(_mm256_mullo_epi32(cb, cbToGreen), greenMask)), 20);
+                channels[2] = _mm256_srai_epi32(_mm256_add_epi32(lumaFixed, _mm256_mullo_epi32(cb, cbToBlue)), 20);
+
+                // Pack the two lanes with saturation to [0, 255] and store
+                for (int c = 0; c < 3; c++) {
+                        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(channels[c]), _mm256_extracti128_si256(channels[c], 1));
+                        _mm_storel_epi64((__m128i*) &planes[c][x], _mm_packus_epi16(words, words));
+                }
+        }
+
+        ycbcr_to_planes_scalar(luma, chromaBlue, chromaRed, red, green, blue, x, count);
+
+}
+
+
+// AVX-512 version, 16 pixels at a time
+CPU_TARGET_AVX512
+static void ycbcr_to_planes_avx512(const uint8_t *luma, const uint8_t *chromaBlue, const uint8_t *chromaRed, uint8_t *red,
+        uint8_t *green, uint8_t *blue, int count) {
+
+        __m512i crToRed = _mm512_set1_epi32(stbi__float2fixed(1.40200f));
+        __m512i crToGreen = _mm512_set1_epi32(-stbi__float2fixed(0.71414f));
+        __m512i cbToGreen = _mm512_set1_epi32(-stbi__float2fixed(0.34414f));
+        __m512i cbToBlue = _mm512_set1_epi32(stbi__float2fixed(1.77200f));
+        __m512i greenMask = _mm512_set1_epi32((int) 0xffff0000);
+        __m512i rounding = _mm512_set1_epi32(1 << 19);
+        __m512i chromaBias = _mm512_set1_epi32(128);
+        __m512i zero = _mm512_setzero_si512();
+        __m512i maxValue = _mm512_set1_epi32(255);
+        uint8_t *planes[3] = {red, green, blue};
+
+        int x = 0;
+        for (; x + 16 <= count; x += 16) {
+                __m512i lumaFixed = _mm512_add_epi32(_mm512_slli_epi32(
+                        _mm512_cvtepu8_epi32(_mm_loadu_si128((__m128i*) &luma[x])), 20), rounding);
+                __m512i cb = _mm512_sub_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((__m128i*) &chromaBlue[x])), chromaBias);
+                __m512i cr = _mm512_sub_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((__m128i*) &chromaRed[x])), chromaBias);
+
+                // Convert in 32 bit fixed point
+                __m512i channels[3];
+                channels[0] = _mm512_srai_epi32(_mm512_add_epi32(lumaFixed, _mm512_mullo_epi32(cr, crToRed)), 20);
+                channels[1] = _mm512_srai_epi32(_mm512_add_epi32(_mm512_add_epi32(lumaFixed, _mm512_mullo_epi32(cr, crToGreen)),
+                        _mm512_and_si512(_mm512_mullo_epi32(cb, cbToGreen), greenMask)), 20);
+                channels[2] = _mm512_srai_epi32(_mm512_add_epi32(lumaFixed, _mm512_mullo_epi32(cb, cbToBlue)), 20);
+
+                // Clamp to [0, 255], narrow to bytes and store
+                for (int c = 0; c < 3; c++) {
+                        __m512i clamped = _mm512_min_epi32(_mm512_max_epi32(channels[c], zero), maxValue);
+                        _mm_storeu_si128((__m128i*) &planes[c][x], _mm512_cvtepi32_epi8(clamped));
+                }
+        }
+
+        ycbcr_to_planes_scalar(luma, chromaBlue, chromaRed, red, green, blue, x, count);
+
+}
+
+
+// Colour converts a row of YCbCr samples into the three planes with the widest version supported by the processor
+static void ycbcr_to_planes(const uint8_t *luma, const uint8_t *chromaBlue, const uint8_t *chromaRed, uint8_t *red, uint8_t *green,
+        uint8_t *blue, int count, enum CpuFeatureLevel level) {
+
+        switch (level) {
+                case CPU_FEATURE_LEVEL_AVX512:  ycbcr_to_planes_avx512(luma, chromaBlue, chromaRed, red, green, blue, count); break;
+                case CPU_FEATURE_LEVEL_AVX2:    ycbcr_to_planes_avx2(luma, chromaBlue, chromaRed, red, green, blue, count); break;
+                case CPU_FEATURE_LEVEL_SSE41:   ycbcr_to_planes_sse41(luma, chromaBlue, chromaRed, red, green, blue, count); break;
+                default:                        ycbcr_to_planes_scalar(luma, chromaBlue, chromaRed, red, green, blue, 0, count); break;
+        }
+
+}
+
+
+// Decodes a JPEG file straight into the planes of a new image. The components are upsampled one row at a time (as in
+// load_jpeg_image() of stb_image) and colour converted into the three planes, so no interleaved copy of the image is
+// made. Returns 1 on success, 0 on failure and -1 (with the file rewound) when the file is not a JPEG of one or three
+// components, which is left to stbi_load()
+static int load_jpeg_planes(FILE *file, struct ImageRGB **loadedImage) {
+
+        // Recognize the file as a JPEG
+        stbi__context context;
+        stbi__start_file(&context, file);
+        if (!stbi__jpeg_test(&context)) {
+                fseek(file, 0, SEEK_SET);
+                return -1;
+        }
+
+        stbi__jpeg *jpeg = (stbi__jpeg*)malloc(sizeof(stbi__jpeg));
+        if (jpeg == NULL) {
+                fprintf(stderr, "\nFatal error: image could not be loaded.\n\n");
+                return 0;
+        }
+        memset(jpeg, 0, sizeof(stbi__jpeg));
+        jpeg->s = &context;
+        stbi__setup_jpeg(jpeg);
+        context.img_n = 0;  // Makes stbi__cleanup_jpeg() safe
+
+        // Decode the components (left in YCbCr, possibly subsampled)
+        if (!stbi__decode_jpeg_image(jpeg)) {
+                stbi__cleanup_jpeg(jpeg);
+                free(jpeg);
+                fprintf(stderr, "\nFatal error: image could not be loaded. Reason: %s.\n\n", stbi_failure_reason());
+                return 0;
+        }
+        int numComponents = context.img_n;
+        if (numComponents != 1 && numComponents != 3) {
+                stbi__cleanup_jpeg(jpeg);
+                free(jpeg);
+                fseek(file, 0, SEEK_SET);
+                return -1;
+        }
+        int isRGB = (numComponents == 3 && (jpeg->rgb == 3 || (jpeg->app14_color_transform == 0 && !jpeg->jfif)));
+
+        int width = (int) context.img_x;
+        int height = (int) context.img_y;
+        struct ImageRGB *image = load_empty_imageRGB(width, height);
+        if (image == NULL) {
+                stbi__cleanup_jpeg(jpeg);
+                free(jpeg);
+                return 0;
+        }
+
+        // Set up the upsampling of every component (line buffers are large enough for an upsampling factor of 4)
+        stbi__resample resamplers[3];
+        for (int k = 0; k < numComponents; k++) {
+                stbi__resample *resampler = &resamplers[k];
+                jpeg->img_comp[k].linebuf = (stbi_uc*)malloc(width + 3);
+                if (jpeg->img_comp[k].linebuf == NULL) {
+                        free_imageRGB(image);
+                        stbi__cleanup_jpeg(jpeg);
+                        free(jpeg);
+                        fprintf(stderr, "\nFatal error: image could not be loaded.\n\n");
+                        return 0;
+                }
+
+                resampler->hs = jpeg->img_h_max / jpeg->img_comp[k].h;
+                resampler->vs = jpeg->img_v_max / jpeg->img_comp[k].v;
+                resampler->ystep = resampler->vs >> 1;
+                resampler->w_lores = (width + resampler->hs - 1) / resampler->hs;
+                resampler->ypos = 0;
+                resampler->line0 = resampler->line1 = jpeg->img_comp[k].data;
+
+                if (resampler->hs == 1 && resampler->vs == 1) resampler->resample = resample_row_1;
+                else if (resampler->hs == 1 && resampler->vs == 2) resampler->resample = stbi__resample_row_v_2;
+                else if (resampler->hs == 2 && resampler->vs == 1) resampler->resample = stbi__resample_row_h_2;
+                else if (resampler->hs == 2 && resampler->vs == 2) resampler->resample = jpeg->resample_row_hv_2_kernel;
+                else resampler->resample = stbi__resample_row_generic;
+        }
+
+        // Upsample and colour convert one row at a time into the planes
+        enum CpuFeatureLevel level = cpu_feature_level();
+        for (int row = 0; row < height; row++) {
+
+                // Upsample the row of every component
+                uint8_t *samples[3];
+                for (int k = 0; k < numComponents; k++) {
+                        stbi__resample *resampler = &resamplers[k];
+                        int bottomHalf = (resampler->ystep >= (resampler->vs >> 1));
+                        samples[k] = resampler->resample(jpeg->img_comp[k].linebuf, bottomHalf ? resampler->line1 : resampler->line0,
+                                bottomHalf ? resampler->line0 : resampler->line1, resampler->w_lores, resampler->hs);
+                        if (++resampler->ystep >= resampler->vs) {
+                                resampler->ystep = 0;
+                                resampler->line0 = resampler->line1;
+                                if (++resampler->ypos < jpeg->img_comp[k].y) resampler->line1 += jpeg->img_comp[k].w2;
+                        }
+                }
+
+                // Write the row of every plane (greyscale JPEGs are replicated into the three planes)
+                size_t offset = (size_t) row * width;
+                if (numComponents == 1) {
+                        memcpy(&image->redChannels[offset], samples[0], width);
+                        memcpy(&image->greenChannels[offset], samples[0], width);
+                        memcpy(&image->blueChannels[offset], samples[0], width);
+                } else if (isRGB) {
+                        memcpy(&image->redChannels[offset], samples[0], width);
+                        memcpy(&image->greenChannels[offset], samples[1], width);
+                        memcpy(&image->blueChannels[offset], samples[2], width);
+                } else {
+                        ycbcr_to_planes(samples[0], samples[1], samples[2], &image->redChannels[offset], &image->greenChannels[offset],
+                                &image->blueChannels[offset], width, level);
+                }
+        }
+
+        // Free the components
+        stbi__cleanup_jpeg(jpeg);
+        free(jpeg);
+
+        *loadedImage = image;
+        return 1;
+
+}
+
+
+// Converts an interleaved RGB image (RGBRGBRGB) into the SoA layout (RRRGGGBBB) within its own buffer. Every row is
+// first deinterleaved in place through a scratch copy (RRGGBB within the row), then the row segments are moved to their
+// plane by following the cycles of the (row, channel) -> (channel, row) permutation, carrying one segment at a time.
+// Returns 0 when the scratch memory cannot be allocated
+static int deinterleave_rows_in_place(uint8_t *pixels, int width, int height) {
+
+        size_t rowSize = (size_t) width;
+
+        // Byte shuffles of the RGB rows, built once for every row
+        struct InterleaveShuffles shuffles;
+        if (!build_interleave_shuffles(&shuffles, 3, 1)) return 0;
+
+        // Flag to indicate error in the parallel processing
+        int errorFlag = 0;
+
+        // Parallelize over rows
+        #pragma omp parallel shared(errorFlag)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread to store the copy of an interleaved row
+                struct MemoryPool *pool = acquire_thread_memory_pool(memory_size_alignment(3*rowSize));
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                #pragma omp for schedule(static)
+                for (int row = 0; row < height; row++) {
+                        if (pool == NULL) continue;
+                        empty_pool(pool);
+                        uint8_t *interleavedRow = (uint8_t*)allocate_from_pool(pool, 3*rowSize);
+
+                        uint8_t *rowPixels = &pixels[3*rowSize*row];
+                        memcpy(interleavedRow, rowPixels, 3*rowSize);
+                        uint8_t *rowPlanes[3] = {rowPixels, rowPixels + rowSize, rowPixels + 2*rowSize};
+                        deinterleave_channels_row(interleavedRow, rowPlanes, &shuffles, rowSize);
+                }
+        }
+        if (errorFlag) return 0;
+
+        // The segment at position row*3 + channel belongs at position channel*height + row
+        size_t numSegments = 3*(size_t) height;
+        uint8_t *carriedSegment = (uint8_t*)malloc(rowSize);
+        uint8_t *moved = (uint8_t*)calloc(numSegments, sizeof(uint8_t));
+        if (carriedSegment == NULL || moved == NULL) {
+                free(carriedSegment);
+                free(moved);
+                return 0;
+        }
+
+        for (size_t start = 0; start < numSegments; start++) {
+                if (moved[start]) continue;
+
+                // Walk the cycle backwards: each position receives the segment belonging to it, the segment first
+                // overwritten is carried to the end of the cycle
+                memcpy(carriedSegment, &pixels[start*rowSize], rowSize);
+                size_t position = start;
+                while (1) {
+                        moved[position] = 1;
+                        size_t source = (position % height)*3 + position / height;
+                        if (source == start) {
+                                memcpy(&pixels[position*rowSize], carriedSegment, rowSize);
+                                break;
+                        }
+                        memcpy(&pixels[position*rowSize], &pixels[source*rowSize], rowSize);
+                        position = source;
+                }
+        }
+
+        free(carriedSegment);
+        free(moved);
+        return 1;
+
+}
+
+
+
+/**
+ * @brief Structure for representing a file mapped into memory (read-only, or writable for the output files).
+ */
+typedef struct MappedFile {
+        uint8_t *data;
+        size_t size;
+#ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+#else
+        int descriptor;
+#endif
+} MappedFile;
+
+
+// Maps an existing file for reading. Returns 0 when it cannot be opened or mapped (e.g. an empty file)
+static int map_file_for_reading(const char *filename, struct MappedFile *mapped) {
+
+#ifdef _WIN32
+        mapped->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (mapped->file == INVALID_HANDLE_VALUE) return 0;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(mapped->file, &fileSize) || fileSize.QuadPart == 0) {
+                CloseHandle(mapped->file);
+                return 0;
+        }
+        mapped->size = (size_t) fileSize.QuadPart;
+        mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapped->mapping == NULL) {
+                CloseHandle(mapped->file);
+                return 0;
+        }
+        mapped->data = (uint8_t*)MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+        if (mapped->data == NULL) {
+                CloseHandle(mapped->mapping);
+                CloseHandle(mapped->file);
+                return 0;
+        }
+#else
+        mapped->descriptor = open(filename, O_RDONLY);
+        if (mapped->descriptor < 0) return 0;
+        struct stat fileStatus;
+        if (fstat(mapped->descriptor, &fileStatus) != 0 || fileStatus.st_size == 0) {
+                close(mapped->descriptor);
+                return 0;
+        }
+        mapped->size = (size_t) fileStatus.st_size;
+        void *data = mmap(NULL, mapped->size, PROT_READ, MAP_PRIVATE, mapped->descriptor, 0);
+        if (data == MAP_FAILED) {
+                close(mapped->descriptor);
+                return 0;
+        }
+        mapped->data = (uint8_t*)data;
+#endif
+
+        return 1;
+
+}
+
+
+// Creates (or truncates) a file of `size` bytes and maps it for writing. Returns 0 on failure
+static int map_file_for_writing(const char *filename, size_t size, struct MappedFile *mapped) {
+
+        mapped->size = size;
+
+#ifdef _WIN32
+        mapped->file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (mapped->file == INVALID_HANDLE_VALUE) return 0;
+        // Mapping a view larger than the file extends the file to that size
+        mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READWRITE, (DWORD) ((uint64_t) size >> 32),
+                (DWORD) ((uint64_t) size & 0xffffffff), NULL);
+        if (mapped->mapping == NULL) {
+                CloseHandle(mapped->file);
+                return 0;
+        }
+        mapped->data = (uint8_t*)MapViewOfFile(mapped->mapping, FILE_MAP_WRITE, 0, 0, 0);
+        if (mapped->data == NULL) {
+                CloseHandle(mapped->mapping);
+                CloseHandle(mapped->file);
+                return 0;
+        }
+#else
+        mapped->descriptor = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (mapped->descriptor < 0) return 0;
+        if (ftruncate(mapped->descriptor, (off_t) size) != 0) {
+                close(mapped->descriptor);
+                return 0;
+        }
+        void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mapped->descriptor, 0);
+        if (data == MAP_FAILED) {
+                close(mapped->descriptor);
+                return 0;
+        }
+        mapped->data = (uint8_t*)data;
+#endif
+
+        return 1;
+
+}
+
+
+// Unmaps a file mapped by map_file_for_reading() or map_file_for_writing() (the written pages are flushed by the system)
+static void unmap_file(struct MappedFile *mapped) {
+
+#ifdef _WIN32
+        UnmapViewOfFile(mapped->data);
+        CloseHandle(mapped->mapping);
+        CloseHandle(mapped->file);
+#else
+        munmap(mapped->data, mapped->size);
+        close(mapped->descriptor);
+#endif
+        mapped->data = NULL;
+
+}
+
+
+
+/**
+ * @brief Structure for representing the layout of the pixels in an uncompressed image file (BMP, PPM or PGM): 1, 3 or 4
+ * bytes per pixel, in R, G, B or (BMP) B, G, R, X order, rows of `rowStride` bytes from `dataOffset` on, stored top-down
+ * or (BMP) bottom-up.
+ */
+typedef struct RawImageLayout {
+        int width, height;
+        int numChannels;
+        int bgrOrder;
+        int bottomUp;
+        size_t dataOffset;
+        size_t rowStride;
+} RawImageLayout;
+
+
+// Reads little-endian integers of a BMP header
+static uint32_t read_u32_le(const uint8_t *bytes) {
+        return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+static uint16_t read_u16_le(const uint8_t *bytes) {
+        return (uint16_t) (bytes[0] | (bytes[1] << 8));
+}
+
+
+// Reads a decimal integer of a PNM header (skipping whitespace and comments), returns -1 when there is none
+static long read_pnm_integer(const uint8_t *data, size_t size, size_t *position) {
+
+        // Skip whitespace and comments (from '#' to the end of the line)
+        while (*position < size) {
+                uint8_t c = data[*position];
+                if (c == '#') {
+                        while (*position < size && data[*position] != '\n') (*position)++;
+                } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') {
+                        (*position)++;
+                } else {
+                        break;
+                }
+        }
+
+        long value = -1;
+        while (*position < size && data[*position] >= '0' && data[*position] <= '9') {
+                value = (value < 0 ? 0 : value)*10 + (data[*position] - '0');
+                if (value > INT32_MAX) return -1;
+                (*position)++;
+        }
+        return value;
+
+}
+
+
+// Parses the header of an uncompressed image file. Returns 1 on success, 0 for a malformed (truncated) file, and -1 for
+// other formats and for the variants left to stb_image (compressed or palette BMPs, PNMs with more than 8 bits per sample)
+static int parse_raw_image_header(const uint8_t *data, size_t size, struct RawImageLayout *layout) {
+
+        if (size >= 54 && data[0] == 'B' && data[1] == 'M') {
+
+                // BITMAPINFOHEADER or one of its extensions, with uncompressed 24 or 32 bit pixels
+                uint32_t headerSize = read_u32_le(&data[14]);
+                if (headerSize != 40 && headerSize != 56 && headerSize != 108 && headerSize != 124) return -1;
+                int32_t width = (int32_t) read_u32_le(&data[18]);
+                int32_t height = (int32_t) read_u32_le(&data[22]);
+                uint16_t bitsPerPixel = read_u16_le(&data[28]);
+                uint32_t compression = read_u32_le(&data[30]);
+                if (read_u16_le(&data[26]) != 1 || compression != 0 || (bitsPerPixel != 24 && bitsPerPixel != 32)) return -1;
+                if (width <= 0 || height == 0 || height == INT32_MIN) return -1;
+
+                layout->width = width;
+                layout->height = (height < 0) ? -height : height;
+                layout->numChannels = bitsPerPixel / 8;
+                layout->bgrOrder = 1;
+                layout->bottomUp = (height > 0);
+                layout->dataOffset = read_u32_le(&data[10]);
+                layout->rowStride = ((size_t) width*layout->numChannels + 3) & ~(size_t) 3;  // Rows are padded to 4 bytes
+
+        } else if (size >= 2 && data[0] == 'P' && (data[1] == '5' || data[1] == '6')) {
+
+                // Binary PGM (P5) or PPM (P6) header: width, height and maximum value, then a single whitespace character
+                size_t position = 2;
+                long width = read_pnm_integer(data, size, &position);
+                long height = read_pnm_integer(data, size, &position);
+                long maxValue = read_pnm_integer(data, size, &position);
+                if (width <= 0 || height <= 0 || maxValue != 255 || position >= size) return -1;
+
+                layout->width = (int) width;
+                layout->height = (int) height;
+                layout->numChannels = (data[1] == '6') ? 3 : 1;
+                layout->bgrOrder = 0;
+                layout->bottomUp = 0;
+                layout->dataOffset = position + 1;
+                layout->rowStride = (size_t) width*layout->numChannels;
+
+        } else {
+                return -1;
+        }
+
+        // The pixels must be within the file
+        if (layout->dataOffset > size || (size - layout->dataOffset) / layout->rowStride < (size_t) layout->height) {
+                fprintf(stderr, "\nFatal error: image could not be loaded. Reason: truncated file.\n\n");
+                return 0;
+        }
+
+        return 1;
+
+}
+
+
+/**
+ * @brief Structure for representing an uncompressed image file (BMP, PPM or PGM) read or written one strip of rows at a
+ * time, top row first, through a mapping of the file. The pages of the rows already read or written are released.
+ */
+struct ImageStream {
+        struct MappedFile mapped;
+        struct RawImageLayout layout;
+        int writable;
+        int numPlanes;          // Planes of the written image (1 or 3)
+        int nextRow;
+        size_t releasedStart, releasedEnd;  // Byte range of the mapping already released
+};
+
+
+// Releases the whole pages of the mapping that only hold rows already read or written (the rows of a bottom-up BMP are
+// consumed from the end of the file). Written pages stay in the page cache and are flushed by the system
+static void release_image_stream_pages(struct ImageStream *stream) {
+
+#ifndef _WIN32
+        const struct RawImageLayout *layout = &stream->layout;
+        size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+        uint8_t *data = stream->mapped.data;
+        size_t rowsBytes = (size_t) stream->nextRow*layout->rowStride;
+
+        if (layout->bottomUp) {
+                // Consumed: [start, end of the pixels), release from the first whole page on
+                size_t start = layout->dataOffset + (size_t) (layout->height - stream->nextRow)*layout->rowStride;
+                size_t pageStart = (start + pageSize - 1) / pageSize*pageSize;
+                if (pageStart < stream->releasedStart) {
+                        madvise(&data[pageStart], stream->releasedStart - pageStart, MADV_DONTNEED);
+                        stream->releasedStart = pageStart;
+                }
+        } else {
+                // Consumed: [start of the file, end), release up to the last whole page
+                size_t end = layout->dataOffset + rowsBytes;
+                size_t pageEnd = end / pageSize*pageSize;
+                if (pageEnd > stream->releasedEnd) {
+                        madvise(&data[stream->releasedEnd], pageEnd - stream->releasedEnd, MADV_DONTNEED);
+                        stream->releasedEnd = pageEnd;
+                }
+        }
+#else
+        (void) stream;  // The working set of the process is trimmed by the system
+#endif
+
+}
+
+
+// Opens an uncompressed image file for reading. Returns 1 on success, 0 for a malformed file and -1 for files left to
+// stb_image (the stream is not created)
+static int open_raw_image_stream(const char *filename, struct ImageStream **createdStream) {
+
+        struct ImageStream *stream = (struct ImageStream*)malloc(sizeof(struct ImageStream));
+        if (stream == NULL) return -1;
+        if (!map_file_for_reading(filename, &stream->mapped)) {
+                free(stream);
+                return -1;
+        }
+
+        int parsed = parse_raw_image_header(stream->mapped.data, stream->mapped.size, &stream->layout);
+        if (parsed != 1) {
+                unmap_file(&stream->mapped);
+                free(stream);
+                return parsed;
+        }
+
+        stream->writable = 0;
+        stream->numPlanes = 0;
+        stream->nextRow = 0;
+        stream->releasedStart = stream->mapped.size;
+        stream->releasedEnd = 0;
+        *createdStream = stream;
+        return 1;
+
+}
+
+
+struct ImageStream *open_image_read_stream(const char *filename, int *width, int *height) {
+
+        struct ImageStream *stream = NULL;
+        int opened = open_raw_image_stream(filename, &stream);
+        if (opened == -1) {
+                fprintf(stderr, "\nFatal error: image could not be streamed. Reason: not an uncompressed BMP, PPM or PGM file.\n\n");
+        }
+        if (opened != 1) return NULL;
+
+        *width = stream->layout.width;
+        *height = stream->layout.height;
+        return stream;
+
+}
+
+
+int read_image_stream_rows(struct ImageStream *stream, int numRows, uint8_t **planes, int numPlanes) {
+
+        const struct RawImageLayout *layout = &stream->layout;
+        if (stream->writable || numRows < 0 || stream->nextRow + numRows > layout->height || (numPlanes != 1 && numPlanes != 3)) {
+                fprintf(stderr, "\nFatal error: image stream rows could not be read.\n\n");
+                return 0;
+        }
+
+        int width = layout->width;
+        int numChannels = layout->numChannels;
+        int firstRow = stream->nextRow;
+
+        // Byte shuffles of the colour rows, built once for every row
+        struct InterleaveShuffles shuffles;
+        if (numChannels > 1 && !build_interleave_shuffles(&shuffles, numChannels, 1)) return 0;
+
+        // Flag to indicate error in the parallel processing
+        int errorFlag = 0;
+
+        // Parallelize over rows
+        #pragma omp parallel shared(errorFlag)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread to store the unused fourth channel of a 32 bit BMP row
+                struct MemoryPool *pool = acquire_thread_memory_pool(memory_size_alignment(width));
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                #pragma omp for schedule(static)
+                for (int row = 0; row < numRows; row++) {
+                        if (pool == NULL) continue;
+                        empty_pool(pool);
+
+                        int imageRow = firstRow + row;
+                        size_t fileRow = layout->bottomUp ? (size_t) (layout->height - 1 - imageRow) : (size_t) imageRow;
+                        const uint8_t *source = &stream->mapped.data[layout->dataOffset + fileRow*layout->rowStride];
+                        size_t offset = (size_t) row*width;
+
+                        if (numChannels == 1) {
+                                // Grey pixels are copied into every plane
+                                for (int plane = 0; plane < numPlanes; plane++) memcpy(&planes[plane][offset], source, width);
+                        } else if (numPlanes == 3) {
+                                // Colour pixels are deinterleaved into the planes in file order
+                                uint8_t *unusedChannel = (uint8_t*)allocate_from_pool(pool, width);
+                                uint8_t *rowPlanes[4] = {&planes[0][offset], &planes[1][offset], &planes[2][offset], unusedChannel};
+                                if (layout->bgrOrder) {
+                                        rowPlanes[0] = &planes[2][offset];
+                                        rowPlanes[2] = &planes[0][offset];
+                                }
+                                deinterleave_channels_row(source, rowPlanes, &shuffles, width);
+                        } else {
+                                // Colour pixels are converted to luma with the weights of stb_image
+                                int redIndex = layout->bgrOrder ? 2 : 0;
+                                int blueIndex = layout->bgrOrder ? 0 : 2;
+                                for (int x = 0; x < width; x++) {
+                                        const uint8_t *pixel = &source[(size_t) x*numChannels];
+                                        planes[0][offset + x] = stbi__compute_y(pixel[redIndex], pixel[1], pixel[blueIndex]);
+                                }
+                        }
+                }
+        }
+        if (errorFlag) {
+                fprintf(stderr, "\nFatal error: image stream rows could not be read.\n\n");
+                return 0;
+        }
+
+        stream->nextRow += numRows;
+        release_image_stream_pages(stream);
+        return 1;
+
+}
+
+
+// Loads an uncompressed BMP, PPM or PGM file from a mapping of the file into the planes of a new image (three planes for
+// an ImageRGB, one for an ImageOneChannel). Returns 1 on success, 0 on failure and -1 for files left to stb_image
+static int load_raw_image(const char *filename, int numPlanes, struct ImageRGB **imageRGB, struct ImageOneChannel **imageOneChannel) {
+
+        struct ImageStream *stream = NULL;
+        int opened = open_raw_image_stream(filename, &stream);
+        if (opened != 1) return opened;
+
+        // Create the image and read the pixels straight from the mapping
+        uint8_t *planes[3];
+        if (numPlanes == 3) {
+                *imageRGB = load_empty_imageRGB(stream->layout.width, stream->layout.height);
+                if (*imageRGB == NULL) {
+                        close_image_stream(stream);
+                        return 0;
+                }
+                planes[0] = (*imageRGB)->redChannels;
+                planes[1] = (*imageRGB)->greenChannels;
+                planes[2] = (*imageRGB)->blueChannels;
+        } else {
+                *imageOneChannel = load_empty_imageOneChannel(stream->layout.width, stream->layout.height);
+                if (*imageOneChannel == NULL) {
+                        close_image_stream(stream);
+                        return 0;
+                }
+                planes[0] = (*imageOneChannel)->pixels;
+        }
+
+        int rowsRead = read_image_stream_rows(stream, stream->layout.height, planes, numPlanes);
+        close_image_stream(stream);
+        if (!rowsRead) {
+                if (numPlanes == 3) free_imageRGB(*imageRGB);
+                else free_imageOneChannel(*imageOneChannel);
+                *imageRGB = NULL;
+                *imageOneChannel = NULL;
+                return 0;
+        }
+
+        return 1;
+
+}
+
+
+// Writes little-endian integers of a BMP header
+static void write_u32_le(uint8_t *bytes, uint32_t value) {
+        bytes[0] = (uint8_t) value;
+        bytes[1] = (uint8_t) (value >> 8);
+        bytes[2] = (uint8_t) (value >> 16);
+        bytes[3] = (uint8_t) (value >> 24);
+}
+
+static void write_u16_le(uint8_t *bytes, uint16_t value) {
+        bytes[0] = (uint8_t) value;
+        bytes[1] = (uint8_t) (value >> 8);
+}
+
+
+struct ImageStream *open_image_write_stream(const char *filename, ImageFileType fileType, int width, int height, int numPlanes) {
+
+        if (fileType != FILE_TYPE_BMP && fileType != FILE_TYPE_PPM && fileType != FILE_TYPE_PGM) {
+                fprintf(stderr, "\nFatal error: image could not be saved. Reason: only BMP, PPM and PGM files are written as streams.\n\n");
+                return NULL;
+        }
+        if (fileType == FILE_TYPE_PGM && numPlanes != 1) {
+                fprintf(stderr, "\nFatal error: image could not be saved. Reason: PGM files hold one channel.\n\n");
+                return NULL;
+        }
+        if (width <= 0 || height <= 0 || (numPlanes != 1 && numPlanes != 3)) {
+                fprintf(stderr, "\nFatal error: image could not be saved.\n\n");
+                return NULL;
+        }
+
+        // Lay out the file: 24 bit bottom-up BMP rows padded to 4 bytes, or top-down PPM and PGM rows
+        struct RawImageLayout layout;
+        layout.width = width;
+        layout.height = height;
+        layout.numChannels = (fileType == FILE_TYPE_PGM) ? 1 : 3;
+        layout.bgrOrder = (fileType == FILE_TYPE_BMP);
+        layout.bottomUp = (fileType == FILE_TYPE_BMP);
+        layout.rowStride = (size_t) width*layout.numChannels;
+
+        // Build the header
+        uint8_t header[64];
+        if (fileType == FILE_TYPE_BMP) {
+                layout.rowStride = (layout.rowStride + 3) & ~(size_t) 3;
+                if (layout.rowStride*height > UINT32_MAX - 54) {
+                        fprintf(stderr, "\nFatal error: image could not be saved. Reason: too large for BMP.\n\n");
+                        return NULL;
+                }
+                layout.dataOffset = 54;
+                memset(header, 0, layout.dataOffset);
+                header[0] = 'B';
+                header[1] = 'M';
+                write_u32_le(&header[2], (uint32_t) (layout.dataOffset + layout.rowStride*height));  // File size
+                write_u32_le(&header[10], (uint32_t) layout.dataOffset);                             // Offset of the pixels
+                write_u32_le(&header[14], 40);                                                        // BITMAPINFOHEADER
+                write_u32_le(&header[18], (uint32_t) width);
+                write_u32_le(&header[22], (uint32_t) height);                                         // Positive: bottom-up rows
+                write_u16_le(&header[26], 1);                                                         // Planes
+                write_u16_le(&header[28], 24);                                                        // Bits per pixel
+                write_u32_le(&header[34], (uint32_t) (layout.rowStride*height));                      // Size of the pixels
+        } else {
+                layout.dataOffset = (size_t) snprintf((char*) header, sizeof(header), "P%c\n%d %d\n255\n",
+                        (fileType == FILE_TYPE_PGM) ? '5' : '6', width, height);
+        }
+
+        // Create and map the output file at its final size
+        struct ImageStream *stream = (struct ImageStream*)malloc(sizeof(struct ImageStream));
+        if (stream == NULL) {
+                fprintf(stderr, "\nFatal error: image could not be saved.\n\n");
+                return NULL;
+        }
+        if (!map_file_for_writing(filename, layout.dataOffset + layout.rowStride*height, &stream->mapped)) {
+                free(stream);
+                fprintf(stderr, "\nFatal error: image could not be saved. Reason: output file could not be mapped.\n\n");
+                return NULL;
+        }
+        memcpy(stream->mapped.data, header, layout.dataOffset);
+
+        stream->layout = layout;
+        stream->writable = 1;
+        stream->numPlanes = numPlanes;
+        stream->nextRow = 0;
+        stream->releasedStart = stream->mapped.size;
+        stream->releasedEnd = 0;
+        return stream;
+
+}
+
+
+int write_image_stream_rows(struct ImageStream *stream, int numRows, uint8_t *const *planes) {
+
+        const struct RawImageLayout *layout = &stream->layout;
+        if (!stream->writable || numRows < 0 || stream->nextRow + numRows > layout->height) {
+                fprintf(stderr, "\nFatal error: image stream rows could not be written.\n\n");
+                return 0;
+        }
+
+        int width = layout->width;
+        int firstRow = stream->nextRow;
+
+        // File order of the planes (BMP pixels are stored as B, G, R, a grey plane fills every channel)
+        uint8_t *filePlanes[3];
+        for (int c = 0; c < 3; c++) {
+                int plane = layout->bgrOrder ? 2 - c : c;
+                filePlanes[c] = planes[(stream->numPlanes == 1) ? 0 : plane];
+        }
+
+        // Byte shuffles of the colour rows, built once for every row
+        struct InterleaveShuffles shuffles;
+        if (layout->numChannels > 1 && !build_interleave_shuffles(&shuffles, 3, 1)) return 0;
+
+        // Interleave the rows into the mapping, in parallel over rows
+        #pragma omp parallel for schedule(static)
+        for (int row = 0; row < numRows; row++) {
+                int imageRow = firstRow + row;
+                size_t fileRow = layout->bottomUp ? (size_t) (layout->height - 1 - imageRow) : (size_t) imageRow;
+                uint8_t *destination = &stream->mapped.data[layout->dataOffset + fileRow*layout->rowStride];
+                size_t offset = (size_t) row*width;
+
+                if (layout->numChannels == 1) {
+                        memcpy(destination, &planes[0][offset], width);
+                } else {
+                        uint8_t *rowPlanes[3] = {&filePlanes[0][offset], &filePlanes[1][offset], &filePlanes[2][offset]};
+                        interleave_channels_row(rowPlanes, destination, &shuffles, width);
+                        memset(&destination[(size_t) width*3], 0, layout->rowStride - (size_t) width*3);
+                }
+        }
+
+        stream->nextRow += numRows;
+        release_image_stream_pages(stream);
+        return 1;
+
+}
+
+
+void close_image_stream(struct ImageStream *stream) {
+
+        if (stream == NULL) return;
+        unmap_file(&stream->mapped);
+        free(stream);
+
+}
+
+
+// Saves planes (three planes: R, G, B, one plane: grey) as an uncompressed BMP (24 bit, bottom-up), PPM or PGM file. The
+// output file is created at its final size and mapped, and the rows are interleaved straight into the mapping in parallel.
+// Returns 0 on failure
+static int save_raw_image(uint8_t *const *planes, int numPlanes, int width, int height, const char *filename, ImageFileType fileType) {
+
+        struct ImageStream *stream = open_image_write_stream(filename, fileType, width, height, numPlanes);
+        if (stream == NULL) return 0;
+        int rowsWritten = write_image_stream_rows(stream, height, planes);
+        close_image_stream(stream);
+        return rowsWritten;
+
+}
 
 
 
 struct ImageRGB *load_imageRGB(const char *filename) {
 
+        // Uncompressed BMP, PPM and PGM files are read straight from a mapping of the file
+        struct ImageRGB *image = NULL;
+        struct ImageOneChannel *unusedImage = NULL;
+        int rawLoaded = load_raw_image(filename, 3, &image, &unusedImage);
+        if (rawLoaded != -1) return image;
+
+        FILE *file = fopen(filename, "rb");
+        if (file == NULL) {
+                fprintf(stderr, "\nFatal error: image could not be loaded. Reason: can't fopen.\n\n");
+		return NULL;
+        }
+
+        // JPEG files are decoded straight into the planes
+        int jpegLoaded = load_jpeg_planes(file, &image);
+        if (jpegLoaded != -1) {
+                fclose(file);
+                return image;
+        }
+
         // Create an ImageRGB struct
-        struct ImageRGB *image = (struct ImageRGB*)malloc(sizeof(struct ImageRGB));
+        image = (struct ImageRGB*)malloc(sizeof(struct ImageRGB));
         if (image == NULL) {
+                fclose(file);
                 fprintf(stderr, "\nFatal error: image could not be loaded.\n\n");
 		return NULL;
         }
 
-        // Load image data in RGB format into a temporary array
+        // Load image data in RGB format (AoS channel layout), the buffer then becomes the SoA channel layout
         int width, height, numChannels;
-        uint8_t *tempArray = stbi_load(filename, &width, &height, &numChannels, 3);
-        if (tempArray == NULL) {
+        uint8_t *pixelMemory = stbi_load_from_file(file, &width, &height, &numChannels, 3);
+        fclose(file);
+        if (pixelMemory == NULL) {
                 free(image);
                 fprintf(stderr, "\nFatal error: image could not be loaded. Reason: %s.\n\n", stbi_failure_reason());
 		return NULL;
         }
-        
-        // Initialize ImageRGB struct fields
-        image->width = width;
-        image->height = height;
-        image->numChannels = 3;
 
-        // Allocate a single contiguous memory block for SoA channel layout
-        uint8_t *pixelMemory = (uint8_t*)malloc(((height * width)*3)*sizeof(uint8_t));
-        if (pixelMemory == NULL) {
+        // Convert from AoS channel layout (RGBRGBRGB) to SoA channel layout (RRRGGGBBB) in place, so that the image
+        // never exists twice in memory
+        if (!deinterleave_rows_in_place(pixelMemory, width, height)) {
                 free(image);
-                stbi_image_free(tempArray);
+                stbi_image_free(pixelMemory);
                 fprintf(stderr, "\nFatal error: image could not be loaded.\n\n");
 		return NULL;
         }
 
+        // Initialize ImageRGB struct fields (stb_image allocates with malloc(), the buffer is freed by free_imageRGB())
+        image->width = width;
+        image->height = height;
+        image->numChannels = 3;
+
         // Assign channel pointers
         image->redChannels = pixelMemory;
-        image->greenChannels = pixelMemory + (width * height);
-        image->blueChannels = pixelMemory + (2 * (width * height));
-
-        // Convert from AoS channel layout (RGBRGBRGB) to SoA channel layout (RRRGGGBBB)
-        for (int i = 0; i < (height * width); i++) {
-
-                int tempIndex = i * 3; // Index in tempArray
-
-                image->redChannels[i] = tempArray[tempIndex];
-                image->greenChannels[i] = tempArray[tempIndex+1];
-                image->blueChannels[i] = tempArray[tempIndex+2];
-
-        }
-
-        // Free temporary array
-        stbi_image_free(tempArray);
+        image->greenChannels = pixelMemory + ((size_t) width * height);
+        image->blueChannels = pixelMemory + (2 * ((size_t) width * height));
 
         return image;
 
@@ -68,8 +1044,14 @@ struct ImageRGB *load_imageRGB(const char *filename) {
 
 struct ImageOneChannel *load_imageOneChannel(const char *filename) {
 
+        // Uncompressed BMP, PPM and PGM files are read straight from a mapping of the file
+        struct ImageOneChannel *image = NULL;
+        struct ImageRGB *unusedImage = NULL;
+        int rawLoaded = load_raw_image(filename, 1, &unusedImage, &image);
+        if (rawLoaded != -1) return image;
+
         // Create an ImageOneChannel struct
-        struct ImageOneChannel *image = (struct ImageOneChannel*)malloc(sizeof(struct ImageOneChannel));
+        image = (struct ImageOneChannel*)malloc(sizeof(struct ImageOneChannel));
         if (image == NULL) {
                 fprintf(stderr, "\nFatal error: image could not be loaded.\n\n");
 		return NULL;
@@ -110,7 +1092,7 @@ struct ImageRGB *load_empty_imageRGB(int width, int height) {
         image->numChannels = 3;
 
         // Allocate a single contiguous memory block for SoA channel layout
-        uint8_t *pixelMemory = (uint8_t*)malloc(((width*height)*3)*sizeof(uint8_t));
+        uint8_t *pixelMemory = (uint8_t*)malloc((((size_t) width*height)*3)*sizeof(uint8_t));
         if (pixelMemory == NULL) {
                 free(image);
                 fprintf(stderr, "\nFatal error: empty image could not be loaded.\n\n");
@@ -119,8 +1101,8 @@ struct ImageRGB *load_empty_imageRGB(int width, int height) {
 
         // Assign channel pointers
         image->redChannels = pixelMemory;
-        image->greenChannels = pixelMemory + (width * height);
-        image->blueChannels = pixelMemory + (2 * (width * height));
+        image->greenChannels = pixelMemory + ((size_t) width * height);
+        image->blueChannels = pixelMemory + (2 * ((size_t) width * height));
         
         return image;
 
@@ -141,7 +1123,7 @@ struct ImageOneChannel *load_empty_imageOneChannel(int width, int height) {
         image->numChannels = 1;
 
         // Allocate required amount of memory for the image struct's pixels array
-        image->pixels = (uint8_t*)malloc((width*height)*sizeof(uint8_t));
+        image->pixels = (uint8_t*)malloc(((size_t) width*height)*sizeof(uint8_t));
         if (image->pixels == NULL) {
                 free(image);
                 fprintf(stderr, "\nFatal error: empty image could not be loaded.\n\n");
@@ -154,7 +1136,16 @@ struct ImageOneChannel *load_empty_imageOneChannel(int width, int height) {
 
 
 
-int save_imageRGB(struct ImageRGB *image, const char *filename, ImageFileType fileType) {
+void init_image_save_options(struct ImageSaveOptions *options) {
+
+        options->pngCompression = PNG_COMPRESSION_FULL;
+        options->jpgQuality = 100;
+        options->jpgSubsampling = JPEG_SUBSAMPLING_444;
+
+}
+
+
+int save_imageRGB(struct ImageRGB *image, const char *filename, ImageFileType fileType, const struct ImageSaveOptions *options) {
 
         // Validate Image struct parameter
         if (image == NULL || image->redChannels == NULL || image->greenChannels == NULL || image->blueChannels == NULL) {
@@ -162,56 +1153,32 @@ int save_imageRGB(struct ImageRGB *image, const char *filename, ImageFileType fi
 		return 0;
         }
 
-        // Allocate a single contiguous memory block for AoS channel layout
-        uint8_t *tempArray = (uint8_t*)malloc(((image->height * image->width)*3)*sizeof(uint8_t));
-        if (tempArray == NULL) {
-                free(tempArray);
-                fprintf(stderr, "\nFatal error: image could not be saved.\n\n");
-		return 0;
+        // Uncompressed formats are written straight into a mapping of the output file
+        if (fileType == FILE_TYPE_BMP || fileType == FILE_TYPE_PPM || fileType == FILE_TYPE_PGM) {
+                uint8_t *planes[3] = {image->redChannels, image->greenChannels, image->blueChannels};
+                return save_raw_image(planes, 3, image->width, image->height, filename, fileType);
         }
-        
-        // Convert from SoA channel layout (RRRGGGBBB) to AoS channel layout (RGBRGBRGB)
-        for (int i = 0; i < (image->height * image->width); i++) {
-                
-                int tempIndex = i * 3; // Index in tempArray
-
-                tempArray[tempIndex] = image->redChannels[i];
-                tempArray[tempIndex+1] = image->greenChannels[i];
-                tempArray[tempIndex+2] = image->blueChannels[i];
-                
-        }
-
-        // Switch-case statement for saving images to different file types
-        int imageWrite = 0;
-        switch (fileType) {
-                case FILE_TYPE_PNG:
-                        int strideBytes = image->width * image->numChannels;
-                        imageWrite = stbi_write_png(filename, image->width, image->height, image->numChannels,
-                                tempArray, strideBytes);
-                        break;
-                case FILE_TYPE_JPG:
-                        int jpgQuality = 100; // For same image quality compared to png and bmp
-                        imageWrite = stbi_write_jpg(filename, image->width, image->height, image->numChannels,
-                                tempArray, jpgQuality);
-                        break;
-                case FILE_TYPE_BMP:
-                        imageWrite = stbi_write_bmp(filename, image->width, image->height, image->numChannels,
-                                tempArray);
-                        break;
+
+        // PNG files are filtered and deflated straight from the planes, in parallel bands of rows, JPG files are encoded
+        // straight from the planes, in parallel rows of MCUs (restart intervals)
+        struct ImageSaveOptions defaultOptions;
+        init_image_save_options(&defaultOptions);
+        if (options == NULL) options = &defaultOptions;
+        uint8_t *planes[3] = {image->redChannels, image->greenChannels, image->blueChannels};
+        if (fileType == FILE_TYPE_PNG) {
+                return write_png_planes(filename, planes, 3, image->width, image->height, options->pngCompression);
+        }
+        if (fileType == FILE_TYPE_JPG) {
+                return write_jpeg_planes(filename, planes, 3, image->width, image->height, options->jpgQuality,
+                        options->jpgSubsampling);
         }
-        if (imageWrite == 0) {
-		fprintf(stderr, "\nFatal error: Image could not be saved. Reason: %s.\n\n", stbi_failure_reason());
-		return 0;
-	}
 
-        // Free temporary array
-        free(tempArray);
-
-        return 1;
+        fprintf(stderr, "\nFatal error: image could not be saved. Reason: unsupported file type.\n\n");
+        return 0;
 
 }
 
-int save_imageOneChannel(struct ImageOneChannel *image, const char *filename, ImageFileType fileType) {
+int save_imageOneChannel(struct ImageOneChannel *image, const char *filename, ImageFileType fileType, const struct ImageSaveOptions *options) {
 
         // Validate Image struct parameter
         if (image == NULL || image->pixels == NULL) {
@@ -219,30 +1186,27 @@ int save_imageOneChannel(struct ImageOneChannel *image, const char *filename, Im
 		return 0;
         }
 
-        // Switch-case statement for saving image to different file types
-        int imageWrite = 0;
-        switch (fileType) {
-                case FILE_TYPE_PNG:
-                        int strideBytes = image->width * image->numChannels;
-                        imageWrite = stbi_write_png(filename, image->width, image->height, image->numChannels,
-                                image->pixels, strideBytes);
-                        break;
-                case FILE_TYPE_JPG:
-                        int jpgQuality = 100; // For same image quality compared to png and bmp
-                        imageWrite = stbi_write_jpg(filename, image->width, image->height, image->numChannels,
-                                image->pixels, jpgQuality);
-                        break;
-                case FILE_TYPE_BMP:
-                        imageWrite = stbi_write_bmp(filename, image->width, image->height, image->numChannels,
-                                image->pixels);
-                        break;
+        // Uncompressed formats are written straight into a mapping of the output file
+        if (fileType == FILE_TYPE_BMP || fileType == FILE_TYPE_PPM || fileType == FILE_TYPE_PGM) {
+                uint8_t *planes[1] = {image->pixels};
+                return save_raw_image(planes, 1, image->width, image->height, filename, fileType);
         }
-        if (imageWrite == 0) {
-		fprintf(stderr, "\nFatal error: Image could not be saved. Reason: %s.\n\n", stbi_failure_reason());
-		return 0;
-	}
 
-        return 1;
+        // PNG files are filtered and deflated in parallel bands of rows, JPG files encoded in parallel rows of MCUs
+        struct ImageSaveOptions defaultOptions;
+        init_image_save_options(&defaultOptions);
+        if (options == NULL) options = &defaultOptions;
+        uint8_t *planes[1] = {image->pixels};
+        if (fileType == FILE_TYPE_PNG) {
+                return write_png_planes(filename, planes, 1, image->width, image->height, options->pngCompression);
+        }
+        if (fileType == FILE_TYPE_JPG) {
+                return write_jpeg_planes(filename, planes, 1, image->width, image->height, options->jpgQuality,
+                        options->jpgSubsampling);
+        }
+
+        fprintf(stderr, "\nFatal error: image could not be saved. Reason: unsupported file type.\n\n");
+        return 0;
 
 }
 
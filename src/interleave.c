@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <string.h>  // For memset()
+#include <stdint.h>  // For types uint8_t and int8_t
+#include <immintrin.h>
+#include <omp.h>  // For parallel processing
+#include "interleave.h"
+#include "cpu.h"
+
+
+
+
+
+int build_interleave_shuffles(struct InterleaveShuffles *shuffles, int numChannels, int bytesPerChannel) {
+
+        if (numChannels < 2 || numChannels > INTERLEAVE_MAX_CHANNELS || bytesPerChannel < 1 || bytesPerChannel > 2) {
+                fprintf(stderr, "\nFatal error: unsupported interleaved layout (%d channels of %d bytes).\n", numChannels,
+                        bytesPerChannel);
+                return 0;
+        }
+
+        shuffles->numChannels = numChannels;
+        shuffles->bytesPerChannel = bytesPerChannel;
+        memset(shuffles->gather, -1, sizeof(shuffles->gather));
+        memset(shuffles->scatter, -1, sizeof(shuffles->scatter));
+
+        // Byte b of channel c of pixel p sits at byte (p*numChannels + c)*bytesPerChannel + b of the group, and at byte
+        // p*bytesPerChannel + b of the plane
+        for (int pixel = 0; pixel < 16 / bytesPerChannel; pixel++) {
+                for (int channel = 0; channel < numChannels; channel++) {
+                        for (int byte = 0; byte < bytesPerChannel; byte++) {
+                                int planeByte = pixel*bytesPerChannel + byte;
+                                int groupByte = (pixel*numChannels + channel)*bytesPerChannel + byte;
+                                shuffles->gather[channel][groupByte / 16][planeByte] = (int8_t) (groupByte % 16);
+                                shuffles->scatter[groupByte / 16][channel][groupByte % 16] = (int8_t) planeByte;
+                        }
+                }
+        }
+
+        return 1;
+
+}
+
+
+// Deinterleaves pixels [start, end), one byte at a time
+static void deinterleave_channels_scalar(const uint8_t *source, uint8_t **planes, int numChannels, int bytesPerChannel, size_t start,
+        size_t end) {
+
+        for (size_t i = start; i < end; i++) {
+                for (int channel = 0; channel < numChannels; channel++) {
+                        for (int byte = 0; byte < bytesPerChannel; byte++) {
+                                planes[channel][i*bytesPerChannel + byte] = source[(i*numChannels + channel)*bytesPerChannel + byte];
+                        }
+                }
+        }
+
+}
+
+
+// Interleaves pixels [start, end), one byte at a time
+static void interleave_channels_scalar(uint8_t *const *planes, uint8_t *destination, int numChannels, int bytesPerChannel, size_t start,
+        size_t end) {
+
+        for (size_t i = start; i < end; i++) {
+                for (int channel = 0; channel < numChannels; channel++) {
+                        for (int byte = 0; byte < bytesPerChannel; byte++) {
+                                destination[(i*numChannels + channel)*bytesPerChannel + byte] = planes[channel][i*bytesPerChannel + byte];
+                        }
+                }
+        }
+
+}
+
+
+// SSE4.1 versions, one group of pixels at a time. Return the first pixel left to the scalar version
+CPU_TARGET_SSE41
+static size_t deinterleave_channels_sse41(const uint8_t *source, uint8_t **planes, const struct InterleaveShuffles *shuffles,
+        size_t start, size_t end) {
+
+        int numChannels = shuffles->numChannels;
+        int bytesPerChannel = shuffles->bytesPerChannel;
+        size_t groupPixels = 16 / bytesPerChannel;
+
+        size_t i = start;
+        for (; i + groupPixels <= end; i += groupPixels) {
+
+                // Load the chunks of the group
+                const uint8_t *group = &source[i*numChannels*bytesPerChannel];
+                __m128i chunks[INTERLEAVE_MAX_CHANNELS];
+                for (int k = 0; k < numChannels; k++) chunks[k] = _mm_loadu_si128((__m128i*) &group[16*k]);
+
+                // Gather each channel from the chunks
+                for (int channel = 0; channel < numChannels; channel++) {
+                        __m128i result = _mm_setzero_si128();
+                        for (int k = 0; k < numChannels; k++) {
+                                __m128i shuffle = _mm_load_si128((__m128i*) shuffles->gather[channel][k]);
+                                result = _mm_or_si128(result, _mm_shuffle_epi8(chunks[k], shuffle));
+                        }
+                        _mm_storeu_si128((__m128i*) &planes[channel][i*bytesPerChannel], result);
+                }
+        }
+
+        return i;
+
+}
+
+CPU_TARGET_SSE41
+static size_t interleave_channels_sse41(uint8_t *const *planes, uint8_t *destination, const struct InterleaveShuffles *shuffles,
+        size_t start, size_t end) {
+
+        int numChannels = shuffles->numChannels;
+        int bytesPerChannel = shuffles->bytesPerChannel;
+        size_t groupPixels = 16 / bytesPerChannel;
+
+        size_t i = start;
+        for (; i + groupPixels <= end; i += groupPixels) {
+
+                // Load the channels of the group
+                __m128i channels[INTERLEAVE_MAX_CHANNELS];
+                for (int c = 0; c < numChannels; c++) channels[c] = _mm_loadu_si128((__m128i*) &planes[c][i*bytesPerChannel]);
+
+                // Scatter the channels into each chunk
+                uint8_t *group = &destination[i*numChannels*bytesPerChannel];
+                for (int k = 0; k < numChannels; k++) {
+                        __m128i result = _mm_setzero_si128();
+                        for (int c = 0; c < numChannels; c++) {
+                                __m128i shuffle = _mm_load_si128((__m128i*) shuffles->scatter[k][c]);
+                                result = _mm_or_si128(result, _mm_shuffle_epi8(channels[c], shuffle));
+                        }
+                        _mm_storeu_si128((__m128i*) &group[16*k], result);
+                }
+        }
+
+        return i;
+
+}
+
+
+// AVX2 versions, two groups of pixels at a time (the byte shuffles work per 128 bit lane, so each lane holds a group)
+CPU_TARGET_AVX2
+static size_t deinterleave_channels_avx2(const uint8_t *source, uint8_t **planes, const struct InterleaveShuffles *shuffles,
+        size_t start, size_t end) {
+
+        int numChannels = shuffles->numChannels;
+        int bytesPerChannel = shuffles->bytesPerChannel;
+        size_t groupPixels = 16 / bytesPerChannel;
+        size_t groupBytes = 16*numChannels;
+
+        size_t i = start;
+        for (; i + 2*groupPixels <= end; i += 2*groupPixels) {
+
+                // Load chunk k of the two groups into the two lanes
+                const uint8_t *group = &source[i*numChannels*bytesPerChannel];
+                __m256i chunks[INTERLEAVE_MAX_CHANNELS];
+                for (int k = 0; k < numChannels; k++) {
+                        __m128i lowerLane = _mm_loadu_si128((__m128i*) &group[16*k]);
+                        __m128i upperLane = _mm_loadu_si128((__m128i*) &group[groupBytes + 16*k]);
+                        chunks[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(lowerLane), upperLane, 1);
+                }
+
+                // Gather each channel from the chunks
+                for (int channel = 0; channel < numChannels; channel++) {
+                        __m256i result = _mm256_setzero_si256();
+                        for (int k = 0; k < numChannels; k++) {
+                                __m256i shuffle = _mm256_broadcastsi128_si256(_mm_load_si128((__m128i*) shuffles->gather[channel][k]));
+                                result = _mm256_or_si256(result, _mm256_shuffle_epi8(chunks[k], shuffle));
+                        }
+                        _mm256_storeu_si256((__m256i*) &planes[channel][i*bytesPerChannel], result);
+                }
+        }
+
+        return i;
+
+}
+
+CPU_TARGET_AVX2
+static size_t interleave_channels_avx2(uint8_t *const *planes, uint8_t *destination, const struct InterleaveShuffles *shuffles,
+        size_t start, size_t end) {
+
+        int numChannels = shuffles->numChannels;
+        int bytesPerChannel = shuffles->bytesPerChannel;
+        size_t groupPixels = 16 / bytesPerChannel;
+        size_t groupBytes = 16*numChannels;
+
+        size_t i = start;
+        for (; i + 2*groupPixels <= end; i += 2*groupPixels) {
+
+                // Load the channels of the two groups (one group per lane)
+                __m256i channels[INTERLEAVE_MAX_CHANNELS];
+                for (int c = 0; c < numChannels; c++) channels[c] = _mm256_loadu_si256((__m256i*) &planes[c][i*bytesPerChannel]);
+
+                // Scatter the channels into chunk k of both groups
+                uint8_t *group = &destination[i*numChannels*bytesPerChannel];
+                for (int k = 0; k < numChannels; k++) {
+                        __m256i result = _mm256_setzero_si256();
+                        for (int c = 0; c < numChannels; c++) {
+                                __m256i shuffle = _mm256_broadcastsi128_si256(_mm_load_si128((__m128i*) shuffles->scatter[k][c]));
+                                result = _mm256_or_si256(result, _mm256_shuffle_epi8(channels[c], shuffle));
+                        }
+                        _mm_storeu_si128((__m128i*) &group[16*k], _mm256_castsi256_si128(result));
+                        _mm_storeu_si128((__m128i*) &group[groupBytes + 16*k], _mm256_extracti128_si256(result, 1));
+                }
+        }
+
+        return i;
+
+}
+
+
+// AVX-512 versions, four groups of pixels at a time (one per 128 bit lane)
+CPU_TARGET_AVX512
+static size_t deinterleave_channels_avx512(const uint8_t *source, uint8_t **planes, const struct InterleaveShuffles *shuffles,
+        size_t start, size_t end) {
+
+        int numChannels = shuffles->numChannels;
+        int bytesPerChannel = shuffles->bytesPerChannel;
+        size_t groupPixels = 16 / bytesPerChannel;
+        size_t groupBytes = 16*numChannels;
+
+        size_t i = start;
+        for (; i + 4*groupPixels <= end; i += 4*groupPixels) {
+
+                // Load chunk k of the four groups into the four lanes
+                const uint8_t *group = &source[i*numChannels*bytesPerChannel];
+                __m512i chunks[INTERLEAVE_MAX_CHANNELS];
+                for (int k = 0; k < numChannels; k++) {
+                        __m512i chunk = _mm512_castsi128_si512(_mm_loadu_si128((__m128i*) &group[16*k]));
+                        chunk = _mm512_inserti32x4(chunk, _mm_loadu_si128((__m128i*) &group[groupBytes + 16*k]), 1);
+                        chunk = _mm512_inserti32x4(chunk, _mm_loadu_si128((__m128i*) &group[2*groupBytes + 16*k]), 2);
+                        chunks[k] = _mm512_inserti32x4(chunk, _mm_loadu_si128((__m128i*) &group[3*groupBytes + 16*k]), 3);
+                }
+
+                // Gather each channel from the chunks
+                for (int channel = 0; channel < numChannels; channel++) {
+                        __m512i result = _mm512_setzero_si512();
+                        for (int k = 0; k < numChannels; k++) {
+                                __m512i shuffle = _mm512_broadcast_i32x4(_mm_load_si128((__m128i*) shuffles->gather[channel][k]));
+                                result = _mm512_or_si512(result, _mm512_shuffle_epi8(chunks[k], shuffle));
+                        }
+                        _mm512_storeu_si512((__m512i*) &planes[channel][i*bytesPerChannel], result);
+                }
+        }
+
+        return i;
+
+}
+
+CPU_TARGET_AVX512
+static size_t interleave_channels_avx512(uint8_t *const *planes, uint8_t *destination, const struct InterleaveShuffles *shuffles,
+        size_t start, size_t end) {
+
+        int numChannels = shuffles->numChannels;
+        int bytesPerChannel = shuffles->bytesPerChannel;
+        size_t groupPixels = 16 / bytesPerChannel;
+        size_t groupBytes = 16*numChannels;
+
+        size_t i = start;
+        for (; i + 4*groupPixels <= end; i += 4*groupPixels) {
+
+                // Load the channels of the four groups (one group per lane)
+                __m512i channels[INTERLEAVE_MAX_CHANNELS];
+                for (int c = 0; c < numChannels; c++) channels[c] = _mm512_loadu_si512((__m512i*) &planes[c][i*bytesPerChannel]);
+
+                // Scatter the channels into chunk k of the four groups
+                uint8_t *group = &destination[i*numChannels*bytesPerChannel];
+                for (int k = 0; k < numChannels; k++) {
+                        __m512i result = _mm512_setzero_si512();
+                        for (int c = 0; c < numChannels; c++) {
+                                __m512i shuffle = _mm512_broadcast_i32x4(_mm_load_si128((__m128i*) shuffles->scatter[k][c]));
+                                result = _mm512_or_si512(result, _mm512_shuffle_epi8(channels[c], shuffle));
+                        }
+                        _mm_storeu_si128((__m128i*) &group[16*k], _mm512_castsi512_si128(result));
+                        _mm_storeu_si128((__m128i*) &group[groupBytes + 16*k], _mm512_extracti32x4_epi32(result, 1));
+                        _mm_storeu_si128((__m128i*) &group[2*groupBytes + 16*k], _mm512_extracti32x4_epi32(result, 2));
+                        _mm_storeu_si128((__m128i*) &group[3*groupBytes + 16*k], _mm512_extracti32x4_epi32(result, 3));
+                }
+        }
+
+        return i;
+
+}
+
+
+// Deinterleaves pixels [start, end) with the widest vector version, finished by the scalar one
+static void deinterleave_channels_range(const uint8_t *source, uint8_t **planes, const struct InterleaveShuffles *shuffles,
+        enum CpuFeatureLevel level, size_t start, size_t end) {
+
+        size_t i = start;
+        switch (level) {
+                case CPU_FEATURE_LEVEL_AVX512:  i = deinterleave_channels_avx512(source, planes, shuffles, start, end); break;
+                case CPU_FEATURE_LEVEL_AVX2:    i = deinterleave_channels_avx2(source, planes, shuffles, start, end); break;
+                case CPU_FEATURE_LEVEL_SSE41:   i = deinterleave_channels_sse41(source, planes, shuffles, start, end); break;
+                default:                        break;
+        }
+        deinterleave_channels_scalar(source, planes, shuffles->numChannels, shuffles->bytesPerChannel, i, end);
+
+}
+
+
+// Interleaves pixels [start, end) with the widest vector version, finished by the scalar one
+static void interleave_channels_range(uint8_t *const *planes, uint8_t *destination, const struct InterleaveShuffles *shuffles,
+        enum CpuFeatureLevel level, size_t start, size_t end) {
+
+        size_t i = start;
+        switch (level) {
+                case CPU_FEATURE_LEVEL_AVX512:  i = interleave_channels_avx512(planes, destination, shuffles, start, end); break;
+                case CPU_FEATURE_LEVEL_AVX2:    i = interleave_channels_avx2(planes, destination, shuffles, start, end); break;
+                case CPU_FEATURE_LEVEL_SSE41:   i = interleave_channels_sse41(planes, destination, shuffles, start, end); break;
+                default:                        break;
+        }
+        interleave_channels_scalar(planes, destination, shuffles->numChannels, shuffles->bytesPerChannel, i, end);
+
+}
+
+
+int deinterleave_channels(const uint8_t *source, uint8_t **planes, int numChannels, int bytesPerChannel, size_t numPixels) {
+
+        struct InterleaveShuffles shuffles;
+        if (!build_interleave_shuffles(&shuffles, numChannels, bytesPerChannel)) return 0;
+        enum CpuFeatureLevel level = cpu_feature_level();
+
+        // Parallelize over blocks of pixels
+        size_t numBlocks = (numPixels + INTERLEAVE_BLOCK_PIXELS - 1) / INTERLEAVE_BLOCK_PIXELS;
+        #pragma omp parallel for schedule(static) if (numBlocks > 1)
+        for (size_t block = 0; block < numBlocks; block++) {
+                size_t start = block*INTERLEAVE_BLOCK_PIXELS;
+                size_t end = (start + INTERLEAVE_BLOCK_PIXELS < numPixels) ? start + INTERLEAVE_BLOCK_PIXELS : numPixels;
+                deinterleave_channels_range(source, planes, &shuffles, level, start, end);
+        }
+
+        return 1;
+
+}
+
+
+int interleave_channels(uint8_t *const *planes, uint8_t *destination, int numChannels, int bytesPerChannel, size_t numPixels) {
+
+        struct InterleaveShuffles shuffles;
+        if (!build_interleave_shuffles(&shuffles, numChannels, bytesPerChannel)) return 0;
+        enum CpuFeatureLevel level = cpu_feature_level();
+
+        // Parallelize over blocks of pixels
+        size_t numBlocks = (numPixels + INTERLEAVE_BLOCK_PIXELS - 1) / INTERLEAVE_BLOCK_PIXELS;
+        #pragma omp parallel for schedule(static) if (numBlocks > 1)
+        for (size_t block = 0; block < numBlocks; block++) {
+                size_t start = block*INTERLEAVE_BLOCK_PIXELS;
+                size_t end = (start + INTERLEAVE_BLOCK_PIXELS < numPixels) ? start + INTERLEAVE_BLOCK_PIXELS : numPixels;
+                interleave_channels_range(planes, destination, &shuffles, level, start, end);
+        }
+
+        return 1;
+
+}
+
+
+void deinterleave_channels_row(const uint8_t *source, uint8_t **planes, const struct InterleaveShuffles *shuffles, size_t numPixels) {
+
+        deinterleave_channels_range(source, planes, shuffles, cpu_feature_level(), 0, numPixels);
+
+}
+
+
+void interleave_channels_row(uint8_t *const *planes, uint8_t *destination, const struct InterleaveShuffles *shuffles, size_t numPixels) {
+
+        interleave_channels_range(planes, destination, shuffles, cpu_feature_level(), 0, numPixels);
+
+}
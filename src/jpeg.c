@@ -0,0 +1,599 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  // For memcpy()
+#include <math.h>  // For copysignf()
+#include <stdint.h>  // For types uint8_t, uint16_t and uint32_t
+#include <omp.h>  // For parallel processing
+#include "jpeg.h"
+#include "pool.h"
+
+
+
+// Samples of a block transformed by the DCT (8x8)
+#define JPEG_BLOCK_SIZE 8
+#define JPEG_BLOCK_SAMPLES 64
+
+// Largest magnitude of a quantized AC coefficient (size category 10 of the standard Huffman tables)
+#define JPEG_MAX_AC 1023
+
+// Bytes a block takes at most in the entropy coded data: the DC difference (a code of up to 11 bits and 11 extra bits), 63
+// AC coefficients (codes of up to 16 bits and 10 extra bits), and a stuffed zero byte after every 0xFF byte
+#define JPEG_MAX_BLOCK_BYTES (2*((22 + 63*26 + 7)/8))
+
+// Markers of the JPEG file
+#define JPEG_MARKER_SOI 0xD8
+#define JPEG_MARKER_EOI 0xD9
+#define JPEG_MARKER_APP0 0xE0
+#define JPEG_MARKER_DQT 0xDB
+#define JPEG_MARKER_SOF0 0xC0
+#define JPEG_MARKER_DHT 0xC4
+#define JPEG_MARKER_DRI 0xDD
+#define JPEG_MARKER_SOS 0xDA
+#define JPEG_MARKER_RST0 0xD0
+
+
+// Position of the coefficients of a block (in row order) in the zig-zag order of the file
+static const uint8_t zigzagPositions[JPEG_BLOCK_SAMPLES] = {0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42, 3, 8, 12, 17,
+        25, 30, 41, 43, 9, 11, 18, 24, 31, 40, 44, 53, 10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60, 21, 34, 37,
+        47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63};
+
+// Standard luminance and chrominance quantization tables (ITU T.81 Annex K.1, in row order) at quality 50
+static const uint8_t standardQuantization[2][JPEG_BLOCK_SAMPLES] = {
+        {16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55, 14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87,
+                80, 62, 18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92, 49, 64, 78, 87, 103, 121, 120, 101,
+                72, 92, 95, 98, 112, 100, 103, 99},
+        {17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99,
+                99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+                99, 99, 99, 99, 99, 99}
+};
+
+// Scale factors of the AAN DCT outputs (cos(k*pi/16)*sqrt(2) for k > 0), times sqrt(8) for the normalization of the DCT
+static const float dctScales[JPEG_BLOCK_SIZE] = {1.0f*2.828427125f, 1.387039845f*2.828427125f, 1.306562965f*2.828427125f,
+        1.175875602f*2.828427125f, 1.0f*2.828427125f, 0.785694958f*2.828427125f, 0.541196100f*2.828427125f,
+        0.275899379f*2.828427125f};
+
+// Standard Huffman tables (ITU T.81 Annex K.3): the number of codes of every length from 1 to 16 bits, then the symbols
+static const uint8_t dcLuminanceCounts[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t dcChrominanceCounts[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t dcSymbols[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t acLuminanceCounts[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t acLuminanceSymbols[162] = {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32,
+        0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+        0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45,
+        0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94,
+        0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+        0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8,
+        0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa};
+static const uint8_t acChrominanceCounts[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t acChrominanceSymbols[162] = {
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81,
+        0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+        0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44,
+        0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92,
+        0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+        0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+        0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa};
+
+// Names of the chroma subsamplings
+static const char *jpegSubsamplingNames[JPEG_SUBSAMPLING_INVALID] = {"4:4:4", "4:2:2", "4:2:0"};
+
+// Horizontal and vertical sampling factors of the luminance (the chrominance always has factors of one)
+static const int lumaSampling[JPEG_SUBSAMPLING_INVALID][2] = {{1, 1}, {2, 1}, {2, 2}};
+
+
+
+/**
+ * @brief Structure for representing the codes of a Huffman table: the code (MSB first) and its length for every symbol.
+ */
+typedef struct JpegHuffmanTable {
+        uint16_t codes[256];
+        uint8_t lengths[256];
+} JpegHuffmanTable;
+
+/**
+ * @brief Structure for representing the tables of the JPEG encoder, index 0 for the luminance and 1 for the chrominance:
+ * the quantization tables in zig-zag order (as stored in the file), the reciprocals of the quantization steps times the
+ * DCT scale factors in row order (multiplied with the AAN DCT outputs to quantize), and the Huffman codes.
+ */
+typedef struct JpegTables {
+        uint8_t quantization[2][JPEG_BLOCK_SAMPLES];
+        float quantizationScales[2][JPEG_BLOCK_SAMPLES];
+        struct JpegHuffmanTable dc[2];
+        struct JpegHuffmanTable ac[2];
+} JpegTables;
+
+/**
+ * @brief Structure for representing a JPEG bit writer: bits are appended MSB first to the top of `bits` and stored a
+ * byte at a time at `output[position]`, with a zero byte stuffed after every 0xFF byte.
+ */
+typedef struct JpegBitWriter {
+        uint8_t *output;
+        size_t position;
+        uint32_t bits;
+        int numBits;
+} JpegBitWriter;
+
+
+
+// Builds the codes of a Huffman table from the number of codes of every length (canonical codes, as decoders rebuild them)
+static void build_huffman_table(struct JpegHuffmanTable *table, const uint8_t *counts, const uint8_t *symbols) {
+
+        memset(table, 0, sizeof(*table));
+        int code = 0;
+        int k = 0;
+        for (int length = 1; length <= 16; length++) {
+                for (int i = 0; i < counts[length - 1]; i++) {
+                        table->codes[symbols[k]] = (uint16_t) code++;
+                        table->lengths[symbols[k]] = (uint8_t) length;
+                        k++;
+                }
+                code <<= 1;
+        }
+
+}
+
+
+// Builds the quantization tables of a quality (1 to 100, scaled as by the IJG library) and the Huffman codes
+static void build_jpeg_tables(struct JpegTables *tables, int quality) {
+
+        int scale = (quality < 50) ? 5000 / quality : 200 - 2*quality;
+        for (int t = 0; t < 2; t++) {
+                for (int row = 0, k = 0; row < JPEG_BLOCK_SIZE; row++) {
+                        for (int col = 0; col < JPEG_BLOCK_SIZE; col++, k++) {
+                                int step = (standardQuantization[t][k]*scale + 50) / 100;
+                                step = (step < 1) ? 1 : (step > 255) ? 255 : step;
+                                tables->quantization[t][zigzagPositions[k]] = (uint8_t) step;
+                                tables->quantizationScales[t][k] = 1.0f / ((float) step*dctScales[row]*dctScales[col]);
+                        }
+                }
+        }
+
+        build_huffman_table(&tables->dc[0], dcLuminanceCounts, dcSymbols);
+        build_huffman_table(&tables->dc[1], dcChrominanceCounts, dcSymbols);
+        build_huffman_table(&tables->ac[0], acLuminanceCounts, acLuminanceSymbols);
+        build_huffman_table(&tables->ac[1], acChrominanceCounts, acChrominanceSymbols);
+
+}
+
+
+// Appends the lowest `count` bits of a value (count <= 16), storing every completed byte
+static inline void put_jpeg_bits(struct JpegBitWriter *writer, uint32_t value, int count) {
+
+        writer->bits |= value << (32 - writer->numBits - count);
+        writer->numBits += count;
+        while (writer->numBits >= 8) {
+                uint8_t byte = (uint8_t) (writer->bits >> 24);
+                writer->output[writer->position++] = byte;
+                if (byte == 0xFF) writer->output[writer->position++] = 0;
+                writer->bits <<= 8;
+                writer->numBits -= 8;
+        }
+
+}
+
+
+// Appends the code of the symbol of a value (its size category, after `run` zero coefficients for AC values) and the bits of
+// the value (negative values as the ones' complement of their magnitude)
+static inline void put_jpeg_value(struct JpegBitWriter *writer, const struct JpegHuffmanTable *table, int run, int value) {
+
+        int magnitude = (value < 0) ? -value : value;
+        int size = (magnitude == 0) ? 0 : 32 - __builtin_clz((unsigned int) magnitude);
+        int symbol = (run << 4) | size;
+        put_jpeg_bits(writer, table->codes[symbol], table->lengths[symbol]);
+        if (size > 0) {
+                put_jpeg_bits(writer, (uint32_t) (value < 0 ? value - 1 : value) & ((1u << size) - 1), size);
+        }
+
+}
+
+
+// Pads the last byte with one bits (the end of a restart interval or of the scan)
+static void flush_jpeg_bits(struct JpegBitWriter *writer) {
+
+        if (writer->numBits > 0) put_jpeg_bits(writer, (1u << (8 - writer->numBits)) - 1, 8 - writer->numBits);
+
+}
+
+
+// One dimensional AAN DCT of eight samples `stride` floats apart, in place (the outputs lack the factors of dctScales)
+static inline void forward_dct_8(float *data, int stride) {
+
+        float *d0 = &data[0], *d1 = &data[stride], *d2 = &data[2*stride], *d3 = &data[3*stride];
+        float *d4 = &data[4*stride], *d5 = &data[5*stride], *d6 = &data[6*stride], *d7 = &data[7*stride];
+
+        float tmp0 = *d0 + *d7, tmp7 = *d0 - *d7;
+        float tmp1 = *d1 + *d6, tmp6 = *d1 - *d6;
+        float tmp2 = *d2 + *d5, tmp5 = *d2 - *d5;
+        float tmp3 = *d3 + *d4, tmp4 = *d3 - *d4;
+
+        // Even part
+        float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+        float tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+        *d0 = tmp10 + tmp11;
+        *d4 = tmp10 - tmp11;
+        float z1 = (tmp12 + tmp13)*0.707106781f;
+        *d2 = tmp13 + z1;
+        *d6 = tmp13 - z1;
+
+        // Odd part
+        tmp10 = tmp4 + tmp5;
+        tmp11 = tmp5 + tmp6;
+        tmp12 = tmp6 + tmp7;
+        float z5 = (tmp10 - tmp12)*0.382683433f;
+        float z2 = tmp10*0.541196100f + z5;
+        float z4 = tmp12*1.306562965f + z5;
+        float z3 = tmp11*0.707106781f;
+        float z11 = tmp7 + z3, z13 = tmp7 - z3;
+        *d5 = z13 + z2;
+        *d3 = z13 - z2;
+        *d1 = z11 + z4;
+        *d7 = z11 - z4;
+
+}
+
+
+// Transforms, quantizes and Huffman codes a block of level shifted samples (destroyed). Returns the quantized DC
+// coefficient, the prediction of the next block of the component
+static int encode_jpeg_block(struct JpegBitWriter *writer, float *block, const float *quantizationScales, int previousDc,
+        const struct JpegHuffmanTable *dcTable, const struct JpegHuffmanTable *acTable) {
+
+        // DCT of the rows, then of the columns
+        for (int i = 0; i < JPEG_BLOCK_SIZE; i++) {
+                forward_dct_8(&block[i*JPEG_BLOCK_SIZE], 1);
+        }
+        for (int i = 0; i < JPEG_BLOCK_SIZE; i++) {
+                forward_dct_8(&block[i], JPEG_BLOCK_SIZE);
+        }
+
+        // Quantize (rounded to the nearest integer, AC values clamped to the largest size category) without branches, so
+        // that the loop vectorizes. The DC value keeps its full range
+        int quantized[JPEG_BLOCK_SAMPLES];
+        for (int k = 0; k < JPEG_BLOCK_SAMPLES; k++) {
+                float value = block[k]*quantizationScales[k];
+                value = (value < -JPEG_MAX_AC) ? -JPEG_MAX_AC : (value > JPEG_MAX_AC) ? JPEG_MAX_AC : value;
+                quantized[k] = (int) (value + copysignf(0.5f, value));
+        }
+        float dc = block[0]*quantizationScales[0];
+        quantized[0] = (int) (dc + copysignf(0.5f, dc));
+
+        // Reorder into zig-zag order, with a mask of the nonzero AC coefficients
+        int coefficients[JPEG_BLOCK_SAMPLES];
+        uint64_t nonzero = 0;
+        for (int k = 0; k < JPEG_BLOCK_SAMPLES; k++) {
+                coefficients[zigzagPositions[k]] = quantized[k];
+                nonzero |= (uint64_t) (quantized[k] != 0) << zigzagPositions[k];
+        }
+        nonzero &= ~(uint64_t) 1;
+
+        // DC difference to the previous block
+        put_jpeg_value(writer, dcTable, 0, coefficients[0] - previousDc);
+
+        // AC coefficients as runs of zeros (at most 15, 0xF0 codes 16 zeros) and values, from one nonzero coefficient to
+        // the next
+        int position = 0;
+        while (nonzero != 0) {
+                int k = __builtin_ctzll(nonzero);
+                int run = k - position - 1;
+                while (run >= 16) {
+                        put_jpeg_bits(writer, acTable->codes[0xF0], acTable->lengths[0xF0]);
+                        run -= 16;
+                }
+                put_jpeg_value(writer, acTable, run, coefficients[k]);
+                position = k;
+                nonzero &= nonzero - 1;
+        }
+
+        // End of block, unless the last coefficient is nonzero
+        if (position < JPEG_BLOCK_SAMPLES - 1) put_jpeg_bits(writer, acTable->codes[0x00], acTable->lengths[0x00]);
+
+        return coefficients[0];
+
+}
+
+
+// Colour converts rows of the planes into level shifted Y, Cb and Cr samples (Y alone for one plane), `paddedWidth` samples
+// per row with the last column and row of the image repeated over the padding
+static void convert_jpeg_rows(uint8_t *const *planes, int numPlanes, int width, int height, int firstRow, int numRows,
+        int paddedWidth, float *luma, float *chromaBlue, float *chromaRed) {
+
+        for (int r = 0; r < numRows; r++) {
+                int y = (firstRow + r < height) ? firstRow + r : height - 1;
+                size_t offset = (size_t) y*width;
+                float *lumaRow = &luma[(size_t) r*paddedWidth];
+
+                if (numPlanes == 1) {
+                        const uint8_t *grey = &planes[0][offset];
+                        for (int x = 0; x < width; x++) {
+                                lumaRow[x] = (float) grey[x] - 128.0f;
+                        }
+                } else {
+                        const uint8_t *red = &planes[0][offset];
+                        const uint8_t *green = &planes[1][offset];
+                        const uint8_t *blue = &planes[2][offset];
+                        float *blueRow = &chromaBlue[(size_t) r*paddedWidth];
+                        float *redRow = &chromaRed[(size_t) r*paddedWidth];
+                        for (int x = 0; x < width; x++) {
+                                float R = red[x], G = green[x], B = blue[x];
+                                lumaRow[x] = 0.29900f*R + 0.58700f*G + 0.11400f*B - 128.0f;
+                                blueRow[x] = -0.16874f*R - 0.33126f*G + 0.50000f*B;
+                                redRow[x] = 0.50000f*R - 0.41869f*G - 0.08131f*B;
+                        }
+                        for (int x = width; x < paddedWidth; x++) {
+                                blueRow[x] = blueRow[width - 1];
+                                redRow[x] = redRow[width - 1];
+                        }
+                }
+                for (int x = width; x < paddedWidth; x++) {
+                        lumaRow[x] = lumaRow[width - 1];
+                }
+        }
+
+}
+
+
+// Averages rows of chroma samples over `horizontal` x `vertical` samples (in place, the output rows are `paddedWidth /
+// horizontal` samples wide and never overtake the input)
+static void subsample_jpeg_chroma(float *chroma, int paddedWidth, int numRows, int horizontal, int vertical) {
+
+        int outputWidth = paddedWidth / horizontal;
+        float weight = 1.0f / (float) (horizontal*vertical);
+        for (int r = 0; r < numRows / vertical; r++) {
+                for (int x = 0; x < outputWidth; x++) {
+                        float sum = 0.0f;
+                        for (int v = 0; v < vertical; v++) {
+                                const float *row = &chroma[(size_t) (r*vertical + v)*paddedWidth + (size_t) x*horizontal];
+                                for (int h = 0; h < horizontal; h++) {
+                                        sum += row[h];
+                                }
+                        }
+                        chroma[(size_t) r*outputWidth + x] = sum*weight;
+                }
+        }
+
+}
+
+
+// Copies the 8x8 block at (x, y) of rows of samples `rowWidth` wide
+static inline void load_jpeg_block(const float *samples, int rowWidth, int x, int y, float *block) {
+
+        for (int r = 0; r < JPEG_BLOCK_SIZE; r++) {
+                memcpy(&block[r*JPEG_BLOCK_SIZE], &samples[(size_t) (y + r)*rowWidth + x], JPEG_BLOCK_SIZE*sizeof(float));
+        }
+
+}
+
+
+static void put_u16_be(uint8_t *bytes, size_t *position, int value) {
+
+        bytes[(*position)++] = (uint8_t) (value >> 8);
+        bytes[(*position)++] = (uint8_t) value;
+
+}
+
+
+// Appends the header of a marker segment (the marker and the length of its payload, the length field included)
+static void put_jpeg_marker(uint8_t *bytes, size_t *position, int marker, int length) {
+
+        bytes[(*position)++] = 0xFF;
+        bytes[(*position)++] = (uint8_t) marker;
+        if (length > 0) put_u16_be(bytes, position, length);
+
+}
+
+
+// Builds the headers of the file up to the start of the scan. Returns their size
+static size_t build_jpeg_headers(uint8_t *bytes, const struct JpegTables *tables, int numComponents, int width, int height,
+        enum JpegSubsampling subsampling, int restartInterval) {
+
+        size_t position = 0;
+        int numTables = (numComponents == 3) ? 2 : 1;
+
+        // Start of image and JFIF header (version 1.1, square pixels, no thumbnail)
+        put_jpeg_marker(bytes, &position, JPEG_MARKER_SOI, 0);
+        static const uint8_t jfif[14] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+        put_jpeg_marker(bytes, &position, JPEG_MARKER_APP0, 2 + sizeof(jfif));
+        memcpy(&bytes[position], jfif, sizeof(jfif));
+        position += sizeof(jfif);
+
+        // Quantization tables (8 bit steps)
+        put_jpeg_marker(bytes, &position, JPEG_MARKER_DQT, 2 + numTables*(1 + JPEG_BLOCK_SAMPLES));
+        for (int t = 0; t < numTables; t++) {
+                bytes[position++] = (uint8_t) t;
+                memcpy(&bytes[position], tables->quantization[t], JPEG_BLOCK_SAMPLES);
+                position += JPEG_BLOCK_SAMPLES;
+        }
+
+        // Frame header: baseline, 8 bit samples, the sampling factors and quantization table of every component
+        put_jpeg_marker(bytes, &position, JPEG_MARKER_SOF0, 8 + 3*numComponents);
+        bytes[position++] = 8;
+        put_u16_be(bytes, &position, height);
+        put_u16_be(bytes, &position, width);
+        bytes[position++] = (uint8_t) numComponents;
+        for (int c = 0; c < numComponents; c++) {
+                bytes[position++] = (uint8_t) (c + 1);
+                bytes[position++] = (c == 0) ? (uint8_t) ((lumaSampling[subsampling][0] << 4) | lumaSampling[subsampling][1]) : 0x11;
+                bytes[position++] = (uint8_t) ((c == 0) ? 0 : 1);
+        }
+
+        // Huffman tables: DC and AC of the luminance, then of the chrominance
+        const uint8_t *counts[2][2] = {{dcLuminanceCounts, acLuminanceCounts}, {dcChrominanceCounts, acChrominanceCounts}};
+        const uint8_t *symbols[2][2] = {{dcSymbols, acLuminanceSymbols}, {dcSymbols, acChrominanceSymbols}};
+        size_t lengthPosition = position + 2;
+        put_jpeg_marker(bytes, &position, JPEG_MARKER_DHT, 0);
+        position += 2;
+        for (int t = 0; t < numTables; t++) {
+                for (int tableClass = 0; tableClass < 2; tableClass++) {
+                        bytes[position++] = (uint8_t) ((tableClass << 4) | t);
+                        int numSymbols = 0;
+                        for (int i = 0; i < 16; i++) {
+                                bytes[position++] = counts[t][tableClass][i];
+                                numSymbols += counts[t][tableClass][i];
+                        }
+                        memcpy(&bytes[position], symbols[t][tableClass], numSymbols);
+                        position += numSymbols;
+                }
+        }
+        put_u16_be(bytes, &lengthPosition, (int) (position - lengthPosition));
+
+        // Restart interval (in MCUs)
+        put_jpeg_marker(bytes, &position, JPEG_MARKER_DRI, 4);
+        put_u16_be(bytes, &position, restartInterval);
+
+        // Scan header: every component with its Huffman tables, all coefficients in a single sequential scan
+        put_jpeg_marker(bytes, &position, JPEG_MARKER_SOS, 6 + 2*numComponents);
+        bytes[position++] = (uint8_t) numComponents;
+        for (int c = 0; c < numComponents; c++) {
+                bytes[position++] = (uint8_t) (c + 1);
+                bytes[position++] = (uint8_t) ((c == 0) ? 0x00 : 0x11);
+        }
+        bytes[position++] = 0;
+        bytes[position++] = JPEG_BLOCK_SAMPLES - 1;
+        bytes[position++] = 0;
+
+        return position;
+
+}
+
+
+
+const char *jpeg_subsampling_name(enum JpegSubsampling subsampling) {
+
+        if (subsampling < 0 || subsampling >= JPEG_SUBSAMPLING_INVALID) return "invalid";
+        return jpegSubsamplingNames[subsampling];
+
+}
+
+
+int write_jpeg_planes(const char *filename, uint8_t *const *planes, int numPlanes, int width, int height, int quality,
+        enum JpegSubsampling subsampling) {
+
+        if ((numPlanes != 1 && numPlanes != 3) || width <= 0 || height <= 0 || quality < 1 || quality > 100 ||
+                        subsampling < 0 || subsampling >= JPEG_SUBSAMPLING_INVALID) {
+                fprintf(stderr, "\nFatal error: image could not be saved as JPEG.\n\n");
+                return 0;
+        }
+        if (width > JPEG_MAX_DIMENSION || height > JPEG_MAX_DIMENSION) {
+                fprintf(stderr, "\nFatal error: image could not be saved as JPEG. Reason: larger than %d pixels.\n\n", JPEG_MAX_DIMENSION);
+                return 0;
+        }
+
+        // A greyscale image has a single component of 8x8 MCUs, the MCU of a colour image covers the luminance blocks of
+        // one chrominance block
+        if (numPlanes == 1) subsampling = JPEG_SUBSAMPLING_444;
+        int horizontal = lumaSampling[subsampling][0];
+        int vertical = lumaSampling[subsampling][1];
+        int mcuWidth = JPEG_BLOCK_SIZE*horizontal;
+        int mcuHeight = JPEG_BLOCK_SIZE*vertical;
+        int mcusPerRow = (width + mcuWidth - 1) / mcuWidth;
+        int numMcuRows = (height + mcuHeight - 1) / mcuHeight;
+        int paddedWidth = mcusPerRow*mcuWidth;
+        int blocksPerMcu = horizontal*vertical + ((numPlanes == 3) ? 2 : 0);
+
+        // A row of MCUs (a restart interval) takes at most JPEG_MAX_BLOCK_BYTES per block, then the padding and the RST marker
+        size_t segmentCapacity = (size_t) mcusPerRow*blocksPerMcu*JPEG_MAX_BLOCK_BYTES + 4;
+        size_t rowSamples = (size_t) mcuHeight*paddedWidth;
+
+        struct JpegTables tables;
+        build_jpeg_tables(&tables, quality);
+
+        FILE *file = fopen(filename, "wb");
+        if (file == NULL) {
+                fprintf(stderr, "\nFatal error: image could not be saved as JPEG. Reason: output file could not be opened.\n\n");
+                return 0;
+        }
+
+        uint8_t headers[1024];
+        size_t headerBytes = build_jpeg_headers(headers, &tables, numPlanes, width, height, subsampling, mcusPerRow);
+
+        // Flag to indicate error in the parallel processing
+        int errorFlag = fwrite(headers, 1, headerBytes, file) != headerBytes;
+
+        // Encode the rows of MCUs in parallel, write them in order
+        #pragma omp parallel shared(errorFlag)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread: the Y, Cb and Cr samples of a row of MCUs and
+                // its entropy coded data
+                size_t poolSize = 3*memory_size_alignment(rowSamples*sizeof(float)) + memory_size_alignment(segmentCapacity);
+                struct MemoryPool *pool = acquire_thread_memory_pool(poolSize);
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                #pragma omp for ordered schedule(static, 1)
+                for (int mcuRow = 0; mcuRow < numMcuRows; mcuRow++) {
+                        if (pool == NULL) continue;
+                        empty_pool(pool);
+
+                        float *luma = (float*)allocate_from_pool(pool, rowSamples*sizeof(float));
+                        float *chromaBlue = (float*)allocate_from_pool(pool, rowSamples*sizeof(float));
+                        float *chromaRed = (float*)allocate_from_pool(pool, rowSamples*sizeof(float));
+                        uint8_t *segment = (uint8_t*)allocate_from_pool(pool, segmentCapacity);
+
+                        // Colour convert the rows of the MCUs, then average the chrominance down to its resolution
+                        convert_jpeg_rows(planes, numPlanes, width, height, mcuRow*mcuHeight, mcuHeight, paddedWidth, luma,
+                                chromaBlue, chromaRed);
+                        int chromaWidth = paddedWidth / horizontal;
+                        if (numPlanes == 3 && subsampling != JPEG_SUBSAMPLING_444) {
+                                subsample_jpeg_chroma(chromaBlue, paddedWidth, mcuHeight, horizontal, vertical);
+                                subsample_jpeg_chroma(chromaRed, paddedWidth, mcuHeight, horizontal, vertical);
+                        }
+
+                        // Code the MCUs: the luminance blocks in row order, then the Cb and Cr blocks. The DC predictions
+                        // restart from zero in every restart interval
+                        struct JpegBitWriter writer = {segment, 0, 0, 0};
+                        int previousDc[3] = {0, 0, 0};
+                        float block[JPEG_BLOCK_SAMPLES];
+                        for (int mcu = 0; mcu < mcusPerRow; mcu++) {
+                                for (int by = 0; by < vertical; by++) {
+                                        for (int bx = 0; bx < horizontal; bx++) {
+                                                load_jpeg_block(luma, paddedWidth, mcu*mcuWidth + bx*JPEG_BLOCK_SIZE, by*JPEG_BLOCK_SIZE, block);
+                                                previousDc[0] = encode_jpeg_block(&writer, block, tables.quantizationScales[0], previousDc[0],
+                                                        &tables.dc[0], &tables.ac[0]);
+                                        }
+                                }
+                                if (numPlanes == 1) continue;
+                                load_jpeg_block(chromaBlue, chromaWidth, mcu*JPEG_BLOCK_SIZE, 0, block);
+                                previousDc[1] = encode_jpeg_block(&writer, block, tables.quantizationScales[1], previousDc[1],
+                                        &tables.dc[1], &tables.ac[1]);
+                                load_jpeg_block(chromaRed, chromaWidth, mcu*JPEG_BLOCK_SIZE, 0, block);
+                                previousDc[2] = encode_jpeg_block(&writer, block, tables.quantizationScales[1], previousDc[2],
+                                        &tables.dc[1], &tables.ac[1]);
+                        }
+
+                        // Byte align the interval and end it with the next RST marker (RST0 to RST7 in turn), except the last
+                        flush_jpeg_bits(&writer);
+                        if (mcuRow < numMcuRows - 1) {
+                                segment[writer.position++] = 0xFF;
+                                segment[writer.position++] = (uint8_t) (JPEG_MARKER_RST0 + (mcuRow & 7));
+                        }
+
+                        // Write the intervals in the order of the rows
+                        #pragma omp ordered
+                        {
+                                if (fwrite(segment, 1, writer.position, file) != writer.position) {
+                                        #pragma omp atomic write
+                                        errorFlag = 1;
+                                }
+                        }
+                }
+        }
+
+        // End of image
+        const uint8_t end[2] = {0xFF, JPEG_MARKER_EOI};
+        if (!errorFlag) errorFlag = fwrite(end, 1, 2, file) != 2;
+        if (fclose(file) != 0) errorFlag = 1;
+
+        if (errorFlag) {
+                fprintf(stderr, "\nFatal error: image could not be saved as JPEG.\n\n");
+                return 0;
+        }
+
+        return 1;
+
+}
@@ -2,9 +2,17 @@
 #include <windows.h> // For performance benchmarking
 #include <math.h>
 #include <string.h>
+#include <stdlib.h>  // For getenv()
 #include "image.h"
 #include "filters.h"
 #include "convolution.h"
+#include "blur.h"
+#include "pool.h"
+#include "tuning.h"
+#include "cpu.h"
+#include "registry.h"
+#include "planner.h"
+#include "png.h"
 
 
 
@@ -16,6 +24,24 @@ enum TypeFilter determine_filter(const char *filterName);
 
 enum GeneralFilterIntensity determine_filter_intensity(const char *intensityName);
 
+int determine_blur_radius(const char *intensityName);
+
+float determine_blur_sigma(const char *intensityName);
+
+int determine_point_op_value(const char *valueName, float *value);
+
+enum BorderMode determine_border_mode(const char *borderModeName);
+
+ImageFileType determine_output_file_type(const char *outputPath);
+
+enum PngCompression determine_png_compression(const char *compressionName);
+
+int determine_jpeg_quality(const char *qualityName);
+
+enum JpegSubsampling determine_jpeg_subsampling(const char *subsamplingName);
+
+int benchmark_png_compression(const char *inputPath, const char *outputPath, enum PngCompression compression);
+
 
 
 int main(int argc, char *argv[]) {
@@ -26,9 +52,31 @@ int main(int argc, char *argv[]) {
 	double elapsedTime = 0.0f;
 	QueryPerformanceFrequency(&frequency); // Get the high-resolution counter's frequency (ticks per second)
 
+        // Detect the instruction set level of the kernels once, before any parallel region asks for it
+        enum CpuFeatureLevel featureLevel = cpu_feature_level();
+
 
-        // Check for invalid number of command line arguments
-        if (argc != 5) {
+        // Calibration run: measure the tile shapes of the convolution pipelines on this machine and save them
+        if (argc == 3 && strcmp(argv[1], "--calibrate") == 0) {
+                int calibrate = calibrate_tile_shapes(argv[2]);
+                release_thread_memory_pools();
+                return (calibrate == 0) ? 1 : 0;
+        }
+
+        // PNG benchmark run: encode an image with one PNG compression mode (or every mode) and report the throughput and
+        // compression ratio
+        if ((argc == 4 || argc == 5) && strcmp(argv[1], "--benchmark-png") == 0) {
+                enum PngCompression compression = (argc == 5) ? determine_png_compression(argv[4]) : PNG_COMPRESSION_INVALID;
+                if (argc == 5 && compression == PNG_COMPRESSION_INVALID) return 1;
+                int benchmark = benchmark_png_compression(argv[2], argv[3], compression);
+                release_thread_memory_pools();
+                return (benchmark == 0) ? 1 : 0;
+        }
+
+        // Check for invalid number of command line arguments: the paths, one or more "FILTER" "FILTER_INTENSITY" pairs (the
+        // stages of a filter chain) and an optional border mode
+        int numStageArguments = argc - 3;
+        if (numStageArguments < 2 || numStageArguments / 2 > FILTER_CHAIN_MAX_STAGES) {
                 print_correct_program_usage();
                 return 1;
         }
@@ -36,82 +84,160 @@ int main(int argc, char *argv[]) {
         // Command line argument strings
         const char *inputImagePath = argv[1];
         const char *outputImagePath = argv[2];
-        const char *filterName = argv[3];
-        const char *filterIntensityName = argv[4];
+        int numStages = numStageArguments / 2;
+        const char *borderModeName = (numStageArguments % 2 == 1) ? argv[argc - 1] : "Zero";
 
         // Validate input and output file paths from command-line arguments
         int validatePaths = validate_path_arguments(inputImagePath, outputImagePath);
         if (validatePaths == 0) return 1;
+        ImageFileType outputFileType = determine_output_file_type(outputImagePath);
+
+        // Determine the filter and intensity of every stage from the command-line arguments. The box blur also accepts
+        // any radius (positive integer) and the gaussian blur any standard deviation in place of a general filter intensity,
+        // the point operations take a value
+        enum TypeFilter filters[FILTER_CHAIN_MAX_STAGES];
+        enum GeneralFilterIntensity intensities[FILTER_CHAIN_MAX_STAGES];
+        float strengths[FILTER_CHAIN_MAX_STAGES];
+        for (int i = 0; i < numStages; i++) {
+                const char *filterName = argv[3 + 2*i];
+                const char *filterIntensityName = argv[4 + 2*i];
+
+                filters[i] = determine_filter(filterName);
+                if (filters[i] == FILTER_INVALID) return 1;
+
+                if (filters[i] >= FILTER_BRIGHTNESS && filters[i] <= FILTER_THRESHOLD) {
+                        intensities[i] = FILTER_INTENSITY_MEDIUM;
+                        if (!determine_point_op_value(filterIntensityName, &strengths[i])) return 1;
+                        continue;
+                }
+
+                int blurRadius = (filters[i] == FILTER_BOX_BLUR) ? determine_blur_radius(filterIntensityName) : 0;
+                float blurSigma = (filters[i] == FILTER_GAUSSIAN_BLUR) ? determine_blur_sigma(filterIntensityName) : 0.0f;
+                intensities[i] = FILTER_INTENSITY_MEDIUM;
+                strengths[i] = (blurRadius > 0) ? (float) blurRadius : blurSigma;
+                if (blurRadius == 0 && blurSigma == 0.0f) {
+                        intensities[i] = determine_filter_intensity(filterIntensityName);
+                        if (intensities[i] == FILTER_INTENSITY_INVALID) return 1;
+                } else if (blurRadius < 0 || blurSigma < 0.0f) {
+                        return 1;
+                }
+        }
+        
+        // Determine the desired border mode from the (optional) command-line argument
+        enum BorderMode borderMode = determine_border_mode(borderModeName);
+        if (borderMode == BORDER_MODE_INVALID) return 1;
+
+        // Use the calibrated tile shapes if a tile shapes file is given by the environment
+        const char *tileShapesPath = getenv("IMAGEPROCESSOR_TILE_SHAPES");
+        if (tileShapesPath != NULL && load_tile_shapes(tileShapesPath) == 0) return 1;
+
+        // Encode the output image with the default encoder options, or the PNG compression mode and the JPG quality and
+        // subsampling given by the environment
+        struct ImageSaveOptions saveOptions;
+        init_image_save_options(&saveOptions);
+        const char *pngCompressionName = getenv("IMAGEPROCESSOR_PNG_COMPRESSION");
+        if (pngCompressionName != NULL) {
+                saveOptions.pngCompression = determine_png_compression(pngCompressionName);
+                if (saveOptions.pngCompression == PNG_COMPRESSION_INVALID) return 1;
+        }
+        const char *jpgQualityName = getenv("IMAGEPROCESSOR_JPG_QUALITY");
+        if (jpgQualityName != NULL) {
+                saveOptions.jpgQuality = determine_jpeg_quality(jpgQualityName);
+                if (saveOptions.jpgQuality == 0) return 1;
+        }
+        const char *jpgSubsamplingName = getenv("IMAGEPROCESSOR_JPG_SUBSAMPLING");
+        if (jpgSubsamplingName != NULL) {
+                saveOptions.jpgSubsampling = determine_jpeg_subsampling(jpgSubsamplingName);
+                if (saveOptions.jpgSubsampling == JPEG_SUBSAMPLING_INVALID) return 1;
+        }
 
-        // Determine the type of the requested filter from command-line argument
-        enum TypeFilter filter = determine_filter(filterName);
-        if (filter == FILTER_INVALID) return 1;
+        // Print the diagnostics of the run if the environment asks for them (any value but "0")
+        const char *verboseValue = getenv("IMAGEPROCESSOR_VERBOSE");
+        int verbose = verboseValue != NULL && strcmp(verboseValue, "0") != 0;
+        if (verbose) printf("Instruction set: %s.\n", cpu_feature_level_name(featureLevel));
+
+        // Stream the image through the chain in strips of rows if a strip height is given by the environment (for images
+        // larger than the memory, from and to uncompressed BMP, PPM or PGM files), otherwise load the input image (once for
+        // the whole chain)
+        const char *stripRowsValue = getenv("IMAGEPROCESSOR_STRIP_ROWS");
+        int stripRows = (stripRowsValue != NULL) ? atoi(stripRowsValue) : 0;
+        struct ImageStream *inputStream = NULL;
+        struct ImageRGB *inputImage = NULL;
+        int width, height;
+        if (stripRowsValue != NULL) {
+                if (outputFileType != FILE_TYPE_BMP && outputFileType != FILE_TYPE_PPM && outputFileType != FILE_TYPE_PGM) {
+                        printf("\nFatal error: streamed images are written as \"bmp\", \"ppm\" or \"pgm\" files.\n\n");
+                        return 1;
+                }
+                inputStream = open_image_read_stream(inputImagePath, &width, &height);
+                if (inputStream == NULL) return 1;
+        } else {
+                inputImage = load_imageRGB(inputImagePath);
+                if (inputImage == NULL) return 1;
+                width = inputImage->width;
+                height = inputImage->height;
+        }
 
-        // Determine the desired filter intensity from command-line argument
-        enum GeneralFilterIntensity intensity = determine_filter_intensity(filterIntensityName);
-        if (intensity == FILTER_INTENSITY_INVALID) return 1;
-        
-        // Load the input image
-        struct ImageRGB *inputImage = load_imageRGB(inputImagePath);
-        if (inputImage == NULL) return 1;
+        // Create the stages of the filter chain for the image dimensions and the border mode, outside of the timed region
+        // (blurs of a given radius or standard deviation are planned, which picks their backend, and point operations are
+        // fused into the previous stage)
+        struct FilterChain filterChain;
+        filterChain.numStages = 0;
+        for (int i = 0; i < numStages; i++) {
+                if (!add_filter_chain_stage(&filterChain, filters[i], intensities[i], strengths[i], height, width, borderMode)) {
+                        if (inputImage != NULL) free_imageRGB(inputImage);
+                        close_image_stream(inputStream);
+                        return 1;
+                }
+                struct FilterStage *stage = &filterChain.stages[filterChain.numStages - 1];
+                if (verbose && (filters[i] == FILTER_BOX_BLUR || filters[i] == FILTER_GAUSSIAN_BLUR) && strengths[i] > 0.0f) {
+                        printf("Blur backend: %s (kernel size %d).\n", blur_backend_name(stage->blurPlan.backend), stage->blurPlan.kernelSize);
+                }
+        }
+        if (verbose && filterChain.numStages < numStages) {
+                printf("Point operations fused into the previous stages: %d.\n", numStages - filterChain.numStages);
+        }
 
         // Start timing
         QueryPerformanceCounter(&start);
 
-        // Apply the desired filter
+        // Apply the filter chain in memory (a single filter is a chain of one stage), or stream it from the input file to the
+        // output file (the timing includes reading and writing the file)
         struct ImageRGB *outputImageRGB = NULL;
         struct ImageOneChannel *outputImageOneChannel = NULL;
-        enum ImageType outputImageType;
-        switch (filter) {
-                case FILTER_GAUSSIAN_BLUR:
-                        outputImageRGB = apply_filter_generic_convolution(&inputImage, filter, intensity); 
-                        outputImageType = IMAGE_TYPE_THREE_CHANNEL; break;
-                case FILTER_BOX_BLUR:
-                        outputImageRGB = apply_filter_generic_convolution(&inputImage, filter, intensity); 
-                        outputImageType = IMAGE_TYPE_THREE_CHANNEL; break;
-                case FILTER_EMBOSS:
-                        outputImageRGB = apply_filter_generic_convolution(&inputImage, filter, intensity); 
-                        outputImageType = IMAGE_TYPE_THREE_CHANNEL; break;
-                case FILTER_SHARPEN:
-                        outputImageRGB = apply_filter_generic_convolution(&inputImage, filter, intensity); 
-                        outputImageType = IMAGE_TYPE_THREE_CHANNEL; break;
-                case FILTER_GREYSCALE:
-                        outputImageOneChannel = apply_filter_greyscale(&inputImage);
-                        outputImageType = IMAGE_TYPE_ONE_CHANNEL; break;
-                case FILTER_SOBEL_EDGE_DETECTION:
-                        outputImageOneChannel = apply_filter_sobel_edge_detection(&inputImage, intensity);
-                        outputImageType = IMAGE_TYPE_ONE_CHANNEL; break;
+        int filterChainApplied;
+        if (inputStream != NULL) {
+                filterChainApplied = apply_filter_chain_streaming(inputStream, height, width, outputImagePath, outputFileType, &filterChain,
+                        borderMode, stripRows);
+                close_image_stream(inputStream);
+        } else {
+                filterChainApplied = apply_filter_chain(&inputImage, &filterChain, borderMode, &outputImageRGB, &outputImageOneChannel);
         }
+        enum ImageType outputImageType = (outputImageOneChannel != NULL) ? IMAGE_TYPE_ONE_CHANNEL : IMAGE_TYPE_THREE_CHANNEL;
 
         QueryPerformanceCounter(&end); // End timing
         elapsedTime += (double) (end.QuadPart - start.QuadPart) / frequency.QuadPart;
         printf("Runtime: %.5lf milliseconds.\n", 1000 * elapsedTime);
 
+        // Save the output image to the output path in the file type of its extension, with the encoder options (a streamed
+        // image is already written). The encoders still use the memory pools of the worker threads
+        int saveImage = 1;
+        if (filterChainApplied != 0 && stripRowsValue == NULL) {
+                if (outputImageType == IMAGE_TYPE_ONE_CHANNEL) {
+                        saveImage = save_imageOneChannel(outputImageOneChannel, outputImagePath, outputFileType, &saveOptions);
+                        free_imageOneChannel(outputImageOneChannel);
+                } else if (outputImageType == IMAGE_TYPE_THREE_CHANNEL) {
+                        saveImage = save_imageRGB(outputImageRGB, outputImagePath, outputFileType, &saveOptions);
+                        free_imageRGB(outputImageRGB);
+                }
+        }
 
-        // // Save the output image to the output path
-        // if (outputImageType == IMAGE_TYPE_ONE_CHANNEL) {
-
-        //         if (outputImageOneChannel == NULL) return 1;
-        //         int saveImage = save_imageOneChannel(outputImageOneChannel, outputImagePath, FILE_TYPE_PNG);
-        //         if (saveImage == 0) {
-        //                 free_imageOneChannel(outputImageOneChannel);
-        //                 return 1;
-        //         }
-
-        //         free_imageOneChannel(outputImageOneChannel);
-
-        // } else if (outputImageType == IMAGE_TYPE_THREE_CHANNEL) {
-
-        //         if (outputImageRGB == NULL) return 1;
-        //         int saveImage = save_imageRGB(outputImageRGB, outputImagePath, FILE_TYPE_PNG);
-        //         if (saveImage == 0) {
-        //                 free_imageRGB(outputImageRGB);
-        //                 return 1;
-        //         }
+        // Free the persistent memory pools (arenas) of the worker threads
+        release_thread_memory_pools();
 
-        //         free_imageRGB(outputImageRGB);
-                
-        // }
+        // Free the registered kernels
+        release_kernel_registry();
+        if (filterChainApplied == 0 || saveImage == 0) return 1;
 
         // Program executed successfully
         return 0;
@@ -122,10 +248,32 @@ int main(int argc, char *argv[]) {
 
 void print_correct_program_usage() {
         printf("\nFatal error: invalid program arguments.\n");
-        printf("Correct usage:  \"..\\ImageProcessor.exe\"  \"..\\input\\INPUT_FILENAME\"  \"..\\output\\OUTPUT_FILENAME\"  \"FILTER\" \"FILTER_INTENSITY\"\n");
-        printf("Accepted image filetypes: \"png\", \"jpg\", \"bmp\".\n");
-        printf("Accepted filters: \"Greyscale\", \"Gaussian Blur\", \"Box Blur\", \"Emboss\", \"Sharpen\", \"Sobel Edge Detection\".\n");
-        printf("Accepted filter intensities: \"Light\", \"Medium\", \"High\".\n\n");
+        printf("Correct usage:  \"..\\ImageProcessor.exe\"  \"..\\input\\INPUT_FILENAME\"  \"..\\output\\OUTPUT_FILENAME\"  \"FILTER\" \"FILTER_INTENSITY\" [\"BORDER_MODE\"]\n");
+        printf("Filter chains:  add more \"FILTER\" \"FILTER_INTENSITY\" pairs (up to %d) before the border mode, e.g. \"Sharpen\" \"High\" \"Emboss\" \"Light\".\n",
+                FILTER_CHAIN_MAX_STAGES);
+        printf("Accepted image filetypes: \"png\", \"jpg\", \"bmp\", \"ppm\", \"pgm\".\n");
+        printf("Accepted filters: \"Greyscale\", \"Gaussian Blur\", \"Box Blur\", \"Emboss\", \"Sharpen\", \"Sobel Edge Detection\", \"Disc Bokeh\", \"Hexagonal Bokeh\",\n"
+                "\"Brightness\", \"Contrast\", \"Gamma\", \"Threshold\".\n");
+        printf("Accepted filter intensities: \"Light\", \"Medium\", \"High\".\n");
+        printf("The box blur also accepts a radius (1 to %d) as its filter intensity, e.g. \"25\".\n", BOX_BLUR_MAX_RADIUS);
+        printf("The gaussian blur also accepts a standard deviation (%.1f to %.1f) as its filter intensity, e.g. \"12.5\".\n",
+                GAUSSIAN_BLUR_MIN_SIGMA, GAUSSIAN_BLUR_MAX_SIGMA);
+        printf("The point operations take a value as their filter intensity: brightness -255 to 255, contrast 0 to 16, gamma 0.1 to 10,\n");
+        printf("threshold 0 to 255. Following another filter they are fused into it (no pass over the image of their own).\n");
+        printf("Accepted border modes (optional, default \"Zero\"): \"Zero\", \"Replicate\", \"Reflect\", \"Wrap\".\n");
+        printf("Tile shape calibration:  \"..\\ImageProcessor.exe\"  --calibrate  \"TILE_SHAPES_FILE\"  (used when the environment\n");
+        printf("variable IMAGEPROCESSOR_TILE_SHAPES is set to TILE_SHAPES_FILE).\n");
+        printf("PNG benchmark:  \"..\\ImageProcessor.exe\"  --benchmark-png  \"INPUT_FILENAME\"  \"OUTPUT_FILENAME.png\"  [\"PNG_COMPRESSION\"]  (encodes\n");
+        printf("the image with one or every compression mode: \"store\", \"rle\", \"fast\", \"full\", and reports throughput and ratio).\n");
+        printf("The environment variable IMAGEPROCESSOR_PNG_COMPRESSION (\"store\", \"rle\", \"fast\", \"full\") sets the compression mode of\n");
+        printf("PNG output files (default \"full\").\n");
+        printf("The environment variables IMAGEPROCESSOR_JPG_QUALITY (1 to 100, default 100) and IMAGEPROCESSOR_JPG_SUBSAMPLING (\"444\",\n");
+        printf("\"422\", \"420\", default \"444\") set the quality and the chroma subsampling of JPG output files.\n");
+        printf("The environment variable IMAGEPROCESSOR_CPU (\"scalar\", \"sse4.1\", \"avx2\", \"avx512\") limits the instruction set.\n");
+        printf("The environment variable IMAGEPROCESSOR_VERBOSE (e.g. \"1\") prints the instruction set in use,\n");
+        printf("the backends picked for the blurs and the number of fused point operations.\n");
+        printf("The environment variable IMAGEPROCESSOR_STRIP_ROWS (e.g. \"256\", 0 for the default) streams the image through the\n");
+        printf("chain in strips of that many rows, for images larger than the memory (BMP, PPM or PGM input and output files, no \"Wrap\" border).\n\n");
 }
 
 int validate_path_arguments(const char *inputPath,  const char *outputPath) {
@@ -149,9 +297,11 @@ int validate_path_arguments(const char *inputPath,  const char *outputPath) {
         // Check for incorrect input image filetype
         if (strncmp(inputPath + (inputPathLength - 4), ".png", 4) != 0 &&
             strncmp(inputPath + (inputPathLength - 4), ".jpg", 4) != 0 &&
-            strncmp(inputPath + (inputPathLength - 4), ".bmp", 4) != 0) {
+            strncmp(inputPath + (inputPathLength - 4), ".bmp", 4) != 0 &&
+            strncmp(inputPath + (inputPathLength - 4), ".ppm", 4) != 0 &&
+            strncmp(inputPath + (inputPathLength - 4), ".pgm", 4) != 0) {
                 printf("\nFatal error: incorrect input image filetype.\n");
-                printf("Accepted image filetypes: \"png\", \"jpg\", \"bmp\".\n\n");
+                printf("Accepted image filetypes: \"png\", \"jpg\", \"bmp\", \"ppm\", \"pgm\".\n\n");
                 return 0;
         }
 
@@ -174,9 +324,11 @@ int validate_path_arguments(const char *inputPath,  const char *outputPath) {
         // Check for incorrect output image filetype
         if (strncmp(outputPath + (outputPathLength - 4), ".png", 4) != 0 &&
             strncmp(outputPath + (outputPathLength - 4), ".jpg", 4) != 0 &&
-            strncmp(outputPath + (outputPathLength - 4), ".bmp", 4) != 0) {
+            strncmp(outputPath + (outputPathLength - 4), ".bmp", 4) != 0 &&
+            strncmp(outputPath + (outputPathLength - 4), ".ppm", 4) != 0 &&
+            strncmp(outputPath + (outputPathLength - 4), ".pgm", 4) != 0) {
                 printf("\nFatal error: incorrect output image filetype.\n");
-                printf("Accepted image filetypes: \"png\", \"jpg\", \"bmp\".\n\n");
+                printf("Accepted image filetypes: \"png\", \"jpg\", \"bmp\", \"ppm\", \"pgm\".\n\n");
                 return 0;
         }
 
@@ -199,13 +351,26 @@ enum TypeFilter determine_filter(const char *filterName) {
                 return FILTER_BOX_BLUR;
         } else if (filterNameLength == 9 && (strncmp(filterName, "Greyscale", 9) == 0)) {
                 return FILTER_GREYSCALE;
+        } else if (filterNameLength == 10 && (strncmp(filterName, "Disc Bokeh", 10) == 0)) {
+                return FILTER_DISC_BOKEH;
         } else if (filterNameLength == 13 && (strncmp(filterName, "Gaussian Blur", 13) == 0)) {
                 return FILTER_GAUSSIAN_BLUR;
+        } else if (filterNameLength == 15 && (strncmp(filterName, "Hexagonal Bokeh", 15) == 0)) {
+                return FILTER_HEXAGONAL_BOKEH;
+        } else if (filterNameLength == 5 && (strncmp(filterName, "Gamma", 5) == 0)) {
+                return FILTER_GAMMA;
+        } else if (filterNameLength == 8 && (strncmp(filterName, "Contrast", 8) == 0)) {
+                return FILTER_CONTRAST;
+        } else if (filterNameLength == 9 && (strncmp(filterName, "Threshold", 9) == 0)) {
+                return FILTER_THRESHOLD;
+        } else if (filterNameLength == 10 && (strncmp(filterName, "Brightness", 10) == 0)) {
+                return FILTER_BRIGHTNESS;
         } else if (filterNameLength == 20 && (strncmp(filterName, "Sobel Edge Detection", 20) == 0)) {
                 return FILTER_SOBEL_EDGE_DETECTION;
         } else {
                 printf("\nFatal error: invalid filter.\n");
-                printf("Accepted filters: \"Greyscale\", \"Gaussian Blur\", \"Box Blur\", \"Emboss\", \"Sharpen\", \"Sobel Edge Detection\".\n\n");
+                printf("Accepted filters: \"Greyscale\", \"Gaussian Blur\", \"Box Blur\", \"Emboss\", \"Sharpen\", \"Sobel Edge Detection\", \"Disc Bokeh\", \"Hexagonal Bokeh\",\n"
+                "\"Brightness\", \"Contrast\", \"Gamma\", \"Threshold\".\n\n");
                 return FILTER_INVALID;
         }
 
@@ -232,4 +397,200 @@ enum GeneralFilterIntensity determine_filter_intensity(const char *intensityName
 
 }
 
+int determine_blur_radius(const char *intensityName) {
+
+        // Not a radius if the filter intensity name does not start with a digit (e.g. "Light")
+        if (intensityName[0] < '0' || intensityName[0] > '9') {
+                return 0;
+        }
+
+        // Parse the radius, every character must be a digit
+        int radius = 0;
+        for (const char *c = intensityName; *c != '\0'; c++) {
+                if (*c < '0' || *c > '9' || radius > BOX_BLUR_MAX_RADIUS) {
+                        radius = -1;
+                        break;
+                }
+                radius = radius*10 + (*c - '0');
+        }
+
+        // Check for invalid radius
+        if (radius < 1 || radius > BOX_BLUR_MAX_RADIUS) {
+                printf("\nFatal error: invalid blur radius.\n");
+                printf("Accepted blur radii: 1 to %d.\n\n", BOX_BLUR_MAX_RADIUS);
+                return -1;
+        }
+
+        return radius;
+
+}
+
+float determine_blur_sigma(const char *intensityName) {
+
+        // Not a standard deviation if the filter intensity name does not start with a digit (e.g. "Light")
+        if (intensityName[0] < '0' || intensityName[0] > '9') {
+                return 0.0f;
+        }
+
+        // Parse the standard deviation, the whole string must be a number
+        char *end;
+        float sigma = strtof(intensityName, &end);
+
+        // Check for invalid standard deviation
+        if (*end != '\0' || !(sigma >= GAUSSIAN_BLUR_MIN_SIGMA && sigma <= GAUSSIAN_BLUR_MAX_SIGMA)) {
+                printf("\nFatal error: invalid blur standard deviation.\n");
+                printf("Accepted blur standard deviations: %.1f to %.1f.\n\n", GAUSSIAN_BLUR_MIN_SIGMA, GAUSSIAN_BLUR_MAX_SIGMA);
+                return -1.0f;
+        }
+
+        return sigma;
+
+}
+
+int determine_point_op_value(const char *valueName, float *value) {
+
+        // Parse the value, the whole string must be a number (the range is checked by the point operation)
+        char *end;
+        *value = strtof(valueName, &end);
+
+        // Check for invalid value
+        if (end == valueName || *end != '\0') {
+                printf("\nFatal error: invalid point operation value.\n");
+                printf("Accepted values: brightness -255 to 255, contrast 0 to 16, gamma 0.1 to 10, threshold 0 to 255.\n\n");
+                return 0;
+        }
+
+        return 1;
+
+}
+
+enum BorderMode determine_border_mode(const char *borderModeName) {
+
+        // Determine the length of the border mode name string
+        int borderModeNameLength = strlen(borderModeName);
+
+        // Determine the border mode
+
+        if (borderModeNameLength == 4 && (strncmp(borderModeName, "Zero", 4) == 0)) {
+                return BORDER_MODE_ZERO;
+        } else if (borderModeNameLength == 4 && (strncmp(borderModeName, "Wrap", 4) == 0)) {
+                return BORDER_MODE_WRAP;
+        } else if (borderModeNameLength == 7 && (strncmp(borderModeName, "Reflect", 7) == 0)) {
+                return BORDER_MODE_REFLECT;
+        } else if (borderModeNameLength == 9 && (strncmp(borderModeName, "Replicate", 9) == 0)) {
+                return BORDER_MODE_REPLICATE;
+        } else {
+                printf("\nFatal error: invalid border mode.\n");
+                printf("Accepted border modes: \"Zero\", \"Replicate\", \"Reflect\", \"Wrap\".\n\n");
+                return BORDER_MODE_INVALID;
+        }
+
+}
+
+ImageFileType determine_output_file_type(const char *outputPath) {
+
+        // Determine the file type from the extension of the (validated) output path
+        const char *extension = outputPath + (strlen(outputPath) - 4);
+        if (strncmp(extension, ".jpg", 4) == 0) return FILE_TYPE_JPG;
+        if (strncmp(extension, ".bmp", 4) == 0) return FILE_TYPE_BMP;
+        if (strncmp(extension, ".ppm", 4) == 0) return FILE_TYPE_PPM;
+        if (strncmp(extension, ".pgm", 4) == 0) return FILE_TYPE_PGM;
+        return FILE_TYPE_PNG;
+
+}
+
+enum PngCompression determine_png_compression(const char *compressionName) {
+
+        // Compare the name with the names of the compression modes
+        for (int compression = 0; compression < PNG_COMPRESSION_INVALID; compression++) {
+                if (strcmp(compressionName, png_compression_name(compression)) == 0) return compression;
+        }
+
+        printf("\nFatal error: invalid PNG compression mode.\n");
+        printf("Accepted PNG compression modes: \"store\", \"rle\", \"fast\", \"full\".\n\n");
+        return PNG_COMPRESSION_INVALID;
 
+}
+
+int determine_jpeg_quality(const char *qualityName) {
+
+        // Parse the quality, every character must be a digit
+        int quality = (qualityName[0] != '\0') ? 0 : -1;
+        for (const char *c = qualityName; *c != '\0'; c++) {
+                if (*c < '0' || *c > '9' || quality > 100) {
+                        quality = -1;
+                        break;
+                }
+                quality = quality*10 + (*c - '0');
+        }
+
+        // Check for invalid quality (the range accepted by the JPEG encoder)
+        if (quality < 1 || quality > 100) {
+                printf("\nFatal error: invalid JPG quality.\n");
+                printf("Accepted JPG qualities: 1 to 100.\n\n");
+                return 0;
+        }
+
+        return quality;
+
+}
+
+enum JpegSubsampling determine_jpeg_subsampling(const char *subsamplingName) {
+
+        // Compare the name with the names of the subsamplings without their colons (e.g. "420" for 4:2:0)
+        static const char *subsamplingNames[JPEG_SUBSAMPLING_INVALID] = {"444", "422", "420"};
+        for (int subsampling = 0; subsampling < JPEG_SUBSAMPLING_INVALID; subsampling++) {
+                if (strcmp(subsamplingName, subsamplingNames[subsampling]) == 0) return subsampling;
+        }
+
+        printf("\nFatal error: invalid JPG subsampling.\n");
+        printf("Accepted JPG subsamplings: \"444\", \"422\", \"420\".\n\n");
+        return JPEG_SUBSAMPLING_INVALID;
+
+}
+
+int benchmark_png_compression(const char *inputPath, const char *outputPath, enum PngCompression compression) {
+
+        // Performance benchmarking
+        LARGE_INTEGER frequency, start, end;
+        QueryPerformanceFrequency(&frequency);
+
+        struct ImageRGB *image = load_imageRGB(inputPath);
+        if (image == NULL) return 0;
+        double rawBytes = (double) image->width*image->height*3;
+
+        // Encode the image with the requested mode, or with every mode (the last one, full, is left in the output file)
+        int firstCompression = (compression == PNG_COMPRESSION_INVALID) ? 0 : compression;
+        int lastCompression = (compression == PNG_COMPRESSION_INVALID) ? PNG_COMPRESSION_INVALID - 1 : compression;
+        for (int mode = firstCompression; mode <= lastCompression; mode++) {
+                struct ImageSaveOptions saveOptions;
+                init_image_save_options(&saveOptions);
+                saveOptions.pngCompression = mode;
+
+                QueryPerformanceCounter(&start);
+                int saveImage = save_imageRGB(image, outputPath, FILE_TYPE_PNG, &saveOptions);
+                QueryPerformanceCounter(&end);
+                if (saveImage == 0) {
+                        free_imageRGB(image);
+                        return 0;
+                }
+
+                // Size of the written file
+                FILE *file = fopen(outputPath, "rb");
+                if (file == NULL) {
+                        free_imageRGB(image);
+                        return 0;
+                }
+                fseek(file, 0, SEEK_END);
+                double fileBytes = (double) ftell(file);
+                fclose(file);
+
+                double elapsedTime = (double) (end.QuadPart - start.QuadPart) / frequency.QuadPart;
+                printf("PNG %-5s: %10.3lf milliseconds, %8.1lf MB/s, compression ratio %.2lf.\n", png_compression_name(mode),
+                        1000 * elapsedTime, rawBytes / elapsedTime / 1e6, rawBytes / fileBytes);
+        }
+
+        free_imageRGB(image);
+        return 1;
+
+}
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  // For strcmp()
+#include <math.h>  // For ceilf() and exp()
+#include <stdint.h>  // For type uint8_t
+#include <omp.h>  // For omp_get_wtime()
+#include "image.h"
+#include "convolution.h"
+#include "blur.h"
+#include "fft.h"
+#include "planner.h"
+
+
+// Number of runs per measurement of the calibration (the best one is kept)
+#define PLANNER_CALIBRATION_REPETITIONS 3
+
+
+
+// Names of the backends (in the cost lines of the tile shapes file)
+static const char *backendNames[BLUR_BACKEND_COUNT] = {"direct", "separable", "runningsum", "iir", "fft"};
+
+// Cost model per backend, in nanoseconds per output channel: the fixed part and the part per kernel entry (direct), tap
+// (separable) or unit of the FFT cost model (whole plane). Measured on an AVX-512 machine, one thread
+static double fixedCosts[BLUR_BACKEND_COUNT] = {1.4, 1.3, 3.1, 3.4, 0.0};
+static double scaledCosts[BLUR_BACKEND_COUNT] = {0.071, 0.16, 0.0, 0.0, 0.084};
+
+
+
+// Returns the number of channels run through by the two passes of the recursive gaussian (each pass runs over the image
+// extended by iir_gaussian_padding channels on both sides of its direction), averaged over the passes
+static double iir_pass_channels(float sigma, int imageHeight, int imageWidth) {
+
+        int padding = iir_gaussian_padding(sigma);
+        return ((double) (imageHeight + 2*padding)*imageWidth + (double) imageHeight*(imageWidth + 2*padding)) / 2;
+
+}
+
+
+const char *blur_backend_name(enum BlurBackend backend) {
+
+        if (backend < 0 || backend >= BLUR_BACKEND_COUNT) return "invalid";
+        return backendNames[backend];
+
+}
+
+
+double estimate_blur_backend_cost(enum BlurBackend backend, enum BlurShape shape, float strength, int kernelSize, int imageHeight,
+        int imageWidth, enum BorderMode borderMode) {
+
+        double numChannels = (double) imageHeight*imageWidth;
+
+        switch (backend) {
+                case BLUR_BACKEND_DIRECT:
+                        return numChannels*(fixedCosts[backend] + scaledCosts[backend]*kernelSize*kernelSize);
+                case BLUR_BACKEND_SEPARABLE:
+                        return numChannels*(fixedCosts[backend] + scaledCosts[backend]*2*kernelSize);
+                case BLUR_BACKEND_RUNNING_SUM:
+                        if (shape != BLUR_SHAPE_BOX || strength > BOX_BLUR_MAX_RADIUS) return -1.0;
+                        return numChannels*fixedCosts[backend];
+                case BLUR_BACKEND_IIR:
+                        if (shape != BLUR_SHAPE_GAUSSIAN || strength < PLANNER_IIR_MIN_SIGMA || strength > GAUSSIAN_BLUR_MAX_SIGMA) return -1.0;
+                        if (borderMode != BORDER_MODE_REPLICATE && borderMode != BORDER_MODE_REFLECT) return -1.0;
+                        return iir_pass_channels(strength, imageHeight, imageWidth)*fixedCosts[backend];
+                case BLUR_BACKEND_FFT: {
+                        double units = fft_convolution_cost(kernelSize, imageHeight, imageWidth);
+                        if (units < 0.0) return -1.0;
+                        return numChannels*fixedCosts[backend] + units*scaledCosts[backend];
+                }
+                default:
+                        return -1.0;
+        }
+
+}
+
+
+int convolution_prefers_fft(int kernelSize, int imageHeight, int imageWidth) {
+
+        double fftCost = estimate_blur_backend_cost(BLUR_BACKEND_FFT, BLUR_SHAPE_INVALID, 0.0f, kernelSize, imageHeight, imageWidth,
+                BORDER_MODE_ZERO);
+        double directCost = estimate_blur_backend_cost(BLUR_BACKEND_DIRECT, BLUR_SHAPE_INVALID, 0.0f, kernelSize, imageHeight, imageWidth,
+                BORDER_MODE_ZERO);
+        return fftCost >= 0.0 && fftCost < directCost;
+
+}
+
+
+struct BlurPlan plan_blur(enum BlurShape shape, float strength, int imageHeight, int imageWidth, enum BorderMode borderMode) {
+
+        struct BlurPlan plan = {BLUR_SHAPE_INVALID, strength, 0, BLUR_BACKEND_DIRECT, 0.0};
+
+        // Validate the strength and size the sampled kernel
+        if (shape == BLUR_SHAPE_GAUSSIAN) {
+                if (!(strength >= GAUSSIAN_BLUR_MIN_SIGMA && strength <= GAUSSIAN_BLUR_MAX_SIGMA)) {
+                        fprintf(stderr, "\nFatal error: gaussian blur sigma must be between %.1f and %.1f.\n", GAUSSIAN_BLUR_MIN_SIGMA,
+                                GAUSSIAN_BLUR_MAX_SIGMA);
+                        return plan;
+                }
+                plan.kernelSize = 2*(int) ceilf(PLANNER_GAUSSIAN_RADIUS_SIGMAS*strength) + 1;
+        } else if (shape == BLUR_SHAPE_BOX) {
+                if (!(strength >= 1.0f && strength <= BOX_BLUR_MAX_RADIUS) || strength != (float) (int) strength) {
+                        fprintf(stderr, "\nFatal error: box blur radius must be an integer between 1 and %d.\n", BOX_BLUR_MAX_RADIUS);
+                        return plan;
+                }
+                plan.kernelSize = 2*(int) strength + 1;
+        } else {
+                fprintf(stderr, "\nFatal error: invalid blur shape.\n");
+                return plan;
+        }
+        plan.shape = shape;
+
+        // Pick the cheapest backend that runs the blur correctly with the border mode (the direct and separable ones always do)
+        plan.estimatedCost = -1.0;
+        for (int backend = 0; backend < BLUR_BACKEND_COUNT; backend++) {
+                double cost = estimate_blur_backend_cost(backend, shape, strength, plan.kernelSize, imageHeight, imageWidth, borderMode);
+                if (cost >= 0.0 && (plan.estimatedCost < 0.0 || cost < plan.estimatedCost)) {
+                        plan.backend = backend;
+                        plan.estimatedCost = cost;
+                }
+        }
+
+        return plan;
+
+}
+
+
+// Creates the sampled 1D kernel of a planned blur (normalized gaussian or box entries)
+static struct SeparableKernel *create_planned_separable_kernel(const struct BlurPlan *plan) {
+
+        struct SeparableKernel *kernel = allocate_separable_kernel(plan->kernelSize);
+        if (kernel == NULL) return NULL;
+
+        int halfWindowSize = plan->kernelSize / 2;
+        double sumEntries = 0.0;  // For kernel normalization
+        for (int i = -halfWindowSize; i <= halfWindowSize; i++) {
+                double entry = (plan->shape == BLUR_SHAPE_GAUSSIAN) ? exp(-(i*i) / (2.0*plan->strength*plan->strength)) : 1.0;
+                kernel->horizontalEntries[i + halfWindowSize] = (float) entry;
+                sumEntries += entry;
+        }
+
+        // Normalize the kernel and copy the entries into the vertical kernel
+        for (int i = 0; i < plan->kernelSize; i++) {
+                kernel->horizontalEntries[i] = (float) (kernel->horizontalEntries[i] / sumEntries);
+                kernel->verticalEntries[i] = kernel->horizontalEntries[i];
+        }
+
+        return kernel;
+
+}
+
+
+// Creates the sampled 2D kernel of a planned blur (outer product of the 1D kernel with itself)
+static struct Kernel *create_planned_kernel(const struct BlurPlan *plan) {
+
+        struct SeparableKernel *separableKernel = create_planned_separable_kernel(plan);
+        if (separableKernel == NULL) return NULL;
+        struct Kernel *kernel = allocate_kernel(plan->kernelSize);
+        if (kernel == NULL) {
+                free_separable_kernel(separableKernel);
+                return NULL;
+        }
+
+        for (int j = 0; j < kernel->size; j++) {
+                for (int i = 0; i < kernel->size; i++) {
+                        kernel->entries[j*kernel->size + i] = separableKernel->verticalEntries[j]*separableKernel->horizontalEntries[i];
+                }
+        }
+
+        free_separable_kernel(separableKernel);
+        return kernel;
+
+}
+
+
+int apply_blur_plan_planes(const struct BlurPlan *plan, uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, int imageHeight,
+        int imageWidth, enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue) {
+
+        if (plan->shape == BLUR_SHAPE_INVALID) {
+                fprintf(stderr, "\nFatal error: invalid blur plan.\n");
+                return 0;
+        }
+
+        // The constant cost backends need no kernel
+        if (plan->backend == BLUR_BACKEND_RUNNING_SUM) {
+                return apply_box_blur_planes(inputPlanes, outputPlanes, numPlanes, (int) plan->strength, imageHeight, imageWidth,
+                        borderMode, epilogue);
+        }
+        if (plan->backend == BLUR_BACKEND_IIR) {
+                return apply_iir_gaussian_blur_planes(inputPlanes, outputPlanes, numPlanes, plan->strength, imageHeight, imageWidth,
+                        borderMode, epilogue);
+        }
+
+        // Separable backend: 1D kernel
+        if (plan->backend == BLUR_BACKEND_SEPARABLE) {
+                struct SeparableKernel *separableKernel = create_planned_separable_kernel(plan);
+                if (separableKernel == NULL) return 0;
+                int separablePipeline = apply_separable_convolution_pipeline_planes(inputPlanes, outputPlanes, numPlanes, separableKernel,
+                        imageHeight, imageWidth, borderMode, epilogue);
+                free_separable_kernel(separableKernel);
+                return separablePipeline;
+        }
+
+        // Direct and FFT backends: 2D kernel
+        struct Kernel *kernel = create_planned_kernel(plan);
+        if (kernel == NULL) return 0;
+        int convolutionPipeline = (plan->backend == BLUR_BACKEND_FFT) ?
+                apply_fft_convolution_pipeline_planes(inputPlanes, outputPlanes, numPlanes, kernel, imageHeight, imageWidth, borderMode,
+                        epilogue) :
+                apply_direct_convolution_pipeline_planes(inputPlanes, outputPlanes, numPlanes, kernel, imageHeight, imageWidth, borderMode,
+                        epilogue);
+        free_kernel(kernel);
+        return convolutionPipeline;
+
+}
+
+
+int apply_blur_plan_RGB(const struct BlurPlan *plan, struct ImageRGB *inputImage, struct ImageRGB *outputImage, enum BorderMode borderMode) {
+
+        uint8_t *inputPlanes[3] = {inputImage->redChannels, inputImage->greenChannels, inputImage->blueChannels};
+        uint8_t *outputPlanes[3] = {outputImage->redChannels, outputImage->greenChannels, outputImage->blueChannels};
+
+        return apply_blur_plan_planes(plan, inputPlanes, outputPlanes, 3, inputImage->height, inputImage->width, borderMode,
+                NULL);
+
+}
+
+
+// Times a backend on the calibration planes for a blur, returns nanoseconds per output channel (or a negative value on
+// failure). The first run also warms up the memory pools
+static double time_blur_backend(enum BlurBackend backend, enum BlurShape shape, float strength, uint8_t **inputPlanes,
+        uint8_t **outputPlanes, int numPlanes, int imageSize) {
+
+        struct BlurPlan plan = plan_blur(shape, strength, imageSize, imageSize, BORDER_MODE_ZERO);
+        if (plan.shape == BLUR_SHAPE_INVALID) return -1.0;
+        plan.backend = backend;
+
+        double bestTime = -1.0;
+        for (int repetition = 0; repetition < PLANNER_CALIBRATION_REPETITIONS; repetition++) {
+                double start = omp_get_wtime();
+                if (!apply_blur_plan_planes(&plan, inputPlanes, outputPlanes, numPlanes, imageSize, imageSize, BORDER_MODE_ZERO, NULL)) {
+                        return -1.0;
+                }
+                double time = omp_get_wtime() - start;
+                if (bestTime < 0.0 || time < bestTime) bestTime = time;
+        }
+
+        return 1e9*bestTime / ((double) numPlanes*imageSize*imageSize);
+
+}
+
+
+int calibrate_blur_cost_model(uint8_t **inputPlanes, uint8_t **outputPlanes, int numPlanes, int imageSize) {
+
+        // Direct: 3x3 and 11x11 box kernels (fixed part and part per entry)
+        double direct3 = time_blur_backend(BLUR_BACKEND_DIRECT, BLUR_SHAPE_BOX, 1.0f, inputPlanes, outputPlanes, numPlanes, imageSize);
+        double direct11 = time_blur_backend(BLUR_BACKEND_DIRECT, BLUR_SHAPE_BOX, 5.0f, inputPlanes, outputPlanes, numPlanes, imageSize);
+
+        // Separable: 7 and 31 tap box kernels
+        double separable7 = time_blur_backend(BLUR_BACKEND_SEPARABLE, BLUR_SHAPE_BOX, 3.0f, inputPlanes, outputPlanes, numPlanes, imageSize);
+        double separable31 = time_blur_backend(BLUR_BACKEND_SEPARABLE, BLUR_SHAPE_BOX, 15.0f, inputPlanes, outputPlanes, numPlanes, imageSize);
+
+        // Constant cost backends, and the FFT pipeline with a 33x33 kernel
+        double runningSum = time_blur_backend(BLUR_BACKEND_RUNNING_SUM, BLUR_SHAPE_BOX, 16.0f, inputPlanes, outputPlanes, numPlanes, imageSize);
+        double iir = time_blur_backend(BLUR_BACKEND_IIR, BLUR_SHAPE_GAUSSIAN, 8.0f, inputPlanes, outputPlanes, numPlanes, imageSize);
+        double fft = time_blur_backend(BLUR_BACKEND_FFT, BLUR_SHAPE_BOX, 16.0f, inputPlanes, outputPlanes, numPlanes, imageSize);
+
+        if (direct3 < 0.0 || direct11 < 0.0 || separable7 < 0.0 || separable31 < 0.0 || runningSum < 0.0 || iir < 0.0 || fft < 0.0) {
+                return 0;
+        }
+
+        // Fit the fixed part and the part per entry (or tap) through the two measurements of each size dependent backend
+        scaledCosts[BLUR_BACKEND_DIRECT] = (direct11 > direct3) ? (direct11 - direct3) / (11*11 - 3*3) : direct11 / (11*11);
+        fixedCosts[BLUR_BACKEND_DIRECT] = fmax(direct3 - scaledCosts[BLUR_BACKEND_DIRECT]*3*3, 0.0);
+        scaledCosts[BLUR_BACKEND_SEPARABLE] = (separable31 > separable7) ? (separable31 - separable7) / (2*31 - 2*7) : separable31 / (2*31);
+        fixedCosts[BLUR_BACKEND_SEPARABLE] = fmax(separable7 - scaledCosts[BLUR_BACKEND_SEPARABLE]*2*7, 0.0);
+        fixedCosts[BLUR_BACKEND_RUNNING_SUM] = runningSum;
+
+        // Scale the recursive cost to the extended image and the FFT cost to its model units
+        double numChannels = (double) imageSize*imageSize;
+        fixedCosts[BLUR_BACKEND_IIR] = iir*numChannels / iir_pass_channels(8.0f, imageSize, imageSize);
+        fixedCosts[BLUR_BACKEND_FFT] = 0.0;
+        scaledCosts[BLUR_BACKEND_FFT] = fft*numChannels / fft_convolution_cost(33, imageSize, imageSize);
+
+        for (int backend = 0; backend < BLUR_BACKEND_COUNT; backend++) {
+                printf("Calibrated %-10s blur backend: %.3f ns per channel + %.4f ns per %s\n", backendNames[backend], fixedCosts[backend],
+                        scaledCosts[backend], (backend == BLUR_BACKEND_DIRECT) ? "entry" : (backend == BLUR_BACKEND_FFT) ? "unit" : "tap");
+        }
+
+        return 1;
+
+}
+
+
+void save_blur_cost_model(FILE *file) {
+
+        fprintf(file, "# cost backend fixedNanoseconds scaledNanoseconds\n");
+        for (int backend = 0; backend < BLUR_BACKEND_COUNT; backend++) {
+                fprintf(file, "cost %s %.6f %.6f\n", backendNames[backend], fixedCosts[backend], scaledCosts[backend]);
+        }
+
+}
+
+
+int parse_blur_cost_line(const char *line) {
+
+        char name[32];
+        double fixedCost, scaledCost;
+        if (sscanf(line, "cost %31s %lf %lf", name, &fixedCost, &scaledCost) != 3) return 0;
+
+        // Keep the default costs of invalid values
+        if (fixedCost < 0.0 || scaledCost < 0.0) return 1;
+        for (int backend = 0; backend < BLUR_BACKEND_COUNT; backend++) {
+                if (strcmp(name, backendNames[backend]) == 0) {
+                        fixedCosts[backend] = fixedCost;
+                        scaledCosts[backend] = scaledCost;
+                }
+        }
+        return 1;
+
+}
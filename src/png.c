@@ -0,0 +1,763 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  // For memcpy() and memset()
+#include <stdint.h>  // For types uint8_t, uint32_t and uint64_t
+#include <omp.h>  // For parallel processing
+#include "png.h"
+#include "interleave.h"
+#include "pool.h"
+
+
+
+// Deflate window (largest match distance) and match lengths
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+// Hash chains of the match finder: buckets of the hash of three bytes, and the length of a match that is taken without
+// looking for a longer one at the next position
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_LAZY_LENGTH 32
+
+// Largest number of bytes of a stored block
+#define DEFLATE_MAX_STORED 65535
+
+// Matches of the minimum length further away than this cost more bits than three literals
+#define DEFLATE_FAR_MIN_MATCH 4096
+
+// Adler-32 modulus, and the bytes summed before the sums must be reduced (the largest n with 255n(n+1)/2 + (n+1)(BASE-1) < 2^32)
+#define ADLER_BASE 65521
+#define ADLER_MAX_RUN 5552
+
+// Filter types of the PNG rows (None, Sub, Up, Average, Paeth)
+#define PNG_NUM_FILTERS 5
+#define PNG_FILTER_ADAPTIVE -1
+#define PNG_FILTER_NONE 0
+#define PNG_FILTER_UP 2
+
+
+// Base values and extra bits of the deflate length (257 to 285) and distance (0 to 29) symbols
+static const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115,
+        131, 163, 195, 227, 258};
+static const uint8_t lengthExtraBits[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+        2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distanceExtraBits[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12,
+        12, 13, 13};
+
+
+
+/**
+ * @brief Structure for representing the tables of the PNG encoder: the CRC-32 tables of the chunks (four bytes at a time,
+ * crc[k][n] is the CRC of byte n followed by k zero bytes), and the fixed Huffman
+ * codes of deflate bit-reversed for an LSB-first bit writer. A match length maps to the code of its symbol followed by its
+ * extra bits, a distance d to its symbol through distanceSymbols[d - 1] (d <= 256) or distanceSymbols[256 + ((d - 1) >> 7)].
+ */
+typedef struct PngTables {
+        uint32_t crc[4][256];
+        uint16_t literalCodes[288];
+        uint8_t literalBits[288];
+        uint32_t lengthCodes[DEFLATE_MAX_MATCH + 1];
+        uint8_t lengthBits[DEFLATE_MAX_MATCH + 1];
+        uint8_t distanceSymbols[512];
+        uint8_t distanceCodes[30];
+} PngTables;
+
+/**
+ * @brief Structure for representing a deflate bit writer: bits are appended LSB first to `bits` and stored four bytes at
+ * a time at `output[position]`.
+ */
+typedef struct BitWriter {
+        uint8_t *output;
+        size_t position;
+        uint64_t bits;
+        int numBits;
+} BitWriter;
+
+// Enumeration for the ways of coding the filtered bytes of a band
+typedef enum DeflateMatching {
+        DEFLATE_MATCHING_STORED,        // Stored blocks (no compression)
+        DEFLATE_MATCHING_RUNS,          // Runs of a repeated pixel (matches at the distance of one pixel) and literals
+        DEFLATE_MATCHING_GREEDY,        // Longest match at every position
+        DEFLATE_MATCHING_LAZY           // Longest match, deferred by one position when the next one is longer
+} DeflateMatching;
+
+/**
+ * @brief Structure for representing the settings of a PNG compression mode: the filter of every row (PNG_FILTER_ADAPTIVE
+ * for the filter picked per row), the coding of the filtered bytes, the candidates tried per position by the match finder
+ * and the second byte of the zlib header (its compression level hint).
+ */
+typedef struct PngProfile {
+        int filter;
+        enum DeflateMatching matching;
+        int maxChain;
+        uint8_t zlibFlags;
+} PngProfile;
+
+// Settings of the compression modes
+static const struct PngProfile pngProfiles[PNG_COMPRESSION_INVALID] = {
+        [PNG_COMPRESSION_STORE] =       {PNG_FILTER_NONE, DEFLATE_MATCHING_STORED, 0, 0x01},
+        [PNG_COMPRESSION_RLE] =         {PNG_FILTER_UP, DEFLATE_MATCHING_RUNS, 0, 0x01},
+        [PNG_COMPRESSION_FAST] =        {PNG_FILTER_UP, DEFLATE_MATCHING_GREEDY, 4, 0x01},
+        [PNG_COMPRESSION_FULL] =        {PNG_FILTER_ADAPTIVE, DEFLATE_MATCHING_LAZY, 16, 0x5E}
+};
+
+// Names of the compression modes
+static const char *pngCompressionNames[PNG_COMPRESSION_INVALID] = {"store", "rle", "fast", "full"};
+
+
+
+// Reverses the lowest `count` bits of a code (Huffman codes are stored MSB first)
+static uint32_t reverse_bits(uint32_t code, int count) {
+
+        uint32_t reversed = 0;
+        for (int i = 0; i < count; i++) {
+                reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        return reversed;
+
+}
+
+
+// Builds the CRC-32 table and the fixed Huffman codes
+static void build_png_tables(struct PngTables *tables) {
+
+        // CRC-32 of the chunks (reflected polynomial 0xEDB88320), then the tables of the following zero bytes
+        for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) {
+                        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                tables->crc[0][n] = c;
+        }
+        for (int n = 0; n < 256; n++) {
+                for (int k = 1; k < 4; k++) {
+                        uint32_t c = tables->crc[k - 1][n];
+                        tables->crc[k][n] = tables->crc[0][c & 0xFF] ^ (c >> 8);
+                }
+        }
+
+        // Fixed literal/length codes (RFC 1951, 3.2.6)
+        for (int symbol = 0; symbol < 288; symbol++) {
+                uint32_t code;
+                int bits;
+                if (symbol < 144)       { code = 0x30 + symbol;          bits = 8; }
+                else if (symbol < 256)  { code = 0x190 + (symbol - 144); bits = 9; }
+                else if (symbol < 280)  { code = symbol - 256;           bits = 7; }
+                else                    { code = 0xC0 + (symbol - 280);  bits = 8; }
+                tables->literalCodes[symbol] = (uint16_t) reverse_bits(code, bits);
+                tables->literalBits[symbol] = (uint8_t) bits;
+        }
+
+        // Match lengths: the code of the length symbol followed by the extra bits
+        int symbol = 0;
+        for (int length = DEFLATE_MIN_MATCH; length <= DEFLATE_MAX_MATCH; length++) {
+                while (symbol < 28 && length >= lengthBase[symbol + 1]) symbol++;
+                int codeBits = tables->literalBits[257 + symbol];
+                tables->lengthCodes[length] = tables->literalCodes[257 + symbol] | ((uint32_t) (length - lengthBase[symbol]) << codeBits);
+                tables->lengthBits[length] = (uint8_t) (codeBits + lengthExtraBits[symbol]);
+        }
+
+        // Distance symbols (five bit fixed codes)
+        for (int distanceSymbol = 0; distanceSymbol < 30; distanceSymbol++) {
+                tables->distanceCodes[distanceSymbol] = (uint8_t) reverse_bits(distanceSymbol, 5);
+                int first = distanceBase[distanceSymbol] - 1;
+                int last = first + (1 << distanceExtraBits[distanceSymbol]) - 1;
+                for (int distance = first; distance <= last; distance++) {
+                        int index = (distance < 256) ? distance : 256 + (distance >> 7);
+                        tables->distanceSymbols[index] = (uint8_t) distanceSymbol;
+                }
+        }
+
+}
+
+
+// Updates a CRC-32 (not inverted) with bytes
+static uint32_t update_crc32(const struct PngTables *tables, uint32_t crc, const uint8_t *bytes, size_t count) {
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+                crc ^= (uint32_t) bytes[i] | ((uint32_t) bytes[i + 1] << 8) | ((uint32_t) bytes[i + 2] << 16) | ((uint32_t) bytes[i + 3] << 24);
+                crc = tables->crc[3][crc & 0xFF] ^ tables->crc[2][(crc >> 8) & 0xFF] ^ tables->crc[1][(crc >> 16) & 0xFF] ^
+                        tables->crc[0][crc >> 24];
+        }
+        for (; i < count; i++) {
+                crc = tables->crc[0][(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+
+}
+
+
+// Returns the Adler-32 of bytes
+static uint32_t compute_adler32(const uint8_t *bytes, size_t count) {
+
+        uint32_t sum1 = 1, sum2 = 0;
+        while (count > 0) {
+                size_t run = (count < ADLER_MAX_RUN) ? count : ADLER_MAX_RUN;
+                count -= run;
+                for (size_t i = 0; i < run; i++) {
+                        sum1 += bytes[i];
+                        sum2 += sum1;
+                }
+                bytes += run;
+                sum1 %= ADLER_BASE;
+                sum2 %= ADLER_BASE;
+        }
+        return (sum2 << 16) | sum1;
+
+}
+
+
+// Returns the Adler-32 of two byte sequences one after the other from their Adler-32s and the length of the second
+static uint32_t combine_adler32(uint32_t adler1, uint32_t adler2, size_t length2) {
+
+        // sum1 = s1(A) + s1(B) - 1 and sum2 = s2(A) + s2(B) + length2*(s1(A) - 1) (mod BASE)
+        uint32_t remainder = (uint32_t) (length2 % ADLER_BASE);
+        uint32_t sum1 = adler1 & 0xFFFF;
+        uint32_t sum2 = (uint32_t) (((uint64_t) remainder*sum1) % ADLER_BASE);
+        sum1 += (adler2 & 0xFFFF) + ADLER_BASE - 1;
+        sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - remainder;
+        if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+        if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+        if (sum2 >= 2*ADLER_BASE) sum2 -= 2*ADLER_BASE;
+        if (sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+        return (sum2 << 16) | sum1;
+
+}
+
+
+// Stores a big-endian integer (PNG chunk lengths, CRCs and dimensions)
+static void write_u32_be(uint8_t *bytes, uint32_t value) {
+        bytes[0] = (uint8_t) (value >> 24);
+        bytes[1] = (uint8_t) (value >> 16);
+        bytes[2] = (uint8_t) (value >> 8);
+        bytes[3] = (uint8_t) value;
+}
+
+
+// Appends `count` (at most 32) bits to the bit writer
+static inline void put_bits(struct BitWriter *writer, uint32_t value, int count) {
+
+        writer->bits |= (uint64_t) value << writer->numBits;
+        writer->numBits += count;
+        if (writer->numBits >= 32) {
+                uint8_t *output = &writer->output[writer->position];
+                output[0] = (uint8_t) writer->bits;
+                output[1] = (uint8_t) (writer->bits >> 8);
+                output[2] = (uint8_t) (writer->bits >> 16);
+                output[3] = (uint8_t) (writer->bits >> 24);
+                writer->position += 4;
+                writer->bits >>= 32;
+                writer->numBits -= 32;
+        }
+
+}
+
+
+// Stores the remaining bits of the bit writer, padded with zero bits to a whole byte
+static void flush_bits(struct BitWriter *writer) {
+
+        while (writer->numBits > 0) {
+                writer->output[writer->position++] = (uint8_t) writer->bits;
+                writer->bits >>= 8;
+                writer->numBits -= 8;
+        }
+        writer->bits = 0;
+        writer->numBits = 0;
+
+}
+
+
+static inline void put_literal(struct BitWriter *writer, const struct PngTables *tables, int literal) {
+        put_bits(writer, tables->literalCodes[literal], tables->literalBits[literal]);
+}
+
+static inline void put_match(struct BitWriter *writer, const struct PngTables *tables, int length, int distance) {
+        put_bits(writer, tables->lengthCodes[length], tables->lengthBits[length]);
+        int index = (distance <= 256) ? distance - 1 : 256 + ((distance - 1) >> 7);
+        int symbol = tables->distanceSymbols[index];
+        put_bits(writer, tables->distanceCodes[symbol] | ((uint32_t) (distance - distanceBase[symbol]) << 5), 5 + distanceExtraBits[symbol]);
+}
+
+
+// Returns the hash chain bucket of the three bytes at a position
+static inline uint32_t hash_three_bytes(const uint8_t *bytes) {
+
+        uint32_t value = (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16);
+        return (value*2654435761u) >> (32 - DEFLATE_HASH_BITS);
+
+}
+
+
+// Returns the length of the longest match of the bytes at `position` among the first maxChain candidates of its hash chain
+// (0 for none), and the distance of that match
+static int find_longest_match(const uint8_t *data, size_t position, size_t size, int32_t candidate, const int32_t *previous,
+        int maxChain, int *distance) {
+
+        int maxLength = (size - position < DEFLATE_MAX_MATCH) ? (int) (size - position) : DEFLATE_MAX_MATCH;
+        int bestLength = DEFLATE_MIN_MATCH - 1;
+        const uint8_t *current = &data[position];
+
+        for (int chain = 0; chain < maxChain && candidate >= 0 && position - candidate <= DEFLATE_WINDOW_SIZE; chain++) {
+                const uint8_t *match = &data[candidate];
+
+                // Skip the candidates that cannot beat the best match, then compare eight bytes at a time
+                if (match[bestLength] == current[bestLength] && match[0] == current[0]) {
+                        int length = 0;
+                        while (length + 8 <= maxLength) {
+                                uint64_t a, b;
+                                memcpy(&a, &match[length], 8);
+                                memcpy(&b, &current[length], 8);
+                                if (a != b) {
+                                        length += __builtin_ctzll(a ^ b) >> 3;
+                                        break;
+                                }
+                                length += 8;
+                        }
+                        if (length + 8 > maxLength) {
+                                while (length < maxLength && match[length] == current[length]) length++;
+                        }
+                        if (length > bestLength) {
+                                bestLength = length;
+                                *distance = (int) (position - candidate);
+                                if (length >= maxLength) break;
+                        }
+                }
+                candidate = previous[candidate & (DEFLATE_WINDOW_SIZE - 1)];
+        }
+
+        if (bestLength < DEFLATE_MIN_MATCH || (bestLength == DEFLATE_MIN_MATCH && *distance > DEFLATE_FAR_MIN_MATCH)) return 0;
+        return bestLength;
+
+}
+
+
+// Codes the bytes as runs of a repeated pixel (matches at the distance of one pixel) and literals
+static void put_runs(struct BitWriter *writer, const struct PngTables *tables, const uint8_t *data, size_t size, int bytesPerPixel) {
+
+        size_t position = 0;
+        while (position < size) {
+
+                // Count the bytes repeating those one pixel before, eight at a time
+                int length = 0;
+                if (position >= (size_t) bytesPerPixel) {
+                        int maxLength = (size - position < DEFLATE_MAX_MATCH) ? (int) (size - position) : DEFLATE_MAX_MATCH;
+                        const uint8_t *current = &data[position];
+                        const uint8_t *match = current - bytesPerPixel;
+                        while (length + 8 <= maxLength) {
+                                uint64_t a, b;
+                                memcpy(&a, &match[length], 8);
+                                memcpy(&b, &current[length], 8);
+                                if (a != b) {
+                                        length += __builtin_ctzll(a ^ b) >> 3;
+                                        break;
+                                }
+                                length += 8;
+                        }
+                        if (length + 8 > maxLength) {
+                                while (length < maxLength && match[length] == current[length]) length++;
+                        }
+                }
+
+                if (length >= DEFLATE_MIN_MATCH) {
+                        put_match(writer, tables, length, bytesPerPixel);
+                        position += length;
+                } else {
+                        put_literal(writer, tables, data[position]);
+                        position++;
+                }
+        }
+
+}
+
+
+// Codes the bytes with the longest match at every position (the positions covered by a match are not inserted into the
+// hash chains)
+static void put_greedy_matches(struct BitWriter *writer, const struct PngTables *tables, const uint8_t *data, size_t size, int maxChain,
+        int32_t *head, int32_t *previous) {
+
+        size_t position = 0;
+        while (position < size) {
+                int length = 0, distance = 0;
+                if (position + DEFLATE_MIN_MATCH <= size) {
+                        uint32_t hash = hash_three_bytes(&data[position]);
+                        length = find_longest_match(data, position, size, head[hash], previous, maxChain, &distance);
+                        previous[position & (DEFLATE_WINDOW_SIZE - 1)] = head[hash];
+                        head[hash] = (int32_t) position;
+                }
+
+                if (length > 0) {
+                        put_match(writer, tables, length, distance);
+                        position += length;
+                } else {
+                        put_literal(writer, tables, data[position]);
+                        position++;
+                }
+        }
+
+}
+
+
+// Codes the bytes with greedy matching and one step of lazy evaluation: the match found at a position is emitted unless
+// the next position has a longer one, in which case the byte becomes a literal
+static void put_lazy_matches(struct BitWriter *writer, const struct PngTables *tables, const uint8_t *data, size_t size, int maxChain,
+        int32_t *head, int32_t *previous) {
+
+        size_t position = 0;
+        int pendingLiteral = 0;
+        int pendingLength = 0, pendingDistance = 0;
+        while (position < size) {
+
+                // Find the longest match at the position and insert the position into its hash chain
+                int length = 0, distance = 0;
+                if (position + DEFLATE_MIN_MATCH <= size) {
+                        uint32_t hash = hash_three_bytes(&data[position]);
+                        if (pendingLength < DEFLATE_LAZY_LENGTH) {
+                                length = find_longest_match(data, position, size, head[hash], previous, maxChain, &distance);
+                        }
+                        previous[position & (DEFLATE_WINDOW_SIZE - 1)] = head[hash];
+                        head[hash] = (int32_t) position;
+                }
+
+                if (pendingLength >= DEFLATE_MIN_MATCH && length <= pendingLength) {
+                        // The match of the previous position is at least as long: emit it and insert the positions it covers
+                        put_match(writer, tables, pendingLength, pendingDistance);
+                        size_t matchEnd = position - 1 + pendingLength;
+                        for (size_t covered = position + 1; covered < matchEnd && covered + DEFLATE_MIN_MATCH <= size; covered++) {
+                                uint32_t hash = hash_three_bytes(&data[covered]);
+                                previous[covered & (DEFLATE_WINDOW_SIZE - 1)] = head[hash];
+                                head[hash] = (int32_t) covered;
+                        }
+                        position = matchEnd;
+                        pendingLiteral = 0;
+                        pendingLength = 0;
+                } else {
+                        // The previous byte is a literal, the match of the position waits for the next one
+                        if (pendingLiteral) put_literal(writer, tables, data[position - 1]);
+                        pendingLiteral = 1;
+                        pendingLength = length;
+                        pendingDistance = distance;
+                        position++;
+                }
+        }
+        if (pendingLiteral) put_literal(writer, tables, data[position - 1]);
+
+}
+
+
+// Deflates bytes with a profile: into stored blocks, or into one block of fixed Huffman codes. The last block of a stream
+// is marked final, a block of fixed codes that is not the last ends with an empty stored block so that the next block
+// starts on a byte boundary (sync flush). `head` (2^DEFLATE_HASH_BITS entries) and `previous` (DEFLATE_WINDOW_SIZE
+// entries) hold the hash chains. Returns the number of bytes written
+static size_t deflate_band(const uint8_t *data, size_t size, int bytesPerPixel, int finalBlock, const struct PngProfile *profile,
+        const struct PngTables *tables, int32_t *head, int32_t *previous, uint8_t *output) {
+
+        // Stored blocks: a byte aligned header (BFINAL, BTYPE = 00), LEN and NLEN, then the bytes
+        if (profile->matching == DEFLATE_MATCHING_STORED) {
+                size_t position = 0;
+                size_t written = 0;
+                do {
+                        size_t length = (size - position < DEFLATE_MAX_STORED) ? size - position : DEFLATE_MAX_STORED;
+                        output[written++] = (finalBlock && position + length == size) ? 1 : 0;
+                        output[written++] = (uint8_t) length;
+                        output[written++] = (uint8_t) (length >> 8);
+                        output[written++] = (uint8_t) ~length;
+                        output[written++] = (uint8_t) (~length >> 8);
+                        memcpy(&output[written], &data[position], length);
+                        written += length;
+                        position += length;
+                } while (position < size);
+                return written;
+        }
+
+        struct BitWriter writer = {output, 0, 0, 0};
+
+        // Block header: BFINAL, BTYPE = 01 (fixed Huffman codes)
+        put_bits(&writer, finalBlock ? 3 : 2, 3);
+
+        if (profile->matching == DEFLATE_MATCHING_RUNS) {
+                put_runs(&writer, tables, data, size, bytesPerPixel);
+        } else {
+                for (int i = 0; i < (1 << DEFLATE_HASH_BITS); i++) head[i] = -1;
+                if (profile->matching == DEFLATE_MATCHING_GREEDY) {
+                        put_greedy_matches(&writer, tables, data, size, profile->maxChain, head, previous);
+                } else {
+                        put_lazy_matches(&writer, tables, data, size, profile->maxChain, head, previous);
+                }
+        }
+
+        // End of block, then the empty stored block of a sync flush (BFINAL = 0, BTYPE = 00, LEN = 0, NLEN = 0xFFFF)
+        put_literal(&writer, tables, 256);
+        if (!finalBlock) {
+                put_bits(&writer, 0, 3);
+                flush_bits(&writer);
+                memcpy(&output[writer.position], "\x00\x00\xFF\xFF", 4);
+                writer.position += 4;
+        }
+        flush_bits(&writer);
+
+        return writer.position;
+
+}
+
+
+// Computes a row filtered with one filter type into `filtered` and returns the sum of the absolute (signed) filtered bytes.
+// `above` is the previous row (zeros for the first row)
+static uint64_t apply_png_filter(int filter, const uint8_t *row, const uint8_t *above, size_t rowBytes, int bytesPerPixel,
+        uint8_t *filtered) {
+
+        size_t first = (rowBytes < (size_t) bytesPerPixel) ? rowBytes : (size_t) bytesPerPixel;
+        uint32_t sum = 0;
+        uint64_t total = 0;
+
+        // The pixels of the first byte run have no left neighbour: left and up-left are zero (None, Sub: the byte, Up, Paeth:
+        // the byte above, Average: half of it)
+        for (size_t x = 0; x < first; x++) {
+                int predictor = (filter == 2 || filter == 4) ? above[x] : (filter == 3) ? above[x] >> 1 : 0;
+                filtered[x] = (uint8_t) (row[x] - predictor);
+                total += (uint64_t) abs((int8_t) filtered[x]);
+        }
+
+        // Sum in runs short enough for 32 bits
+        for (size_t start = first; start < rowBytes; start += 1 << 23) {
+                size_t end = (rowBytes - start > (1 << 23)) ? start + (1 << 23) : rowBytes;
+                sum = 0;
+                switch (filter) {
+                        case 0:
+                                for (size_t x = start; x < end; x++) {
+                                        filtered[x] = row[x];
+                                        sum += (uint32_t) abs((int8_t) filtered[x]);
+                                }
+                                break;
+                        case 1:
+                                for (size_t x = start; x < end; x++) {
+                                        filtered[x] = (uint8_t) (row[x] - row[x - bytesPerPixel]);
+                                        sum += (uint32_t) abs((int8_t) filtered[x]);
+                                }
+                                break;
+                        case 2:
+                                for (size_t x = start; x < end; x++) {
+                                        filtered[x] = (uint8_t) (row[x] - above[x]);
+                                        sum += (uint32_t) abs((int8_t) filtered[x]);
+                                }
+                                break;
+                        case 3:
+                                for (size_t x = start; x < end; x++) {
+                                        filtered[x] = (uint8_t) (row[x] - ((row[x - bytesPerPixel] + above[x]) >> 1));
+                                        sum += (uint32_t) abs((int8_t) filtered[x]);
+                                }
+                                break;
+                        default:
+                                // Paeth: the neighbour (left, up, up-left) closest to left + up - upLeft
+                                for (size_t x = start; x < end; x++) {
+                                        int left = row[x - bytesPerPixel], up = above[x], upLeft = above[x - bytesPerPixel];
+                                        int pa = abs(up - upLeft), pb = abs(left - upLeft), pc = abs(left + up - 2*upLeft);
+                                        int predictor = (pa <= pb && pa <= pc) ? left : (pb <= pc) ? up : upLeft;
+                                        filtered[x] = (uint8_t) (row[x] - predictor);
+                                        sum += (uint32_t) abs((int8_t) filtered[x]);
+                                }
+                                break;
+                }
+                total += sum;
+        }
+
+        return total;
+
+}
+
+
+// Filters a row with the filter of the profile, or the filter of the smallest sum of absolute (signed) differences, and
+// stores the filter type followed by the filtered bytes. `candidate` is a scratch row
+static void filter_png_row(const uint8_t *row, const uint8_t *above, size_t rowBytes, int bytesPerPixel, int filter, uint8_t *candidate,
+        uint8_t *output) {
+
+        if (filter != PNG_FILTER_ADAPTIVE) {
+                output[0] = (uint8_t) filter;
+                apply_png_filter(filter, row, above, rowBytes, bytesPerPixel, &output[1]);
+                return;
+        }
+
+        // The first filter (None) is written straight into the output, the others into the scratch row and copied when better
+        uint64_t bestSum = apply_png_filter(0, row, above, rowBytes, bytesPerPixel, &output[1]);
+        output[0] = 0;
+        for (int filter = 1; filter < PNG_NUM_FILTERS; filter++) {
+                uint64_t sum = apply_png_filter(filter, row, above, rowBytes, bytesPerPixel, candidate);
+                if (sum < bestSum) {
+                        bestSum = sum;
+                        output[0] = (uint8_t) filter;
+                        memcpy(&output[1], candidate, rowBytes);
+                }
+        }
+
+}
+
+
+// Returns row y of the image interleaved (or the plane row of a greyscale image)
+static const uint8_t *get_png_row(uint8_t *const *planes, int numPlanes, int width, int y, const struct InterleaveShuffles *shuffles,
+        uint8_t *buffer) {
+
+        size_t offset = (size_t) y*width;
+        if (numPlanes == 1) return &planes[0][offset];
+        uint8_t *rowPlanes[3] = {&planes[0][offset], &planes[1][offset], &planes[2][offset]};
+        interleave_channels_row(rowPlanes, buffer, shuffles, width);
+        return buffer;
+
+}
+
+
+// Writes a chunk from its type and data, returns 0 on failure
+static int write_png_chunk(FILE *file, const struct PngTables *tables, const char *type, const uint8_t *data, uint32_t length) {
+
+        uint8_t header[8], trailer[4];
+        write_u32_be(header, length);
+        memcpy(&header[4], type, 4);
+        uint32_t crc = update_crc32(tables, 0xFFFFFFFFu, &header[4], 4);
+        crc = update_crc32(tables, crc, data, length);
+        write_u32_be(trailer, crc ^ 0xFFFFFFFFu);
+        return fwrite(header, 1, 8, file) == 8 && (length == 0 || fwrite(data, 1, length, file) == length) && fwrite(trailer, 1, 4, file) == 4;
+
+}
+
+
+const char *png_compression_name(enum PngCompression compression) {
+
+        if (compression < 0 || compression >= PNG_COMPRESSION_INVALID) return "invalid";
+        return pngCompressionNames[compression];
+
+}
+
+
+int write_png_planes(const char *filename, uint8_t *const *planes, int numPlanes, int width, int height, enum PngCompression compression) {
+
+        if ((numPlanes != 1 && numPlanes != 3) || width <= 0 || height <= 0 || compression < 0 || compression >= PNG_COMPRESSION_INVALID) {
+                fprintf(stderr, "\nFatal error: image could not be saved as PNG.\n\n");
+                return 0;
+        }
+        const struct PngProfile *profile = &pngProfiles[compression];
+
+        // Split the rows into bands of about PNG_BAND_BYTES filtered bytes (a filter type byte and the pixels per row)
+        size_t rowBytes = (size_t) width*numPlanes;
+        size_t lineBytes = rowBytes + 1;
+        int bandRows = (lineBytes < PNG_BAND_BYTES) ? (int) (PNG_BAND_BYTES / lineBytes) : 1;
+        int numBands = (height + bandRows - 1) / bandRows;
+        size_t bandBytes = (size_t) bandRows*lineBytes;
+        if (bandBytes > INT32_MAX) {
+                fprintf(stderr, "\nFatal error: image could not be saved as PNG. Reason: rows too wide.\n\n");
+                return 0;
+        }
+
+        // Fixed Huffman codes take at most 9 bits per byte (stored blocks 5 bytes per DEFLATE_MAX_STORED bytes), a band chunk
+        // also holds its chunk header, the zlib header (first band), the sync flush and its CRC
+        size_t chunkCapacity = bandBytes + bandBytes / 8 + 64;
+
+        struct PngTables tables;
+        build_png_tables(&tables);
+
+        // Byte shuffles of the RGB rows, built once for every row
+        struct InterleaveShuffles shuffles;
+        if (numPlanes == 3 && !build_interleave_shuffles(&shuffles, 3, 1)) return 0;
+
+        FILE *file = fopen(filename, "wb");
+        if (file == NULL) {
+                fprintf(stderr, "\nFatal error: image could not be saved as PNG. Reason: output file could not be opened.\n\n");
+                return 0;
+        }
+
+        // Signature and header (8 bit depth, greyscale or RGB, no interlacing)
+        uint8_t header[13];
+        write_u32_be(&header[0], (uint32_t) width);
+        write_u32_be(&header[4], (uint32_t) height);
+        header[8] = 8;
+        header[9] = (numPlanes == 3) ? 2 : 0;
+        header[10] = 0;
+        header[11] = 0;
+        header[12] = 0;
+        int written = fwrite("\x89PNG\r\n\x1A\n", 1, 8, file) == 8 && write_png_chunk(file, &tables, "IHDR", header, 13);
+
+        // Flag to indicate error in the parallel processing
+        int errorFlag = !written;
+        uint32_t streamAdler = 1;
+
+        // Filter and deflate the bands in parallel, write their chunks in order
+        #pragma omp parallel shared(errorFlag, streamAdler)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread: the filtered band, its chunk, the hash chains,
+                // the interleaved rows and a scratch row of the filters
+                size_t poolSize = memory_size_alignment(bandBytes) + memory_size_alignment(chunkCapacity) +
+                        memory_size_alignment(((size_t) 1 << DEFLATE_HASH_BITS)*sizeof(int32_t)) +
+                        memory_size_alignment(DEFLATE_WINDOW_SIZE*sizeof(int32_t)) + 4*memory_size_alignment(rowBytes);
+                struct MemoryPool *pool = acquire_thread_memory_pool(poolSize);
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                #pragma omp for ordered schedule(static, 1)
+                for (int band = 0; band < numBands; band++) {
+                        if (pool == NULL) continue;
+                        empty_pool(pool);
+
+                        uint8_t *filtered = (uint8_t*)allocate_from_pool(pool, bandBytes);
+                        uint8_t *chunk = (uint8_t*)allocate_from_pool(pool, chunkCapacity);
+                        int32_t *head = (int32_t*)allocate_from_pool(pool, ((size_t) 1 << DEFLATE_HASH_BITS)*sizeof(int32_t));
+                        int32_t *previous = (int32_t*)allocate_from_pool(pool, DEFLATE_WINDOW_SIZE*sizeof(int32_t));
+                        uint8_t *rowBuffers[2] = {(uint8_t*)allocate_from_pool(pool, rowBytes), (uint8_t*)allocate_from_pool(pool, rowBytes)};
+                        uint8_t *zeroRow = (uint8_t*)allocate_from_pool(pool, rowBytes);
+                        uint8_t *candidate = (uint8_t*)allocate_from_pool(pool, rowBytes);
+
+                        // Filter the rows of the band (the first row of the band is filtered against the last row of the
+                        // previous band, the first row of the image against zeros)
+                        int firstRow = band*bandRows;
+                        int lastRow = (firstRow + bandRows < height) ? firstRow + bandRows : height;
+                        memset(zeroRow, 0, rowBytes);
+                        const uint8_t *above = (firstRow > 0) ? get_png_row(planes, numPlanes, width, firstRow - 1, &shuffles, rowBuffers[1]) : zeroRow;
+                        for (int y = firstRow; y < lastRow; y++) {
+                                const uint8_t *row = get_png_row(planes, numPlanes, width, y, &shuffles, rowBuffers[(y - firstRow) % 2]);
+                                filter_png_row(row, above, rowBytes, numPlanes, profile->filter, candidate, &filtered[(size_t) (y - firstRow)*lineBytes]);
+                                above = row;
+                        }
+                        size_t filteredBytes = (size_t) (lastRow - firstRow)*lineBytes;
+                        uint32_t bandAdler = compute_adler32(filtered, filteredBytes);
+
+                        // Deflate the band after the chunk header (and the zlib header: 32K window, no dictionary)
+                        size_t dataStart = 8;
+                        if (band == 0) {
+                                chunk[dataStart++] = 0x78;
+                                chunk[dataStart++] = profile->zlibFlags;
+                        }
+                        size_t dataBytes = dataStart - 8 + deflate_band(filtered, filteredBytes, numPlanes, band == numBands - 1, profile, &tables, head,
+                                previous, &chunk[dataStart]);
+
+                        // Complete the chunk
+                        write_u32_be(chunk, (uint32_t) dataBytes);
+                        memcpy(&chunk[4], "IDAT", 4);
+                        uint32_t crc = update_crc32(&tables, 0xFFFFFFFFu, &chunk[4], dataBytes + 4);
+                        write_u32_be(&chunk[8 + dataBytes], crc ^ 0xFFFFFFFFu);
+
+                        // Write the chunks in the order of the bands
+                        #pragma omp ordered
+                        {
+                                streamAdler = combine_adler32(streamAdler, bandAdler, filteredBytes);
+                                if (fwrite(chunk, 1, dataBytes + 12, file) != dataBytes + 12) {
+                                        #pragma omp atomic write
+                                        errorFlag = 1;
+                                }
+                        }
+                }
+        }
+
+        // The zlib stream ends with the Adler-32 of the filtered rows, then the image ends
+        uint8_t adler[4];
+        write_u32_be(adler, streamAdler);
+        if (!errorFlag) errorFlag = !write_png_chunk(file, &tables, "IDAT", adler, 4) || !write_png_chunk(file, &tables, "IEND", NULL, 0);
+        if (fclose(file) != 0) errorFlag = 1;
+
+        if (errorFlag) {
+                fprintf(stderr, "\nFatal error: image could not be saved as PNG.\n\n");
+                return 0;
+        }
+
+        return 1;
+
+}
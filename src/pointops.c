@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <math.h>  // For powf() and roundf()
+#include <stdint.h>  // For type uint8_t
+#include "pointops.h"
+
+
+
+void init_point_op_epilogue(struct PointOpEpilogue *epilogue) {
+
+        epilogue->numOps = 0;
+        for (int value = 0; value < 256; value++) {
+                epilogue->table[value] = (uint8_t) value;
+        }
+
+}
+
+
+// Rounds and clamps the result of a point operation to [0, 255]
+static uint8_t clamp_point_op_result(float result) {
+
+        if (result <= 0.0f) return 0;
+        if (result >= 255.0f) return 255;
+        return (uint8_t) roundf(result);
+
+}
+
+
+int append_point_op(struct PointOpEpilogue *epilogue, enum PointOpType type, float value) {
+
+        if (epilogue->numOps >= POINT_OP_MAX_OPS) {
+                fprintf(stderr, "\nFatal error: at most %d point operations can be fused into a stage.\n", POINT_OP_MAX_OPS);
+                return 0;
+        }
+
+        // Validate the value of the operation
+        int validValue;
+        switch (type) {
+                case POINT_OP_BRIGHTNESS:       validValue = (value >= -255.0f && value <= 255.0f); break;
+                case POINT_OP_CONTRAST:         validValue = (value >= 0.0f && value <= 16.0f); break;
+                case POINT_OP_GAMMA:            validValue = (value >= 0.1f && value <= 10.0f); break;
+                case POINT_OP_THRESHOLD:        validValue = (value >= 0.0f && value <= 255.0f); break;
+                default:
+                        fprintf(stderr, "\nFatal error: invalid point operation.\n");
+                        return 0;
+        }
+        if (!validValue) {
+                fprintf(stderr, "\nFatal error: invalid point operation value %g.\n", value);
+                return 0;
+        }
+
+        // Compose the operation after the table (every entry maps through the previous operations first)
+        for (int i = 0; i < 256; i++) {
+                float channel = (float) epilogue->table[i];
+                switch (type) {
+                        case POINT_OP_BRIGHTNESS:
+                                epilogue->table[i] = clamp_point_op_result(channel + value);
+                                break;
+                        case POINT_OP_CONTRAST:
+                                epilogue->table[i] = clamp_point_op_result((channel - 128.0f)*value + 128.0f);
+                                break;
+                        case POINT_OP_GAMMA:
+                                epilogue->table[i] = clamp_point_op_result(255.0f*powf(channel / 255.0f, 1.0f / value));
+                                break;
+                        case POINT_OP_THRESHOLD:
+                                epilogue->table[i] = (channel >= value) ? 255 : 0;
+                                break;
+                        default:
+                                break;
+                }
+        }
+        epilogue->numOps++;
+
+        return 1;
+
+}
+
+
+void apply_point_op_epilogue_row(const struct PointOpEpilogue *epilogue, uint8_t *row, int count) {
+
+        if (epilogue == NULL || epilogue->numOps == 0) return;
+
+        // One table lookup per channel, four at a time (the row was just written and is in the L1 cache)
+        const uint8_t *table = epilogue->table;
+        int x = 0;
+        for (; x + 4 <= count; x += 4) {
+                uint8_t a = table[row[x]], b = table[row[x + 1]], c = table[row[x + 2]], d = table[row[x + 3]];
+                row[x] = a; row[x + 1] = b; row[x + 2] = c; row[x + 3] = d;
+        }
+        for (; x < count; x++) {
+                row[x] = table[row[x]];
+        }
+
+}
@@ -1,10 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h> // For type size_t
+#include <omp.h>  // For releasing the arenas of the worker threads
 #include "pool.h"
 
 
 
+// Persistent MemoryPool (arena) of each thread, OpenMP reuses its worker threads between parallel regions
+static _Thread_local struct MemoryPool *threadMemoryPool = NULL;
+
+
+
 
 size_t memory_size_alignment(size_t size) {
 
@@ -99,6 +105,22 @@ void empty_pool(struct MemoryPool *pool) {
 }
 
 
+void *mark_pool(struct MemoryPool *pool) {
+
+        // The mark is simply the current position of the nextFree pointer
+        return pool->nextFree;
+
+}
+
+
+void rollback_pool(struct MemoryPool *pool, void *mark) {
+
+        // Move the nextFree pointer backward to "free" all memory allocated after the mark
+        pool->nextFree = mark;
+
+}
+
+
 void release_entire_memory_pool(struct MemoryPool *pool) {
 
 #ifdef _WIN32
@@ -111,4 +133,45 @@ void release_entire_memory_pool(struct MemoryPool *pool) {
         pool->memory = NULL;
         pool->nextFree = NULL;
         free(pool);
-} 
\ No newline at end of file
+} 
+
+
+
+struct MemoryPool *acquire_thread_memory_pool(size_t desiredSize) {
+
+        // Align the desired memory region size to proper memory alignment
+        size_t alignedSize = memory_size_alignment(desiredSize);
+
+        // Replace the arena of the calling thread if it is too small (grow at least twofold to avoid repeated reallocation)
+        if (threadMemoryPool != NULL && threadMemoryPool->poolSize < alignedSize) {
+                size_t grownSize = 2*threadMemoryPool->poolSize;
+                if (grownSize > alignedSize) alignedSize = grownSize;
+                release_entire_memory_pool(threadMemoryPool);
+                threadMemoryPool = NULL;
+        }
+
+        // Create the arena on first use
+        if (threadMemoryPool == NULL) {
+                threadMemoryPool = init_memory_pool(alignedSize);
+                if (threadMemoryPool == NULL) return NULL;
+        }
+
+        // Hand out an empty arena
+        empty_pool(threadMemoryPool);
+        return threadMemoryPool;
+
+}
+
+
+void release_thread_memory_pools(void) {
+
+        // Every thread of the team releases its own arena (the master thread included)
+        #pragma omp parallel
+        {
+                if (threadMemoryPool != NULL) {
+                        release_entire_memory_pool(threadMemoryPool);
+                        threadMemoryPool = NULL;
+                }
+        }
+
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "convolution.h"
+#include "fixedpoint.h"
+#include "filters.h"
+#include "registry.h"
+
+
+
+/**
+ * @brief Structure for representing an entry of the kernel registry: the registered forms (owned by the entry) and a
+ * flag indicating that they were built.
+ */
+typedef struct RegistryEntry {
+        int built;
+        struct Kernel *kernel;
+        struct SeparableKernel *separableKernel;
+        struct FixedPointKernel *fixedPointKernel;
+        struct KernelSet kernelSet;
+} RegistryEntry;
+
+
+// Registered kernels of every (filter, intensity) pair, only accessed within the kernel_registry critical section
+static struct RegistryEntry registry[FILTER_INVALID][FILTER_INTENSITY_INVALID];
+
+
+
+// Frees the forms of a registry entry and marks it as not built
+static void free_registry_entry(struct RegistryEntry *entry) {
+
+        if (entry->fixedPointKernel != NULL) free_fixed_point_kernel(entry->fixedPointKernel);
+        if (entry->separableKernel != NULL) free_separable_kernel(entry->separableKernel);
+        if (entry->kernel != NULL) free_kernel(entry->kernel);
+        entry->kernel = NULL;
+        entry->separableKernel = NULL;
+        entry->fixedPointKernel = NULL;
+        entry->built = 0;
+
+}
+
+
+// Builds the forms of a registry entry. Returns 0 on failure (the entry is left empty)
+static int build_registry_entry(struct RegistryEntry *entry, enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity) {
+
+        // Create the float kernel and, for the rank-1 (separable) blurs, its 1D form
+        switch (typeFilter) {
+                case FILTER_GAUSSIAN_BLUR:
+                        entry->kernel = create_gaussian_kernel(filterIntensity);
+                        entry->separableKernel = create_gaussian_separable_kernel(filterIntensity);
+                        break;
+                case FILTER_BOX_BLUR:
+                        entry->kernel = create_box_blur_kernel(filterIntensity);
+                        entry->separableKernel = create_box_blur_separable_kernel(filterIntensity);
+                        break;
+                case FILTER_EMBOSS:
+                        entry->kernel = create_emboss_kernel(filterIntensity);
+                        break;
+                case FILTER_SHARPEN:
+                        entry->kernel = create_sharpen_kernel(filterIntensity);
+                        break;
+                case FILTER_DISC_BOKEH:
+                        entry->kernel = create_disc_bokeh_kernel(filterIntensity);
+                        break;
+                case FILTER_HEXAGONAL_BOKEH:
+                        entry->kernel = create_hexagonal_bokeh_kernel(filterIntensity);
+                        break;
+                default:
+                        fprintf(stderr, "\nFatal error: the filter has no convolution kernel.\n");
+                        return 0;
+        }
+        if (entry->kernel == NULL || ((typeFilter == FILTER_GAUSSIAN_BLUR || typeFilter == FILTER_BOX_BLUR) &&
+                        entry->separableKernel == NULL)) {
+                free_registry_entry(entry);
+                return 0;
+        }
+
+        // Quantize the float kernel for the integer convolution pipeline. A kernel that cannot be quantized keeps its
+        // other forms (NULL fixed-point form), its stages run through the float pipeline
+        entry->fixedPointKernel = create_fixed_point_kernel(entry->kernel);
+
+        // Hand out the forms as read-only pointers
+        entry->kernelSet.kernel = entry->kernel;
+        entry->kernelSet.separableKernel = entry->separableKernel;
+        entry->kernelSet.fixedPointKernel = entry->fixedPointKernel;
+        entry->built = 1;
+        return 1;
+
+}
+
+
+const struct KernelSet *get_registered_kernels(enum TypeFilter typeFilter, enum GeneralFilterIntensity filterIntensity) {
+
+        // Verify the registry key
+        if (typeFilter < 0 || typeFilter >= FILTER_INVALID || filterIntensity < 0 || filterIntensity >= FILTER_INTENSITY_INVALID) {
+                fprintf(stderr, "\nFatal error: invalid kernel registry key.\n");
+                return NULL;
+        }
+
+        const struct KernelSet *kernelSet = NULL;
+
+        // Build the entry on the first request, concurrent requests wait for it
+        #pragma omp critical(kernel_registry)
+        {
+                struct RegistryEntry *entry = &registry[typeFilter][filterIntensity];
+                if (entry->built || build_registry_entry(entry, typeFilter, filterIntensity)) {
+                        kernelSet = &entry->kernelSet;
+                }
+        }
+
+        return kernelSet;
+
+}
+
+
+void release_kernel_registry(void) {
+
+        #pragma omp critical(kernel_registry)
+        {
+                for (int filter = 0; filter < FILTER_INVALID; filter++) {
+                        for (int intensity = 0; intensity < FILTER_INTENSITY_INVALID; intensity++) {
+                                free_registry_entry(&registry[filter][intensity]);
+                        }
+                }
+        }
+
+}
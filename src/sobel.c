@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  // For memset() and memcpy()
+#include <math.h>  // For sqrtf() and lrintf()
+#include <stdint.h>  // For types uint8_t and int16_t
+#include <immintrin.h>  // For AVX2 intrinsics
+#include <omp.h>  // For multithreading
+#include "pool.h"
+#include "convolution.h"
+#include "sobel.h"
+#include "tuning.h"
+#include "cpu.h"
+
+
+
+// Extra columns at the end of each padded luminance row so that the last (partial) vector of a row can be loaded
+#define SOBEL_ROW_SLACK 32
+
+
+
+float sobel_intensity_scale(enum GeneralFilterIntensity filterIntensity) {
+
+        // Scaling factors of the sobel kernels (determine the intensity of the sobel filter)
+        switch (filterIntensity) {
+                case FILTER_INTENSITY_LIGHT:    return 1.0f;
+                case FILTER_INTENSITY_MEDIUM:   return 1.25f;
+                case FILTER_INTENSITY_HIGH:     return 1.5f;
+                default:                        return 1.0f;
+        }
+
+}
+
+
+
+// Converts `count` pixels of the RGB rows to luminance (fixed-point weights, exact in int16)
+typedef void (*LumaSpanFunction)(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *lumaRow, int count);
+
+
+// Scalar version
+static void luma_span_scalar(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *lumaRow, int count) {
+
+        for (int x = 0; x < count; x++) {
+                lumaRow[x] = (uint8_t) ((SOBEL_LUMA_RED_WEIGHT*redRow[x] + SOBEL_LUMA_GREEN_WEIGHT*greenRow[x] +
+                        SOBEL_LUMA_BLUE_WEIGHT*blueRow[x]) >> 7);
+        }
+
+}
+
+
+// SSE4.1 version, 8 pixels at a time
+CPU_TARGET_SSE41
+static void luma_span_sse41(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *lumaRow, int count) {
+
+        __m128i redWeight_vec16i = _mm_set1_epi16(SOBEL_LUMA_RED_WEIGHT);
+        __m128i greenWeight_vec16i = _mm_set1_epi16(SOBEL_LUMA_GREEN_WEIGHT);
+        __m128i blueWeight_vec16i = _mm_set1_epi16(SOBEL_LUMA_BLUE_WEIGHT);
+
+        int x = 0;
+        for (; x + 8 <= count; x += 8) {
+
+                // Load 8 pixels from each channel of type uint8 and convert to int16
+                __m128i red_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &redRow[x]));
+                __m128i green_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &greenRow[x]));
+                __m128i blue_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &blueRow[x]));
+
+                // Weighted sum (at most 127*255, no overflow), normalized by 128 and packed to uint8
+                __m128i luma_vec16i = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(red_vec16i, redWeight_vec16i),
+                        _mm_mullo_epi16(green_vec16i, greenWeight_vec16i)), _mm_mullo_epi16(blue_vec16i, blueWeight_vec16i));
+                luma_vec16i = _mm_srli_epi16(luma_vec16i, 7);
+                _mm_storel_epi64((__m128i*) &lumaRow[x], _mm_packus_epi16(luma_vec16i, luma_vec16i));
+        }
+
+        luma_span_scalar(&redRow[x], &greenRow[x], &blueRow[x], &lumaRow[x], count - x);
+
+}
+
+
+// AVX2 version, 16 pixels at a time
+CPU_TARGET_AVX2
+static void luma_span_avx2(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *lumaRow, int count) {
+
+        __m256i redWeight_vec16i = _mm256_set1_epi16(SOBEL_LUMA_RED_WEIGHT);
+        __m256i greenWeight_vec16i = _mm256_set1_epi16(SOBEL_LUMA_GREEN_WEIGHT);
+        __m256i blueWeight_vec16i = _mm256_set1_epi16(SOBEL_LUMA_BLUE_WEIGHT);
+
+        int x = 0;
+        for (; x + 16 <= count; x += 16) {
+
+                // Load 16 pixels from each channel of type uint8 and convert to int16
+                __m256i red_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &redRow[x]));
+                __m256i green_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &greenRow[x]));
+                __m256i blue_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &blueRow[x]));
+
+                // Weighted sum (at most 127*255, no overflow), normalized by 128 and packed to uint8
+                __m256i luma_vec16i = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(red_vec16i, redWeight_vec16i),
+                        _mm256_mullo_epi16(green_vec16i, greenWeight_vec16i)), _mm256_mullo_epi16(blue_vec16i, blueWeight_vec16i));
+                luma_vec16i = _mm256_srli_epi16(luma_vec16i, 7);
+                _mm_storeu_si128((__m128i*) &lumaRow[x], _mm_packus_epi16(_mm256_castsi256_si128(luma_vec16i),
+                        _mm256_extracti128_si256(luma_vec16i, 1)));
+        }
+
+        luma_span_scalar(&redRow[x], &greenRow[x], &blueRow[x], &lumaRow[x], count - x);
+
+}
+
+
+// AVX-512 version, 32 pixels at a time
+CPU_TARGET_AVX512
+static void luma_span_avx512(uint8_t *redRow, uint8_t *greenRow, uint8_t *blueRow, uint8_t *lumaRow, int count) {
+
+        __m512i redWeight_vec16i = _mm512_set1_epi16(SOBEL_LUMA_RED_WEIGHT);
+        __m512i greenWeight_vec16i = _mm512_set1_epi16(SOBEL_LUMA_GREEN_WEIGHT);
+        __m512i blueWeight_vec16i = _mm512_set1_epi16(SOBEL_LUMA_BLUE_WEIGHT);
+
+        int x = 0;
+        for (; x + 32 <= count; x += 32) {
+
+                // Load 32 pixels from each channel of type uint8 and convert to int16
+                __m512i red_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &redRow[x]));
+                __m512i green_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &greenRow[x]));
+                __m512i blue_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &blueRow[x]));
+
+                // Weighted sum, normalized by 128, narrowed to uint8 (results are at most 253)
+                __m512i luma_vec16i = _mm512_add_epi16(_mm512_add_epi16(_mm512_mullo_epi16(red_vec16i, redWeight_vec16i),
+                        _mm512_mullo_epi16(green_vec16i, greenWeight_vec16i)), _mm512_mullo_epi16(blue_vec16i, blueWeight_vec16i));
+                luma_vec16i = _mm512_srli_epi16(luma_vec16i, 7);
+                _mm256_storeu_si256((__m256i*) &lumaRow[x], _mm512_cvtepi16_epi8(luma_vec16i));
+        }
+
+        luma_span_scalar(&redRow[x], &greenRow[x], &blueRow[x], &lumaRow[x], count - x);
+
+}
+
+
+// Fills a padded luminance row with `count` pixels of image row `y` starting at column `xStart` (may be negative)
+// Columns outside of the image are sampled according to the border mode
+static void fill_luma_row(uint8_t **inputPlanes, int imageWidth, int y, int xStart, int count, enum BorderMode borderMode,
+        LumaSpanFunction lumaSpan, uint8_t *lumaRow) {
+
+        uint8_t *redRow = &inputPlanes[0][(size_t) y*imageWidth];
+        uint8_t *greenRow = &inputPlanes[1][(size_t) y*imageWidth];
+        uint8_t *blueRow = &inputPlanes[2][(size_t) y*imageWidth];
+
+        // Determine the in-bounds span of the requested columns (relative to the padded row)
+        int spanStart = (xStart < 0) ? -xStart : 0;
+        int spanEnd = (xStart + count > imageWidth) ? imageWidth - xStart : count;
+        if (spanStart > count) spanStart = count;
+        if (spanEnd < spanStart) spanEnd = spanStart;
+
+        // Interior: convert the in-bounds span as is
+        lumaSpan(&redRow[xStart + spanStart], &greenRow[xStart + spanStart], &blueRow[xStart + spanStart], &lumaRow[spanStart],
+                spanEnd - spanStart);
+
+        // Border: sample the out-of-bounds columns on both sides of the span according to the border mode
+        for (int i = 0; i < spanStart; i++) {
+                int x = map_border_index(xStart + i, imageWidth, borderMode);
+                if (x < 0) lumaRow[i] = 0;
+                else luma_span_scalar(&redRow[x], &greenRow[x], &blueRow[x], &lumaRow[i], 1);
+        }
+        for (int i = spanEnd; i < count; i++) {
+                int x = map_border_index(xStart + i, imageWidth, borderMode);
+                if (x < 0) lumaRow[i] = 0;
+                else luma_span_scalar(&redRow[x], &greenRow[x], &blueRow[x], &lumaRow[i], 1);
+        }
+
+}
+
+
+// Computes up to `count` gradient magnitudes of a row from the padded luminance tile (the row above the output row is
+// `row`). Both separable sobel kernels are evaluated on signed values: Gx = [1 2 1]^T * [-1 0 1] and
+// Gy = [-1 0 1]^T * [1 2 1], then the magnitude scale*sqrt(Gx^2 + Gy^2) is rounded to nearest and clamped to 255
+typedef void (*SobelRowFunction)(uint8_t *paddedTile, int stride, int row, int x, float scale, uint8_t *outputRow, int count);
+
+
+// Scalar version: same float operations as the vector version (so the results are identical)
+static void sobel_row_scalar(uint8_t *paddedTile, int stride, int row, int x, float scale, uint8_t *outputRow, int count) {
+
+        uint8_t *top = &paddedTile[row*stride + x];
+        uint8_t *middle = top + stride;
+        uint8_t *bottom = middle + stride;
+
+        for (int channel = 0; channel < count; channel++) {
+
+                int i = channel;
+                int gradientX = (top[i + 2] + 2*middle[i + 2] + bottom[i + 2]) - (top[i] + 2*middle[i] + bottom[i]);
+                int gradientY = (bottom[i] - top[i]) + 2*(bottom[i + 1] - top[i + 1]) + (bottom[i + 2] - top[i + 2]);
+
+                long magnitude = lrintf(sqrtf((float) (gradientX*gradientX + gradientY*gradientY)) * scale);
+                outputRow[channel] = (magnitude >= 255) ? 255 : (uint8_t) magnitude;
+        }
+
+}
+
+
+// SSE4.1 version, 16 output channels as two halves of 8 in int16 registers (gradients are within +-1020)
+CPU_TARGET_SSE41
+static void sobel_row_sse41(uint8_t *paddedTile, int stride, int row, int x, float scale, uint8_t *outputRow, int count) {
+
+        __m128 scale_ps = _mm_set1_ps(scale);
+
+        for (int half = 0; half < count; half += 8) {
+
+                uint8_t *top = &paddedTile[row*stride + x + half];
+                uint8_t *middle = top + stride;
+                uint8_t *bottom = middle + stride;
+
+                // Load the left, centre and right neighbours of 8 channels from the three rows and convert to int16
+                __m128i topLeft_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &top[0]));
+                __m128i topCentre_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &top[1]));
+                __m128i topRight_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &top[2]));
+                __m128i middleLeft_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &middle[0]));
+                __m128i middleRight_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &middle[2]));
+                __m128i bottomLeft_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &bottom[0]));
+                __m128i bottomCentre_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &bottom[1]));
+                __m128i bottomRight_vec16i = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*) &bottom[2]));
+
+                // Gx: vertical smoothing [1 2 1] of the left and right columns, then their difference
+                __m128i left_vec16i = _mm_add_epi16(_mm_add_epi16(topLeft_vec16i, bottomLeft_vec16i), _mm_slli_epi16(middleLeft_vec16i, 1));
+                __m128i right_vec16i = _mm_add_epi16(_mm_add_epi16(topRight_vec16i, bottomRight_vec16i), _mm_slli_epi16(middleRight_vec16i, 1));
+                __m128i gradientX_vec16i = _mm_sub_epi16(right_vec16i, left_vec16i);
+
+                // Gy: vertical differences of the three columns, then horizontal smoothing [1 2 1]
+                __m128i gradientY_vec16i = _mm_add_epi16(
+                        _mm_add_epi16(_mm_sub_epi16(bottomLeft_vec16i, topLeft_vec16i), _mm_sub_epi16(bottomRight_vec16i, topRight_vec16i)),
+                        _mm_slli_epi16(_mm_sub_epi16(bottomCentre_vec16i, topCentre_vec16i), 1)
+                );
+
+                // Gx^2 + Gy^2 in int32 (madd of the interleaved gradients), scaled magnitude rounded to nearest
+                __m128i lowerPairs_vec16i = _mm_unpacklo_epi16(gradientX_vec16i, gradientY_vec16i);  // Channels 0-3
+                __m128i upperPairs_vec16i = _mm_unpackhi_epi16(gradientX_vec16i, gradientY_vec16i);  // Channels 4-7
+                __m128i lowerMagnitude_32i = _mm_cvtps_epi32(_mm_mul_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(
+                        _mm_madd_epi16(lowerPairs_vec16i, lowerPairs_vec16i))), scale_ps));
+                __m128i upperMagnitude_32i = _mm_cvtps_epi32(_mm_mul_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(
+                        _mm_madd_epi16(upperPairs_vec16i, upperPairs_vec16i))), scale_ps));
+
+                // Saturation epilogue: pack int32 -> int16 -> uint8 with clamping
+                __m128i magnitude_vec16i = _mm_packs_epi32(lowerMagnitude_32i, upperMagnitude_32i);
+                __m128i result_vec8u = _mm_packus_epi16(magnitude_vec16i, magnitude_vec16i);
+
+                // Store all 8 channels at once, or only the remaining channels at the end of a row
+                int halfCount = (count - half < 8) ? count - half : 8;
+                if (halfCount == 8) {
+                        _mm_storel_epi64((__m128i*) &outputRow[half], result_vec8u);
+                } else {
+                        uint8_t tempArray[16];
+                        _mm_storeu_si128((__m128i*) tempArray, result_vec8u);
+                        memcpy(&outputRow[half], tempArray, halfCount);
+                }
+        }
+
+}
+
+
+// AVX2 version, 16 output channels at a time in int16 registers (gradients are within +-1020)
+CPU_TARGET_AVX2
+static void sobel_row_avx2(uint8_t *paddedTile, int stride, int row, int x, float scale, uint8_t *outputRow, int count) {
+
+        uint8_t *top = &paddedTile[row*stride + x];
+        uint8_t *middle = top + stride;
+        uint8_t *bottom = middle + stride;
+
+        // Load the left, centre and right neighbours of 16 channels from the three rows and convert to int16
+        __m256i topLeft_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &top[0]));
+        __m256i topCentre_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &top[1]));
+        __m256i topRight_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &top[2]));
+        __m256i middleLeft_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &middle[0]));
+        __m256i middleRight_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &middle[2]));
+        __m256i bottomLeft_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &bottom[0]));
+        __m256i bottomCentre_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &bottom[1]));
+        __m256i bottomRight_vec16i = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) &bottom[2]));
+
+        // Gx: vertical smoothing [1 2 1] of the left and right columns, then their difference
+        __m256i left_vec16i = _mm256_add_epi16(_mm256_add_epi16(topLeft_vec16i, bottomLeft_vec16i),
+                _mm256_slli_epi16(middleLeft_vec16i, 1));
+        __m256i right_vec16i = _mm256_add_epi16(_mm256_add_epi16(topRight_vec16i, bottomRight_vec16i),
+                _mm256_slli_epi16(middleRight_vec16i, 1));
+        __m256i gradientX_vec16i = _mm256_sub_epi16(right_vec16i, left_vec16i);
+
+        // Gy: vertical differences of the three columns, then horizontal smoothing [1 2 1]
+        __m256i gradientY_vec16i = _mm256_add_epi16(
+                _mm256_add_epi16(_mm256_sub_epi16(bottomLeft_vec16i, topLeft_vec16i), _mm256_sub_epi16(bottomRight_vec16i, topRight_vec16i)),
+                _mm256_slli_epi16(_mm256_sub_epi16(bottomCentre_vec16i, topCentre_vec16i), 1)
+        );
+
+        // Gx^2 + Gy^2 in int32: interleave the gradients so that madd squares and adds each pair
+        __m256i lowerPairs_vec16i = _mm256_unpacklo_epi16(gradientX_vec16i, gradientY_vec16i);  // Channels 0-3 and 8-11
+        __m256i upperPairs_vec16i = _mm256_unpackhi_epi16(gradientX_vec16i, gradientY_vec16i);  // Channels 4-7 and 12-15
+        __m256 lowerSquares_ps = _mm256_cvtepi32_ps(_mm256_madd_epi16(lowerPairs_vec16i, lowerPairs_vec16i));
+        __m256 upperSquares_ps = _mm256_cvtepi32_ps(_mm256_madd_epi16(upperPairs_vec16i, upperPairs_vec16i));
+
+        // Scaled magnitude, rounded to nearest
+        __m256 scale_ps = _mm256_set1_ps(scale);
+        __m256i lowerMagnitude_32i = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_sqrt_ps(lowerSquares_ps), scale_ps));
+        __m256i upperMagnitude_32i = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_sqrt_ps(upperSquares_ps), scale_ps));
+
+        // Saturation epilogue: pack int32 -> int16 (restores the channel order per lane) -> uint8 with clamping
+        __m256i magnitude_vec16i = _mm256_packs_epi32(lowerMagnitude_32i, upperMagnitude_32i);
+        __m128i result_vec8u = _mm_packus_epi16(_mm256_castsi256_si128(magnitude_vec16i), _mm256_extracti128_si256(magnitude_vec16i, 1));
+
+        // Store all 16 channels at once, or only the first `count` channels at the end of a row
+        if (count == 16) {
+                _mm_storeu_si128((__m128i*) outputRow, result_vec8u);
+        } else {
+                uint8_t tempArray[16];
+                _mm_storeu_si128((__m128i*) tempArray, result_vec8u);
+                memcpy(outputRow, tempArray, count);
+        }
+
+}
+
+
+// AVX-512 version, 32 output channels at a time in int16 registers (gradients are within +-1020)
+CPU_TARGET_AVX512
+static void sobel_row_avx512(uint8_t *paddedTile, int stride, int row, int x, float scale, uint8_t *outputRow, int count) {
+
+        uint8_t *top = &paddedTile[row*stride + x];
+        uint8_t *middle = top + stride;
+        uint8_t *bottom = middle + stride;
+
+        // Load the left, centre and right neighbours of 32 channels from the three rows and convert to int16
+        __m512i topLeft_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &top[0]));
+        __m512i topCentre_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &top[1]));
+        __m512i topRight_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &top[2]));
+        __m512i middleLeft_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &middle[0]));
+        __m512i middleRight_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &middle[2]));
+        __m512i bottomLeft_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &bottom[0]));
+        __m512i bottomCentre_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &bottom[1]));
+        __m512i bottomRight_vec16i = _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i*) &bottom[2]));
+
+        // Gx: vertical smoothing [1 2 1] of the left and right columns, then their difference
+        __m512i left_vec16i = _mm512_add_epi16(_mm512_add_epi16(topLeft_vec16i, bottomLeft_vec16i),
+                _mm512_slli_epi16(middleLeft_vec16i, 1));
+        __m512i right_vec16i = _mm512_add_epi16(_mm512_add_epi16(topRight_vec16i, bottomRight_vec16i),
+                _mm512_slli_epi16(middleRight_vec16i, 1));
+        __m512i gradientX_vec16i = _mm512_sub_epi16(right_vec16i, left_vec16i);
+
+        // Gy: vertical differences of the three columns, then horizontal smoothing [1 2 1]
+        __m512i gradientY_vec16i = _mm512_add_epi16(
+                _mm512_add_epi16(_mm512_sub_epi16(bottomLeft_vec16i, topLeft_vec16i), _mm512_sub_epi16(bottomRight_vec16i, topRight_vec16i)),
+                _mm512_slli_epi16(_mm512_sub_epi16(bottomCentre_vec16i, topCentre_vec16i), 1)
+        );
+
+        // Gx^2 + Gy^2 in int32: interleave the gradients (within each 128 bit lane) so that madd squares and adds each pair
+        __m512i lowerPairs_vec16i = _mm512_unpacklo_epi16(gradientX_vec16i, gradientY_vec16i);
+        __m512i upperPairs_vec16i = _mm512_unpackhi_epi16(gradientX_vec16i, gradientY_vec16i);
+        __m512 lowerSquares_ps = _mm512_cvtepi32_ps(_mm512_madd_epi16(lowerPairs_vec16i, lowerPairs_vec16i));
+        __m512 upperSquares_ps = _mm512_cvtepi32_ps(_mm512_madd_epi16(upperPairs_vec16i, upperPairs_vec16i));
+
+        // Scaled magnitude, rounded to nearest
+        __m512 scale_ps = _mm512_set1_ps(scale);
+        __m512i lowerMagnitude_32i = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_sqrt_ps(lowerSquares_ps), scale_ps));
+        __m512i upperMagnitude_32i = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_sqrt_ps(upperSquares_ps), scale_ps));
+
+        // Saturation epilogue: pack int32 -> int16 (restores the channel order per lane) -> uint8 with unsigned clamping
+        __m512i magnitude_vec16i = _mm512_packs_epi32(lowerMagnitude_32i, upperMagnitude_32i);
+        __m256i result_vec8u = _mm512_cvtusepi16_epi8(magnitude_vec16i);
+
+        // Store the first `count` (<= 32) channels through a byte mask
+        __mmask64 storeMask = ((uint64_t) 1 << count) - 1;
+        _mm512_mask_storeu_epi8(outputRow, storeMask, _mm512_castsi256_si512(result_vec8u));
+
+}
+
+
+int apply_sobel_pipeline(uint8_t **inputPlanes, uint8_t *outputChannels, float scale, int imageHeight, int imageWidth,
+        enum BorderMode borderMode,
+        const struct PointOpEpilogue *epilogue) {
+
+        // Initialize useful values
+        struct TileShape tileShape = choose_tile_shape(TUNING_PIPELINE_SOBEL, 3, imageHeight, imageWidth);
+        int tileWidth = tileShape.width;
+        int tileHeight = tileShape.height;
+        int stride = (int) memory_size_alignment(tileWidth + 2 + SOBEL_ROW_SLACK);
+        int paddedRows = tileHeight + 2;
+
+        // Select the row functions for the processor's instruction set level (the scalar versions handle any count)
+        // and the output channels per call of the row function
+        LumaSpanFunction lumaSpan;
+        SobelRowFunction sobelRow;
+        int rowStep = 16;
+        switch (cpu_feature_level()) {
+                case CPU_FEATURE_LEVEL_AVX512:  lumaSpan = luma_span_avx512; sobelRow = sobel_row_avx512; rowStep = 32; break;
+                case CPU_FEATURE_LEVEL_AVX2:    lumaSpan = luma_span_avx2; sobelRow = sobel_row_avx2; break;
+                case CPU_FEATURE_LEVEL_SSE41:   lumaSpan = luma_span_sse41; sobelRow = sobel_row_sse41; break;
+                default:                        lumaSpan = luma_span_scalar; sobelRow = sobel_row_scalar; break;
+        }
+
+        // Flag to indicate error in the parallel processing
+        int errorFlag = 0;
+
+        // Parallelize over tiles in row-major order
+        #pragma omp parallel shared(errorFlag)
+        {
+                // Acquire the persistent MemoryPool (arena) of the thread, sized once per parallel region to store
+                // the padded luminance tile
+                struct MemoryPool *pool = acquire_thread_memory_pool(paddedRows*stride);
+                if (pool == NULL) {
+                        #pragma omp atomic write
+                        errorFlag = 1;
+                }
+
+                #pragma omp for collapse(2) schedule(static)
+                for (int yy = 0; yy < imageHeight; yy += tileHeight) {
+                        for (int xx = 0; xx < imageWidth; xx += tileWidth) {
+
+                                // Start the tile with an empty arena
+                                if (pool == NULL) continue;
+                                empty_pool(pool);
+                                uint8_t *paddedTile = (uint8_t*)allocate_from_pool(pool, paddedRows*stride);
+
+                                // Determine the actual tile dimensions (tiles on the right and bottom edges may be cut off)
+                                int currentTileWidth = (xx + tileWidth <= imageWidth) ? tileWidth : imageWidth - xx;
+                                int currentTileHeight = (yy + tileHeight <= imageHeight) ? tileHeight : imageHeight - yy;
+                                int rowLength = currentTileWidth + 2;
+
+                                // Compute the luminance of the tile and its one pixel halo, rows outside of the image are
+                                // sampled according to the border mode
+                                for (int row = 0; row < currentTileHeight + 2; row++) {
+                                        uint8_t *paddedRow = &paddedTile[row*stride];
+                                        int y = map_border_index(yy - 1 + row, imageHeight, borderMode);
+                                        if (y < 0) {
+                                                memset(paddedRow, 0, stride);
+                                                continue;
+                                        }
+                                        fill_luma_row(inputPlanes, imageWidth, y, xx - 1, rowLength, borderMode, lumaSpan, paddedRow);
+                                        memset(&paddedRow[rowLength], 0, stride - rowLength);
+                                }
+
+                                // Loop over the rows of the tile, vectorizing across neighbouring output channels
+                                for (int row = 0; row < currentTileHeight; row++) {
+
+                                        uint8_t *outputRow = &outputChannels[(size_t) (yy + row)*imageWidth + xx];
+
+                                        for (int x = 0; x < currentTileWidth; x += rowStep) {
+                                                int count = (currentTileWidth - x < rowStep) ? currentTileWidth - x : rowStep;
+                                                sobelRow(paddedTile, stride, row, x, scale, &outputRow[x], count);
+                                        }
+                                        apply_point_op_epilogue_row(epilogue, outputRow, currentTileWidth);
+                                }
+                        }
+                }
+        }
+
+        // Check if an error occurred during the parallel processing and return 0
+        if (errorFlag) return 0;
+
+        // Indicate that the sobel pipeline executed successfully
+        return 1;
+
+}
@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>  // For strcmp()
+#include <stdint.h>  // For type uint8_t
+#include <omp.h>  // For omp_get_wtime()
+#ifdef _WIN32
+    #include <windows.h>  // For GetLogicalProcessorInformation()
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <cpuid.h>  // For __get_cpuid() and __get_cpuid_count()
+    #define TUNING_HAS_CPUID
+#endif
+#include "convolution.h"
+#include "fixedpoint.h"
+#include "sobel.h"
+#include "planner.h"
+#include "tuning.h"
+
+
+// Cache geometry used when nothing can be detected
+#define DEFAULT_LEVEL_ONE_SIZE (32*1024)
+#define DEFAULT_LEVEL_TWO_SIZE (256*1024)
+#define DEFAULT_LINE_SIZE 64
+
+// Minimum number of tiles per thread, so that the tiles of smaller images are still spread over all threads
+#define TILES_PER_THREAD 4
+
+// Side of the synthetic (three plane) image used by the calibration run, and the number of runs per candidate
+#define CALIBRATION_IMAGE_SIZE 1024
+#define CALIBRATION_REPETITIONS 3
+
+
+
+// Detected cache geometry (detected once)
+static struct CacheGeometry cacheGeometry;
+static int cacheGeometryDetected = 0;
+
+// Calibrated tile shapes per pipeline and kernel size (a width of 0 means "use the cache model")
+static struct TileShape calibratedShapes[TUNING_PIPELINE_COUNT][TUNING_MAX_KERNEL_SIZE + 1];
+
+// Names of the pipelines in the tile shapes file
+static const char *pipelineNames[TUNING_PIPELINE_COUNT] = {"direct", "separable", "fixedpoint", "sobel"};
+
+// Kernel sizes measured by the calibration run (the sizes of the filters of the program)
+static const int calibrationKernelSizes[] = {3, 5, 9, 13, 19};
+
+
+
+// Parses a cache size of the form "48K" or "2M" (sysfs), returns 0 on failure
+static size_t parse_cache_size(const char *text) {
+
+        char *end;
+        unsigned long value = strtoul(text, &end, 10);
+        if (end == text) return 0;
+        if (*end == 'K') return (size_t) value*1024;
+        if (*end == 'M') return (size_t) value*1024*1024;
+        return (size_t) value;
+
+}
+
+
+// Reads the first line of a (sysfs) text file into `buffer`, returns 0 on failure
+static int read_first_line(const char *path, char *buffer, int bufferSize) {
+
+        FILE *file = fopen(path, "r");
+        if (file == NULL) return 0;
+        int read = (fgets(buffer, bufferSize, file) != NULL);
+        fclose(file);
+        return read;
+
+}
+
+
+// Fills the cache geometry from the sysfs cache directories of cpu0 (Linux), returns 0 when nothing was found
+static int detect_cache_geometry_sysfs(struct CacheGeometry *geometry) {
+
+        int found = 0;
+        for (int index = 0; index < 16; index++) {
+
+                // Each cache of cpu0 has a directory with its level, type and size
+                char path[128], level[16], type[32], size[32], lineSize[16];
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+                if (!read_first_line(path, level, sizeof(level))) break;
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+                if (!read_first_line(path, type, sizeof(type))) continue;
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+                if (!read_first_line(path, size, sizeof(size))) continue;
+
+                // Instruction caches do not hold image data
+                if (strncmp(type, "Instruction", 11) == 0) continue;
+
+                if (atoi(level) == 1) {
+                        geometry->levelOneSize = parse_cache_size(size);
+                        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/coherency_line_size", index);
+                        if (read_first_line(path, lineSize, sizeof(lineSize))) geometry->lineSize = (size_t) atoi(lineSize);
+                        found = 1;
+                } else if (atoi(level) == 2) {
+                        geometry->levelTwoSize = parse_cache_size(size);
+                        found = 1;
+                }
+        }
+
+        return found;
+
+}
+
+
+// Fills the cache geometry with GetLogicalProcessorInformation (Windows), returns 0 when nothing was found
+static int detect_cache_geometry_windows(struct CacheGeometry *geometry) {
+
+#ifdef _WIN32
+        // Query the required buffer length first
+        DWORD length = 0;
+        GetLogicalProcessorInformation(NULL, &length);
+        if (length == 0) return 0;
+
+        SYSTEM_LOGICAL_PROCESSOR_INFORMATION *information = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)malloc(length);
+        if (information == NULL) return 0;
+        if (!GetLogicalProcessorInformation(information, &length)) {
+                free(information);
+                return 0;
+        }
+
+        // Look at the data (and unified) caches
+        int found = 0;
+        int count = (int) (length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+        for (int i = 0; i < count; i++) {
+                if (information[i].Relationship != RelationCache) continue;
+                CACHE_DESCRIPTOR *cache = &information[i].Cache;
+                if (cache->Type == CacheInstruction) continue;
+                if (cache->Level == 1) {
+                        geometry->levelOneSize = cache->Size;
+                        geometry->lineSize = cache->LineSize;
+                        found = 1;
+                } else if (cache->Level == 2) {
+                        geometry->levelTwoSize = cache->Size;
+                        found = 1;
+                }
+        }
+
+        free(information);
+        return found;
+#else
+        (void) geometry;
+        return 0;
+#endif
+
+}
+
+
+// Fills the cache geometry with cpuid (leaf 4 on Intel, leaves 0x80000005/6 on AMD), returns 0 when nothing was found
+static int detect_cache_geometry_cpuid(struct CacheGeometry *geometry) {
+
+#ifdef TUNING_HAS_CPUID
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        int found = 0;
+
+        // Deterministic cache parameters: size = ways * partitions * line size * sets
+        unsigned int maxLeaf = __get_cpuid_max(0, NULL);
+        for (unsigned int subleaf = 0; maxLeaf >= 4 && subleaf < 16; subleaf++) {
+                __get_cpuid_count(4, subleaf, &eax, &ebx, &ecx, &edx);
+                unsigned int type = eax & 0x1F;
+                if (type == 0) break;
+                if (type == 2) continue;  // Instruction cache
+                unsigned int level = (eax >> 5) & 0x7;
+                size_t lineSize = (ebx & 0xFFF) + 1;
+                size_t size = (size_t) (((ebx >> 22) & 0x3FF) + 1) * (((ebx >> 12) & 0x3FF) + 1) * lineSize * (ecx + 1);
+                if (level == 1) {
+                        geometry->levelOneSize = size;
+                        geometry->lineSize = lineSize;
+                        found = 1;
+                } else if (level == 2) {
+                        geometry->levelTwoSize = size;
+                        found = 1;
+                }
+        }
+        if (found) return 1;
+
+        // Extended leaves: L1 data cache in KB (0x80000005 ecx[31:24]), L2 cache in KB (0x80000006 ecx[31:16])
+        if (__get_cpuid_max(0x80000000, NULL) >= 0x80000006) {
+                __get_cpuid(0x80000005, &eax, &ebx, &ecx, &edx);
+                if ((ecx >> 24) != 0) {
+                        geometry->levelOneSize = (size_t) (ecx >> 24)*1024;
+                        geometry->lineSize = ecx & 0xFF;
+                        found = 1;
+                }
+                __get_cpuid(0x80000006, &eax, &ebx, &ecx, &edx);
+                if ((ecx >> 16) != 0) {
+                        geometry->levelTwoSize = (size_t) (ecx >> 16)*1024;
+                        found = 1;
+                }
+        }
+        return found;
+#else
+        (void) geometry;
+        return 0;
+#endif
+
+}
+
+
+struct CacheGeometry detect_cache_geometry(void) {
+
+        #pragma omp critical(tuning_cache_geometry)
+        {
+                if (!cacheGeometryDetected) {
+
+                        // Start from the defaults, then let the operating system (or cpuid) fill in what it knows
+                        struct CacheGeometry geometry = {DEFAULT_LEVEL_ONE_SIZE, DEFAULT_LEVEL_TWO_SIZE, DEFAULT_LINE_SIZE};
+                        if (!detect_cache_geometry_sysfs(&geometry) && !detect_cache_geometry_windows(&geometry)) {
+                                detect_cache_geometry_cpuid(&geometry);
+                        }
+
+                        // Guard against nonsense values
+                        if (geometry.levelOneSize < 8*1024) geometry.levelOneSize = DEFAULT_LEVEL_ONE_SIZE;
+                        if (geometry.levelTwoSize < geometry.levelOneSize) geometry.levelTwoSize = 8*geometry.levelOneSize;
+                        if (geometry.lineSize == 0) geometry.lineSize = DEFAULT_LINE_SIZE;
+
+                        cacheGeometry = geometry;
+                        cacheGeometryDetected = 1;
+                }
+        }
+
+        return cacheGeometry;
+
+}
+
+
+// Rounds a value down to a multiple and clamps it to [minimum, maximum] (both multiples as well)
+static int round_down_clamped(long value, int multiple, int minimum, int maximum) {
+
+        if (value > maximum) value = maximum;
+        value -= value % multiple;
+        if (value < minimum) value = minimum;
+        return (int) value;
+
+}
+
+
+// Derives the tile shape of a pipeline from the kernel size and the cache geometry
+static struct TileShape model_tile_shape(enum TuningPipeline pipeline, int kernelSize) {
+
+        struct CacheGeometry geometry = detect_cache_geometry();
+        long levelOne = (long) geometry.levelOneSize;
+        long levelTwo = (long) geometry.levelTwoSize;
+        int haloSize = kernelSize / 2;
+        struct TileShape shape;
+
+        switch (pipeline) {
+                case TUNING_PIPELINE_DIRECT:
+                        // The rings of the three (RGB) planes (kernelSize rows of width + 2*halo + 32 floats each) are read
+                        // kernelSize times per output row, keep them within 3/4 of L1. The tile height amortizes the
+                        // warm-up of the rings (kernelSize - 1 rows per tile)
+                        shape.width = round_down_clamped(3*levelOne/4 / (3*kernelSize*(long) sizeof(float)) - 2*haloSize - 32,
+                                32, 32, 512);
+                        shape.height = round_down_clamped(16L*(kernelSize - 1), 8, 64, 256);
+                        break;
+                case TUNING_PIPELINE_SEPARABLE:
+                        // The vertical pass reads kernelSize intermediate rows per output row, keep them within half of L1.
+                        // The whole intermediate buffer (height + 2*halo rows) should stay within half of L2
+                        shape.width = round_down_clamped(levelOne/2 / (kernelSize*(long) sizeof(float)), 8, 64, 512);
+                        shape.height = round_down_clamped(levelTwo/2 / (shape.width*(long) sizeof(float)) - 2*haloSize,
+                                8, 32, 256);
+                        break;
+                default:
+                        // The integer (fixed-point or sobel luminance) rows are read kernelSize times per output row, keep
+                        // kernelSize of them within half of L1. The padded tile (height + 2*halo rows) should stay within
+                        // half of L2
+                        shape.width = round_down_clamped(levelOne/2 / kernelSize - 2*haloSize - 32, 32, 64, 512);
+                        shape.height = round_down_clamped(levelTwo/2 / (shape.width + 2*haloSize + 32) - 2*haloSize,
+                                8, 32, 256);
+                        break;
+        }
+
+        return shape;
+
+}
+
+
+struct TileShape choose_tile_shape(enum TuningPipeline pipeline, int kernelSize, int imageHeight, int imageWidth) {
+
+        // Prefer a calibrated shape of this kernel size
+        struct TileShape shape;
+        if (kernelSize <= TUNING_MAX_KERNEL_SIZE && calibratedShapes[pipeline][kernelSize].width > 0) {
+                shape = calibratedShapes[pipeline][kernelSize];
+        } else {
+                shape = model_tile_shape(pipeline, kernelSize);
+        }
+
+        // Halve the tile height (down to 8 rows) until every thread gets a few tiles
+        long minimumTiles = (long) TILES_PER_THREAD*omp_get_max_threads();
+        while (shape.height > 8) {
+                long numTiles = (long) ((imageHeight + shape.height - 1) / shape.height)*((imageWidth + shape.width - 1) / shape.width);
+                if (numTiles >= minimumTiles) break;
+                shape.height = round_down_clamped(shape.height / 2, 8, 8, shape.height);
+        }
+
+        return shape;
+
+}
+
+
+// Creates a normalized kernel with all entries equal (the values do not matter for timing)
+static struct Kernel *create_uniform_kernel(int size) {
+
+        struct Kernel *kernel = allocate_kernel(size);
+        if (kernel == NULL) return NULL;
+        for (int i = 0; i < size*size; i++) {
+                kernel->entries[i] = 1.0f / (size*size);
+        }
+        return kernel;
+
+}
+
+
+// Times one run of a pipeline for the current entry of the calibration table, returns the duration in seconds (or a
+// negative value on failure)
+static double time_pipeline(enum TuningPipeline pipeline, struct Kernel *kernel, struct SeparableKernel *separableKernel,
+        struct FixedPointKernel *fixedPointKernel, uint8_t **inputPlanes, uint8_t **outputPlanes, int imageSize) {
+
+        double start = omp_get_wtime();
+        int success;
+        switch (pipeline) {
+                case TUNING_PIPELINE_DIRECT:
+                        success = apply_convolution_pipeline_planes(inputPlanes, outputPlanes, 3, kernel, imageSize, imageSize,
+                                BORDER_MODE_ZERO, NULL);
+                        break;
+                case TUNING_PIPELINE_SEPARABLE:
+                        success = apply_separable_convolution_pipeline_planes(inputPlanes, outputPlanes, 3, separableKernel,
+                                imageSize, imageSize, BORDER_MODE_ZERO, NULL);
+                        break;
+                case TUNING_PIPELINE_SOBEL:
+                        success = apply_sobel_pipeline(inputPlanes, outputPlanes[0], 1.0f, imageSize, imageSize, BORDER_MODE_ZERO,
+                                NULL);
+                        break;
+                default:
+                        success = apply_fixed_point_convolution_pipeline_planes(inputPlanes, outputPlanes, 3, fixedPointKernel,
+                                imageSize, imageSize, BORDER_MODE_ZERO, NULL);
+                        break;
+        }
+        if (success == 0) return -1.0;
+        return omp_get_wtime() - start;
+
+}
+
+
+// Measures the candidate tile shapes (the cache model scaled by 1/2, 1 and 2 in each direction) of one pipeline and
+// kernel size, and stores the fastest one into the calibration table. Returns 0 on failure
+static int calibrate_pipeline(enum TuningPipeline pipeline, int kernelSize, uint8_t **inputPlanes, uint8_t **outputPlanes,
+        int imageSize) {
+
+        // Create the kernels used by the pipeline
+        struct Kernel *kernel = create_uniform_kernel(kernelSize);
+        if (kernel == NULL) return 0;
+        struct SeparableKernel *separableKernel = allocate_separable_kernel(kernelSize);
+        if (separableKernel == NULL) {
+                free_kernel(kernel);
+                return 0;
+        }
+        for (int i = 0; i < kernelSize; i++) {
+                separableKernel->horizontalEntries[i] = 1.0f / kernelSize;
+                separableKernel->verticalEntries[i] = 1.0f / kernelSize;
+        }
+        struct FixedPointKernel *fixedPointKernel = create_fixed_point_kernel(kernel);
+        if (fixedPointKernel == NULL) {
+                free_separable_kernel(separableKernel);
+                free_kernel(kernel);
+                return 0;
+        }
+
+        // Candidate multiples of the tile width (32 channels for the direct and integer pipelines, 8 for separable)
+        int widthMultiple = (pipeline == TUNING_PIPELINE_SEPARABLE) ? 8 : 32;
+        struct TileShape model = model_tile_shape(pipeline, kernelSize);
+        struct TileShape bestShape = model;
+        double bestTime = -1.0;
+
+        for (int widthScale = 0; widthScale < 3; widthScale++) {
+                for (int heightScale = 0; heightScale < 3; heightScale++) {
+
+                        // Scale the model shape by 1/2, 1 or 2 in each direction
+                        struct TileShape candidate;
+                        candidate.width = round_down_clamped(((long) model.width << widthScale) / 2, widthMultiple, widthMultiple, 2048);
+                        candidate.height = round_down_clamped(((long) model.height << heightScale) / 2, 8, 8, 2048);
+                        calibratedShapes[pipeline][kernelSize] = candidate;
+
+                        // Keep the best of a few runs (the first run also warms up the memory pools)
+                        double candidateTime = -1.0;
+                        for (int repetition = 0; repetition < CALIBRATION_REPETITIONS; repetition++) {
+                                double time = time_pipeline(pipeline, kernel, separableKernel, fixedPointKernel, inputPlanes,
+                                        outputPlanes, imageSize);
+                                if (time < 0.0) {
+                                        free_fixed_point_kernel(fixedPointKernel);
+                                        free_separable_kernel(separableKernel);
+                                        free_kernel(kernel);
+                                        calibratedShapes[pipeline][kernelSize].width = 0;
+                                        return 0;
+                                }
+                                if (candidateTime < 0.0 || time < candidateTime) candidateTime = time;
+                        }
+
+                        if (bestTime < 0.0 || candidateTime < bestTime) {
+                                bestTime = candidateTime;
+                                bestShape = candidate;
+                        }
+                }
+        }
+
+        calibratedShapes[pipeline][kernelSize] = bestShape;
+        printf("Calibrated %-10s %2dx%-2d kernel: %4d x %-4d tiles (%.3f ms)\n", pipelineNames[pipeline], kernelSize,
+                kernelSize, bestShape.width, bestShape.height, 1000*bestTime);
+
+        free_fixed_point_kernel(fixedPointKernel);
+        free_separable_kernel(separableKernel);
+        free_kernel(kernel);
+        return 1;
+
+}
+
+
+// Saves the calibration table to a text file, one "pipeline kernelSize width height" line per calibrated entry, followed by
+// the cost model of the blur planner
+static int save_tile_shapes(const char *path) {
+
+        FILE *file = fopen(path, "w");
+        if (file == NULL) {
+                fprintf(stderr, "\nFatal error: could not open tile shapes file %s for writing.\n", path);
+                return 0;
+        }
+
+        fprintf(file, "# pipeline kernelSize tileWidth tileHeight\n");
+        for (int pipeline = 0; pipeline < TUNING_PIPELINE_COUNT; pipeline++) {
+                for (int size = 1; size <= TUNING_MAX_KERNEL_SIZE; size++) {
+                        struct TileShape shape = calibratedShapes[pipeline][size];
+                        if (shape.width > 0) fprintf(file, "%s %d %d %d\n", pipelineNames[pipeline], size, shape.width, shape.height);
+                }
+        }
+        save_blur_cost_model(file);
+
+        fclose(file);
+        return 1;
+
+}
+
+
+int calibrate_tile_shapes(const char *path) {
+
+        // Create a synthetic three plane image (the pipelines do not depend on the channel values)
+        size_t planeSize = (size_t) CALIBRATION_IMAGE_SIZE*CALIBRATION_IMAGE_SIZE;
+        uint8_t *buffer = (uint8_t*)malloc(6*planeSize);
+        if (buffer == NULL) {
+                fprintf(stderr, "\nFatal error: could not allocate memory for the calibration image.\n");
+                return 0;
+        }
+        for (size_t i = 0; i < 3*planeSize; i++) {
+                buffer[i] = (uint8_t) ((i*2654435761u) >> 24);
+        }
+        uint8_t *inputPlanes[3] = {buffer, buffer + planeSize, buffer + 2*planeSize};
+        uint8_t *outputPlanes[3] = {buffer + 3*planeSize, buffer + 4*planeSize, buffer + 5*planeSize};
+
+        // Fit the cost model of the blur backends first (it decides which kernel sizes go to the FFT pipeline)
+        if (!calibrate_blur_cost_model(inputPlanes, outputPlanes, 3, CALIBRATION_IMAGE_SIZE)) {
+                free(buffer);
+                return 0;
+        }
+
+        // Measure every pipeline for the kernel sizes of the program
+        int numSizes = (int) (sizeof(calibrationKernelSizes) / sizeof(calibrationKernelSizes[0]));
+        for (int pipeline = 0; pipeline < TUNING_PIPELINE_COUNT; pipeline++) {
+                for (int i = 0; i < numSizes; i++) {
+                        if (pipeline == TUNING_PIPELINE_SOBEL && calibrationKernelSizes[i] != 3) continue;
+
+                        // Kernels handed over to the FFT pipeline do not use the tiles of the direct pipeline
+                        if (pipeline == TUNING_PIPELINE_DIRECT &&
+                                        convolution_prefers_fft(calibrationKernelSizes[i], CALIBRATION_IMAGE_SIZE, CALIBRATION_IMAGE_SIZE)) {
+                                continue;
+                        }
+                        if (!calibrate_pipeline(pipeline, calibrationKernelSizes[i], inputPlanes, outputPlanes, CALIBRATION_IMAGE_SIZE)) {
+                                free(buffer);
+                                return 0;
+                        }
+                }
+        }
+
+        free(buffer);
+        return save_tile_shapes(path);
+
+}
+
+
+int load_tile_shapes(const char *path) {
+
+        FILE *file = fopen(path, "r");
+        if (file == NULL) {
+                fprintf(stderr, "\nFatal error: could not open tile shapes file %s.\n", path);
+                return 0;
+        }
+
+        // Read "pipeline kernelSize width height" and blur cost lines, skipping comments
+        char line[128];
+        while (fgets(line, sizeof(line), file) != NULL) {
+
+                if (line[0] == '#') continue;
+                if (parse_blur_cost_line(line)) continue;
+
+                char name[32];
+                int size, width, height;
+                if (sscanf(line, "%31s %d %d %d", name, &size, &width, &height) != 4) continue;
+                if (size < 1 || size > TUNING_MAX_KERNEL_SIZE || width < 8 || height < 1) continue;
+
+                for (int pipeline = 0; pipeline < TUNING_PIPELINE_COUNT; pipeline++) {
+                        if (strcmp(name, pipelineNames[pipeline]) == 0) {
+                                // The direct and integer pipelines compute 32 channels at a time, the separable one 8
+                                int multiple = (pipeline == TUNING_PIPELINE_SEPARABLE) ? 8 : 32;
+                                calibratedShapes[pipeline][size].width = round_down_clamped(width, multiple, multiple, 2048);
+                                calibratedShapes[pipeline][size].height = height;
+                        }
+                }
+        }
+
+        fclose(file);
+        return 1;
+
+}